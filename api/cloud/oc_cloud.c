@@ -24,6 +24,9 @@
 #include "oc_collection.h"
 #include "oc_core_res.h"
 #include "oc_network_monitor.h"
+#ifdef OC_SERVER
+#include "messaging/coap/observe.h"
+#endif /* OC_SERVER */
 #ifdef OC_SECURITY
 #include "security/oc_tls.h"
 #endif /* OC_SECURITY */
@@ -31,11 +34,38 @@
 OC_LIST(cloud_context_list);
 OC_MEMB(cloud_context_pool, oc_cloud_context_t, OC_MAX_NUM_DEVICES);
 
+static void
+cloud_update_notify_scheduler(oc_cloud_context_t *ctx)
+{
+#ifdef OC_SERVER
+  if ((ctx->store.status & OC_CLOUD_LOGGED_IN) &&
+      (ctx->notify_window_ms > 0 || ctx->notify_rate > 0)) {
+    coap_set_notify_scheduler(ctx->cloud_ep, ctx->notify_window_ms,
+                              ctx->notify_rate, ctx->notify_burst);
+  } else {
+    coap_remove_notify_scheduler(ctx->cloud_ep);
+  }
+#else  /* OC_SERVER */
+  (void)ctx;
+#endif /* !OC_SERVER */
+}
+
+static void
+cloud_remove_notify_scheduler(oc_cloud_context_t *ctx)
+{
+#ifdef OC_SERVER
+  coap_remove_notify_scheduler(ctx->cloud_ep);
+#else  /* OC_SERVER */
+  (void)ctx;
+#endif /* !OC_SERVER */
+}
+
 void
 cloud_manager_cb(oc_cloud_context_t *ctx)
 {
   OC_DBG("cloud manager status changed %d", (int)ctx->store.status);
   cloud_rd_manager_status_changed(ctx);
+  cloud_update_notify_scheduler(ctx);
 
   if (ctx->callback) {
     ctx->callback(ctx, ctx->store.status, ctx->user_data);
@@ -59,6 +89,7 @@ static oc_event_callback_retval_t
 start_manager(void *user_data)
 {
   oc_cloud_context_t *ctx = (oc_cloud_context_t *)user_data;
+  cloud_remove_notify_scheduler(ctx);
   oc_free_endpoint(ctx->cloud_ep);
   ctx->cloud_ep = oc_new_endpoint();
   cloud_manager_start(ctx);
@@ -68,6 +99,7 @@ start_manager(void *user_data)
 static void
 cloud_manager_restart(oc_cloud_context_t *ctx)
 {
+  cloud_rd_cancel_requests(ctx);
   cloud_manager_stop(ctx);
   oc_remove_delayed_callback(ctx, start_manager);
   oc_set_delayed_callback(ctx, start_manager, 0);
@@ -295,6 +327,20 @@ oc_cloud_manager_start(oc_cloud_context_t *ctx, oc_cloud_cb_t cb, void *data)
   return 0;
 }
 
+int
+oc_cloud_set_notification_policy(oc_cloud_context_t *ctx, uint16_t window_ms,
+                                 uint16_t rate, uint16_t burst)
+{
+  if (!ctx) {
+    return -1;
+  }
+  ctx->notify_window_ms = window_ms;
+  ctx->notify_rate = rate;
+  ctx->notify_burst = burst;
+  cloud_update_notify_scheduler(ctx);
+  return 0;
+}
+
 int
 oc_cloud_manager_stop(oc_cloud_context_t *ctx)
 {
@@ -310,6 +356,7 @@ oc_cloud_manager_stop(oc_cloud_context_t *ctx)
   oc_remove_delayed_callback(ctx, restart_manager);
   oc_remove_delayed_callback(ctx, start_manager);
   cloud_rd_deinit(ctx);
+  cloud_remove_notify_scheduler(ctx);
   cloud_manager_stop(ctx);
   cloud_store_initialize(&ctx->store);
   cloud_close_endpoint(ctx->cloud_ep);
@@ -354,6 +401,7 @@ oc_cloud_shutdown(void)
     oc_cloud_context_t *ctx = oc_cloud_get_context(device);
     if (ctx) {
       cloud_rd_deinit(ctx);
+      cloud_remove_notify_scheduler(ctx);
       cloud_manager_stop(ctx);
       cloud_store_deinit(&ctx->store);
       cloud_close_endpoint(ctx->cloud_ep);
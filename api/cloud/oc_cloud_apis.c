@@ -75,9 +75,10 @@ conv_cloud_endpoint(oc_cloud_context_t *ctx)
   memset(&ep, 0, sizeof(oc_endpoint_t));
   if (memcmp(&ep, ctx->cloud_ep, sizeof(oc_endpoint_t)) == 0) {
     ret = oc_string_to_endpoint(&ctx->store.ci_server, ctx->cloud_ep, NULL);
-#ifdef OC_DNS_CACHE
-    oc_dns_clear_cache();
-#endif /* OC_DNS_CACHE */
+    if (ret != 0) {
+      /* convert again on the next attempt, e.g. once the host is resolved */
+      memset(ctx->cloud_ep, 0, sizeof(oc_endpoint_t));
+    }
   }
   return ret;
 }
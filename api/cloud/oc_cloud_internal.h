@@ -97,6 +97,9 @@ bool cloud_access_refresh_access_token(oc_endpoint_t *endpoint, const char *uid,
 
 void cloud_rd_manager_status_changed(oc_cloud_context_t *ctx);
 void cloud_rd_deinit(oc_cloud_context_t *ctx);
+/* Abandon the rd requests in flight, whose answers are lost with the session
+ * to the cloud. Their links return to the pending lists. */
+void cloud_rd_cancel_requests(oc_cloud_context_t *ctx);
 
 void cloud_manager_start(oc_cloud_context_t *ctx);
 void cloud_manager_stop(oc_cloud_context_t *ctx);
@@ -30,7 +30,9 @@
 #ifdef OC_SECURITY
 #include "security/oc_tls.h"
 #endif /* OC_SECURITY */
+#include <ctype.h>
 #include <stdint.h>
+#include <string.h>
 
 #define ACCESS_TOKEN_KEY "accesstoken"
 #define REFRESH_TOKEN_KEY "refreshtoken"
@@ -42,7 +44,9 @@
 #define PING_DELAY_ON_TIMEOUT 3
 #define MAX_RETRY_COUNT (5)
 
-struct oc_memb rep_objects_pool = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+struct oc_memb rep_objects_pool = {
+  sizeof(oc_rep_t), 0, 0, 0, 0 OC_MEMB_TRACE_NAME(rep_objects_pool)
+};
 
 static void cloud_start_process(oc_cloud_context_t *ctx);
 static oc_event_callback_retval_t cloud_register(void *data);
@@ -50,6 +54,10 @@ static oc_event_callback_retval_t cloud_login(void *data);
 static oc_event_callback_retval_t refresh_token(void *data);
 static oc_event_callback_retval_t send_ping(void *data);
 
+static void cloud_register_resolved(void *data);
+static void cloud_login_resolved(void *data);
+static void refresh_token_resolved(void *data);
+
 static uint16_t session_timeout[5] = { 3, 60, 1200, 24000, 60 };
 static uint8_t message_timeout[5] = { 1, 2, 4, 8, 10 };
 
@@ -81,6 +89,11 @@ cloud_manager_stop(oc_cloud_context_t *ctx)
   oc_remove_delayed_callback(ctx, send_ping);
   oc_remove_delayed_callback(ctx, refresh_token);
   oc_remove_delayed_callback(ctx, callback_handler);
+#if defined(OC_DNS_LOOKUP) && defined(OC_DNS_CACHE)
+  oc_dns_cancel_lookup(cloud_register_resolved, ctx);
+  oc_dns_cancel_lookup(cloud_login_resolved, ctx);
+  oc_dns_cancel_lookup(refresh_token_resolved, ctx);
+#endif /* OC_DNS_LOOKUP && OC_DNS_CACHE */
 }
 
 static void
@@ -111,6 +124,66 @@ is_retry_over(oc_cloud_context_t *ctx)
   return true;
 }
 
+#if defined(OC_DNS_LOOKUP) && defined(OC_DNS_CACHE)
+/* Copy the domain of the cloud server, if it has one, into host. */
+static bool
+cloud_server_domain(oc_cloud_context_t *ctx, char *host, size_t size)
+{
+  const char *server = oc_string(ctx->store.ci_server);
+  if (!server) {
+    return false;
+  }
+  const char *start = strstr(server, "://");
+  start = start ? start + 3 : server;
+  size_t len = strcspn(start, ":/?");
+  if (len == 0 || len >= size || *start == '[' ||
+      !isalpha((unsigned char)start[len - 1])) {
+    /* address literal */
+    return false;
+  }
+  memcpy(host, start, len);
+  host[len] = '\0';
+  return true;
+}
+#endif /* OC_DNS_LOOKUP && OC_DNS_CACHE */
+
+static void
+cloud_register_resolved(void *data)
+{
+  oc_set_delayed_callback(data, cloud_register, 0);
+}
+
+static void
+cloud_login_resolved(void *data)
+{
+  oc_set_delayed_callback(data, cloud_login, 0);
+}
+
+static void
+refresh_token_resolved(void *data)
+{
+  oc_set_delayed_callback(data, refresh_token, 0);
+}
+
+/* Resolve the host of the cloud in the background rather than block the
+ * event loop, step runs again through resolved once it is cached. */
+static bool
+resolving_cloud_endpoint(oc_cloud_context_t *ctx, oc_dns_lookup_cb_t resolved)
+{
+#if defined(OC_DNS_LOOKUP) && defined(OC_DNS_CACHE)
+  char host[256];
+  if (cloud_server_domain(ctx, host, sizeof(host)) &&
+      oc_dns_lookup_async(host, resolved, ctx) == 1) {
+    OC_DBG("[CM] resolving cloud server %s", host);
+    return true;
+  }
+#else  /* OC_DNS_LOOKUP && OC_DNS_CACHE */
+  (void)ctx;
+  (void)resolved;
+#endif /* !OC_DNS_LOOKUP || !OC_DNS_CACHE */
+  return false;
+}
+
 static void
 cloud_start_process(oc_cloud_context_t *ctx)
 {
@@ -249,6 +322,9 @@ cloud_register(void *data)
   oc_cloud_context_t *ctx = (oc_cloud_context_t *)data;
 
   if (ctx->store.status == OC_CLOUD_INITIALIZED) {
+    if (resolving_cloud_endpoint(ctx, cloud_register_resolved)) {
+      return OC_EVENT_DONE;
+    }
     OC_DBG("[CM] try register(%d)\n", ctx->retry_count);
     ctx->retry_count++;
     if (!is_retry_over(ctx)) {
@@ -357,6 +433,9 @@ cloud_login(void *data)
   oc_cloud_context_t *ctx = (oc_cloud_context_t *)data;
 
   if (ctx->store.status & OC_CLOUD_REGISTERED) {
+    if (resolving_cloud_endpoint(ctx, cloud_login_resolved)) {
+      return OC_EVENT_DONE;
+    }
     OC_DBG("[CM] try login (%d)\n", ctx->retry_count);
     ctx->retry_count++;
     if (!is_retry_over(ctx)) {
@@ -482,6 +561,9 @@ refresh_token(void *data)
   if (!(ctx->store.status & OC_CLOUD_REGISTERED)) {
     return OC_EVENT_DONE;
   }
+  if (resolving_cloud_endpoint(ctx, refresh_token_resolved)) {
+    return OC_EVENT_DONE;
+  }
   OC_DBG("[CM] try refresh token(%d)\n", ctx->retry_refresh_token_count);
 
   ctx->retry_refresh_token_count++;
@@ -29,6 +29,57 @@
 #define OC_RSRVD_HREF "href"
 #define OC_RSRVD_INSTANCEID "ins"
 
+/* Maximum number of links carried by a single rd publish request */
+#ifndef OC_CLOUD_RD_PUBLISH_CHUNK
+#define OC_CLOUD_RD_PUBLISH_CHUNK (16)
+#endif /* OC_CLOUD_RD_PUBLISH_CHUNK */
+
+/* Maximum number of instance ids carried by a single rd delete request, as
+ * bounded by the size of its query string */
+#ifndef OC_CLOUD_RD_DELETE_CHUNK
+#define OC_CLOUD_RD_DELETE_CHUNK (8)
+#endif /* OC_CLOUD_RD_DELETE_CHUNK */
+
+/* Maximum number of rd publish/delete requests in flight per device */
+#ifndef OC_CLOUD_RD_MAX_PENDING_REQUESTS
+#define OC_CLOUD_RD_MAX_PENDING_REQUESTS (2)
+#endif /* OC_CLOUD_RD_MAX_PENDING_REQUESTS */
+
+/* Seconds after which an unanswered rd request returns its links to the
+ * pending lists */
+#define RD_REQUEST_TIMEOUT (60)
+
+/* Seconds to wait before sending rd requests again after consecutive
+ * failures */
+static uint16_t rd_retry_timeout[6] = { 2, 4, 8, 16, 32, 60 };
+
+/* A link whose resource was deleted while it was being published. The cloud
+ * answers with the href, which outlives the resource. */
+typedef struct cloud_rd_withdrawn_t
+{
+  struct cloud_rd_withdrawn_t *next;
+  oc_link_t *link;
+  oc_string_t href;
+} cloud_rd_withdrawn_t;
+
+typedef struct cloud_rd_request_t
+{
+  struct cloud_rd_request_t *next;
+  oc_cloud_context_t *ctx;
+  oc_link_t *links;
+  OC_LIST_STRUCT(withdrawn);
+  uint32_t id; /* passed as user_data, as the slot may be reused */
+  bool delete;
+} cloud_rd_request_t;
+
+OC_LIST(rd_requests);
+static uint32_t rd_request_seq;
+OC_MEMB(rd_requests_s, cloud_rd_request_t,
+        (OC_MAX_NUM_DEVICES * OC_CLOUD_RD_MAX_PENDING_REQUESTS));
+OC_MEMB(rd_withdrawn_s, cloud_rd_withdrawn_t,
+        (OC_MAX_NUM_DEVICES * OC_CLOUD_RD_MAX_PENDING_REQUESTS *
+         OC_CLOUD_RD_PUBLISH_CHUNK));
+
 static oc_link_t *
 rd_link_find(oc_link_t *head, oc_resource_t *res)
 {
@@ -52,6 +103,20 @@ rd_link_add(oc_link_t **head, oc_link_t *link)
   oc_list_add((oc_list_t)*head, link);
 }
 
+static void
+rd_link_push_front(oc_link_t **head, oc_link_t *links)
+{
+  if (!head || !links) {
+    return;
+  }
+  oc_link_t *tail = links;
+  while (tail->next != NULL) {
+    tail = tail->next;
+  }
+  tail->next = *head;
+  *head = links;
+}
+
 static oc_link_t *
 rd_link_pop(oc_link_t **head)
 {
@@ -64,6 +129,23 @@ rd_link_pop(oc_link_t **head)
   return link;
 }
 
+static oc_link_t *
+rd_link_take(oc_link_t **head, size_t max)
+{
+  if (!head || !*head || max == 0) {
+    return NULL;
+  }
+  oc_link_t *first = *head;
+  oc_link_t *last = first;
+  size_t i;
+  for (i = 1; i < max && last->next != NULL; i++) {
+    last = last->next;
+  }
+  *head = last->next;
+  last->next = NULL;
+  return first;
+}
+
 static void
 rd_link_free(oc_link_t **head)
 {
@@ -77,8 +159,10 @@ static oc_link_t *
 rd_link_find_by_href(oc_link_t *head, const char *href, size_t href_size)
 {
   oc_link_t *iter = head;
-  while (iter != NULL && oc_string_len(iter->resource->uri) != href_size &&
-         !strncmp(oc_string(iter->resource->uri), href, href_size)) {
+  while (iter != NULL &&
+         (!iter->resource ||
+          oc_string_len(iter->resource->uri) != href_size ||
+          strncmp(oc_string(iter->resource->uri), href, href_size) != 0)) {
     iter = iter->next;
   }
   return iter;
@@ -103,14 +187,246 @@ rd_link_remove_by_resource(oc_link_t **head, oc_resource_t *res)
   return rd_link_remove(head, rd_link_find(*head, res));
 }
 
+static void
+rd_withdrawn_free(cloud_rd_request_t *req, cloud_rd_withdrawn_t *w)
+{
+  oc_list_remove(req->withdrawn, w);
+  oc_free_string(&w->href);
+  oc_memb_free(&rd_withdrawn_s, w);
+}
+
+/* Takes the link of a deleted resource out of the request publishing it */
+static void
+rd_withdrawn_add(cloud_rd_request_t *req, oc_link_t *link)
+{
+  cloud_rd_withdrawn_t *w =
+    (cloud_rd_withdrawn_t *)oc_memb_alloc(&rd_withdrawn_s);
+  rd_link_remove(&req->links, link);
+  if (!w) {
+    /* the cloud keeps the link until the next full publish */
+    OC_WRN("[CRD] insufficient memory to withdraw link");
+    oc_delete_link(link);
+    return;
+  }
+  oc_new_string(&w->href, oc_string(link->resource->uri),
+                oc_string_len(link->resource->uri));
+  link->resource = NULL;
+  w->link = link;
+  oc_list_add(req->withdrawn, w);
+}
+
+/* Returns the link withdrawn from req for href, if any */
+static oc_link_t *
+rd_withdrawn_take(cloud_rd_request_t *req, const char *href, size_t href_size)
+{
+  cloud_rd_withdrawn_t *w =
+    (cloud_rd_withdrawn_t *)oc_list_head(req->withdrawn);
+  while (w != NULL &&
+         (oc_string_len(w->href) != href_size ||
+          strncmp(oc_string(w->href), href, href_size) != 0)) {
+    w = w->next;
+  }
+  if (!w) {
+    return NULL;
+  }
+  oc_link_t *link = w->link;
+  rd_withdrawn_free(req, w);
+  return link;
+}
+
+static cloud_rd_request_t *
+rd_request_find(void *data)
+{
+  uint32_t id = (uint32_t)(uintptr_t)data;
+  cloud_rd_request_t *req = (cloud_rd_request_t *)oc_list_head(rd_requests);
+  while (req != NULL && req->id != id) {
+    req = req->next;
+  }
+  return req;
+}
+
+static size_t
+rd_request_count(oc_cloud_context_t *ctx)
+{
+  size_t count = 0;
+  cloud_rd_request_t *req = (cloud_rd_request_t *)oc_list_head(rd_requests);
+  for (; req != NULL; req = req->next) {
+    if (req->ctx == ctx) {
+      count++;
+    }
+  }
+  return count;
+}
+
+static cloud_rd_request_t *
+rd_request_find_link(oc_cloud_context_t *ctx, oc_resource_t *res,
+                     oc_link_t **link)
+{
+  cloud_rd_request_t *req = (cloud_rd_request_t *)oc_list_head(rd_requests);
+  for (; req != NULL; req = req->next) {
+    if (req->ctx == ctx && !req->delete) {
+      *link = rd_link_find(req->links, res);
+      if (*link) {
+        return req;
+      }
+    }
+  }
+  return NULL;
+}
+
+static oc_event_callback_retval_t rd_request_timeout(void *data);
+
+static cloud_rd_request_t *
+rd_request_new(oc_cloud_context_t *ctx, oc_link_t **head, size_t max,
+               bool delete)
+{
+  cloud_rd_request_t *req =
+    (cloud_rd_request_t *)oc_memb_alloc(&rd_requests_s);
+  if (!req) {
+    OC_WRN("[CRD] insufficient memory to create rd request");
+    return NULL;
+  }
+  req->ctx = ctx;
+  if (++rd_request_seq == 0) {
+    rd_request_seq = 1;
+  }
+  req->id = rd_request_seq;
+  req->delete = delete;
+  req->links = rd_link_take(head, max);
+  OC_LIST_STRUCT_INIT(req, withdrawn);
+  oc_list_add(rd_requests, req);
+  oc_set_delayed_callback(req, rd_request_timeout, RD_REQUEST_TIMEOUT);
+  return req;
+}
+
+/* Returns links that were not confirmed by the cloud to the front of their
+ * pending list so that an interrupted publish resumes where it stopped. */
+static void
+rd_request_restore(cloud_rd_request_t *req)
+{
+  oc_link_t **head = req->delete ? &req->ctx->rd_delete_resources
+                                 : &req->ctx->rd_publish_resources;
+  rd_link_push_front(head, req->links);
+  req->links = NULL;
+}
+
+static void
+rd_request_release(cloud_rd_request_t *req)
+{
+  rd_link_free(&req->links);
+  cloud_rd_withdrawn_t *w =
+    (cloud_rd_withdrawn_t *)oc_list_head(req->withdrawn);
+  while (w != NULL) {
+    oc_delete_link(w->link);
+    rd_withdrawn_free(req, w);
+    w = (cloud_rd_withdrawn_t *)oc_list_head(req->withdrawn);
+  }
+  oc_list_remove(rd_requests, req);
+  oc_memb_free(&rd_requests_s, req);
+}
+
+static void
+rd_request_free(cloud_rd_request_t *req)
+{
+  oc_remove_delayed_callback(req, rd_request_timeout);
+  rd_request_release(req);
+}
+
+static void rd_retry_later(oc_cloud_context_t *ctx);
+
+static oc_event_callback_retval_t
+rd_request_timeout(void *data)
+{
+  cloud_rd_request_t *req = (cloud_rd_request_t *)data;
+  oc_cloud_context_t *ctx = req->ctx;
+  OC_DBG("[CRD] rd request timed out");
+  rd_request_restore(req);
+  rd_request_release(req);
+  rd_retry_later(ctx);
+  return OC_EVENT_DONE;
+}
+
+static void
+rd_request_cancel_all(oc_cloud_context_t *ctx)
+{
+  cloud_rd_request_t *req = (cloud_rd_request_t *)oc_list_head(rd_requests);
+  while (req != NULL) {
+    cloud_rd_request_t *next = req->next;
+    if (req->ctx == ctx) {
+      rd_request_restore(req);
+      rd_request_free(req);
+    }
+    req = next;
+  }
+}
+
+static bool
+rd_can_send(oc_cloud_context_t *ctx)
+{
+  if (ctx->rd_retry_pending) {
+    return false;
+  }
+#ifdef OC_SECURITY
+  oc_sec_pstat_t *pstat = oc_sec_get_pstat(ctx->device);
+  if (pstat->s != OC_DOS_RFNOP) {
+    return false;
+  }
+#endif /* OC_SECURITY */
+  if (!(ctx->store.status & OC_CLOUD_LOGGED_IN)) {
+    return false;
+  }
+  return true;
+}
+
+static void publish_resources(oc_cloud_context_t *ctx);
+static void delete_resources(oc_cloud_context_t *ctx);
+
+static oc_event_callback_retval_t
+rd_retry(void *data)
+{
+  oc_cloud_context_t *ctx = (oc_cloud_context_t *)data;
+  ctx->rd_retry_pending = false;
+  publish_resources(ctx);
+  delete_resources(ctx);
+  return OC_EVENT_DONE;
+}
+
+/* Holds back rd requests after the cloud failed one, for longer with every
+ * consecutive failure */
+static void
+rd_retry_later(oc_cloud_context_t *ctx)
+{
+  if (ctx->rd_retry_pending) {
+    return;
+  }
+  uint16_t delay = rd_retry_timeout[ctx->rd_retry_count];
+  if ((size_t)ctx->rd_retry_count + 1 <
+      sizeof(rd_retry_timeout) / sizeof(rd_retry_timeout[0])) {
+    ctx->rd_retry_count++;
+  }
+  OC_DBG("[CRD] retrying rd requests in %d seconds", (int)delay);
+  ctx->rd_retry_pending = true;
+  oc_set_delayed_callback(ctx, rd_retry, delay);
+}
+
+static void
+rd_retry_cancel(oc_cloud_context_t *ctx)
+{
+  oc_remove_delayed_callback(ctx, rd_retry);
+  ctx->rd_retry_pending = false;
+}
+
 static void
 publish_resources_handler(oc_client_response_t *data)
 {
-  oc_cloud_context_t *ctx = (oc_cloud_context_t *)data->user_data;
+  cloud_rd_request_t *req = rd_request_find(data->user_data);
   OC_DBG("[CRD] publish resources handler(%d)\n", data->code);
-
-  if (!(ctx->store.status & OC_CLOUD_LOGGED_IN))
+  if (!req) {
     return;
+  }
+  oc_cloud_context_t *ctx = req->ctx;
+  bool progress = false;
+
   if (data->code != OC_STATUS_CHANGED)
     goto error;
 
@@ -124,39 +440,68 @@ publish_resources_handler(oc_client_response_t *data)
                             &href_size) &&
           oc_rep_get_int(link->value.object, OC_RSRVD_INSTANCEID,
                          &instance_id)) {
-        oc_link_t *l =
-          rd_link_find_by_href(ctx->rd_publish_resources, href, href_size);
+        oc_link_t *l = rd_link_find_by_href(req->links, href, href_size);
         if (l) {
           l->ins = instance_id;
-          rd_link_remove(&ctx->rd_publish_resources, l);
-          rd_link_add(&ctx->rd_published_resources, l);
+          rd_link_remove(&req->links, l);
+          rd_link_push_front(&ctx->rd_published_resources, l);
+          progress = true;
+        } else {
+          /* The resource was deleted while this request was in flight, so
+           * withdraw the link the cloud has just created for it. */
+          l = rd_withdrawn_take(req, href, href_size);
+          if (l) {
+            l->ins = instance_id;
+            rd_link_add(&ctx->rd_delete_resources, l);
+            progress = true;
+          }
         }
       }
       link = link->next;
     }
   }
 
-  return;
-
-error : {
-}
+error:
+  rd_request_restore(req);
+  rd_request_free(req);
+  if (!progress) {
+    rd_retry_later(ctx);
+    return;
+  }
+  ctx->rd_retry_count = 0;
+  publish_resources(ctx);
+  delete_resources(ctx);
 }
 
 static void
 publish_resources(oc_cloud_context_t *ctx)
 {
-#ifdef OC_SECURITY
-  oc_sec_pstat_t *pstat = oc_sec_get_pstat(ctx->device);
-  if (pstat->s != OC_DOS_RFNOP) {
-    return;
-  }
-#endif /* OC_SECURITY */
-  if (!(ctx->store.status & OC_CLOUD_LOGGED_IN)) {
+  if (!rd_can_send(ctx)) {
     return;
   }
 
-  rd_publish(ctx->cloud_ep, ctx->rd_publish_resources, ctx->device,
-             publish_resources_handler, LOW_QOS, ctx);
+  size_t chunk = OC_CLOUD_RD_PUBLISH_CHUNK;
+  while (ctx->rd_publish_resources &&
+         rd_request_count(ctx) < OC_CLOUD_RD_MAX_PENDING_REQUESTS) {
+    cloud_rd_request_t *req =
+      rd_request_new(ctx, &ctx->rd_publish_resources, chunk, false);
+    if (!req) {
+      return;
+    }
+    if (rd_publish(ctx->cloud_ep, req->links, ctx->device,
+                   publish_resources_handler, LOW_QOS,
+                   (void *)(uintptr_t)req->id)) {
+      continue;
+    }
+    rd_request_restore(req);
+    rd_request_free(req);
+    if (chunk == 1) {
+      OC_ERR("[CRD] could not publish resources");
+      return;
+    }
+    /* The links may not fit into one request payload, retry with fewer */
+    chunk /= 2;
+  }
 }
 
 int
@@ -174,6 +519,10 @@ oc_cloud_add_resource(oc_resource_t *res)
   if (published) {
     return 0;
   }
+  oc_link_t *publishing = NULL;
+  if (rd_request_find_link(ctx, res, &publishing)) {
+    return 0;
+  }
   oc_link_t *delete =
     rd_link_remove_by_resource(&ctx->rd_delete_resources, res);
   if (delete) {
@@ -189,10 +538,8 @@ oc_cloud_add_resource(oc_resource_t *res)
 static void
 move_published_to_publish_resources(oc_cloud_context_t *ctx)
 {
-  while (ctx->rd_published_resources) {
-    oc_link_t *link = rd_link_pop(&ctx->rd_published_resources);
-    rd_link_add(&ctx->rd_publish_resources, link);
-  }
+  rd_link_push_front(&ctx->rd_publish_resources, ctx->rd_published_resources);
+  ctx->rd_published_resources = NULL;
 }
 
 static oc_event_callback_retval_t
@@ -200,6 +547,7 @@ publish_published_resources(void *data)
 {
   oc_cloud_context_t *ctx = (oc_cloud_context_t *)data;
   move_published_to_publish_resources(ctx);
+  ctx->rd_publish_time = oc_clock_time();
   publish_resources(ctx);
   return OC_EVENT_CONTINUE;
 }
@@ -207,43 +555,44 @@ publish_published_resources(void *data)
 static void
 delete_resources_handler(oc_client_response_t *data)
 {
-  oc_cloud_context_t *ctx = (oc_cloud_context_t *)data->user_data;
+  cloud_rd_request_t *req = rd_request_find(data->user_data);
   OC_DBG("[CRD] delete resources handler(%d)\n", data->code);
-
-  if (!(ctx->store.status & OC_CLOUD_LOGGED_IN))
+  if (!req) {
     return;
-  if (data->code != OC_STATUS_DELETED)
-    goto error;
-  while (ctx->rd_delete_resources) {
-    oc_link_t *link = rd_link_pop(&ctx->rd_delete_resources);
-    oc_delete_link(link);
   }
+  oc_cloud_context_t *ctx = req->ctx;
 
-error : {
-}
+  if (data->code != OC_STATUS_DELETED) {
+    rd_request_restore(req);
+    rd_request_free(req);
+    rd_retry_later(ctx);
+    return;
+  }
+  rd_request_free(req);
+  ctx->rd_retry_count = 0;
+  delete_resources(ctx);
 }
 
 static void
-delete_resources(oc_cloud_context_t *ctx, bool all)
+delete_resources(oc_cloud_context_t *ctx)
 {
-#ifdef OC_SECURITY
-  oc_sec_pstat_t *pstat = oc_sec_get_pstat(ctx->device);
-  if (pstat->s != OC_DOS_RFNOP) {
-    return;
-  }
-#endif /* OC_SECURITY */
-  if (!(ctx->store.status & OC_CLOUD_LOGGED_IN)) {
+  if (!rd_can_send(ctx)) {
     return;
   }
-
-  if (all) {
-    rd_delete(ctx->cloud_ep, NULL, ctx->device, delete_resources_handler,
-              LOW_QOS, ctx);
-    return;
-  }
-  if (ctx->rd_delete_resources) {
-    rd_delete(ctx->cloud_ep, ctx->rd_delete_resources, ctx->device,
-              delete_resources_handler, LOW_QOS, ctx);
+  while (ctx->rd_delete_resources &&
+         rd_request_count(ctx) < OC_CLOUD_RD_MAX_PENDING_REQUESTS) {
+    cloud_rd_request_t *req = rd_request_new(ctx, &ctx->rd_delete_resources,
+                                             OC_CLOUD_RD_DELETE_CHUNK, true);
+    if (!req) {
+      return;
+    }
+    if (!rd_delete(ctx->cloud_ep, req->links, ctx->device,
+                   delete_resources_handler, LOW_QOS,
+                   (void *)(uintptr_t)req->id)) {
+      rd_request_restore(req);
+      rd_request_free(req);
+      return;
+    }
   }
 }
 
@@ -251,23 +600,52 @@ void
 cloud_rd_manager_status_changed(oc_cloud_context_t *ctx)
 {
   if (ctx->store.status & OC_CLOUD_LOGGED_IN) {
-    publish_published_resources(ctx);
-    delete_resources(ctx, false);
+    /* Links published within the last refresh period are still live in the
+     * cloud, so after a reconnect only the pending changes are sent. */
+    if (ctx->rd_publish_time == 0 ||
+        oc_clock_time() - ctx->rd_publish_time >=
+          (oc_clock_time_t)ONE_HOUR * OC_CLOCK_SECOND) {
+      publish_published_resources(ctx);
+    } else {
+      publish_resources(ctx);
+    }
+    delete_resources(ctx);
     oc_remove_delayed_callback(ctx, publish_published_resources);
     oc_set_delayed_callback(ctx, publish_published_resources, ONE_HOUR);
   } else {
     oc_remove_delayed_callback(ctx, publish_published_resources);
+    cloud_rd_cancel_requests(ctx);
   }
 }
 
+void
+cloud_rd_cancel_requests(oc_cloud_context_t *ctx)
+{
+  rd_request_cancel_all(ctx);
+  rd_retry_cancel(ctx);
+  ctx->rd_retry_count = 0;
+}
+
 void
 cloud_rd_deinit(oc_cloud_context_t *ctx)
 {
   oc_remove_delayed_callback(ctx, publish_published_resources);
+  rd_retry_cancel(ctx);
+  ctx->rd_retry_count = 0;
+
+  cloud_rd_request_t *req = (cloud_rd_request_t *)oc_list_head(rd_requests);
+  while (req != NULL) {
+    cloud_rd_request_t *next = req->next;
+    if (req->ctx == ctx) {
+      rd_request_free(req);
+    }
+    req = next;
+  }
 
   rd_link_free(&ctx->rd_delete_resources);
   rd_link_free(&ctx->rd_published_resources);
   rd_link_free(&ctx->rd_publish_resources);
+  ctx->rd_publish_time = 0;
 }
 
 void
@@ -282,6 +660,11 @@ oc_cloud_delete_resource(oc_resource_t *res)
   if (publish != NULL) {
     oc_delete_link(publish);
   }
+  oc_link_t *publishing = NULL;
+  cloud_rd_request_t *req = rd_request_find_link(ctx, res, &publishing);
+  if (req != NULL) {
+    rd_withdrawn_add(req, publishing);
+  }
   oc_link_t *published =
     rd_link_remove_by_resource(&ctx->rd_published_resources, res);
   if (published != NULL) {
@@ -289,7 +672,7 @@ oc_cloud_delete_resource(oc_resource_t *res)
       published->resource = NULL;
     }
     rd_link_add(&ctx->rd_delete_resources, published);
-    delete_resources(ctx, false);
+    delete_resources(ctx);
   }
 }
 
@@ -298,8 +681,10 @@ oc_cloud_publish_resources(size_t device)
 {
   oc_cloud_context_t *ctx = oc_cloud_get_context(device);
   if (ctx) {
+    /* an explicit publish does not wait for a pending retry */
+    rd_retry_cancel(ctx);
     publish_published_resources(ctx);
-    delete_resources(ctx, false);
+    delete_resources(ctx);
     return 0;
   }
   return -1;
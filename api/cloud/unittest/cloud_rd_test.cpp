@@ -19,8 +19,13 @@
 #include <gtest/gtest.h>
 
 #include "oc_api.h"
+#include "oc_client_state.h"
 #include "oc_cloud_internal.h"
 #include "oc_collection.h"
+#include "rd_client.h"
+#ifdef OC_SECURITY
+#include "security/oc_pstat.h"
+#endif /* OC_SECURITY */
 
 class TestCloudRD : public testing::Test
 {
@@ -96,6 +101,96 @@ protected:
     return nullptr;
   }
 
+  static size_t countLinks(oc_link_t *head)
+  {
+    size_t count = 0;
+    for (oc_link_t *l = head; l; l = l->next) {
+      count++;
+    }
+    return count;
+  }
+
+  /* Answer an rd request as the cloud would */
+  static void answerRequest(oc_cloud_context_t *ctx, void *user_data,
+                            oc_status_t code, oc_rep_t *payload)
+  {
+    oc_client_response_t response;
+    memset(&response, 0, sizeof(response));
+    response.endpoint = ctx->cloud_ep;
+    response.user_data = user_data;
+    response.code = code;
+    response.payload = payload;
+    oc_client_cb_t *cb =
+      oc_ri_get_client_cb(OC_RSRVD_RD_URI, ctx->cloud_ep, OC_POST);
+    ASSERT_NE(nullptr, cb);
+    cb->handler.response(&response);
+  }
+
+  /* Confirm the publication of links to res as the cloud would */
+  static void answerPublish(oc_cloud_context_t *ctx, void *user_data,
+                            oc_resource_t **res, size_t count)
+  {
+    uint8_t buf[1024];
+    oc_rep_new(buf, sizeof(buf));
+    oc_rep_start_root_object();
+    oc_rep_set_array(root, links);
+    for (size_t i = 0; i < count; i++) {
+      oc_rep_object_array_start_item(links);
+      oc_rep_set_text_string(links, href, oc_string(res[i]->uri));
+      oc_rep_set_int(links, ins, (int64_t)i + 1);
+      oc_rep_object_array_end_item(links);
+    }
+    oc_rep_close_array(root, links);
+    oc_rep_end_root_object();
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
+    oc_rep_set_pool(&rep_objects);
+    oc_rep_t *rep = NULL;
+    ASSERT_EQ(0, oc_parse_rep(oc_rep_get_encoder_buf(),
+                              oc_rep_get_encoded_payload_size(), &rep));
+    answerRequest(ctx, user_data, OC_STATUS_CHANGED, rep);
+    oc_free_rep(rep);
+  }
+
+  /* Start from empty rd lists with a cloud endpoint that never answers */
+  static void addResources(oc_cloud_context_t *ctx, oc_resource_t **res,
+                           size_t count)
+  {
+    cloud_rd_deinit(ctx);
+    oc_string_t ep;
+    oc_new_string(&ep, "coap://127.0.0.1:5683",
+                  strlen("coap://127.0.0.1:5683"));
+    ASSERT_EQ(0, oc_string_to_endpoint(&ep, ctx->cloud_ep, NULL));
+    oc_free_string(&ep);
+    for (size_t i = 0; i < count; i++) {
+      char uri[32];
+      snprintf(uri, sizeof(uri), "/light/rd/%d", (int)i);
+      res[i] = oc_new_resource(NULL, uri, 1, 0);
+      oc_resource_bind_resource_type(res[i], "test");
+      ASSERT_EQ(0, oc_cloud_add_resource(res[i]));
+    }
+  }
+
+  static void login(oc_cloud_context_t *ctx)
+  {
+#ifdef OC_SECURITY
+    oc_sec_get_pstat(0)->s = OC_DOS_RFNOP;
+#endif /* OC_SECURITY */
+    ctx->store.status |= OC_CLOUD_LOGGED_IN;
+  }
+
+  static void cleanup(oc_cloud_context_t *ctx, oc_resource_t **res,
+                      size_t count)
+  {
+    for (size_t i = 0; i < count; i++) {
+      oc_cloud_delete_resource(res[i]);
+      oc_ri_delete_resource(res[i]);
+    }
+    oc_ri_free_client_cbs_by_endpoint(ctx->cloud_ep);
+    ctx->store.status &= ~OC_CLOUD_LOGGED_IN;
+    cloud_rd_deinit(ctx);
+  }
+
   static void TearDownTestCase() { oc_main_shutdown(); }
 };
 
@@ -141,3 +236,182 @@ TEST_F(TestCloudRD, cloud_delete)
   ASSERT_NE(NULL, ctx);
   EXPECT_EQ(NULL, findResource(ctx->rd_publish_resources, res1));
 }
+
+TEST_F(TestCloudRD, cloud_publish_many)
+{
+  // When
+  oc_resource_t *res[40];
+  for (size_t i = 0; i < sizeof(res) / sizeof(res[0]); i++) {
+    char uri[32];
+    snprintf(uri, sizeof(uri), "/light/many/%d", (int)i);
+    res[i] = oc_new_resource(NULL, uri, 1, 0);
+    oc_resource_bind_resource_type(res[i], "test");
+    ASSERT_EQ(0, oc_cloud_add_resource(res[i]));
+  }
+  oc_cloud_delete_resource(res[0]);
+
+  // Then
+  oc_cloud_context_t *ctx = oc_cloud_get_context(0);
+  ASSERT_NE(NULL, ctx);
+  EXPECT_EQ(NULL, findResource(ctx->rd_publish_resources, res[0]));
+  for (size_t i = 1; i < sizeof(res) / sizeof(res[0]); i++) {
+    EXPECT_EQ(res[i], findResource(ctx->rd_publish_resources, res[i]));
+  }
+}
+
+TEST_F(TestCloudRD, cloud_publish_chunks)
+{
+  oc_cloud_context_t *ctx = oc_cloud_get_context(0);
+  ASSERT_NE(NULL, ctx);
+  oc_resource_t *res[40];
+  addResources(ctx, res, sizeof(res) / sizeof(res[0]));
+
+  // When
+  login(ctx);
+  ASSERT_EQ(0, oc_cloud_publish_resources(0));
+
+  // Then
+  /* two requests of a chunk each are in flight, the rest waits */
+  size_t sent = 2 * 16;
+  EXPECT_EQ(sizeof(res) / sizeof(res[0]) - sent,
+            countLinks(ctx->rd_publish_resources));
+  EXPECT_EQ(res[sent], ctx->rd_publish_resources->resource);
+  oc_client_cb_t *cb =
+    oc_ri_get_client_cb(OC_RSRVD_RD_URI, ctx->cloud_ep, OC_POST);
+  ASSERT_NE(nullptr, cb);
+  void *first = cb->user_data;
+
+  // When
+  answerRequest(ctx, first, OC_STATUS_SERVICE_UNAVAILABLE, NULL);
+
+  // Then
+  /* the failed chunk resumes ahead of the links that were never sent */
+  EXPECT_EQ(sizeof(res) / sizeof(res[0]) - sent / 2,
+            countLinks(ctx->rd_publish_resources));
+  EXPECT_EQ(res[0], ctx->rd_publish_resources->resource);
+
+  // When
+  /* a late answer to the failed request does not touch newer ones */
+  oc_ri_free_client_cbs_by_mid(cb->mid);
+  oc_cloud_publish_resources(0);
+  size_t pending = countLinks(ctx->rd_publish_resources);
+  answerRequest(ctx, first, OC_STATUS_SERVICE_UNAVAILABLE, NULL);
+
+  // Then
+  EXPECT_EQ(pending, countLinks(ctx->rd_publish_resources));
+  EXPECT_EQ(sizeof(res) / sizeof(res[0]) - sent, pending);
+
+  // When
+  oc_cloud_delete_resource(res[39]);
+
+  // Then
+  EXPECT_EQ(NULL, findResource(ctx->rd_publish_resources, res[39]));
+  cleanup(ctx, res, sizeof(res) / sizeof(res[0]));
+}
+
+TEST_F(TestCloudRD, cloud_publish_withdrawn)
+{
+  oc_cloud_context_t *ctx = oc_cloud_get_context(0);
+  ASSERT_NE(NULL, ctx);
+  oc_resource_t *res[3];
+  addResources(ctx, res, sizeof(res) / sizeof(res[0]));
+  login(ctx);
+  ASSERT_EQ(0, oc_cloud_publish_resources(0));
+  oc_client_cb_t *cb =
+    oc_ri_get_client_cb(OC_RSRVD_RD_URI, ctx->cloud_ep, OC_POST);
+  ASSERT_NE(nullptr, cb);
+  void *user_data = cb->user_data;
+
+  // When
+  /* deleted while the cloud publishes its link */
+  oc_cloud_delete_resource(res[1]);
+  answerPublish(ctx, user_data, res, sizeof(res) / sizeof(res[0]));
+  oc_ri_free_client_cbs_by_mid(cb->mid);
+
+  // Then
+  EXPECT_EQ(res[0], findResource(ctx->rd_published_resources, res[0]));
+  EXPECT_EQ(res[2], findResource(ctx->rd_published_resources, res[2]));
+  EXPECT_EQ(2, countLinks(ctx->rd_published_resources));
+  /* and the link the cloud created for it is deleted right away */
+  EXPECT_EQ(NULL, ctx->rd_delete_resources);
+  EXPECT_NE(nullptr,
+            oc_ri_get_client_cb(OC_RSRVD_RD_URI, ctx->cloud_ep, OC_DELETE));
+  cleanup(ctx, res, sizeof(res) / sizeof(res[0]));
+}
+
+TEST_F(TestCloudRD, cloud_publish_cancel_on_logout)
+{
+  oc_cloud_context_t *ctx = oc_cloud_get_context(0);
+  ASSERT_NE(NULL, ctx);
+  oc_resource_t *res[40];
+  addResources(ctx, res, sizeof(res) / sizeof(res[0]));
+  login(ctx);
+  ASSERT_EQ(0, oc_cloud_publish_resources(0));
+  oc_client_cb_t *cb =
+    oc_ri_get_client_cb(OC_RSRVD_RD_URI, ctx->cloud_ep, OC_POST);
+  ASSERT_NE(nullptr, cb);
+  void *user_data = cb->user_data;
+
+  // When
+  ctx->store.status &= ~OC_CLOUD_LOGGED_IN;
+  cloud_rd_manager_status_changed(ctx);
+
+  // Then
+  /* the requests in flight give their links back in order */
+  EXPECT_EQ(sizeof(res) / sizeof(res[0]),
+            countLinks(ctx->rd_publish_resources));
+  EXPECT_EQ(res[0], ctx->rd_publish_resources->resource);
+  answerRequest(ctx, user_data, OC_STATUS_SERVICE_UNAVAILABLE, NULL);
+  EXPECT_EQ(sizeof(res) / sizeof(res[0]),
+            countLinks(ctx->rd_publish_resources));
+
+  // When
+  login(ctx);
+  cloud_rd_manager_status_changed(ctx);
+
+  // Then
+  /* both request slots are free again */
+  EXPECT_EQ(sizeof(res) / sizeof(res[0]) - 2 * 16,
+            countLinks(ctx->rd_publish_resources));
+  cleanup(ctx, res, sizeof(res) / sizeof(res[0]));
+}
+
+TEST_F(TestCloudRD, cloud_publish_retry)
+{
+  oc_cloud_context_t *ctx = oc_cloud_get_context(0);
+  ASSERT_NE(NULL, ctx);
+  oc_resource_t *res[3];
+  addResources(ctx, res, sizeof(res) / sizeof(res[0]));
+  login(ctx);
+  ASSERT_EQ(0, oc_cloud_publish_resources(0));
+  oc_client_cb_t *cb =
+    oc_ri_get_client_cb(OC_RSRVD_RD_URI, ctx->cloud_ep, OC_POST);
+  ASSERT_NE(nullptr, cb);
+  void *user_data = cb->user_data;
+
+  // When
+  answerRequest(ctx, user_data, OC_STATUS_SERVICE_UNAVAILABLE, NULL);
+  oc_ri_free_client_cbs_by_mid(cb->mid);
+  oc_resource_t *later = oc_new_resource(NULL, "/light/later", 1, 0);
+  oc_resource_bind_resource_type(later, "test");
+  ASSERT_EQ(0, oc_cloud_add_resource(later));
+
+  // Then
+  /* nothing is sent until the backoff has passed */
+  EXPECT_EQ(sizeof(res) / sizeof(res[0]) + 1,
+            countLinks(ctx->rd_publish_resources));
+  EXPECT_EQ(nullptr,
+            oc_ri_get_client_cb(OC_RSRVD_RD_URI, ctx->cloud_ep, OC_POST));
+  EXPECT_EQ(1, ctx->rd_retry_count);
+
+  // When
+  poolEvents(3);
+
+  // Then
+  EXPECT_EQ(NULL, ctx->rd_publish_resources);
+  EXPECT_NE(nullptr,
+            oc_ri_get_client_cb(OC_RSRVD_RD_URI, ctx->cloud_ep, OC_POST));
+  oc_cloud_delete_resource(later);
+  oc_ri_delete_resource(later);
+  cleanup(ctx, res, sizeof(res) / sizeof(res[0]));
+}
@@ -19,6 +19,7 @@
 #ifdef OC_BLOCK_WISE
 #include "oc_blockwise.h"
 #include "oc_endpoint.h"
+#include "port/oc_clock.h"
 #include "port/oc_log.h"
 #include "util/oc_list.h"
 #include "util/oc_memb.h"
@@ -30,6 +31,8 @@ OC_MEMB(oc_blockwise_response_states_s, oc_blockwise_response_state_t,
 OC_LIST(oc_blockwise_requests);
 OC_LIST(oc_blockwise_responses);
 
+static oc_blockwise_stats_t blockwise_stats;
+
 #ifdef OC_APP_DATA_BUFFER_POOL
 typedef struct oc_app_data_buffer_t
 {
@@ -67,6 +70,12 @@ oc_blockwise_init_buffer(struct oc_memb *pool, const char *href,
 #endif /* OC_DYNAMIC_ALLOCATION */
     buffer->next_block_offset = 0;
     buffer->payload_size = 0;
+    buffer->received_end = 0;
+    buffer->blocks_ahead = 0;
+    buffer->expected_size = 0;
+    buffer->block_size = 0;
+    buffer->last_block_received = false;
+    buffer->start_time = oc_clock_loop_time();
     buffer->ref_count = 1;
     buffer->method = method;
     buffer->role = role;
@@ -77,6 +86,8 @@ oc_blockwise_init_buffer(struct oc_memb *pool, const char *href,
 #ifdef OC_CLIENT
     buffer->mid = 0;
     buffer->client_cb = NULL;
+    buffer->token_len = 0;
+    buffer->next_request_offset = 0;
 #endif /* OC_CLIENT */
     return buffer;
   }
@@ -381,18 +392,100 @@ oc_blockwise_handle_block(oc_blockwise_state_t *buffer,
                           uint32_t incoming_block_size)
 {
   if (incoming_block_offset >= (unsigned)OC_MAX_APP_DATA_SIZE ||
-      incoming_block_size > (OC_MAX_APP_DATA_SIZE - incoming_block_offset) ||
-      incoming_block_offset > buffer->next_block_offset) {
+      incoming_block_size > (OC_MAX_APP_DATA_SIZE - incoming_block_offset)) {
     return false;
   }
 
-  if (buffer->next_block_offset == incoming_block_offset) {
-    memcpy(&buffer->buffer[buffer->next_block_offset], incoming_block,
+  blockwise_stats.blocks_received++;
+
+  if (incoming_block_offset < buffer->next_block_offset) {
+    blockwise_stats.blocks_duplicate++;
+    return true;
+  }
+
+  if (incoming_block_offset > buffer->next_block_offset) {
+    /* Out-of-order block: hold it in place and mark it in the window of
+     * blocks following next_block_offset.
+     */
+    uint32_t gap = incoming_block_offset - buffer->next_block_offset;
+    if (buffer->block_size == 0 || gap % buffer->block_size != 0 ||
+        gap / buffer->block_size > 32 ||
+        incoming_block_size > buffer->block_size) {
+      return false;
+    }
+    uint32_t bit = 1u << (gap / buffer->block_size - 1);
+    if (buffer->blocks_ahead & bit) {
+      blockwise_stats.blocks_duplicate++;
+      return true;
+    }
+    memcpy(&buffer->buffer[incoming_block_offset], incoming_block,
            incoming_block_size);
+    buffer->blocks_ahead |= bit;
+    if (incoming_block_offset + incoming_block_size > buffer->received_end) {
+      buffer->received_end = incoming_block_offset + incoming_block_size;
+    }
+    blockwise_stats.blocks_out_of_order++;
+    return true;
+  }
 
-    buffer->next_block_offset += incoming_block_size;
+  if (buffer->block_size == 0) {
+    buffer->block_size = (uint16_t)incoming_block_size;
   }
+  memcpy(&buffer->buffer[buffer->next_block_offset], incoming_block,
+         incoming_block_size);
+  buffer->next_block_offset += incoming_block_size;
+  if (buffer->next_block_offset > buffer->received_end) {
+    buffer->received_end = buffer->next_block_offset;
+  }
+
+  /* Pull in the blocks that arrived ahead of this one. */
+  bool present;
+  do {
+    present = (buffer->blocks_ahead & 1) != 0;
+    buffer->blocks_ahead >>= 1;
+    if (present) {
+      buffer->next_block_offset = MIN(
+        buffer->next_block_offset + buffer->block_size, buffer->received_end);
+    }
+  } while (present);
 
   return true;
 }
+
+void
+oc_blockwise_handle_last_block(oc_blockwise_state_t *buffer)
+{
+  buffer->last_block_received = true;
+}
+
+bool
+oc_blockwise_transfer_complete(const oc_blockwise_state_t *buffer)
+{
+  return buffer->last_block_received &&
+         buffer->next_block_offset == buffer->received_end;
+}
+
+void
+oc_blockwise_finish_transfer(oc_blockwise_state_t *buffer)
+{
+  buffer->payload_size = buffer->next_block_offset;
+  oc_clock_time_t duration = oc_clock_loop_time() - buffer->start_time;
+  blockwise_stats.transfers_completed++;
+  blockwise_stats.bytes_completed += buffer->payload_size;
+  blockwise_stats.transfer_time += duration;
+  OC_DBG("block-wise transfer of %u bytes completed in %u ticks",
+         (unsigned)buffer->payload_size, (unsigned)duration);
+}
+
+void
+oc_blockwise_get_stats(oc_blockwise_stats_t *stats)
+{
+  memcpy(stats, &blockwise_stats, sizeof(oc_blockwise_stats_t));
+}
+
+void
+oc_blockwise_reset_stats(void)
+{
+  memset(&blockwise_stats, 0, sizeof(oc_blockwise_stats_t));
+}
 #endif /* OC_BLOCK_WISE */
@@ -14,10 +14,15 @@
 // limitations under the License.
 */
 
+#include "api/oc_metrics_internal.h"
 #include "messaging/coap/engine.h"
 #include "oc_signal_event_loop.h"
 #include "port/oc_network_events_mutex.h"
+#include "util/oc_atomic.h"
 #include "util/oc_memb.h"
+#ifdef OC_MEMORY_TRACE
+#include "util/oc_mem_trace.h"
+#endif /* OC_MEMORY_TRACE */
 #include <stdint.h>
 #include <stdio.h>
 #ifdef OC_DYNAMIC_ALLOCATION
@@ -41,38 +46,304 @@ OC_MEMB(oc_incoming_buffers, oc_message_t, OC_MAX_NUM_CONCURRENT_REQUESTS);
 OC_MEMB(oc_outgoing_buffers, oc_message_t, OC_MAX_NUM_CONCURRENT_REQUESTS);
 #endif /* !OC_INOUT_BUFFER_POOL */
 
+/* Messages and their buffers are allocated on the network threads and freed
+ * on the event loop. When both only reach the heap and the lock-free free
+ * lists below, no lock is needed; static pools are serialized by the network
+ * event handler mutex.
+ */
+#if defined(OC_ATOMICS) && defined(OC_DYNAMIC_ALLOCATION) &&                   \
+  !defined(OC_INOUT_BUFFER_SIZE) && !defined(OC_INOUT_BUFFER_POOL)
+#define OC_MESSAGE_POOL_LOCKFREE
+#define message_buffer_pool_lock()
+#define message_buffer_pool_unlock()
+#else  /* OC_ATOMICS && OC_DYNAMIC_ALLOCATION && ... */
+#define message_buffer_pool_lock() oc_network_event_handler_mutex_lock()
+#define message_buffer_pool_unlock() oc_network_event_handler_mutex_unlock()
+#endif /* !OC_ATOMICS || !OC_DYNAMIC_ALLOCATION || ... */
+
+#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
+/* Message buffers come in size classes so that ACKs, pings and small
+ * notifications do not each pin a full OC_PDU_SIZE allocation. Released
+ * buffers are kept on a short per-class free list for reuse.
+ */
+#define OC_MESSAGE_BUFFER_SMALL_SIZE (128)
+#define OC_MESSAGE_BUFFER_MEDIUM_SIZE (1280)
+#ifndef OC_MESSAGE_BUFFER_CACHE_SIZE
+#define OC_MESSAGE_BUFFER_CACHE_SIZE (4)
+#endif /* !OC_MESSAGE_BUFFER_CACHE_SIZE */
+
+typedef struct
+{
+  size_t cached_size; /* size of the buffers on the free list */
+  uint8_t *free_list[OC_MESSAGE_BUFFER_CACHE_SIZE];
+  int num_free;
+  oc_message_buffer_stats_t stats;
+} message_buffer_class_t;
+
+static message_buffer_class_t buffer_classes[OC_MESSAGE_BUFFER_NUM_CLASSES];
+
+static size_t
+buffer_class_size(oc_message_buffer_class_t buffer_class)
+{
+  size_t pdu_size = (size_t)OC_PDU_SIZE;
+  switch (buffer_class) {
+  case OC_MESSAGE_BUFFER_SMALL:
+    return (pdu_size < OC_MESSAGE_BUFFER_SMALL_SIZE)
+             ? pdu_size
+             : OC_MESSAGE_BUFFER_SMALL_SIZE;
+  case OC_MESSAGE_BUFFER_MEDIUM:
+    return (pdu_size < OC_MESSAGE_BUFFER_MEDIUM_SIZE)
+             ? pdu_size
+             : OC_MESSAGE_BUFFER_MEDIUM_SIZE;
+  default:
+    break;
+  }
+  return pdu_size;
+}
+
+#ifdef OC_MEMORY_TRACE
+static const char *buffer_class_names[OC_MESSAGE_BUFFER_NUM_CLASSES] = {
+  "message buffers (small)", "message buffers (medium)",
+  "message buffers (large)"
+};
+#define trace_buffer_alloc(buffer_class, buffer)                               \
+  oc_mem_trace_alloc(__func__, buffer_class_names[buffer_class],               \
+                     buffer_class_size(buffer_class), buffer)
+#define trace_buffer_free(buffer_class, buffer)                                \
+  oc_mem_trace_free(__func__, buffer_class_names[buffer_class],                \
+                    buffer_class_size(buffer_class), buffer)
+#else /* OC_MEMORY_TRACE */
+#define trace_buffer_alloc(buffer_class, buffer)
+#define trace_buffer_free(buffer_class, buffer)
+#endif /* !OC_MEMORY_TRACE */
+
+static oc_message_buffer_class_t
+buffer_class_for_size(size_t size)
+{
+  int c;
+  for (c = OC_MESSAGE_BUFFER_SMALL; c < OC_MESSAGE_BUFFER_LARGE; c++) {
+    if (size <= buffer_class_size((oc_message_buffer_class_t)c)) {
+      return (oc_message_buffer_class_t)c;
+    }
+  }
+  return OC_MESSAGE_BUFFER_LARGE;
+}
+
+#ifdef OC_MESSAGE_POOL_LOCKFREE
+static void
+update_peak_in_use(message_buffer_class_t *c, uint32_t in_use)
+{
+  uint32_t peak = oc_atomic_load(&c->stats.peak_in_use);
+  while (in_use > peak &&
+         !oc_atomic_compare_exchange(&c->stats.peak_in_use, &peak, in_use))
+    ;
+}
+
+/* The free list slots are claimed and filled with single atomic operations,
+ * so network threads and the event loop allocate without any lock. The PDU
+ * size, and with it the cached size, is only expected to change before the
+ * stack starts.
+ */
+static uint8_t *
+get_message_buffer(oc_message_buffer_class_t buffer_class)
+{
+  message_buffer_class_t *c = &buffer_classes[buffer_class];
+  size_t size = buffer_class_size(buffer_class);
+  uint8_t *buffer = NULL;
+  if (oc_atomic_load(&c->cached_size) == size) {
+    int i;
+    for (i = 0; i < OC_MESSAGE_BUFFER_CACHE_SIZE && !buffer; i++) {
+      if (oc_atomic_load(&c->free_list[i])) {
+        buffer = oc_atomic_exchange(&c->free_list[i], NULL);
+      }
+    }
+  }
+  if (buffer) {
+    oc_atomic_increment(&c->stats.recycled);
+  } else {
+    buffer = (uint8_t *)malloc(size);
+    if (!buffer) {
+      return NULL;
+    }
+  }
+  oc_atomic_increment(&c->stats.allocations);
+  update_peak_in_use(c, oc_atomic_increment(&c->stats.in_use));
+  return buffer;
+}
+
+static void
+put_message_buffer(oc_message_buffer_class_t buffer_class, uint8_t *buffer)
+{
+  message_buffer_class_t *c = &buffer_classes[buffer_class];
+  size_t size = buffer_class_size(buffer_class);
+  int i;
+  oc_atomic_decrement(&c->stats.in_use);
+  if (oc_atomic_load(&c->cached_size) != size) {
+    /* the PDU size changed; drop buffers of the old size */
+    for (i = 0; i < OC_MESSAGE_BUFFER_CACHE_SIZE; i++) {
+      free(oc_atomic_exchange(&c->free_list[i], NULL));
+    }
+    oc_atomic_store(&c->cached_size, size);
+  }
+  for (i = 0; i < OC_MESSAGE_BUFFER_CACHE_SIZE; i++) {
+    uint8_t *expected = NULL;
+    if (!oc_atomic_load(&c->free_list[i]) &&
+        oc_atomic_compare_exchange(&c->free_list[i], &expected, buffer)) {
+      return;
+    }
+  }
+  free(buffer);
+}
+#else  /* OC_MESSAGE_POOL_LOCKFREE */
+/* called with the network event handler mutex held */
+static uint8_t *
+get_message_buffer(oc_message_buffer_class_t buffer_class)
+{
+  message_buffer_class_t *c = &buffer_classes[buffer_class];
+  size_t size = buffer_class_size(buffer_class);
+  uint8_t *buffer = NULL;
+  if (c->num_free > 0 && c->cached_size == size) {
+    buffer = c->free_list[--c->num_free];
+    c->stats.recycled++;
+  } else {
+    buffer = (uint8_t *)malloc(size);
+    if (!buffer) {
+      return NULL;
+    }
+  }
+  c->stats.allocations++;
+  c->stats.in_use++;
+  if (c->stats.in_use > c->stats.peak_in_use) {
+    c->stats.peak_in_use = c->stats.in_use;
+  }
+  return buffer;
+}
+
+/* called with the network event handler mutex held */
+static void
+put_message_buffer(oc_message_buffer_class_t buffer_class, uint8_t *buffer)
+{
+  message_buffer_class_t *c = &buffer_classes[buffer_class];
+  size_t size = buffer_class_size(buffer_class);
+  c->stats.in_use--;
+  if (c->cached_size != size) {
+    /* the PDU size changed; drop buffers of the old size */
+    while (c->num_free > 0) {
+      free(c->free_list[--c->num_free]);
+    }
+    c->cached_size = size;
+  }
+  if (c->num_free < OC_MESSAGE_BUFFER_CACHE_SIZE) {
+    c->free_list[c->num_free++] = buffer;
+  } else {
+    free(buffer);
+  }
+}
+#endif /* !OC_MESSAGE_POOL_LOCKFREE */
+
+bool
+oc_message_buffer_get_stats(oc_message_buffer_class_t buffer_class,
+                            oc_message_buffer_stats_t *stats)
+{
+  if (buffer_class >= OC_MESSAGE_BUFFER_NUM_CLASSES || !stats) {
+    return false;
+  }
+  message_buffer_pool_lock();
+  memcpy(stats, &buffer_classes[buffer_class].stats,
+         sizeof(oc_message_buffer_stats_t));
+  message_buffer_pool_unlock();
+  stats->buffer_size = buffer_class_size(buffer_class);
+  stats->peak_bytes = stats->peak_in_use * stats->buffer_size;
+  return true;
+}
+
+void
+oc_message_buffer_reset_stats(void)
+{
+  int c;
+  message_buffer_pool_lock();
+  for (c = 0; c < OC_MESSAGE_BUFFER_NUM_CLASSES; c++) {
+    oc_message_buffer_stats_t *stats = &buffer_classes[c].stats;
+    uint32_t in_use = stats->in_use;
+    memset(stats, 0, sizeof(oc_message_buffer_stats_t));
+    stats->in_use = in_use;
+    stats->peak_in_use = in_use;
+  }
+  message_buffer_pool_unlock();
+}
+#endif /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
+
+/* Payloads are copied and messages released on both the network threads
+ * and the event loop, some of them with the network event handler mutex held.
+ * Without atomics the counters are best effort.
+ */
+static oc_message_copy_stats_t copy_stats;
+
+static void
+count_copy_stats(uint32_t messages, uint32_t copied_messages, uint32_t copies,
+                 size_t bytes)
+{
+#ifdef OC_ATOMICS
+  if (messages > 0) {
+    oc_atomic_add(&copy_stats.messages, messages);
+  }
+  if (copied_messages > 0) {
+    oc_atomic_add(&copy_stats.copied_messages, copied_messages);
+  }
+  if (copies > 0) {
+    oc_atomic_add(&copy_stats.copies, copies);
+    oc_atomic_add(&copy_stats.bytes, bytes);
+  }
+#else  /* OC_ATOMICS */
+  copy_stats.messages += messages;
+  copy_stats.copied_messages += copied_messages;
+  copy_stats.copies += copies;
+  copy_stats.bytes += bytes;
+#endif /* !OC_ATOMICS */
+}
+
 static oc_message_t *
-allocate_message(struct oc_memb *pool)
+allocate_message(struct oc_memb *pool, size_t size)
 {
-  oc_network_event_handler_mutex_lock();
+  (void)size;
+  message_buffer_pool_lock();
   oc_message_t *message = (oc_message_t *)oc_memb_alloc(pool);
-  oc_network_event_handler_mutex_unlock();
-  if (message) {
 #if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
-    message->data = malloc(OC_PDU_SIZE);
+  if (message) {
+    message->buffer_class = buffer_class_for_size(size);
+    message->headroom = 0;
+    message->data = get_message_buffer(message->buffer_class);
+    trace_buffer_alloc(message->buffer_class, message->data);
     if (!message->data) {
       oc_memb_free(pool, message);
-      return NULL;
+      message = NULL;
     }
+  }
 #endif /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
+  message_buffer_pool_unlock();
+  if (message) {
     message->pool = pool;
     message->length = 0;
     message->next = 0;
     message->ref_count = 1;
+    message->copies = 0;
     message->endpoint.interface_index = -1;
 #ifdef OC_SECURITY
     message->encrypted = 0;
 #endif /* OC_SECURITY */
+#ifdef OC_REQUEST_TRACE
+    message->trace[OC_METRICS_STAGE_RECEIVED] = 0;
+#endif /* OC_REQUEST_TRACE */
 #if !defined(OC_DYNAMIC_ALLOCATION) || defined(OC_INOUT_BUFFER_SIZE)
     OC_DBG("buffer: Allocated TX/RX buffer; num free: %d",
            oc_memb_numfree(pool));
 #endif /* !OC_DYNAMIC_ALLOCATION || OC_INOUT_BUFFER_SIZE */
-  }
+  } else {
 #if !defined(OC_DYNAMIC_ALLOCATION) || defined(OC_INOUT_BUFFER_SIZE)
-  else {
     OC_WRN("buffer: No free TX/RX buffers!");
-  }
 #endif /* !OC_DYNAMIC_ALLOCATION || OC_INOUT_BUFFER_SIZE */
+    OC_METRICS_INC(OC_METRICS_BUFFER_EXHAUSTED);
+  }
   return message;
 }
 
@@ -80,7 +351,7 @@ oc_message_t *
 oc_allocate_message_from_pool(struct oc_memb *pool)
 {
   if (pool) {
-    return allocate_message(pool);
+    return allocate_message(pool, (size_t)OC_PDU_SIZE);
   }
   return NULL;
 }
@@ -94,13 +365,130 @@ oc_set_buffers_avail_cb(oc_memb_buffers_avail_callback_t cb)
 oc_message_t *
 oc_allocate_message(void)
 {
-  return allocate_message(&oc_incoming_buffers);
+  return allocate_message(&oc_incoming_buffers, (size_t)OC_PDU_SIZE);
+}
+
+oc_message_t *
+oc_allocate_message_sized(size_t size)
+{
+  return allocate_message(&oc_incoming_buffers, size);
 }
 
 oc_message_t *
 oc_internal_allocate_outgoing_message(void)
 {
-  return allocate_message(&oc_outgoing_buffers);
+  return allocate_message(&oc_outgoing_buffers, (size_t)OC_PDU_SIZE);
+}
+
+oc_message_t *
+oc_internal_allocate_outgoing_message_sized(size_t size)
+{
+  return allocate_message(&oc_outgoing_buffers, size);
+}
+
+void
+oc_message_shrink_buffer(oc_message_t *message)
+{
+#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
+  if (!message) {
+    return;
+  }
+  oc_message_buffer_class_t buffer_class =
+    buffer_class_for_size(message->length);
+  if (buffer_class >= message->buffer_class) {
+    return;
+  }
+  message_buffer_pool_lock();
+  uint8_t *data = get_message_buffer(buffer_class);
+  if (data) {
+    trace_buffer_alloc(buffer_class, data);
+    memcpy(data, message->data, message->length);
+    trace_buffer_free(message->buffer_class,
+                      message->data - message->headroom);
+    put_message_buffer(message->buffer_class,
+                       message->data - message->headroom);
+    message->data = data;
+    message->buffer_class = buffer_class;
+    message->headroom = 0;
+  }
+  message_buffer_pool_unlock();
+  if (data) {
+    oc_message_count_copy(message, message->length);
+  }
+#else  /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
+  (void)message;
+#endif /* !OC_DYNAMIC_ALLOCATION || OC_INOUT_BUFFER_SIZE */
+}
+
+size_t
+oc_message_headroom(const oc_message_t *message)
+{
+#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
+  return message ? message->headroom : 0;
+#else  /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
+  (void)message;
+  return 0;
+#endif /* !OC_DYNAMIC_ALLOCATION || OC_INOUT_BUFFER_SIZE */
+}
+
+size_t
+oc_message_tailroom(const oc_message_t *message)
+{
+  if (!message) {
+    return 0;
+  }
+#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
+  size_t size =
+    buffer_class_size((oc_message_buffer_class_t)message->buffer_class);
+  size_t used = message->headroom + message->length;
+#else  /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
+  size_t size = sizeof(message->data);
+  size_t used = message->length;
+#endif /* !OC_DYNAMIC_ALLOCATION || OC_INOUT_BUFFER_SIZE */
+  return (size > used) ? size - used : 0;
+}
+
+bool
+oc_message_reserve(oc_message_t *message, size_t len)
+{
+#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
+  if (!message || message->length > 0 || len > oc_message_tailroom(message) ||
+      message->headroom + len > UINT16_MAX) {
+    return false;
+  }
+  message->data += len;
+  message->headroom = (uint16_t)(message->headroom + len);
+  return true;
+#else  /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
+  /* data is an array within the message */
+  (void)message;
+  (void)len;
+  return false;
+#endif /* !OC_DYNAMIC_ALLOCATION || OC_INOUT_BUFFER_SIZE */
+}
+
+void
+oc_message_count_copy(oc_message_t *message, size_t len)
+{
+  if (message && message->copies < UINT8_MAX) {
+    message->copies++;
+  }
+  count_copy_stats(0, 0, 1, len);
+}
+
+void
+oc_message_get_copy_stats(oc_message_copy_stats_t *stats)
+{
+  if (!stats) {
+    return;
+  }
+  memcpy(stats, &copy_stats, sizeof(oc_message_copy_stats_t));
+}
+
+void
+oc_message_reset_copy_stats(void)
+{
+  memset(&copy_stats, 0, sizeof(oc_message_copy_stats_t));
 }
 
 void
@@ -116,11 +504,19 @@ oc_message_unref(oc_message_t *message)
   if (message) {
     message->ref_count--;
     if (message->ref_count <= 0) {
-#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
-      free(message->data);
-#endif /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
       struct oc_memb *pool = message->pool;
+      count_copy_stats(1, message->copies > 0 ? 1 : 0, 0, 0);
+#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
+      message_buffer_pool_lock();
+      trace_buffer_free(message->buffer_class,
+                        message->data - message->headroom);
+      put_message_buffer(message->buffer_class,
+                         message->data - message->headroom);
       oc_memb_free(pool, message);
+      message_buffer_pool_unlock();
+#else  /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
+      oc_memb_free(pool, message);
+#endif /* !OC_DYNAMIC_ALLOCATION || OC_INOUT_BUFFER_SIZE */
 #if !defined(OC_DYNAMIC_ALLOCATION) || defined(OC_INOUT_BUFFER_SIZE)
       OC_DBG("buffer: freed TX/RX buffer; num free: %d", oc_memb_numfree(pool));
 #endif /* !OC_DYNAMIC_ALLOCATION || OC_INOUT_BUFFER_SIZE */
@@ -128,17 +524,110 @@ oc_message_unref(oc_message_t *message)
   }
 }
 
+#ifdef OC_SECURITY
+static bool
+is_from_peer(oc_process_data_t data, const void *peer)
+{
+  return oc_endpoint_compare(&((const oc_message_t *)data)->endpoint,
+                             (const oc_endpoint_t *)peer) == 0;
+}
+#endif /* OC_SECURITY */
+
+/* Inbound messages are queued by class so that an overload sheds discovery
+ * traffic first and never delays handshakes. */
+static oc_process_priority_t
+message_priority(const oc_message_t *message)
+{
+  if (message->endpoint.flags & MULTICAST) {
+    return OC_PROCESS_PRIORITY_MULTICAST;
+  }
+#ifdef OC_SECURITY
+  /* Any (D)TLS record but application data: handshakes, alerts and change
+   * cipher spec messages. It must not overtake the records of its peer that
+   * are still queued as unicast messages, e.g. a close_notify that follows
+   * the last application data. */
+  if (message->encrypted && message->length > 0 && message->data[0] != 23 &&
+      !oc_process_has_event(OC_PROCESS_PRIORITY_UNICAST,
+                            oc_events[INBOUND_NETWORK_EVENT], is_from_peer,
+                            &message->endpoint)) {
+    return OC_PROCESS_PRIORITY_SECURITY;
+  }
+#endif /* OC_SECURITY */
+  return OC_PROCESS_PRIORITY_UNICAST;
+}
+
+static void
+post_inbound_message(struct oc_process *p, oc_process_event_t ev,
+                     oc_message_t *message)
+{
+  if (oc_process_post_priority(p, ev, message, message_priority(message)) ==
+      OC_PROCESS_ERR_FULL) {
+    OC_DBG("buffer: shedding inbound message");
+    OC_METRICS_INC(OC_METRICS_RX_SHED);
+    oc_message_unref(message);
+  }
+}
+
+static void
+shed_message(struct oc_process *p, oc_process_event_t ev,
+             oc_process_data_t data)
+{
+  (void)p;
+  (void)ev;
+  OC_DBG("buffer: shedding queued inbound message");
+  OC_METRICS_INC(OC_METRICS_RX_SHED);
+  oc_message_unref((oc_message_t *)data);
+}
+
+#ifdef OC_METRICS
+static void
+count_message(const oc_message_t *message, bool inbound)
+{
+  oc_metrics_counter_t counter =
+    inbound ? OC_METRICS_RX_UDP : OC_METRICS_TX_UDP;
+#ifdef OC_TCP
+  if (message->endpoint.flags & TCP) {
+    counter = inbound ? OC_METRICS_RX_TCP : OC_METRICS_TX_TCP;
+  }
+#endif /* OC_TCP */
+#ifdef OC_CLIENT
+  if (!inbound && (message->endpoint.flags & DISCOVERY)) {
+    counter = OC_METRICS_TX_MULTICAST;
+  }
+#endif /* OC_CLIENT */
+  OC_METRICS_INC(counter);
+#ifdef OC_SECURITY
+  if (inbound ? message->encrypted == 1
+              : (message->endpoint.flags & SECURED) != 0) {
+    OC_METRICS_INC(inbound ? OC_METRICS_RX_SECURED : OC_METRICS_TX_SECURED);
+  }
+#endif /* OC_SECURITY */
+  OC_METRICS_ADD(inbound ? OC_METRICS_RX_BYTES : OC_METRICS_TX_BYTES,
+                 message->length);
+  OC_METRICS_OBSERVE(inbound ? OC_METRICS_RX_MESSAGE_SIZE
+                             : OC_METRICS_TX_MESSAGE_SIZE,
+                     message->length);
+}
+#endif /* OC_METRICS */
+
 void
 oc_recv_message(oc_message_t *message)
 {
-  if (oc_process_post(&message_buffer_handler, oc_events[INBOUND_NETWORK_EVENT],
-                      message) == OC_PROCESS_ERR_FULL)
-    oc_message_unref(message);
+#ifdef OC_METRICS
+  count_message(message, true);
+#endif /* OC_METRICS */
+  OC_METRICS_TRACE_STAMP(message, OC_METRICS_STAGE_DEQUEUED);
+  post_inbound_message(&message_buffer_handler,
+                       oc_events[INBOUND_NETWORK_EVENT], message);
 }
 
 void
 oc_send_message(oc_message_t *message)
 {
+#ifdef OC_METRICS
+  count_message(message, false);
+#endif /* OC_METRICS */
+  oc_message_shrink_buffer(message);
   if (oc_process_post(&message_buffer_handler,
                       oc_events[OUTBOUND_NETWORK_EVENT],
                       message) == OC_PROCESS_ERR_FULL)
@@ -167,21 +656,28 @@ OC_PROCESS_THREAD(message_buffer_handler, ev, data)
 {
   OC_PROCESS_BEGIN();
   OC_DBG("Started buffer handler process");
+  /* only inbound messages are posted below the control priority */
+  oc_process_set_shed_callback(shed_message);
   while (1) {
     OC_PROCESS_YIELD();
 
     if (ev == oc_events[INBOUND_NETWORK_EVENT]) {
+      OC_METRICS_TRACE_STAMP((oc_message_t *)data,
+                             OC_METRICS_STAGE_DISPATCHED);
 #ifdef OC_SECURITY
       if (((oc_message_t *)data)->encrypted == 1) {
         OC_DBG("Inbound network event: encrypted request");
-        oc_process_post(&oc_tls_handler, oc_events[UDP_TO_TLS_EVENT], data);
+        post_inbound_message(&oc_tls_handler, oc_events[UDP_TO_TLS_EVENT],
+                             (oc_message_t *)data);
       } else {
         OC_DBG("Inbound network event: decrypted request");
-        oc_process_post(&coap_engine, oc_events[INBOUND_RI_EVENT], data);
+        post_inbound_message(&coap_engine, oc_events[INBOUND_RI_EVENT],
+                             (oc_message_t *)data);
       }
 #else  /* OC_SECURITY */
       OC_DBG("Inbound network event: decrypted request");
-      oc_process_post(&coap_engine, oc_events[INBOUND_RI_EVENT], data);
+      post_inbound_message(&coap_engine, oc_events[INBOUND_RI_EVENT],
+                           (oc_message_t *)data);
 #endif /* !OC_SECURITY */
     } else if (ev == oc_events[OUTBOUND_NETWORK_EVENT]) {
       oc_message_t *message = (oc_message_t *)data;
@@ -86,8 +86,11 @@ dispatch_coap_request(void)
   }
 
   bool success = false;
-  transaction->message->length =
-    coap_serialize_message(request, transaction->message->data);
+  transaction->message->length = 0;
+  if (payload_size >= 0) {
+    transaction->message->length =
+      coap_serialize_message_into(request, transaction->message);
+  }
   if (transaction->message->length > 0) {
     coap_send_transaction(transaction);
 
@@ -273,6 +276,30 @@ oc_do_get(const char *uri, oc_endpoint_t *endpoint, const char *query,
   return status;
 }
 
+#ifdef OC_BLOCK_WISE
+bool
+oc_do_get_stream(const char *uri, oc_endpoint_t *endpoint, const char *query,
+                 oc_response_handler_t handler, oc_qos_t qos, void *user_data)
+{
+  oc_client_handler_t client_handler;
+  client_handler.response = handler;
+
+  oc_client_cb_t *cb = oc_ri_alloc_client_cb(uri, endpoint, OC_GET, query,
+                                             client_handler, qos, user_data);
+  if (!cb)
+    return false;
+
+  cb->stream = true;
+
+  bool status = prepare_coap_request(cb);
+
+  if (status)
+    status = dispatch_coap_request();
+
+  return status;
+}
+#endif /* OC_BLOCK_WISE */
+
 bool
 oc_init_put(const char *uri, oc_endpoint_t *endpoint, const char *query,
             oc_response_handler_t handler, oc_qos_t qos, void *user_data)
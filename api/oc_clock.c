@@ -20,6 +20,24 @@
 
 #define OC_NSEC_PER_SEC 1000000000
 
+/* 0 when not inside oc_main_poll() */
+static oc_clock_time_t loop_time;
+
+oc_clock_time_t
+oc_clock_loop_time(void)
+{
+  if (loop_time != 0) {
+    return loop_time;
+  }
+  return oc_clock_time_monotonic();
+}
+
+void
+oc_clock_set_loop_time(bool in_loop)
+{
+  loop_time = in_loop ? oc_clock_time_monotonic() : 0;
+}
+
 size_t
 oc_clock_time_rfc3339(char *out_buf, size_t out_buf_len)
 {
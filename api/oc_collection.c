@@ -57,11 +57,16 @@ oc_collection_alloc(void)
   return NULL;
 }
 
+static oc_event_callback_retval_t pending_notify_collection(void *data);
+
 void
 oc_collection_free(oc_collection_t *collection)
 {
   if (collection != NULL) {
     oc_list_remove(oc_collections, collection);
+    if (collection->batch_notify_scheduled) {
+      oc_remove_delayed_callback(collection, pending_notify_collection);
+    }
     oc_ri_free_resource_properties((oc_resource_t *)collection);
 
     oc_link_t *link;
@@ -154,6 +159,64 @@ links_list_notify_collection(void *data)
   return OC_EVENT_DONE;
 }
 
+static oc_event_callback_retval_t
+pending_notify_collection(void *data)
+{
+  oc_collection_t *collection = (oc_collection_t *)data;
+  collection->batch_notify_scheduled = false;
+  if (collection->batch_notify_full) {
+    coap_notify_collection_batch(collection);
+  } else {
+    coap_notify_collection_changed_links(collection);
+  }
+  oc_link_t *link = (oc_link_t *)oc_list_head(collection->links);
+  while (link) {
+    link->notify_pending = false;
+    link = link->next;
+  }
+  return OC_EVENT_DONE;
+}
+
+bool
+oc_collection_defer_batch_notification(oc_collection_t *collection,
+                                       oc_resource_t *resource)
+{
+  if (collection->batch_notify_interval == 0) {
+    return false;
+  }
+  oc_link_t *link = (oc_link_t *)oc_list_head(collection->links);
+  while (link) {
+    if (link->resource == resource) {
+      link->notify_pending = true;
+    }
+    link = link->next;
+  }
+  if (!collection->batch_notify_scheduled) {
+    collection->batch_notify_scheduled = true;
+    oc_set_delayed_callback(collection, pending_notify_collection,
+                            collection->batch_notify_interval);
+  }
+  return true;
+}
+
+void
+oc_collection_set_batch_notify_interval(oc_resource_t *collection,
+                                        uint16_t interval_seconds,
+                                        bool full_batch)
+{
+  if (!collection) {
+    return;
+  }
+  oc_collection_t *c = (oc_collection_t *)collection;
+  c->batch_notify_interval = interval_seconds;
+  c->batch_notify_full = full_batch;
+  if (interval_seconds == 0 && c->batch_notify_scheduled) {
+    /* flush whatever has accumulated so far */
+    oc_remove_delayed_callback(c, pending_notify_collection);
+    pending_notify_collection(c);
+  }
+}
+
 void
 oc_collection_add_link(oc_resource_t *collection, oc_link_t *link)
 {
@@ -843,7 +906,8 @@ oc_handle_collection_request(oc_method_t method, oc_request_t *request,
         link = oc_list_head(collection->links);
         while (link != NULL) {
           if (link->resource &&
-              (!notify_resource == !(link->resource == notify_resource))) {
+              (!notify_resource || link->resource == notify_resource ||
+               link->notify_pending)) {
             if (oc_filter_resource_by_rt(link->resource, request)) {
               if (!get_delete && href && oc_string_len(*href) > 0 &&
                   (oc_string_len(*href) != oc_string_len(link->resource->uri) ||
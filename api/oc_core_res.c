@@ -20,6 +20,12 @@
 #ifdef OC_MNT
 #include "api/oc_mnt.h"
 #endif /* OC_MNT */
+#ifdef OC_MEMORY_TRACE
+#include "api/oc_mem_trace_res.h"
+#endif /* OC_MEMORY_TRACE */
+#ifdef OC_METRICS
+#include "api/oc_metrics_internal.h"
+#endif /* OC_METRICS */
 #include "messaging/coap/oc_coap.h"
 #include "oc_discovery.h"
 #include "oc_introspection_internal.h"
@@ -362,6 +368,12 @@ oc_core_add_new_device(const char *uri, const char *rt, const char *name,
 #ifdef OC_MNT
   oc_create_maintenance_resource(device_count);
 #endif /* OC_MNT */
+#ifdef OC_MEMORY_TRACE
+  oc_create_mem_trace_resource(device_count);
+#endif /* OC_MEMORY_TRACE */
+#ifdef OC_METRICS
+  oc_create_metrics_resource(device_count);
+#endif /* OC_METRICS */
 #if defined(OC_CLIENT) && defined(OC_SERVER) && defined(OC_CLOUD)
   oc_create_cloudconf_resource(device_count);
 #endif /* OC_CLIENT && OC_SERVER && OC_CLOUD */
@@ -593,6 +605,18 @@ oc_core_get_resource_by_uri(const char *uri, size_t device)
     type = OCF_MNT;
   }
 #endif /* OC_MNT */
+#ifdef OC_MEMORY_TRACE
+  else if ((strlen(uri) - skip) == 11 &&
+           memcmp(uri + skip, "oc/memtrace", 11) == 0) {
+    type = OCF_MEM_TRACE;
+  }
+#endif /* OC_MEMORY_TRACE */
+#ifdef OC_METRICS
+  else if ((strlen(uri) - skip) == 10 &&
+           memcmp(uri + skip, "oc/metrics", 10) == 0) {
+    type = OCF_METRICS;
+  }
+#endif /* OC_METRICS */
 #ifdef OC_CLOUD
   else if ((strlen(uri) - skip) == 19 &&
            memcmp(uri + skip, "CoapCloudConfResURI", 19) == 0) {
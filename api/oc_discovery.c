@@ -643,6 +643,14 @@ process_batch_request(CborEncoder *links_array, oc_endpoint_t *endpoint,
 #endif /* OC_COLLECTIONS */
 #endif /* OC_SERVER */
 }
+
+void
+oc_discovery_process_batch_response(CborEncoder *links_array,
+                                    oc_resource_t *resource,
+                                    oc_endpoint_t *endpoint)
+{
+  process_batch_response(links_array, resource, endpoint);
+}
 #endif /* OC_RES_BATCH_SUPPORT */
 
 static void
@@ -757,9 +765,10 @@ oc_ri_process_discovery_payload(uint8_t *payload, int len,
   memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
   struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                  rep_objects_alloc, (void *)rep_objects_pool,
-                                 0 };
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
   oc_rep_set_pool(&rep_objects);
 
@@ -914,9 +923,6 @@ oc_ri_process_discovery_payload(uint8_t *payload, int len,
 
 done:
   oc_free_rep(p);
-#ifdef OC_DNS_CACHE
-  oc_dns_clear_cache();
-#endif /* OC_DNS_CACHE */
   return ret;
 }
 #endif /* OC_CLIENT */
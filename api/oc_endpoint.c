@@ -446,6 +446,10 @@ oc_parse_endpoint_string(oc_string_t *endpoint_str, oc_endpoint_t *endpoint,
     if (oc_dns_lookup(domain, &ipaddress, endpoint->flags | IPV6) != 0) {
 #endif /* OC_DNS_LOOKUP_IPV6 */
       if (oc_dns_lookup(domain, &ipaddress, endpoint->flags | IPV4) != 0) {
+        /* possibly still resolving, the caller tries again later */
+        if (uri && u) {
+          oc_free_string(uri);
+        }
         return -1;
       }
 #ifdef OC_DNS_LOOKUP_IPV6
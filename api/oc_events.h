@@ -37,6 +37,9 @@ typedef enum {
   INTERFACE_DOWN,
   INTERFACE_UP,
   TLS_CLOSE_ALL_SESSIONS,
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  TLS_HANDSHAKE_DONE,
+#endif /* OC_TLS_HANDSHAKE_THREADS */
 #ifdef OC_SOFTWARE_UPDATE
   SW_UPDATE_NSA,
   SW_UPDATE_DOWNLOADED,
@@ -290,12 +290,60 @@ err:
 oc_clock_time_t
 oc_main_poll(void)
 {
-  oc_clock_time_t ticks_until_next_event = oc_etimer_request_poll();
+  oc_clock_set_loop_time(true);
+  oc_clock_time_t next_event = oc_etimer_request_poll();
   while (oc_process_run()) {
-    ticks_until_next_event = oc_etimer_request_poll();
+    oc_clock_set_loop_time(true);
+    next_event = oc_etimer_request_poll();
   }
-  return ticks_until_next_event;
+  oc_clock_set_loop_time(false);
+  if (next_event == 0) {
+    return 0;
+  }
+  /* Timers run on the monotonic clock, callers wait on oc_clock_time() */
+  oc_clock_time_t now = oc_clock_time_monotonic();
+  return oc_clock_time() + (next_event > now ? next_event - now : 0);
+}
+
+#ifdef OC_EXTERNAL_EVENT_LOOP
+void
+oc_set_fd_watch_callback(oc_fd_watch_cb_t cb, void *user_data)
+{
+  oc_connectivity_set_fd_watch_callback(cb, user_data);
+}
+
+static oc_clock_time_t
+external_loop_poll(void)
+{
+  oc_clock_time_t next_event = oc_main_poll();
+  oc_clock_time_t port_deadline = oc_connectivity_update_fd_watches();
+  if (port_deadline > 0 && (next_event == 0 || port_deadline < next_event)) {
+    next_event = port_deadline;
+  }
+  return next_event;
+}
+
+oc_clock_time_t
+oc_main_on_readable(int fd)
+{
+  oc_connectivity_on_readable(fd);
+  return external_loop_poll();
+}
+
+oc_clock_time_t
+oc_main_on_writable(int fd)
+{
+  oc_connectivity_on_writable(fd);
+  return external_loop_poll();
+}
+
+oc_clock_time_t
+oc_main_on_timeout(void)
+{
+  oc_connectivity_on_timeout();
+  return external_loop_poll();
 }
+#endif /* OC_EXTERNAL_EVENT_LOOP */
 
 void
 oc_main_shutdown(void)
@@ -0,0 +1,111 @@
+/*
+ // Copyright (c) 2020 Intel Corporation
+ //
+ // Licensed under the Apache License, Version 2.0 (the "License");
+ // you may not use this file except in compliance with the License.
+ // You may obtain a copy of the License at
+ //
+ //      http://www.apache.org/licenses/LICENSE-2.0
+ //
+ // Unless required by applicable law or agreed to in writing, software
+ // distributed under the License is distributed on an "AS IS" BASIS,
+ // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ // See the License for the specific language governing permissions and
+ // limitations under the License.
+ */
+
+#include "oc_api.h"
+#ifdef OC_MEMORY_TRACE
+#include "api/oc_mem_trace_res.h"
+#include "oc_core_res.h"
+#include "util/oc_mem_trace.h"
+
+/* Entries reported per list, kept small enough for one response */
+#define MEM_TRACE_RES_TOP (8)
+#define MEM_TRACE_RES_EVENTS (16)
+
+#define encode_stats(array, stats)                                             \
+  do {                                                                         \
+    oc_rep_set_text_string(array, name, (stats)->name);                        \
+    if ((stats)->pool) {                                                       \
+      oc_rep_set_text_string(array, pool, (stats)->pool);                      \
+    }                                                                          \
+    oc_rep_set_uint(array, allocs, (stats)->allocs);                           \
+    oc_rep_set_uint(array, frees, (stats)->frees);                             \
+    oc_rep_set_uint(array, current, (stats)->current_bytes);                   \
+    oc_rep_set_uint(array, peak, (stats)->peak_bytes);                         \
+    oc_rep_set_uint(array, lifetimemax, (stats)->lifetime_max);                \
+  } while (0)
+
+static void
+get_mem_trace(oc_request_t *request, oc_interface_mask_t iface_mask,
+              void *data)
+{
+  (void)data;
+  oc_mem_trace_stats_t stats[MEM_TRACE_RES_TOP];
+  oc_mem_trace_event_t events[MEM_TRACE_RES_EVENTS];
+  uint32_t untracked = 0;
+  size_t count, i;
+
+  oc_rep_start_root_object();
+  switch (iface_mask) {
+  case OC_IF_BASELINE:
+    oc_process_baseline_interface(request->resource);
+  /* fall through */
+  case OC_IF_R:
+    oc_mem_trace_get_totals(&stats[0], &untracked);
+    oc_rep_set_uint(root, allocs, stats[0].allocs);
+    oc_rep_set_uint(root, frees, stats[0].frees);
+    oc_rep_set_uint(root, current, stats[0].current_bytes);
+    oc_rep_set_uint(root, peak, stats[0].peak_bytes);
+    oc_rep_set_uint(root, untracked, untracked);
+
+    count = oc_mem_trace_get_pools(stats, MEM_TRACE_RES_TOP);
+    oc_rep_set_array(root, pools);
+    for (i = 0; i < count; i++) {
+      oc_rep_object_array_start_item(pools);
+      encode_stats(pools, &stats[i]);
+      oc_rep_object_array_end_item(pools);
+    }
+    oc_rep_close_array(root, pools);
+
+    count = oc_mem_trace_get_sites(stats, MEM_TRACE_RES_TOP);
+    oc_rep_set_array(root, sites);
+    for (i = 0; i < count; i++) {
+      oc_rep_object_array_start_item(sites);
+      encode_stats(sites, &stats[i]);
+      oc_rep_object_array_end_item(sites);
+    }
+    oc_rep_close_array(root, sites);
+
+    count = oc_mem_trace_get_events(events, MEM_TRACE_RES_EVENTS);
+    oc_rep_set_array(root, events);
+    for (i = 0; i < count; i++) {
+      oc_rep_object_array_start_item(events);
+      oc_rep_set_uint(events, time, events[i].time);
+      oc_rep_set_text_string(events, func, events[i].func);
+      oc_rep_set_text_string(events, pool, events[i].pool);
+      oc_rep_set_uint(events, size, events[i].size);
+      oc_rep_set_boolean(events, alloc, events[i].type == MEM_TRACE_ALLOC);
+      oc_rep_object_array_end_item(events);
+    }
+    oc_rep_close_array(root, events);
+    break;
+  default:
+    break;
+  }
+  oc_rep_end_root_object();
+  oc_send_response(request, OC_STATUS_OK);
+}
+
+void
+oc_create_mem_trace_resource(size_t device)
+{
+  OC_DBG("oc_mem_trace: Initializing memory trace resource");
+
+  oc_core_populate_resource(OCF_MEM_TRACE, device, "oc/memtrace",
+                            OC_IF_R | OC_IF_BASELINE, OC_IF_R, OC_SECURE,
+                            get_mem_trace, 0, 0, 0, 1,
+                            "x.org.iotivity.memtrace");
+}
+#endif /* OC_MEMORY_TRACE */
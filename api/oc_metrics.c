@@ -0,0 +1,553 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "oc_api.h"
+#ifdef OC_METRICS
+#include "api/oc_metrics_internal.h"
+#include "oc_core_res.h"
+#include "util/oc_atomic.h"
+#include <string.h>
+
+/* Each thread updates its own shard, so the network threads, the TLS
+ * handshake threads and the event loop do not contend for cache lines.
+ * Threads beyond the shard count share the last shard; updates are atomic
+ * so that sharing only costs contention. Without atomics the stack is
+ * driven from a single thread and one shard is used.
+ */
+#ifdef OC_ATOMICS
+#ifndef OC_METRICS_SHARDS
+#define OC_METRICS_SHARDS (8)
+#endif /* !OC_METRICS_SHARDS */
+#define metrics_add(ptr, value) oc_atomic_add(ptr, value)
+#define metrics_load(ptr) oc_atomic_load(ptr)
+#define metrics_store(ptr, value) oc_atomic_store(ptr, value)
+#else /* OC_ATOMICS */
+#undef OC_METRICS_SHARDS
+#define OC_METRICS_SHARDS (1)
+#define metrics_add(ptr, value) (*(ptr) += (value))
+#define metrics_load(ptr) (*(ptr))
+#define metrics_store(ptr, value) (*(ptr) = (value))
+#endif /* !OC_ATOMICS */
+
+typedef struct
+{
+  unsigned long count;
+  unsigned long sum;
+  unsigned long max;
+  unsigned long buckets[OC_METRICS_HISTOGRAM_BUCKETS];
+} histogram_shard_t;
+
+typedef struct
+{
+  unsigned long counters[OC_METRICS_NUM_COUNTERS];
+  histogram_shard_t histograms[OC_METRICS_NUM_HISTOGRAMS];
+} metrics_shard_t;
+
+static metrics_shard_t shards[OC_METRICS_SHARDS];
+#ifdef OC_ATOMICS
+static int num_shards;
+static __thread metrics_shard_t *thread_shard;
+#endif /* OC_ATOMICS */
+
+static long gauges[OC_METRICS_NUM_GAUGES];
+static long gauge_peaks[OC_METRICS_NUM_GAUGES];
+
+static const char *counter_names[OC_METRICS_NUM_COUNTERS] = {
+  "rx_udp",
+  "rx_tcp",
+  "rx_secured",
+  "rx_bytes",
+  "rx_shed",
+  "tx_udp",
+  "tx_tcp",
+  "tx_secured",
+  "tx_multicast",
+  "tx_bytes",
+  "buffer_exhausted",
+  "coap_retransmissions",
+  "coap_timeouts",
+  "coap_duplicates",
+  "events_dropped",
+  "tls_handshakes",
+  "tls_handshakes_completed",
+  "tls_handshakes_failed"
+};
+
+static const char *gauge_names[OC_METRICS_NUM_GAUGES] = { "process_events",
+                                                          "observers",
+                                                          "tls_peers" };
+
+static const char *histogram_names[OC_METRICS_NUM_HISTOGRAMS] = {
+  "rx_message_size",    "tx_message_size",    "event_queue_depth",
+  "tls_handshake_time", "network_queue_time", "dispatch_time",
+  "decrypt_time",       "engine_queue_time",  "authorization_time",
+  "handler_time",       "response_time",      "request_time"
+};
+
+static const char *stage_names[OC_METRICS_NUM_STAGES] = {
+  "received", "dequeued",   "dispatched", "decrypted",
+  "engine",   "authorized", "handled",    "responded"
+};
+
+static metrics_shard_t *
+get_shard(void)
+{
+#ifdef OC_ATOMICS
+  metrics_shard_t *shard = thread_shard;
+  if (!shard) {
+    int index = oc_atomic_increment(&num_shards) - 1;
+    if (index >= OC_METRICS_SHARDS) {
+      index = OC_METRICS_SHARDS - 1;
+    }
+    shard = &shards[index];
+    thread_shard = shard;
+  }
+  return shard;
+#else  /* OC_ATOMICS */
+  return &shards[0];
+#endif /* !OC_ATOMICS */
+}
+
+static void
+raise_peak(long *peak, long value)
+{
+#ifdef OC_ATOMICS
+  long current = oc_atomic_load(peak);
+  while (value > current &&
+         !oc_atomic_compare_exchange(peak, &current, value)) {
+  }
+#else  /* OC_ATOMICS */
+  if (value > *peak) {
+    *peak = value;
+  }
+#endif /* !OC_ATOMICS */
+}
+
+static void
+raise_max(unsigned long *max, unsigned long value)
+{
+#ifdef OC_ATOMICS
+  unsigned long current = oc_atomic_load(max);
+  while (value > current &&
+         !oc_atomic_compare_exchange(max, &current, value)) {
+  }
+#else  /* OC_ATOMICS */
+  if (value > *max) {
+    *max = value;
+  }
+#endif /* !OC_ATOMICS */
+}
+
+static unsigned int
+bucket_index(unsigned long value)
+{
+  unsigned int index = 0;
+  while (value > 0 && index < OC_METRICS_HISTOGRAM_BUCKETS - 1) {
+    value >>= 1;
+    index++;
+  }
+  return index;
+}
+
+void
+oc_metrics_add(oc_metrics_counter_t counter, unsigned long value)
+{
+  if ((unsigned)counter < OC_METRICS_NUM_COUNTERS) {
+    metrics_add(&get_shard()->counters[counter], value);
+  }
+}
+
+void
+oc_metrics_gauge_set(oc_metrics_gauge_t gauge, long value)
+{
+  if ((unsigned)gauge < OC_METRICS_NUM_GAUGES) {
+    metrics_store(&gauges[gauge], value);
+    raise_peak(&gauge_peaks[gauge], value);
+  }
+}
+
+void
+oc_metrics_gauge_add(oc_metrics_gauge_t gauge, long value)
+{
+  if ((unsigned)gauge < OC_METRICS_NUM_GAUGES) {
+    raise_peak(&gauge_peaks[gauge], metrics_add(&gauges[gauge], value));
+  }
+}
+
+void
+oc_metrics_observe(oc_metrics_histogram_id_t histogram, unsigned long value)
+{
+  if ((unsigned)histogram < OC_METRICS_NUM_HISTOGRAMS) {
+    histogram_shard_t *h = &get_shard()->histograms[histogram];
+    metrics_add(&h->buckets[bucket_index(value)], 1);
+    metrics_add(&h->count, 1);
+    metrics_add(&h->sum, value);
+    raise_max(&h->max, value);
+  }
+}
+
+void
+oc_metrics_get_snapshot(oc_metrics_snapshot_t *snapshot)
+{
+  if (!snapshot) {
+    return;
+  }
+  memset(snapshot, 0, sizeof(oc_metrics_snapshot_t));
+  int s, i, b;
+  for (s = 0; s < OC_METRICS_SHARDS; s++) {
+    metrics_shard_t *shard = &shards[s];
+    for (i = 0; i < OC_METRICS_NUM_COUNTERS; i++) {
+      snapshot->counters[i] += metrics_load(&shard->counters[i]);
+    }
+    for (i = 0; i < OC_METRICS_NUM_HISTOGRAMS; i++) {
+      histogram_shard_t *h = &shard->histograms[i];
+      oc_metrics_histogram_t *out = &snapshot->histograms[i];
+      unsigned long max = metrics_load(&h->max);
+      out->count += metrics_load(&h->count);
+      out->sum += metrics_load(&h->sum);
+      if (max > out->max) {
+        out->max = max;
+      }
+      for (b = 0; b < OC_METRICS_HISTOGRAM_BUCKETS; b++) {
+        out->buckets[b] += metrics_load(&h->buckets[b]);
+      }
+    }
+  }
+  for (i = 0; i < OC_METRICS_NUM_GAUGES; i++) {
+    snapshot->gauges[i] = metrics_load(&gauges[i]);
+    snapshot->gauge_peaks[i] = metrics_load(&gauge_peaks[i]);
+  }
+}
+
+void
+oc_metrics_reset(void)
+{
+  int s, i, b;
+  for (s = 0; s < OC_METRICS_SHARDS; s++) {
+    metrics_shard_t *shard = &shards[s];
+    for (i = 0; i < OC_METRICS_NUM_COUNTERS; i++) {
+      metrics_store(&shard->counters[i], 0);
+    }
+    for (i = 0; i < OC_METRICS_NUM_HISTOGRAMS; i++) {
+      histogram_shard_t *h = &shard->histograms[i];
+      metrics_store(&h->count, 0);
+      metrics_store(&h->sum, 0);
+      metrics_store(&h->max, 0);
+      for (b = 0; b < OC_METRICS_HISTOGRAM_BUCKETS; b++) {
+        metrics_store(&h->buckets[b], 0);
+      }
+    }
+  }
+  for (i = 0; i < OC_METRICS_NUM_GAUGES; i++) {
+    metrics_store(&gauge_peaks[i], metrics_load(&gauges[i]));
+  }
+}
+
+uint64_t
+oc_metrics_percentile(const oc_metrics_histogram_t *histogram,
+                      unsigned int percent)
+{
+  if (!histogram || histogram->count == 0) {
+    return 0;
+  }
+  if (percent > 100) {
+    percent = 100;
+  }
+  uint64_t rank = (histogram->count * percent + 99) / 100;
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  int b;
+  for (b = 0; b < OC_METRICS_HISTOGRAM_BUCKETS - 1; b++) {
+    seen += histogram->buckets[b];
+    if (seen >= rank) {
+      uint64_t upper = ((uint64_t)1 << b) - 1;
+      return (upper < histogram->max) ? upper : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+const char *
+oc_metrics_counter_name(oc_metrics_counter_t counter)
+{
+  if ((unsigned)counter < OC_METRICS_NUM_COUNTERS) {
+    return counter_names[counter];
+  }
+  return NULL;
+}
+
+const char *
+oc_metrics_gauge_name(oc_metrics_gauge_t gauge)
+{
+  if ((unsigned)gauge < OC_METRICS_NUM_GAUGES) {
+    return gauge_names[gauge];
+  }
+  return NULL;
+}
+
+const char *
+oc_metrics_histogram_name(oc_metrics_histogram_id_t histogram)
+{
+  if ((unsigned)histogram < OC_METRICS_NUM_HISTOGRAMS) {
+    return histogram_names[histogram];
+  }
+  return NULL;
+}
+
+const char *
+oc_metrics_stage_name(oc_metrics_stage_t stage)
+{
+  if ((unsigned)stage < OC_METRICS_NUM_STAGES) {
+    return stage_names[stage];
+  }
+  return NULL;
+}
+
+void
+oc_metrics_print_request_trace(const oc_metrics_request_trace_t *trace)
+{
+  if (!trace) {
+    return;
+  }
+  if (trace->uri) {
+    PRINT("oc_metrics: request %d /%.*s took %lu us\n", trace->method,
+          (int)trace->uri_len, trace->uri, (unsigned long)trace->total);
+  } else {
+    PRINT("oc_metrics: message took %lu us\n", (unsigned long)trace->total);
+  }
+  int s;
+  for (s = 1; s < OC_METRICS_NUM_STAGES; s++) {
+    if (trace->stages[s] >= 0) {
+      PRINT("  %-12s %8lu us\n", stage_names[s],
+            (unsigned long)trace->stages[s]);
+    }
+  }
+}
+
+#ifdef OC_REQUEST_TRACE
+typedef struct
+{
+  oc_clock_time_t *trace;
+  const char *uri;
+  size_t uri_len;
+  int method;
+} current_request_t;
+
+/* the CoAP engine runs on the event loop, but keeps to its own thread */
+#ifdef OC_ATOMICS
+static __thread current_request_t current;
+#else  /* OC_ATOMICS */
+static current_request_t current;
+#endif /* !OC_ATOMICS */
+
+static uint64_t slow_threshold;
+static oc_metrics_slow_request_cb_t slow_cb;
+static void *slow_user_data;
+
+static uint64_t
+ticks_to_us(oc_clock_time_t ticks)
+{
+  return (uint64_t)ticks * 1000000 / OC_CLOCK_SECOND;
+}
+
+void
+oc_metrics_trace_start(oc_clock_time_t *trace)
+{
+  memset(trace, 0, OC_METRICS_NUM_STAGES * sizeof(oc_clock_time_t));
+  trace[OC_METRICS_STAGE_RECEIVED] = oc_clock_time_monotonic();
+}
+
+void
+oc_metrics_trace_stamp(oc_clock_time_t *trace, oc_metrics_stage_t stage)
+{
+  /* messages the stack did not receive are not traced */
+  if (trace[OC_METRICS_STAGE_RECEIVED] != 0) {
+    trace[stage] = oc_clock_time_monotonic();
+  }
+}
+
+void
+oc_metrics_trace_begin(oc_clock_time_t *trace)
+{
+  current.trace = trace;
+  current.uri = NULL;
+  current.uri_len = 0;
+  current.method = 0;
+  oc_metrics_trace_stamp(trace, OC_METRICS_STAGE_ENGINE);
+}
+
+void
+oc_metrics_trace_request(const char *uri, size_t uri_len, int method)
+{
+  current.uri = uri;
+  current.uri_len = uri_len;
+  current.method = method;
+}
+
+void
+oc_metrics_trace_stamp_current(oc_metrics_stage_t stage)
+{
+  if (current.trace) {
+    oc_metrics_trace_stamp(current.trace, stage);
+  }
+}
+
+void
+oc_metrics_trace_end(void)
+{
+  oc_clock_time_t *trace = current.trace;
+  current.trace = NULL;
+  if (!trace || trace[OC_METRICS_STAGE_RECEIVED] == 0) {
+    return;
+  }
+  oc_metrics_trace_stamp(trace, OC_METRICS_STAGE_RESPONDED);
+
+  oc_metrics_request_trace_t report;
+  oc_clock_time_t received = trace[OC_METRICS_STAGE_RECEIVED];
+  oc_clock_time_t previous = received;
+  report.stages[OC_METRICS_STAGE_RECEIVED] = 0;
+  int s;
+  for (s = 1; s < OC_METRICS_NUM_STAGES; s++) {
+    if (trace[s] == 0) {
+      report.stages[s] = -1;
+      continue;
+    }
+    oc_metrics_histogram_id_t histogram =
+      (oc_metrics_histogram_id_t)(OC_METRICS_NETWORK_QUEUE_TIME + s - 1);
+    oc_metrics_observe(histogram,
+                       (unsigned long)ticks_to_us(trace[s] - previous));
+    report.stages[s] = (int64_t)ticks_to_us(trace[s] - received);
+    previous = trace[s];
+  }
+  report.total = ticks_to_us(previous - received);
+  oc_metrics_observe(OC_METRICS_REQUEST_TIME, (unsigned long)report.total);
+
+  if (slow_threshold > 0 && report.total >= slow_threshold) {
+    report.uri = current.uri;
+    report.uri_len = current.uri_len;
+    report.method = current.method;
+    if (slow_cb) {
+      slow_cb(&report, slow_user_data);
+    } else {
+      oc_metrics_print_request_trace(&report);
+    }
+  }
+}
+#endif /* OC_REQUEST_TRACE */
+
+void
+oc_metrics_set_slow_request_callback(uint64_t threshold,
+                                     oc_metrics_slow_request_cb_t cb,
+                                     void *user_data)
+{
+#ifdef OC_REQUEST_TRACE
+  slow_threshold = threshold;
+  slow_cb = cb;
+  slow_user_data = user_data;
+#else  /* OC_REQUEST_TRACE */
+  (void)threshold;
+  (void)cb;
+  (void)user_data;
+#endif /* !OC_REQUEST_TRACE */
+}
+
+static void
+get_metrics(oc_request_t *request, oc_interface_mask_t iface_mask, void *data)
+{
+  (void)data;
+  oc_metrics_snapshot_t snapshot;
+  int i;
+
+  oc_rep_start_root_object();
+  switch (iface_mask) {
+  case OC_IF_BASELINE:
+    oc_process_baseline_interface(request->resource);
+  /* fall through */
+  case OC_IF_RW:
+    oc_metrics_get_snapshot(&snapshot);
+
+    oc_rep_set_object(root, counters);
+    for (i = 0; i < OC_METRICS_NUM_COUNTERS; i++) {
+      oc_rep_set_key(oc_rep_object(counters), counter_names[i]);
+      oc_rep_set_value_int(counters, (int64_t)snapshot.counters[i]);
+    }
+    oc_rep_close_object(root, counters);
+
+    oc_rep_set_object(root, gauges);
+    for (i = 0; i < OC_METRICS_NUM_GAUGES; i++) {
+      oc_rep_set_key(oc_rep_object(gauges), gauge_names[i]);
+      oc_rep_begin_object(oc_rep_object(gauges), gauge);
+      oc_rep_set_int(gauge, value, snapshot.gauges[i]);
+      oc_rep_set_int(gauge, peak, snapshot.gauge_peaks[i]);
+      oc_rep_end_object(oc_rep_object(gauges), gauge);
+    }
+    oc_rep_close_object(root, gauges);
+
+    oc_rep_set_object(root, histograms);
+    for (i = 0; i < OC_METRICS_NUM_HISTOGRAMS; i++) {
+      const oc_metrics_histogram_t *h = &snapshot.histograms[i];
+      oc_rep_set_key(oc_rep_object(histograms), histogram_names[i]);
+      oc_rep_begin_object(oc_rep_object(histograms), histogram);
+      oc_rep_set_int(histogram, count, (int64_t)h->count);
+      oc_rep_set_int(histogram, sum, (int64_t)h->sum);
+      oc_rep_set_int(histogram, max, (int64_t)h->max);
+      oc_rep_set_int(histogram, p50, (int64_t)oc_metrics_percentile(h, 50));
+      oc_rep_set_int(histogram, p99, (int64_t)oc_metrics_percentile(h, 99));
+      oc_rep_set_array(histogram, buckets);
+      int b;
+      for (b = 0; b < OC_METRICS_HISTOGRAM_BUCKETS; b++) {
+        oc_rep_add_int(buckets, (int64_t)h->buckets[b]);
+      }
+      oc_rep_close_array(histogram, buckets);
+      oc_rep_end_object(oc_rep_object(histograms), histogram);
+    }
+    oc_rep_close_object(root, histograms);
+    break;
+  default:
+    break;
+  }
+  oc_rep_end_root_object();
+  oc_send_response(request, OC_STATUS_OK);
+}
+
+static void
+post_metrics(oc_request_t *request, oc_interface_mask_t iface_mask,
+             void *data)
+{
+  (void)iface_mask;
+  (void)data;
+  bool reset = false;
+  if (oc_rep_get_bool(request->request_payload, "reset", &reset) && reset) {
+    oc_metrics_reset();
+    oc_send_response(request, OC_STATUS_CHANGED);
+  } else {
+    oc_send_response(request, OC_STATUS_BAD_REQUEST);
+  }
+}
+
+void
+oc_create_metrics_resource(size_t device)
+{
+  OC_DBG("oc_metrics: Initializing metrics resource");
+
+  oc_core_populate_resource(OCF_METRICS, device, "oc/metrics",
+                            OC_IF_RW | OC_IF_BASELINE, OC_IF_RW, OC_SECURE,
+                            get_metrics, 0, post_metrics, 0, 1,
+                            "x.org.iotivity.metrics");
+}
+#endif /* OC_METRICS */
@@ -0,0 +1,92 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef OC_METRICS_INTERNAL_H
+#define OC_METRICS_INTERNAL_H
+
+#include "oc_metrics.h"
+#include "port/oc_clock.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef OC_METRICS
+void oc_metrics_add(oc_metrics_counter_t counter, unsigned long value);
+void oc_metrics_gauge_set(oc_metrics_gauge_t gauge, long value);
+void oc_metrics_gauge_add(oc_metrics_gauge_t gauge, long value);
+void oc_metrics_observe(oc_metrics_histogram_id_t histogram,
+                        unsigned long value);
+
+/**
+@brief Creation of the x.org.iotivity.metrics diagnostic resource.
+
+@param device index of the device to which the resource is to be created
+*/
+void oc_create_metrics_resource(size_t device);
+
+#define OC_METRICS_INC(counter) oc_metrics_add((counter), 1)
+#define OC_METRICS_ADD(counter, value)                                         \
+  oc_metrics_add((counter), (unsigned long)(value))
+#define OC_METRICS_GAUGE_SET(gauge, value)                                     \
+  oc_metrics_gauge_set((gauge), (long)(value))
+#define OC_METRICS_GAUGE_ADD(gauge, value)                                     \
+  oc_metrics_gauge_add((gauge), (long)(value))
+#define OC_METRICS_OBSERVE(histogram, value)                                   \
+  oc_metrics_observe((histogram), (unsigned long)(value))
+#else /* OC_METRICS */
+/* the arguments are not evaluated */
+#define OC_METRICS_INC(counter)
+#define OC_METRICS_ADD(counter, value)
+#define OC_METRICS_GAUGE_SET(gauge, value)
+#define OC_METRICS_GAUGE_ADD(gauge, value)
+#define OC_METRICS_OBSERVE(histogram, value)
+#endif /* !OC_METRICS */
+
+#ifdef OC_REQUEST_TRACE
+/* Per message timestamps, see oc_message_t */
+void oc_metrics_trace_start(oc_clock_time_t *trace);
+void oc_metrics_trace_stamp(oc_clock_time_t *trace, oc_metrics_stage_t stage);
+/* The message being processed by the CoAP engine on this thread, from
+ * begin to end; stages past the engine are stamped on it. */
+void oc_metrics_trace_begin(oc_clock_time_t *trace);
+void oc_metrics_trace_request(const char *uri, size_t uri_len, int method);
+void oc_metrics_trace_stamp_current(oc_metrics_stage_t stage);
+void oc_metrics_trace_end(void);
+
+#define OC_METRICS_TRACE_START(message) oc_metrics_trace_start((message)->trace)
+#define OC_METRICS_TRACE_STAMP(message, stage)                                 \
+  oc_metrics_trace_stamp((message)->trace, (stage))
+#define OC_METRICS_TRACE_BEGIN(message) oc_metrics_trace_begin((message)->trace)
+#define OC_METRICS_TRACE_REQUEST(uri, uri_len, method)                         \
+  oc_metrics_trace_request((uri), (uri_len), (int)(method))
+#define OC_METRICS_TRACE_STAMP_CURRENT(stage)                                  \
+  oc_metrics_trace_stamp_current(stage)
+#define OC_METRICS_TRACE_END() oc_metrics_trace_end()
+#else /* OC_REQUEST_TRACE */
+#define OC_METRICS_TRACE_START(message)
+#define OC_METRICS_TRACE_STAMP(message, stage)
+#define OC_METRICS_TRACE_BEGIN(message)
+#define OC_METRICS_TRACE_REQUEST(uri, uri_len, method)
+#define OC_METRICS_TRACE_STAMP_CURRENT(stage)
+#define OC_METRICS_TRACE_END()
+#endif /* !OC_REQUEST_TRACE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_METRICS_INTERNAL_H */
@@ -15,13 +15,22 @@
 */
 
 #include "oc_network_events.h"
+#include "api/oc_metrics_internal.h"
 #include "oc_buffer.h"
 #include "oc_events.h"
 #include "oc_signal_event_loop.h"
 #include "port/oc_connectivity.h"
 #include "util/oc_list.h"
+#include "util/oc_mpsc.h"
 
+#ifdef OC_ATOMICS
+/* Network threads hand messages over without taking the network event
+ * handler mutex; the event loop is the only consumer.
+ */
+OC_MPSC_QUEUE(network_events);
+#else  /* OC_ATOMICS */
 OC_LIST(network_events);
+#endif /* !OC_ATOMICS */
 #ifdef OC_NETWORK_MONITOR
 static bool interface_up, interface_down;
 #endif /* OC_NETWORK_MONITOR */
@@ -29,12 +38,23 @@ static bool interface_up, interface_down;
 static void
 oc_process_network_event(void)
 {
+#ifdef OC_ATOMICS
+  oc_message_t *message = (oc_message_t *)oc_mpsc_pop(&network_events);
+  while (message != NULL) {
+    oc_recv_message(message);
+    message = (oc_message_t *)oc_mpsc_pop(&network_events);
+  }
+#ifdef OC_NETWORK_MONITOR
+  oc_network_event_handler_mutex_lock();
+#endif /* OC_NETWORK_MONITOR */
+#else  /* OC_ATOMICS */
   oc_network_event_handler_mutex_lock();
   oc_message_t *message = (oc_message_t *)oc_list_pop(network_events);
   while (message != NULL) {
     oc_recv_message(message);
     message = oc_list_pop(network_events);
   }
+#endif /* !OC_ATOMICS */
 #ifdef OC_NETWORK_MONITOR
   if (interface_up) {
     oc_process_post(&oc_network_events, oc_events[INTERFACE_UP], NULL);
@@ -45,7 +65,9 @@ oc_process_network_event(void)
     interface_down = false;
   }
 #endif /* OC_NETWORK_MONITOR */
+#if !defined(OC_ATOMICS) || defined(OC_NETWORK_MONITOR)
   oc_network_event_handler_mutex_unlock();
+#endif /* !OC_ATOMICS || OC_NETWORK_MONITOR */
 }
 
 OC_PROCESS(oc_network_events, "");
@@ -74,14 +96,38 @@ oc_network_event(oc_message_t *message)
     oc_message_unref(message);
     return;
   }
+  OC_METRICS_TRACE_START(message);
+  /* received into a full sized buffer; release what is not needed while the
+   * message waits in the queue */
+  oc_message_shrink_buffer(message);
+#ifdef OC_ATOMICS
+  oc_mpsc_push(&network_events, message);
+#else  /* OC_ATOMICS */
   oc_network_event_handler_mutex_lock();
   oc_list_add(network_events, message);
   oc_network_event_handler_mutex_unlock();
+#endif /* !OC_ATOMICS */
 
   oc_process_poll(&(oc_network_events));
   _oc_signal_event_loop();
 }
 
+#ifdef OC_EXTERNAL_EVENT_LOOP
+void
+oc_network_event_in_loop(oc_message_t *message)
+{
+  if (!oc_process_is_running(&(oc_network_events))) {
+    oc_message_unref(message);
+    return;
+  }
+  OC_METRICS_TRACE_START(message);
+  /* the caller runs the event loop right after receiving, so the message
+   * skips the queue shared with other threads and the wakeup */
+  oc_message_shrink_buffer(message);
+  oc_recv_message(message);
+}
+#endif /* OC_EXTERNAL_EVENT_LOOP */
+
 #ifdef OC_NETWORK_MONITOR
 void
 oc_network_interface_event(oc_interface_event_t event)
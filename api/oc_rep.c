@@ -24,9 +24,9 @@
 #include <inttypes.h>
 
 static struct oc_memb *rep_objects;
-static uint8_t *g_buf;
-CborEncoder g_encoder, root_map, links_array;
-CborError g_err;
+static OC_REP_THREAD_LOCAL uint8_t *g_buf;
+OC_REP_THREAD_LOCAL CborEncoder g_encoder, root_map, links_array;
+OC_REP_THREAD_LOCAL CborError g_err;
 
 void
 oc_rep_set_pool(struct oc_memb *rep_objects_pool)
@@ -32,6 +32,7 @@
 
 #include "port/oc_random.h"
 
+#include "api/oc_metrics_internal.h"
 #include "oc_buffer.h"
 #include "oc_core_res.h"
 #include "oc_discovery.h"
@@ -43,6 +44,7 @@
 #include "oc_api.h"
 #include "oc_ri.h"
 #include "oc_uuid.h"
+#include "oc_worker_internal.h"
 
 #ifdef OC_BLOCK_WISE
 #include "oc_blockwise.h"
@@ -298,6 +300,80 @@ oc_ri_get_app_resource_by_uri(const char *uri, size_t uri_len, size_t device)
   return res;
 }
 
+static bool
+uri_matches(const char *uri, size_t uri_len, const oc_string_t *res_uri)
+{
+  int skip = (uri[0] != '/') ? 1 : 0;
+  return oc_string_len(*res_uri) == (uri_len + skip) &&
+         strncmp(uri, oc_string(*res_uri) + skip, uri_len) == 0;
+}
+
+size_t
+oc_ri_get_request_device(size_t device, const char *uri, size_t uri_len,
+                         const char *query, size_t query_len)
+{
+  char *value = NULL;
+  int value_len = -1;
+  if (query && query_len > 0) {
+    value_len = oc_ri_get_query_value(query, query_len, "di", &value);
+    if (value_len < 0) {
+      value_len = oc_ri_get_query_value(query, query_len, "anchor", &value);
+      if (value_len > 6 && memcmp(value, "ocf://", 6) == 0) {
+        value += 6;
+        value_len -= 6;
+      } else {
+        value_len = -1;
+      }
+    }
+  }
+  if (value_len == OC_UUID_LEN - 1) {
+    char di[OC_UUID_LEN];
+    memcpy(di, value, value_len);
+    di[value_len] = '\0';
+    oc_uuid_t uuid;
+    oc_str_to_uuid(di, &uuid);
+    size_t d;
+    for (d = 0; d < oc_core_get_num_devices(); d++) {
+      if (memcmp(oc_core_get_device_id(d)->id, uuid.id, 16) == 0) {
+        return d;
+      }
+    }
+  }
+
+  if (!uri || uri_len == 0) {
+    return device;
+  }
+  /* A URI hosted by several devices goes to the receiving device if it is
+   * one of them, else to the lowest numbered one.
+   */
+  size_t match = (size_t)-1;
+  oc_resource_t *res = oc_ri_get_app_resources();
+  for (; res != NULL; res = res->next) {
+    if (uri_matches(uri, uri_len, &res->uri)) {
+      if (res->device == device) {
+        return device;
+      }
+      if (res->device < match) {
+        match = res->device;
+      }
+    }
+  }
+#ifdef OC_COLLECTIONS
+  oc_collection_t *collection = oc_collection_get_all();
+  for (; collection != NULL; collection = collection->next) {
+    if (uri_matches(uri, uri_len, &collection->uri)) {
+      if (collection->device == device) {
+        return device;
+      }
+      if (collection->device < match) {
+        match = collection->device;
+      }
+    }
+  }
+#endif /* OC_COLLECTIONS */
+  return (match != (size_t)-1) ? match : device;
+}
+
 static void
 oc_ri_delete_all_app_resources(void)
 {
@@ -329,6 +405,9 @@ oc_ri_init(void)
 
   oc_process_init();
   start_processes();
+#if defined(OC_WORKER_THREADS) && defined(OC_SERVER)
+  oc_worker_init();
+#endif /* OC_WORKER_THREADS && OC_SERVER */
 }
 
 #ifdef OC_SERVER
@@ -344,9 +423,12 @@ oc_ri_delete_resource(oc_resource_t *resource)
   if (!resource)
     return false;
 
-  if (resource->num_observers > 0) {
-    coap_remove_observer_by_resource(resource);
-  }
+#if defined(OC_WORKER_THREADS) && defined(OC_SERVER)
+  /* workers may still run, or hold responses from, its handlers, even if it
+   * is no longer concurrent */
+  oc_worker_drain();
+#endif /* OC_WORKER_THREADS && OC_SERVER */
+  coap_remove_observer_by_resource(resource);
   oc_list_remove(app_resources, resource);
   oc_ri_free_resource_properties(resource);
   oc_memb_free(&app_resources_s, resource);
@@ -673,11 +755,76 @@ oc_ri_audit_log(oc_method_t method, oc_resource_t *resource,
 #endif /* OC_SECURITY */
 
 #ifdef OC_BLOCK_WISE
+bool
+oc_ri_produce_stream_block(void *request, void *response,
+                           oc_resource_t *resource, uint16_t block2_size,
+                           uint8_t *buffer)
+{
+  uint32_t block2_num = 0;
+  coap_get_header_block2(request, &block2_num, NULL, NULL, NULL);
+  size_t offset = (size_t)block2_num * block2_size;
+  bool last = true;
+  int len =
+    resource->stream_handler.cb(resource, offset, buffer, block2_size, &last,
+                                resource->stream_handler.user_data);
+  if (len < 0 || len > block2_size) {
+    OC_ERR("ocri: stream producer failed at offset %u", (unsigned)offset);
+    return false;
+  }
+  coap_set_payload(response, buffer, (size_t)len);
+  if (block2_num > 0 || !last) {
+    coap_set_header_block2(response, block2_num, last ? 0 : 1, block2_size);
+  }
+  coap_set_header_content_format(response,
+                                 resource->stream_handler.content_format);
+  coap_set_header_etag(response, (uint8_t *)&resource->stream_handler.etag,
+                       sizeof(resource->stream_handler.etag));
+  return true;
+}
+
+/* Run the handler of a non-collection resource for the requested method.
+ * Returns false if the resource does not implement the method. */
+static bool
+invoke_request_handler(oc_resource_t *resource, oc_method_t method,
+                       oc_request_t *request, oc_interface_mask_t iface_mask)
+{
+  oc_request_handler_t *handler = NULL;
+  switch (method) {
+  case OC_GET:
+    handler = &resource->get_handler;
+    break;
+  case OC_POST:
+    handler = &resource->post_handler;
+    break;
+  case OC_PUT:
+    handler = &resource->put_handler;
+    break;
+  case OC_DELETE:
+    handler = &resource->delete_handler;
+    break;
+  }
+  if (!handler || !handler->cb) {
+    return false;
+  }
+#if defined(OC_WORKER_THREADS) && defined(OC_SERVER)
+  /* Handlers of a concurrent resource run on the worker serving the
+   * request's origin, which completes it with a separate response.
+   */
+  if ((resource->properties & OC_CONCURRENT) &&
+      oc_worker_dispatch(request, method, iface_mask)) {
+    return true;
+  }
+#endif /* OC_WORKER_THREADS && OC_SERVER */
+  handler->cb(request, iface_mask, handler->user_data);
+  return true;
+}
+
 bool
 oc_ri_invoke_coap_entity_handler(void *request, void *response,
                                  oc_blockwise_state_t **request_state,
                                  oc_blockwise_state_t **response_state,
-                                 uint16_t block2_size, oc_endpoint_t *endpoint)
+                                 uint16_t block2_size, uint8_t *buffer,
+                                 oc_endpoint_t *endpoint)
 #else  /* OC_BLOCK_WISE */
 bool
 oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
@@ -753,6 +900,7 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
   /* Obtain request uri from the CoAP packet. */
   const char *uri_path = NULL;
   size_t uri_path_len = coap_get_header_uri_path(request, &uri_path);
+  OC_METRICS_TRACE_REQUEST(uri_path, uri_path_len, (int)method);
 
   /* Obtain query string from CoAP packet. */
   const char *uri_query = 0;
@@ -796,9 +944,10 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
   memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
   struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                  rep_objects_alloc, (void *)rep_objects_pool,
-                                 0 };
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
   oc_rep_set_pool(&rep_objects);
 
@@ -890,7 +1039,15 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
 /* Alloc response_state. It also affects request_obj.response.
  */
 #ifdef OC_BLOCK_WISE
-  if (cur_resource && !bad_request) {
+  /* Streamed representations are produced one block at a time straight
+   * into the outgoing message, without a response_state.
+   */
+  bool stream_response = cur_resource && !bad_request && method == OC_GET &&
+                         cur_resource->stream_handler.cb;
+  if (stream_response) {
+    response_buffer.buffer = buffer;
+    response_buffer.buffer_size = block2_size;
+  } else if (cur_resource && !bad_request) {
     if (!(*response_state)) {
       OC_DBG("creating new block-wise response state");
       *response_state = oc_blockwise_alloc_response_buffer(
@@ -934,33 +1091,35 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
     } else
 #endif /* OC_SECURITY */
     {
+      OC_METRICS_TRACE_STAMP_CURRENT(OC_METRICS_STAGE_AUTHORIZED);
 /* If cur_resource is a collection resource, invoke the framework's
  * internal handler for collections.
  */
+#ifdef OC_BLOCK_WISE
+      if (stream_response) {
+        if (oc_ri_produce_stream_block(request, response, cur_resource,
+                                       block2_size, buffer)) {
+          response_buffer.code = oc_status_code(OC_STATUS_OK);
+        } else {
+          response_buffer.code =
+            oc_status_code(OC_STATUS_INTERNAL_SERVER_ERROR);
+        }
+      } else
+#endif /* OC_BLOCK_WISE */
 #if defined(OC_COLLECTIONS) && defined(OC_SERVER)
       if (resource_is_collection) {
         oc_handle_collection_request(method, &request_obj, iface_mask, NULL);
       } else
 #endif /* OC_COLLECTIONS && OC_SERVER */
+      {
         /* If cur_resource is a non-collection resource, invoke
          * its handler for the requested method. If it has not
          * implemented that method, then return a 4.05 response.
          */
-        if (method == OC_GET && cur_resource->get_handler.cb) {
-        cur_resource->get_handler.cb(&request_obj, iface_mask,
-                                     cur_resource->get_handler.user_data);
-      } else if (method == OC_POST && cur_resource->post_handler.cb) {
-        cur_resource->post_handler.cb(&request_obj, iface_mask,
-                                      cur_resource->post_handler.user_data);
-      } else if (method == OC_PUT && cur_resource->put_handler.cb) {
-        cur_resource->put_handler.cb(&request_obj, iface_mask,
-                                     cur_resource->put_handler.user_data);
-      } else if (method == OC_DELETE && cur_resource->delete_handler.cb) {
-        cur_resource->delete_handler.cb(&request_obj, iface_mask,
-                                        cur_resource->delete_handler.user_data);
-      } else {
-        method_impl = false;
+        method_impl = invoke_request_handler(cur_resource, method,
+                                             &request_obj, iface_mask);
       }
+      OC_METRICS_TRACE_STAMP_CURRENT(OC_METRICS_STAGE_HANDLED);
     }
   }
 
@@ -1384,9 +1543,10 @@ oc_ri_invoke_client_cb(void *response, oc_client_cb_t *cb,
   memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
   struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                  rep_objects_alloc, (void *)rep_objects_pool,
-                                 0 };
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
   oc_rep_set_pool(&rep_objects);
   if (payload_len) {
@@ -1516,6 +1676,68 @@ free_all_client_cbs(void)
   }
 }
 
+#ifdef OC_BLOCK_WISE
+bool
+oc_ri_invoke_client_stream_cb(void *response, oc_client_cb_t *cb,
+                              oc_endpoint_t *endpoint, uint32_t offset,
+                              bool more)
+{
+  coap_packet_t *const pkt = (coap_packet_t *)response;
+  oc_client_response_t client_response;
+  memset(&client_response, 0, sizeof(oc_client_response_t));
+  client_response.client_cb = cb;
+  client_response.endpoint = endpoint;
+  client_response.observe_option = -1;
+  client_response.user_data = cb->user_data;
+  coap_get_header_content_format(response, &client_response.content_format);
+  int i;
+  for (i = 0; i < __NUM_OC_STATUS_CODES__; i++) {
+    if (oc_coap_status_codes[i] == pkt->code) {
+      client_response.code = i;
+      break;
+    }
+  }
+  const uint8_t *payload = NULL;
+  client_response._payload_len = coap_get_payload(response, &payload);
+  client_response._payload = payload;
+  client_response.offset = offset;
+  client_response.more = more;
+
+  /* every block must come from the representation of the first one */
+  const uint8_t *etag = NULL;
+  int etag_len = coap_get_header_etag(response, &etag);
+  if (offset == 0) {
+    cb->stream_etag_len = (uint8_t)etag_len;
+    if (etag_len > 0) {
+      memcpy(cb->stream_etag, etag, etag_len);
+    }
+  } else if (pkt->code < BAD_REQUEST_4_00 &&
+             (etag_len != cb->stream_etag_len ||
+              (etag_len > 0 && memcmp(etag, cb->stream_etag, etag_len) != 0))) {
+    OC_WRN("streamed representation changed during the transfer");
+    client_response.code = OC_STATUS_SERVICE_UNAVAILABLE;
+    client_response._payload = NULL;
+    client_response._payload_len = 0;
+    client_response.more = more = false;
+  }
+
+  /* Blocks following the first one are fetched with CON requests whose
+   * failure is reported through oc_ri_free_client_cbs_by_mid().
+   */
+  oc_ri_remove_timed_event_callback(cb, &oc_ri_remove_client_cb);
+  cb->ref_count = 1;
+  cb->handler.response(&client_response);
+  if (!oc_ri_is_client_cb_valid(cb)) {
+    return true;
+  }
+  cb->ref_count = 0;
+  if (!more) {
+    free_client_cb(cb);
+  }
+  return true;
+}
+#endif /* OC_BLOCK_WISE */
+
 oc_client_cb_t *
 oc_ri_alloc_client_cb(const char *uri, oc_endpoint_t *endpoint,
                       oc_method_t method, const char *query,
@@ -1543,6 +1765,11 @@ oc_ri_alloc_client_cb(const char *uri, oc_endpoint_t *endpoint,
     i += sizeof(r);
   }
   cb->discovery = false;
+#ifdef OC_BLOCK_WISE
+  cb->stream = false;
+  cb->stream_offset = 0;
+  cb->stream_etag_len = 0;
+#endif /* OC_BLOCK_WISE */
   cb->timestamp = oc_clock_time();
   cb->observe_seq = -1;
   oc_endpoint_copy(&cb->endpoint, endpoint);
@@ -1572,6 +1799,10 @@ oc_ri_shutdown(void)
   while (oc_main_poll() != 0)
     ;
 
+#if defined(OC_WORKER_THREADS) && defined(OC_SERVER)
+  oc_worker_shutdown();
+#endif /* OC_WORKER_THREADS && OC_SERVER */
+
   stop_processes();
 
   oc_process_shutdown();
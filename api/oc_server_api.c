@@ -32,6 +32,8 @@
 #endif /* OC_DYNAMIC_ALLOCATION */
 
 #include "oc_core_res.h"
+#include "oc_worker_internal.h"
+#include "port/oc_random.h"
 
 static size_t query_iterator;
 
@@ -282,6 +284,7 @@ oc_new_resource(const char *name, const char *uri, uint8_t num_resource_types,
     resource->default_interface = OC_IF_BASELINE;
     resource->observe_period_seconds = 0;
     resource->num_observers = 0;
+    resource->num_scheduled_observers = 0;
     oc_populate_resource_object(resource, name, uri, num_resource_types,
                                 device);
   }
@@ -376,6 +379,15 @@ oc_resource_set_periodic_observable(oc_resource_t *resource, uint16_t seconds)
   resource->observe_period_seconds = seconds;
 }
 
+void
+oc_resource_set_concurrent(oc_resource_t *resource, bool state)
+{
+  if (state)
+    resource->properties |= OC_CONCURRENT;
+  else
+    resource->properties &= ~OC_CONCURRENT;
+}
+
 void
 oc_resource_set_properties_cbs(oc_resource_t *resource,
                                oc_get_properties_cb_t get_properties,
@@ -417,6 +429,26 @@ oc_resource_set_request_handler(oc_resource_t *resource, oc_method_t method,
   }
 }
 
+#ifdef OC_BLOCK_WISE
+void
+oc_resource_set_stream_handler(oc_resource_t *resource,
+                               oc_stream_producer_t producer,
+                               oc_content_format_t content_format,
+                               void *user_data)
+{
+  resource->stream_handler.cb = producer;
+  resource->stream_handler.content_format = content_format;
+  resource->stream_handler.user_data = user_data;
+  resource->stream_handler.etag = oc_random_value();
+}
+
+void
+oc_resource_stream_changed(oc_resource_t *resource)
+{
+  resource->stream_handler.etag++;
+}
+#endif /* OC_BLOCK_WISE */
+
 void
 oc_set_con_write_cb(oc_con_write_cb_t callback)
 {
@@ -459,37 +491,35 @@ oc_set_separate_response_buffer(oc_separate_response_t *handle)
 #endif /* !OC_BLOCK_WISE */
 }
 
-void
-oc_send_separate_response(oc_separate_response_t *handle,
-                          oc_status_t response_code)
+static void
+send_separate_response(oc_separate_response_t *handle,
+                       oc_response_buffer_t *response_buffer)
 {
-  oc_response_buffer_t response_buffer;
-  response_buffer.buffer = handle->buffer;
-  response_buffer.response_length = (uint16_t)response_length();
-  response_buffer.code = oc_status_code(response_code);
-  response_buffer.content_format = APPLICATION_VND_OCF_CBOR;
-
   coap_separate_t *cur = oc_list_head(handle->requests), *next = NULL;
   coap_packet_t response[1];
 
   while (cur != NULL) {
     next = cur->next;
     if (cur->observe < 3) {
-      coap_transaction_t *t =
-        coap_new_transaction(coap_get_mid(), &cur->endpoint);
-      if (t) {
-        coap_separate_resume(response, cur,
-                             (uint8_t)oc_status_code(response_code), t->mid);
+      /* the response rides on an ACK that is still held back */
+      bool piggyback = (cur->type == COAP_TYPE_ACK);
+      coap_transaction_t *t = NULL;
+      if (!piggyback) {
+        t = coap_new_transaction(coap_get_mid(), &cur->endpoint);
+      }
+      if (piggyback || t) {
+        coap_separate_resume(response, cur, (uint8_t)response_buffer->code,
+                             piggyback ? cur->mid : t->mid);
         coap_set_header_content_format(response,
-                                       response_buffer.content_format);
+                                       response_buffer->content_format);
 
 #ifdef OC_BLOCK_WISE
         oc_blockwise_state_t *response_state = NULL;
 #ifdef OC_TCP
         if (!(cur->endpoint.flags & TCP) &&
-            response_buffer.response_length > cur->block2_size) {
+            response_buffer->response_length > cur->block2_size) {
 #else  /* OC_TCP */
-        if (response_buffer.response_length > cur->block2_size) {
+        if (response_buffer->response_length > cur->block2_size) {
 #endif /* !OC_TCP */
           response_state = oc_blockwise_find_response_buffer(
             oc_string(cur->uri), oc_string_len(cur->uri), &cur->endpoint,
@@ -510,9 +540,9 @@ oc_send_separate_response(oc_separate_response_t *handle,
             goto next_separate_request;
           }
 
-          memcpy(response_state->buffer, response_buffer.buffer,
-                 response_buffer.response_length);
-          response_state->payload_size = response_buffer.response_length;
+          memcpy(response_state->buffer, response_buffer->buffer,
+                 response_buffer->response_length);
+          response_state->payload_size = response_buffer->response_length;
 
           uint32_t payload_size = 0;
           const void *payload = oc_blockwise_dispatch_block(
@@ -527,23 +557,28 @@ oc_send_separate_response(oc_separate_response_t *handle,
           }
         } else
 #endif /* OC_BLOCK_WISE */
-          if (response_buffer.response_length > 0) {
+          if (response_buffer->response_length > 0) {
           coap_set_payload(response, handle->buffer,
-                           response_buffer.response_length);
+                           response_buffer->response_length);
         }
-        coap_set_status_code(response, response_buffer.code);
-        t->message->length = coap_serialize_message(response, t->message->data);
-        if (t->message->length > 0) {
-          coap_send_transaction(t);
+        coap_set_status_code(response, response_buffer->code);
+        if (piggyback) {
+          coap_separate_send_ack(response, &cur->endpoint);
         } else {
-          coap_clear_transaction(t);
+          t->message->length =
+            coap_serialize_message_into(response, t->message);
+          if (t->message->length > 0) {
+            coap_send_transaction(t);
+          } else {
+            coap_clear_transaction(t);
+          }
         }
       }
     } else {
       oc_resource_t *resource = oc_ri_get_app_resource_by_uri(
         oc_string(cur->uri), oc_string_len(cur->uri), cur->endpoint.device);
       if (resource) {
-        coap_notify_observers(resource, &response_buffer, &cur->endpoint);
+        coap_notify_observers(resource, response_buffer, &cur->endpoint);
       }
     }
 #ifdef OC_BLOCK_WISE
@@ -558,6 +593,38 @@ oc_send_separate_response(oc_separate_response_t *handle,
 #endif /* OC_DYNAMIC_ALLOCATION */
 }
 
+void
+oc_send_separate_response(oc_separate_response_t *handle,
+                          oc_status_t response_code)
+{
+  oc_response_buffer_t response_buffer;
+  response_buffer.buffer = handle->buffer;
+  response_buffer.response_length = (uint16_t)response_length();
+  response_buffer.code = oc_status_code(response_code);
+  response_buffer.content_format = APPLICATION_VND_OCF_CBOR;
+
+  send_separate_response(handle, &response_buffer);
+}
+
+#ifdef OC_WORKER_THREADS
+void
+oc_send_separate_response_buffer(oc_separate_response_t *handle,
+                                 const oc_response_buffer_t *response)
+{
+  oc_response_buffer_t response_buffer;
+  response_buffer.buffer = handle->buffer;
+  response_buffer.response_length = 0;
+  response_buffer.code = response->code;
+  response_buffer.content_format = response->content_format;
+  if (handle->buffer && response->response_length <= OC_MAX_APP_DATA_SIZE) {
+    memcpy(handle->buffer, response->buffer, response->response_length);
+    response_buffer.response_length = response->response_length;
+  }
+
+  send_separate_response(handle, &response_buffer);
+}
+#endif /* OC_WORKER_THREADS */
+
 int
 oc_notify_observers(oc_resource_t *resource)
 {
@@ -84,9 +84,10 @@ oc_load_sw(size_t device)
     memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
     struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                    rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
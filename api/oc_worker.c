@@ -0,0 +1,395 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "oc_config.h"
+
+#if defined(OC_WORKER_THREADS) && defined(OC_SERVER)
+
+#ifndef OC_DYNAMIC_ALLOCATION
+#error "OC_WORKER_THREADS requires OC_DYNAMIC_ALLOCATION"
+#endif /* !OC_DYNAMIC_ALLOCATION */
+
+#include "oc_worker_internal.h"
+#include "messaging/coap/oc_coap.h"
+#include "messaging/coap/observe.h"
+#include "messaging/coap/separate.h"
+#include "oc_api.h"
+#include "oc_rep.h"
+#include "oc_signal_event_loop.h"
+#include "port/oc_log.h"
+#include "util/oc_list.h"
+#include "util/oc_process.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A request to a concurrent resource, together with everything the handler
+ * may touch while it runs on a worker thread. Jobs are allocated, completed
+ * and freed on the event loop; a worker only runs the handler. */
+typedef struct oc_worker_job_s
+{
+  struct oc_worker_job_s *next;
+  oc_request_t request;
+  oc_response_t response;
+  oc_response_buffer_t response_buffer;
+  oc_separate_response_t separate_response;
+  oc_endpoint_t origin;
+  oc_string_t query;
+  oc_string_t payload;
+  oc_request_callback_t handler;
+  void *user_data;
+  oc_interface_mask_t iface_mask;
+  oc_method_t method;
+} oc_worker_job_t;
+
+typedef struct
+{
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  OC_LIST_STRUCT(jobs);
+  size_t queued; /* jobs waiting or running on this worker */
+  bool terminate;
+} oc_worker_t;
+
+static oc_worker_t workers[OC_WORKER_THREADS];
+static size_t num_workers;
+static pthread_mutex_t completed_mutex;
+OC_LIST(completed_jobs);
+
+OC_PROCESS(oc_worker_events, "");
+
+static size_t
+worker_for_endpoint(const oc_endpoint_t *endpoint)
+{
+  const uint8_t *address = endpoint->addr.ipv6.address;
+  size_t len = sizeof(endpoint->addr.ipv6.address);
+  uint16_t port = endpoint->addr.ipv6.port;
+#ifdef OC_IPV4
+  if (endpoint->flags & IPV4) {
+    address = endpoint->addr.ipv4.address;
+    len = sizeof(endpoint->addr.ipv4.address);
+    port = endpoint->addr.ipv4.port;
+  }
+#endif /* OC_IPV4 */
+  /* FNV-1a over the peer's address and port */
+  uint32_t hash = 2166136261u;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ address[i]) * 16777619u;
+  }
+  hash = (hash ^ (port & 0xff)) * 16777619u;
+  hash = (hash ^ (port >> 8)) * 16777619u;
+  return hash % num_workers;
+}
+
+static void
+free_job(oc_worker_job_t *job)
+{
+  if (job->request.request_payload) {
+    oc_free_rep(job->request.request_payload);
+  }
+  oc_free_string(&job->query);
+  oc_free_string(&job->payload);
+  free(job->response_buffer.buffer);
+  free(job);
+}
+
+static oc_event_callback_retval_t
+ack_window_expired(void *data)
+{
+  /* the handler is slow, so acknowledge the request and send its response
+   * separately once it is ready */
+  oc_worker_job_t *job = (oc_worker_job_t *)data;
+  coap_separate_ack(&job->separate_response);
+  return OC_EVENT_DONE;
+}
+
+static void
+discard_job(oc_worker_job_t *job)
+{
+  oc_ri_remove_timed_event_callback(job, ack_window_expired);
+  coap_separate_t *cur = oc_list_head(job->separate_response.requests), *next;
+  while (cur != NULL) {
+    next = cur->next;
+    coap_separate_clear(&job->separate_response, cur);
+    cur = next;
+  }
+  free(job->separate_response.buffer);
+  free_job(job);
+}
+
+static void
+complete_job(oc_worker_job_t *job)
+{
+  oc_ri_remove_timed_event_callback(job, ack_window_expired);
+  if (!job->separate_response.active ||
+      job->response_buffer.code == OC_IGNORE) {
+    discard_job(job);
+    return;
+  }
+
+  /* oc_send_separate_response_buffer() releases the handle's buffer */
+  oc_send_separate_response_buffer(&job->separate_response,
+                                   &job->response_buffer);
+  oc_resource_t *resource = job->request.resource;
+  if ((resource->properties & OC_OBSERVABLE) &&
+      (job->method == OC_PUT || job->method == OC_POST) &&
+      job->response_buffer.code < oc_status_code(OC_STATUS_BAD_REQUEST)) {
+    coap_notify_observers(resource, NULL, NULL);
+  }
+  free_job(job);
+}
+
+static void
+process_completed_jobs(void)
+{
+  pthread_mutex_lock(&completed_mutex);
+  oc_worker_job_t *job = (oc_worker_job_t *)oc_list_pop(completed_jobs);
+  pthread_mutex_unlock(&completed_mutex);
+  while (job != NULL) {
+    complete_job(job);
+    pthread_mutex_lock(&completed_mutex);
+    job = (oc_worker_job_t *)oc_list_pop(completed_jobs);
+    pthread_mutex_unlock(&completed_mutex);
+  }
+}
+
+OC_PROCESS_THREAD(oc_worker_events, ev, data)
+{
+  (void)ev;
+  (void)data;
+  OC_PROCESS_POLLHANDLER(process_completed_jobs());
+  OC_PROCESS_BEGIN();
+  while (oc_process_is_running(&(oc_worker_events))) {
+    OC_PROCESS_YIELD();
+  }
+  OC_PROCESS_END();
+}
+
+static void
+run_job(oc_worker_job_t *job)
+{
+  /* the encoder state is thread-local, see OC_REP_THREAD_LOCAL */
+  oc_rep_new(job->response_buffer.buffer, job->response_buffer.buffer_size);
+  job->handler(&job->request, job->iface_mask, job->user_data);
+}
+
+static void *
+worker_thread(void *data)
+{
+  oc_worker_t *worker = (oc_worker_t *)data;
+
+  pthread_mutex_lock(&worker->mutex);
+  while (!worker->terminate) {
+    oc_worker_job_t *job = (oc_worker_job_t *)oc_list_pop(worker->jobs);
+    if (!job) {
+      pthread_cond_wait(&worker->cond, &worker->mutex);
+      continue;
+    }
+    pthread_mutex_unlock(&worker->mutex);
+
+    run_job(job);
+
+    pthread_mutex_lock(&completed_mutex);
+    oc_list_add(completed_jobs, job);
+    pthread_mutex_unlock(&completed_mutex);
+    oc_process_poll(&(oc_worker_events));
+    _oc_signal_event_loop();
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->queued--;
+    pthread_cond_broadcast(&worker->cond);
+  }
+  pthread_mutex_unlock(&worker->mutex);
+
+  return NULL;
+}
+
+void
+oc_worker_init(void)
+{
+  if (num_workers > 0) {
+    return;
+  }
+  pthread_mutex_init(&completed_mutex, NULL);
+  oc_process_start(&oc_worker_events, NULL);
+
+  size_t i;
+  for (i = 0; i < OC_WORKER_THREADS; i++) {
+    oc_worker_t *worker = &workers[i];
+    memset(worker, 0, sizeof(oc_worker_t));
+    OC_LIST_STRUCT_INIT(worker, jobs);
+    pthread_mutex_init(&worker->mutex, NULL);
+    pthread_cond_init(&worker->cond, NULL);
+    if (pthread_create(&worker->thread, NULL, worker_thread, worker) != 0) {
+      OC_ERR("could not start worker thread %zd", i);
+      pthread_cond_destroy(&worker->cond);
+      pthread_mutex_destroy(&worker->mutex);
+      break;
+    }
+    num_workers++;
+  }
+  OC_DBG("started %zd worker threads", num_workers);
+}
+
+void
+oc_worker_shutdown(void)
+{
+  size_t i;
+  for (i = 0; i < num_workers; i++) {
+    oc_worker_t *worker = &workers[i];
+    pthread_mutex_lock(&worker->mutex);
+    worker->terminate = true;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+    pthread_join(worker->thread, NULL);
+
+    oc_worker_job_t *job = (oc_worker_job_t *)oc_list_pop(worker->jobs);
+    while (job != NULL) {
+      discard_job(job);
+      job = (oc_worker_job_t *)oc_list_pop(worker->jobs);
+    }
+    pthread_cond_destroy(&worker->cond);
+    pthread_mutex_destroy(&worker->mutex);
+  }
+
+  if (num_workers > 0) {
+    oc_worker_job_t *job = (oc_worker_job_t *)oc_list_pop(completed_jobs);
+    while (job != NULL) {
+      discard_job(job);
+      job = (oc_worker_job_t *)oc_list_pop(completed_jobs);
+    }
+    oc_process_exit(&oc_worker_events);
+    pthread_mutex_destroy(&completed_mutex);
+  }
+  num_workers = 0;
+}
+
+bool
+oc_worker_dispatch(oc_request_t *request, oc_method_t method,
+                   oc_interface_mask_t iface_mask)
+{
+  oc_resource_t *resource = request->resource;
+  oc_request_handler_t *handler = NULL;
+  switch (method) {
+  case OC_GET:
+    handler = &resource->get_handler;
+    break;
+  case OC_POST:
+    handler = &resource->post_handler;
+    break;
+  case OC_PUT:
+    handler = &resource->put_handler;
+    break;
+  case OC_DELETE:
+    handler = &resource->delete_handler;
+    break;
+  }
+  /* multicast requests stay on the event loop as their responses are
+   * spread out over time by the messaging layer */
+  if (num_workers == 0 || !handler || !handler->cb ||
+      (request->origin->flags & MULTICAST)) {
+    return false;
+  }
+
+  /* Running the request inline could overtake earlier requests of the same
+   * peer, so it is turned away when it cannot be queued. */
+  oc_worker_t *worker = &workers[worker_for_endpoint(request->origin)];
+  pthread_mutex_lock(&worker->mutex);
+  bool full = (worker->queued >= OC_WORKER_QUEUE_DEPTH);
+  pthread_mutex_unlock(&worker->mutex);
+  oc_worker_job_t *job = NULL;
+  if (!full) {
+    job = (oc_worker_job_t *)calloc(1, sizeof(oc_worker_job_t));
+  }
+  if (job) {
+    job->response_buffer.buffer = (uint8_t *)malloc(OC_MAX_APP_DATA_SIZE);
+    if (!job->response_buffer.buffer) {
+      free(job);
+      job = NULL;
+    }
+  }
+  if (!job) {
+    OC_DBG("worker queue full, rejecting request");
+    oc_send_response(request, OC_STATUS_SERVICE_UNAVAILABLE);
+    return true;
+  }
+  job->response_buffer.buffer_size = (uint16_t)OC_MAX_APP_DATA_SIZE;
+  job->response.response_buffer = &job->response_buffer;
+  job->handler = handler->cb;
+  job->user_data = handler->user_data;
+  job->iface_mask = iface_mask;
+  job->method = method;
+
+  /* the incoming message is released once this request returns, so the
+   * worker gets copies of everything that points into it */
+  memcpy(&job->origin, request->origin, sizeof(oc_endpoint_t));
+  job->origin.next = NULL;
+  if (request->query_len > 0) {
+    oc_new_string(&job->query, request->query, request->query_len);
+    job->request.query = oc_string(job->query);
+    job->request.query_len = request->query_len;
+  }
+  if (request->_payload_len > 0) {
+    oc_alloc_string(&job->payload, request->_payload_len);
+    memcpy(oc_cast(job->payload, uint8_t), request->_payload,
+           request->_payload_len);
+    job->request._payload = oc_cast(job->payload, uint8_t);
+    job->request._payload_len = request->_payload_len;
+  }
+  job->request.origin = &job->origin;
+  job->request.resource = resource;
+  job->request.content_format = request->content_format;
+  job->request.response = &job->response;
+  job->request.request_payload = request->request_payload;
+  request->request_payload = NULL;
+
+  /* The handle is registered with the messaging layer once this function
+   * returns, which happens before the response can be completed below. A
+   * response that is ready within the ACK window is piggy-backed. */
+  job->separate_response.defer_ack = 1;
+  oc_indicate_separate_response(request, &job->separate_response);
+  oc_ri_add_timed_event_callback_ticks(job, ack_window_expired,
+                                       OC_WORKER_ACK_WINDOW);
+
+  pthread_mutex_lock(&worker->mutex);
+  oc_list_add(worker->jobs, job);
+  worker->queued++;
+  pthread_cond_broadcast(&worker->cond);
+  pthread_mutex_unlock(&worker->mutex);
+  return true;
+}
+
+void
+oc_worker_drain(void)
+{
+  size_t i;
+  for (i = 0; i < num_workers; i++) {
+    oc_worker_t *worker = &workers[i];
+    pthread_mutex_lock(&worker->mutex);
+    while (worker->queued > 0) {
+      pthread_cond_wait(&worker->cond, &worker->mutex);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+  }
+  if (num_workers > 0) {
+    process_completed_jobs();
+  }
+}
+#else  /* OC_WORKER_THREADS && OC_SERVER */
+typedef int dummy_declaration;
+#endif /* !OC_WORKER_THREADS || !OC_SERVER */
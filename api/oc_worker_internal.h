@@ -0,0 +1,69 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef OC_WORKER_INTERNAL_H
+#define OC_WORKER_INTERNAL_H
+
+#include "oc_ri.h"
+#include "port/oc_clock.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef OC_WORKER_THREADS
+
+#ifndef OC_WORKER_QUEUE_DEPTH
+#define OC_WORKER_QUEUE_DEPTH (16)
+#endif /* !OC_WORKER_QUEUE_DEPTH */
+
+/* How long the ACK of a confirmable request is held back for its response to
+ * be piggy-backed. Stays below COAP_RESPONSE_TIMEOUT, after which the client
+ * retransmits. */
+#ifndef OC_WORKER_ACK_WINDOW
+#define OC_WORKER_ACK_WINDOW (OC_CLOCK_SECOND / 2)
+#endif /* !OC_WORKER_ACK_WINDOW */
+
+/* Start and stop the worker threads; called from oc_ri_init() and
+ * oc_ri_shutdown(). */
+void oc_worker_init(void);
+void oc_worker_shutdown(void);
+
+/* Hand a request to a concurrent resource over to the worker serving its
+ * origin. On success the request is answered through a separate response and
+ * the worker owns the parsed request payload. A request that cannot be queued
+ * is answered with 5.03. Returns false if the request must be handled
+ * inline. */
+bool oc_worker_dispatch(oc_request_t *request, oc_method_t method,
+                        oc_interface_mask_t iface_mask);
+
+/* Wait until no worker runs or holds a request, and send all their responses.
+ * Called before a concurrent resource is deleted. */
+void oc_worker_drain(void);
+
+/* Send a response produced outside of the event loop to the requests waiting
+ * on a separate response handle; implemented in oc_server_api.c. */
+void oc_send_separate_response_buffer(oc_separate_response_t *handle,
+                                      const oc_response_buffer_t *response);
+
+#endif /* OC_WORKER_THREADS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_WORKER_INTERNAL_H */
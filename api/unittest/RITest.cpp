@@ -18,6 +18,7 @@
  *
  ******************************************************************/
 
+#include <cctype>
 #include <cstdlib>
 #include <string>
 #include <stdio.h>
@@ -25,8 +26,10 @@
 
 #include "port/linux/oc_config.h"
 #include "oc_api.h"
+#include "oc_core_res.h"
 #include "oc_ri.h"
 #include "oc_helpers.h"
+#include "port/oc_connectivity.h"
 
 
 #define RESOURCE_URI "/LightResourceURI"
@@ -141,3 +144,95 @@ TEST_F(TestOcRi, RiAddResource_P)
     EXPECT_EQ(res_check, 1);
     oc_ri_delete_resource(res);
 }
+
+class TestRequestDevice: public testing::Test
+{
+    protected:
+        virtual void SetUp()
+        {
+            oc_ri_init();
+            oc_core_init();
+            for (size_t d = 0; d < 2; d++) {
+                oc_core_add_new_device("/oic/d", "oic.d.light", "Lamp",
+                                       "ocf.1.0.0", "ocf.res.1.0.0", NULL,
+                                       NULL);
+                oc_uuid_to_str(oc_core_get_device_id(d), di[d], OC_UUID_LEN);
+            }
+            res = oc_new_resource(RESOURCE_NAME, RESOURCE_URI, 1, 1);
+            oc_resource_set_request_handler(res, OC_GET, onGet, NULL);
+            oc_ri_add_resource(res);
+        }
+        virtual void TearDown()
+        {
+            oc_ri_delete_resource(res);
+            oc_connectivity_shutdown(1);
+            oc_connectivity_shutdown(0);
+            oc_core_shutdown();
+            oc_ri_shutdown();
+        }
+
+        size_t route(const char *uri, std::string query)
+        {
+            return oc_ri_get_request_device(0, uri, strlen(uri),
+                                            query.c_str(), query.length());
+        }
+
+        char di[2][OC_UUID_LEN];
+        oc_resource_t *res;
+};
+
+TEST_F(TestRequestDevice, DiQuery)
+{
+    EXPECT_EQ(1u, route("oic/d", std::string("di=") + di[1]));
+    EXPECT_EQ(0u, route("LightResourceURI", std::string("di=") + di[0]));
+    EXPECT_EQ(1u, route("oic/res", std::string("rt=oic.r.light&di=") + di[1]));
+}
+
+TEST_F(TestRequestDevice, AnchorQuery)
+{
+    EXPECT_EQ(1u, route("oic/d", std::string("anchor=ocf://") + di[1]));
+    /* only ocf:// anchors name a device */
+    EXPECT_EQ(0u, route("oic/d", std::string("anchor=coap://") + di[1]));
+}
+
+TEST_F(TestRequestDevice, AppResourceUri)
+{
+    EXPECT_EQ(1u, route("LightResourceURI", ""));
+    EXPECT_EQ(1u, route(RESOURCE_URI, ""));
+    /* an unknown device falls back to the resource */
+    EXPECT_EQ(1u, route("LightResourceURI",
+                        "di=00000000-0000-0000-0000-000000000000"));
+}
+
+TEST_F(TestRequestDevice, SharedUri)
+{
+    oc_resource_t *shared = oc_new_resource(RESOURCE_NAME, RESOURCE_URI, 1, 0);
+    oc_resource_set_request_handler(shared, OC_GET, onGet, NULL);
+    oc_ri_add_resource(shared);
+    /* the receiving device wins, else the lowest numbered device */
+    EXPECT_EQ(0u, route(RESOURCE_URI, ""));
+    EXPECT_EQ(1u, oc_ri_get_request_device(1, RESOURCE_URI,
+                                           strlen(RESOURCE_URI), NULL, 0));
+    EXPECT_EQ(0u, oc_ri_get_request_device(2, RESOURCE_URI,
+                                           strlen(RESOURCE_URI), NULL, 0));
+    oc_ri_delete_resource(shared);
+}
+
+TEST_F(TestRequestDevice, DiIgnoresCase)
+{
+    std::string upper(di[1]);
+    for (size_t i = 0; i < upper.length(); i++) {
+        upper[i] = (char)toupper((unsigned char)upper[i]);
+    }
+    EXPECT_EQ(1u, route("oic/d", "di=" + upper));
+}
+
+TEST_F(TestRequestDevice, Fallback)
+{
+    /* core resources stay with the receiving device */
+    EXPECT_EQ(0u, route("oic/d", ""));
+    EXPECT_EQ(0u, route("oic/p", "if=oic.if.baseline"));
+    EXPECT_EQ(0u, route("unknown", ""));
+    EXPECT_EQ(0u, oc_ri_get_request_device(0, NULL, 0, NULL, 0));
+    EXPECT_EQ(1u, oc_ri_get_request_device(1, "unknown", 7, NULL, 0));
+}
@@ -0,0 +1,484 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <map>
+
+#include "messaging/coap/coap.h"
+#include "messaging/coap/engine.h"
+#include "messaging/coap/transactions.h"
+#include "oc_api.h"
+#include "oc_blockwise.h"
+#include "oc_buffer.h"
+#include "oc_client_state.h"
+#include "oc_ri.h"
+
+#ifdef OC_BLOCK_WISE
+
+#define BLOCK_SIZE (16)
+#define NUM_BLOCKS (4)
+#define PAYLOAD_SIZE (BLOCK_SIZE * NUM_BLOCKS - 5)
+
+class TestBlockwise : public testing::Test {
+protected:
+  virtual void SetUp()
+  {
+    oc_ri_init();
+    oc_blockwise_reset_stats();
+    memset(&endpoint, 0, sizeof(oc_endpoint_t));
+    for (int i = 0; i < PAYLOAD_SIZE; i++) {
+      payload[i] = (uint8_t)i;
+    }
+    buffer = oc_blockwise_alloc_response_buffer(
+      "a/light", strlen("a/light"), &endpoint, OC_GET, OC_BLOCKWISE_CLIENT);
+    ASSERT_NE(nullptr, buffer);
+  }
+  virtual void TearDown()
+  {
+    oc_blockwise_scrub_buffers(true);
+    oc_ri_shutdown();
+  }
+
+  bool handle(int num)
+  {
+    uint32_t offset = num * BLOCK_SIZE;
+    uint32_t size = MIN(BLOCK_SIZE, PAYLOAD_SIZE - offset);
+    bool ret =
+      oc_blockwise_handle_block(buffer, offset, &payload[offset], size);
+    if (num == NUM_BLOCKS - 1) {
+      oc_blockwise_handle_last_block(buffer);
+    }
+    return ret;
+  }
+
+  oc_endpoint_t endpoint;
+  oc_blockwise_state_t *buffer;
+  uint8_t payload[PAYLOAD_SIZE];
+};
+
+TEST_F(TestBlockwise, InOrder)
+{
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    EXPECT_FALSE(oc_blockwise_transfer_complete(buffer));
+    EXPECT_TRUE(handle(i));
+  }
+  EXPECT_TRUE(oc_blockwise_transfer_complete(buffer));
+  oc_blockwise_finish_transfer(buffer);
+  EXPECT_EQ(PAYLOAD_SIZE, buffer->payload_size);
+  EXPECT_EQ(0, memcmp(payload, buffer->buffer, PAYLOAD_SIZE));
+}
+
+TEST_F(TestBlockwise, OutOfOrder)
+{
+  EXPECT_TRUE(handle(0));
+  EXPECT_TRUE(handle(3));
+  EXPECT_FALSE(oc_blockwise_transfer_complete(buffer));
+  EXPECT_TRUE(handle(2));
+  EXPECT_TRUE(handle(2));
+  EXPECT_EQ(BLOCK_SIZE, buffer->next_block_offset);
+  EXPECT_FALSE(oc_blockwise_transfer_complete(buffer));
+  EXPECT_TRUE(handle(1));
+  EXPECT_TRUE(handle(1));
+  EXPECT_TRUE(oc_blockwise_transfer_complete(buffer));
+  oc_blockwise_finish_transfer(buffer);
+  EXPECT_EQ(PAYLOAD_SIZE, buffer->payload_size);
+  EXPECT_EQ(0, memcmp(payload, buffer->buffer, PAYLOAD_SIZE));
+
+  oc_blockwise_stats_t stats;
+  oc_blockwise_get_stats(&stats);
+  EXPECT_EQ(6u, stats.blocks_received);
+  EXPECT_EQ(2u, stats.blocks_out_of_order);
+  EXPECT_EQ(2u, stats.blocks_duplicate);
+  EXPECT_EQ(1u, stats.transfers_completed);
+  EXPECT_EQ((uint64_t)PAYLOAD_SIZE, stats.bytes_completed);
+}
+
+TEST_F(TestBlockwise, RejectMisalignedBlock)
+{
+  EXPECT_TRUE(handle(0));
+  EXPECT_FALSE(oc_blockwise_handle_block(buffer, BLOCK_SIZE + 1,
+                                         &payload[BLOCK_SIZE + 1], BLOCK_SIZE));
+  EXPECT_EQ(BLOCK_SIZE, buffer->next_block_offset);
+}
+
+#define STREAM_SIZE (BLOCK_SIZE * 3 + 8)
+
+class TestStream : public testing::Test {
+protected:
+  virtual void SetUp()
+  {
+    oc_ri_init();
+    resource = oc_new_resource(NULL, "/stream", 1, 0);
+    oc_resource_set_stream_handler(resource, produce, APPLICATION_JSON, this);
+    produced = 0;
+    fail_at = STREAM_SIZE;
+  }
+  virtual void TearDown()
+  {
+    oc_ri_delete_resource(resource);
+    oc_ri_shutdown();
+  }
+
+  static int produce(oc_resource_t *resource, size_t offset, uint8_t *buffer,
+                     size_t buffer_size, bool *last, void *user_data)
+  {
+    (void)resource;
+    TestStream *test = (TestStream *)user_data;
+    test->offsets[test->produced++] = offset;
+    if (offset >= test->fail_at) {
+      return -1;
+    }
+    size_t len = MIN(buffer_size, STREAM_SIZE - offset);
+    for (size_t i = 0; i < len; i++) {
+      buffer[i] = (uint8_t)(offset + i);
+    }
+    *last = (offset + len == STREAM_SIZE);
+    return (int)len;
+  }
+
+  /* GET block num, as a client following Block2 would request it */
+  bool get(uint32_t num, coap_packet_t *response)
+  {
+    coap_packet_t request[1];
+    coap_udp_init_message(request, COAP_TYPE_CON, COAP_GET, 0x100 + num);
+    coap_set_header_uri_path(request, "/stream", strlen("/stream"));
+    coap_set_header_block2(request, num, 0, BLOCK_SIZE);
+    coap_udp_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0x100 + num);
+    return oc_ri_produce_stream_block(request, response, resource, BLOCK_SIZE,
+                                      buffer);
+  }
+
+  oc_resource_t *resource;
+  uint8_t buffer[BLOCK_SIZE];
+  size_t offsets[8];
+  int produced;
+  size_t fail_at;
+};
+
+TEST_F(TestStream, ProducesEachBlockAtItsOffset)
+{
+  uint32_t num = 0;
+  uint8_t more = 1;
+  while (more) {
+    coap_packet_t response[1];
+    ASSERT_TRUE(get(num, response));
+    uint32_t block_num = 0;
+    uint16_t block_size = 0;
+    ASSERT_EQ(1, coap_get_header_block2(response, &block_num, &more,
+                                        &block_size, NULL));
+    EXPECT_EQ(num, block_num);
+    EXPECT_EQ(BLOCK_SIZE, block_size);
+
+    const uint8_t *payload = NULL;
+    int len = coap_get_payload(response, &payload);
+    EXPECT_EQ(more ? BLOCK_SIZE : STREAM_SIZE - 3 * BLOCK_SIZE, len);
+    for (int i = 0; i < len; i++) {
+      EXPECT_EQ((uint8_t)(num * BLOCK_SIZE + i), payload[i]);
+    }
+    oc_content_format_t cf = TEXT_PLAIN;
+    coap_get_header_content_format(response, &cf);
+    EXPECT_EQ(APPLICATION_JSON, cf);
+    num++;
+  }
+  EXPECT_EQ(4u, num);
+  ASSERT_EQ(4, produced);
+  for (int i = 0; i < produced; i++) {
+    EXPECT_EQ((size_t)(i * BLOCK_SIZE), offsets[i]);
+  }
+}
+
+TEST_F(TestStream, SingleBlockHasNoBlock2Option)
+{
+  fail_at = STREAM_SIZE;
+  coap_packet_t response[1];
+  coap_packet_t request[1];
+  coap_udp_init_message(request, COAP_TYPE_CON, COAP_GET, 0x200);
+  coap_udp_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0x200);
+  /* a whole representation fits in a block of STREAM_SIZE or more */
+  uint8_t large[STREAM_SIZE + BLOCK_SIZE];
+  ASSERT_TRUE(oc_ri_produce_stream_block(request, response, resource,
+                                         sizeof(large), large));
+  uint32_t block_num = 0;
+  EXPECT_EQ(0, coap_get_header_block2(response, &block_num, NULL, NULL, NULL));
+  const uint8_t *payload = NULL;
+  EXPECT_EQ(STREAM_SIZE, coap_get_payload(response, &payload));
+}
+
+TEST_F(TestStream, EtagOfTheRepresentation)
+{
+  coap_packet_t response[1];
+  const uint8_t *etag = NULL;
+  ASSERT_TRUE(get(0, response));
+  ASSERT_EQ(4, coap_get_header_etag(response, &etag));
+  uint8_t first[4];
+  memcpy(first, etag, sizeof(first));
+
+  /* the same ETag on every block of a representation */
+  ASSERT_TRUE(get(1, response));
+  ASSERT_EQ(4, coap_get_header_etag(response, &etag));
+  EXPECT_EQ(0, memcmp(first, etag, sizeof(first)));
+
+  /* and another one once it changed */
+  oc_resource_stream_changed(resource);
+  ASSERT_TRUE(get(2, response));
+  ASSERT_EQ(4, coap_get_header_etag(response, &etag));
+  EXPECT_NE(0, memcmp(first, etag, sizeof(first)));
+}
+
+#ifdef OC_CLIENT
+static oc_status_t stream_code;
+static size_t stream_chunks;
+
+static void
+onStreamChunk(oc_client_response_t *response)
+{
+  stream_code = response->code;
+  stream_chunks++;
+}
+
+TEST_F(TestStream, ChangedRepresentationEndsTransfer)
+{
+  oc_endpoint_t ep;
+  memset(&ep, 0, sizeof(ep));
+  oc_client_handler_t handler;
+  handler.response = onStreamChunk;
+  oc_client_cb_t *cb = oc_ri_alloc_client_cb("/stream", &ep, OC_GET, NULL,
+                                             handler, HIGH_QOS, NULL);
+  ASSERT_NE(nullptr, cb);
+  cb->stream = true;
+  stream_chunks = 0;
+
+  coap_packet_t response[1];
+  ASSERT_TRUE(get(0, response));
+  oc_ri_invoke_client_stream_cb(response, cb, &ep, 0, true);
+  EXPECT_EQ(OC_STATUS_OK, stream_code);
+  ASSERT_TRUE(oc_ri_is_client_cb_valid(cb));
+
+  /* the next block comes from another representation */
+  oc_resource_stream_changed(resource);
+  ASSERT_TRUE(get(1, response));
+  oc_ri_invoke_client_stream_cb(response, cb, &ep, BLOCK_SIZE, true);
+  EXPECT_EQ(2u, stream_chunks);
+  EXPECT_EQ(OC_STATUS_SERVICE_UNAVAILABLE, stream_code);
+  EXPECT_FALSE(oc_ri_is_client_cb_valid(cb));
+}
+#endif /* OC_CLIENT */
+
+TEST_F(TestStream, ProducerFailure)
+{
+  fail_at = BLOCK_SIZE;
+  coap_packet_t response[1];
+  EXPECT_TRUE(get(0, response));
+  EXPECT_FALSE(get(1, response));
+  ASSERT_EQ(2, produced);
+  EXPECT_EQ((size_t)BLOCK_SIZE, offsets[1]);
+}
+
+#ifdef OC_CLIENT
+/* nothing listens on the discard port, the test answers the requests */
+#define SERVER_ENDPOINT "coap://[::1]:9"
+#define BYTES_SIZE (BLOCK_SIZE * 3 + 6)
+/* a CBOR map with a byte string "d" of BYTES_SIZE bytes */
+#define CBOR_SIZE (5 + BYTES_SIZE)
+
+class TestBlockwiseClient : public testing::Test {
+public:
+  static oc_handler_t s_handler;
+  static int responses;
+  static oc_status_t code;
+  static bool intact;
+
+  static int appInit(void)
+  {
+    int result = oc_init_platform("Cascoda", NULL, NULL);
+    result |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                            "ocf.res.1.0.0", NULL, NULL);
+    return result;
+  }
+
+  static void signalEventLoop(void) {}
+
+  static void onGet(oc_client_response_t *response)
+  {
+    responses++;
+    code = response->code;
+    char *bytes = NULL;
+    size_t size = 0;
+    intact = oc_rep_get_byte_string(response->payload, "d", &bytes, &size) &&
+             size == BYTES_SIZE;
+    for (size_t i = 0; intact && i < size; i++) {
+      intact = ((uint8_t)bytes[i] == (uint8_t)i);
+    }
+  }
+
+protected:
+  static void SetUpTestCase()
+  {
+    s_handler.init = &appInit;
+    s_handler.signal_event_loop = &signalEventLoop;
+    ASSERT_EQ(0, oc_main_init(&s_handler));
+  }
+
+  static void TearDownTestCase() { oc_main_shutdown(); }
+
+  virtual void SetUp()
+  {
+    responses = 0;
+    code = OC_STATUS_INTERNAL_SERVER_ERROR;
+    intact = false;
+    oc_blockwise_reset_stats();
+    memset(&ep, 0, sizeof(ep));
+    oc_string_t ep_str;
+    oc_new_string(&ep_str, SERVER_ENDPOINT, strlen(SERVER_ENDPOINT));
+    ASSERT_EQ(0, oc_string_to_endpoint(&ep_str, &ep, NULL));
+    oc_free_string(&ep_str);
+    cbor[0] = 0xa1;
+    cbor[1] = 0x61;
+    cbor[2] = 'd';
+    cbor[3] = 0x58;
+    cbor[4] = BYTES_SIZE;
+    for (int i = 0; i < BYTES_SIZE; i++) {
+      cbor[5 + i] = (uint8_t)i;
+    }
+    first_mid = coap_get_mid();
+    ASSERT_TRUE(oc_do_get("/big", &ep, NULL, onGet, HIGH_QOS, NULL));
+    cb = oc_ri_get_client_cb("/big", &ep, OC_GET);
+    ASSERT_NE(nullptr, cb);
+  }
+
+  virtual void TearDown()
+  {
+    coap_free_transactions_by_endpoint(&ep);
+    oc_blockwise_scrub_buffers(true);
+  }
+
+  /* Receive block num of the representation in reply to the request mid. */
+  void answer(uint32_t num, uint16_t mid)
+  {
+    uint32_t offset = num * BLOCK_SIZE;
+    uint32_t size = MIN(BLOCK_SIZE, CBOR_SIZE - offset);
+    coap_packet_t response[1];
+    coap_udp_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, mid);
+    coap_set_token(response, cb->token, cb->token_len);
+    coap_set_header_content_format(response, APPLICATION_VND_OCF_CBOR);
+    coap_set_header_block2(response, num, offset + size < CBOR_SIZE,
+                           BLOCK_SIZE);
+    if (num == 0) {
+      coap_set_header_size2(response, CBOR_SIZE);
+    }
+    coap_set_payload(response, &cbor[offset], size);
+    oc_message_t *message = oc_allocate_message();
+    ASSERT_NE(nullptr, message);
+    memcpy(&message->endpoint, &ep, sizeof(ep));
+    message->length = coap_serialize_message(response, message->data);
+    coap_receive(message);
+    oc_message_unref(message);
+  }
+
+  /* Blocks requested and not answered yet, by block number. */
+  std::map<uint32_t, uint16_t> pending(void)
+  {
+    std::map<uint32_t, uint16_t> blocks;
+    uint16_t last_mid = coap_get_mid();
+    for (uint16_t mid = first_mid; mid != last_mid; mid++) {
+      coap_transaction_t *t = coap_get_transaction_by_mid(mid);
+      if (!t) {
+        continue;
+      }
+      coap_packet_t request[1];
+      if (coap_udp_parse_message(request, t->message->data,
+                                 t->message->length) != COAP_NO_ERROR) {
+        continue;
+      }
+      uint32_t num = 0;
+      if (coap_get_header_block2(request, &num, NULL, NULL, NULL) == 1) {
+        blocks[num] = mid;
+      }
+    }
+    return blocks;
+  }
+
+  oc_endpoint_t ep;
+  oc_client_cb_t *cb;
+  uint16_t first_mid;
+  uint8_t cbor[CBOR_SIZE];
+};
+
+oc_handler_t TestBlockwiseClient::s_handler;
+int TestBlockwiseClient::responses;
+oc_status_t TestBlockwiseClient::code;
+bool TestBlockwiseClient::intact;
+
+TEST_F(TestBlockwiseClient, ReorderedBlocks)
+{
+  answer(0, cb->mid);
+  while (responses == 0) {
+    std::map<uint32_t, uint16_t> blocks = pending();
+    ASSERT_FALSE(blocks.empty());
+    EXPECT_GE((size_t)OC_BLOCK_WISE_WINDOW, blocks.size());
+    /* the blocks in flight arrive last first */
+    std::map<uint32_t, uint16_t>::reverse_iterator it = blocks.rbegin();
+    for (; it != blocks.rend(); ++it) {
+      answer(it->first, it->second);
+    }
+  }
+  EXPECT_EQ(1, responses);
+  EXPECT_EQ(OC_STATUS_OK, code);
+  EXPECT_TRUE(intact);
+#if OC_BLOCK_WISE_WINDOW > 1
+  oc_blockwise_stats_t stats;
+  oc_blockwise_get_stats(&stats);
+  EXPECT_LT(0u, stats.blocks_out_of_order);
+#endif /* OC_BLOCK_WISE_WINDOW > 1 */
+}
+
+TEST_F(TestBlockwiseClient, LostBlock)
+{
+  answer(0, cb->mid);
+  std::map<uint32_t, uint16_t> blocks = pending();
+  ASSERT_FALSE(blocks.empty());
+  /* the reply to the first block in flight is lost */
+  std::pair<uint32_t, uint16_t> lost = *blocks.begin();
+  std::map<uint32_t, uint16_t>::iterator it = std::next(blocks.begin());
+  for (; it != blocks.end(); ++it) {
+    answer(it->first, it->second);
+  }
+  EXPECT_EQ(0, responses);
+  /* its request waits to be sent again, the others are not repeated */
+  EXPECT_NE(nullptr, coap_get_transaction_by_mid(lost.second));
+  blocks = pending();
+  EXPECT_EQ(1u, blocks.size());
+  EXPECT_EQ(1u, blocks.count(lost.first));
+
+  /* the retransmission is answered and the transfer completes */
+  answer(lost.first, lost.second);
+  while (responses == 0) {
+    blocks = pending();
+    ASSERT_FALSE(blocks.empty());
+    for (it = blocks.begin(); it != blocks.end(); ++it) {
+      answer(it->first, it->second);
+    }
+  }
+  EXPECT_EQ(1, responses);
+  EXPECT_EQ(OC_STATUS_OK, code);
+  EXPECT_TRUE(intact);
+}
+#endif /* OC_CLIENT */
+
+#endif /* OC_BLOCK_WISE */
@@ -0,0 +1,165 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+
+#include "messaging/coap/coap.h"
+#include "oc_buffer.h"
+
+#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
+
+class TestMessageBuffer : public testing::Test {
+protected:
+  virtual void SetUp() { oc_message_buffer_reset_stats(); }
+
+  static uint32_t in_use(oc_message_buffer_class_t buffer_class)
+  {
+    oc_message_buffer_stats_t stats;
+    EXPECT_TRUE(oc_message_buffer_get_stats(buffer_class, &stats));
+    return stats.in_use;
+  }
+};
+
+TEST_F(TestMessageBuffer, SizedAllocation)
+{
+  oc_message_t *message = oc_internal_allocate_outgoing_message_sized(16);
+  ASSERT_NE(nullptr, message);
+  EXPECT_EQ(1u, in_use(OC_MESSAGE_BUFFER_SMALL));
+  EXPECT_EQ(0u, in_use(OC_MESSAGE_BUFFER_LARGE));
+  oc_message_unref(message);
+  EXPECT_EQ(0u, in_use(OC_MESSAGE_BUFFER_SMALL));
+
+  /* the released buffer is recycled by the next allocation */
+  message = oc_internal_allocate_outgoing_message_sized(16);
+  ASSERT_NE(nullptr, message);
+  oc_message_buffer_stats_t stats;
+  EXPECT_TRUE(oc_message_buffer_get_stats(OC_MESSAGE_BUFFER_SMALL, &stats));
+  EXPECT_EQ(2u, stats.allocations);
+  EXPECT_EQ(1u, stats.recycled);
+  EXPECT_EQ(1u, stats.peak_in_use);
+  EXPECT_EQ(stats.buffer_size, stats.peak_bytes);
+  oc_message_unref(message);
+}
+
+TEST_F(TestMessageBuffer, IncomingSizedAllocation)
+{
+  oc_message_t *message = oc_allocate_message_sized(600);
+  ASSERT_NE(nullptr, message);
+  EXPECT_EQ(1u, in_use(OC_MESSAGE_BUFFER_MEDIUM));
+  EXPECT_EQ(0u, in_use(OC_MESSAGE_BUFFER_LARGE));
+  oc_message_unref(message);
+  EXPECT_EQ(0u, in_use(OC_MESSAGE_BUFFER_MEDIUM));
+}
+
+TEST_F(TestMessageBuffer, Shrink)
+{
+  oc_message_t *message = oc_allocate_message();
+  ASSERT_NE(nullptr, message);
+  EXPECT_EQ(1u, in_use(OC_MESSAGE_BUFFER_LARGE));
+  for (size_t i = 0; i < 32; i++) {
+    message->data[i] = (uint8_t)i;
+  }
+  message->length = 32;
+  oc_message_shrink_buffer(message);
+  EXPECT_EQ(0u, in_use(OC_MESSAGE_BUFFER_LARGE));
+  EXPECT_EQ(1u, in_use(OC_MESSAGE_BUFFER_SMALL));
+  for (size_t i = 0; i < 32; i++) {
+    EXPECT_EQ((uint8_t)i, message->data[i]);
+  }
+  oc_message_unref(message);
+  EXPECT_EQ(0u, in_use(OC_MESSAGE_BUFFER_SMALL));
+}
+
+TEST_F(TestMessageBuffer, Headroom)
+{
+  oc_message_t *message = oc_internal_allocate_outgoing_message();
+  ASSERT_NE(nullptr, message);
+  size_t size = oc_message_tailroom(message);
+  EXPECT_EQ(0u, oc_message_headroom(message));
+  EXPECT_LT(100u, size);
+
+  uint8_t *data = message->data;
+  EXPECT_TRUE(oc_message_reserve(message, 100));
+  EXPECT_EQ(data + 100, message->data);
+  EXPECT_EQ(100u, oc_message_headroom(message));
+  EXPECT_EQ(size - 100, oc_message_tailroom(message));
+  EXPECT_FALSE(oc_message_reserve(message, size));
+
+  /* only an empty message can be moved */
+  message->length = 10;
+  EXPECT_EQ(size - 110, oc_message_tailroom(message));
+  EXPECT_FALSE(oc_message_reserve(message, 1));
+  oc_message_unref(message);
+  EXPECT_EQ(0u, in_use(OC_MESSAGE_BUFFER_LARGE));
+}
+
+TEST_F(TestMessageBuffer, SerializeInPlace)
+{
+  oc_message_t *message = oc_internal_allocate_outgoing_message();
+  ASSERT_NE(nullptr, message);
+  uint8_t *payload = message->data + COAP_MAX_HEADER_SIZE;
+  for (size_t i = 0; i < 64; i++) {
+    payload[i] = (uint8_t)i;
+  }
+  coap_packet_t packet[1];
+  coap_udp_init_message(packet, COAP_TYPE_NON, CONTENT_2_05, 0x1234);
+  const uint8_t token[] = { 1, 2, 3, 4 };
+  coap_set_token(packet, token, sizeof(token));
+  coap_set_header_content_format(packet, APPLICATION_VND_OCF_CBOR);
+  coap_set_payload(packet, payload, 64);
+
+  oc_message_reset_copy_stats();
+  size_t length = coap_serialize_message_into(packet, message);
+  ASSERT_LT(64u, length);
+  EXPECT_EQ(length, message->length);
+  /* the header was written in front of the payload, which did not move */
+  EXPECT_EQ(payload + 64, message->data + length);
+  EXPECT_LT(0u, oc_message_headroom(message));
+  oc_message_copy_stats_t stats;
+  oc_message_get_copy_stats(&stats);
+  EXPECT_EQ(0u, stats.copies);
+
+  uint8_t expected[COAP_MAX_HEADER_SIZE + 64];
+  ASSERT_EQ(length, coap_serialize_message(packet, expected));
+  EXPECT_EQ(0, memcmp(expected, message->data, length));
+  oc_message_unref(message);
+}
+
+#endif /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
+
+TEST(TestMessageCopies, CountedPerMessage)
+{
+  oc_message_reset_copy_stats();
+  oc_message_t *message = oc_internal_allocate_outgoing_message();
+  ASSERT_NE(nullptr, message);
+  oc_message_t *copied = oc_internal_allocate_outgoing_message();
+  ASSERT_NE(nullptr, copied);
+  oc_message_count_copy(copied, 10);
+  oc_message_count_copy(copied, 20);
+  oc_message_count_copy(nullptr, 5);
+  EXPECT_EQ(2, copied->copies);
+  oc_message_unref(message);
+  oc_message_unref(copied);
+
+  oc_message_copy_stats_t stats;
+  oc_message_get_copy_stats(&stats);
+  EXPECT_EQ(2u, stats.messages);
+  EXPECT_EQ(1u, stats.copied_messages);
+  EXPECT_EQ(3u, stats.copies);
+  EXPECT_EQ(35u, stats.bytes);
+}
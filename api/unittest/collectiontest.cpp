@@ -0,0 +1,261 @@
+/******************************************************************
+ *
+ * Copyright 2020 Cascoda Ltd All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include <cstring>
+#include <gtest/gtest.h>
+
+#include "messaging/coap/observe.h"
+#include "oc_api.h"
+#include "oc_collection.h"
+#include "port/oc_clock.h"
+#ifdef OC_SECURITY
+#include "security/oc_pstat.h"
+#endif /* OC_SECURITY */
+
+#if defined(OC_SERVER) && defined(OC_COLLECTIONS)
+
+/* nothing listens on the discard port, so notifications go nowhere */
+#define OBSERVER_ENDPOINT "coap://[::1]:9"
+#define COLLECTION_URI "/batch"
+
+class TestCollectionBatch : public testing::Test {
+public:
+  static oc_handler_t s_handler;
+  static pthread_mutex_t mutex;
+  static pthread_cond_t cv;
+  static int gets;
+
+  static int appInit(void)
+  {
+    int result = oc_init_platform("Cascoda", NULL, NULL);
+    result |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                            "ocf.res.1.0.0", NULL, NULL);
+    return result;
+  }
+
+  static void signalEventLoop(void)
+  {
+    pthread_mutex_lock(&mutex);
+    pthread_cond_signal(&cv);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  static void onGet(oc_request_t *request, oc_interface_mask_t iface_mask,
+                    void *user_data)
+  {
+    (void)iface_mask;
+    (void)user_data;
+    gets++;
+    oc_rep_start_root_object();
+    oc_rep_set_int(root, gets, gets);
+    oc_rep_end_root_object();
+    oc_send_response(request, OC_STATUS_OK);
+  }
+
+  static oc_event_callback_retval_t quitEvent(void *data)
+  {
+    *(bool *)data = true;
+    return OC_EVENT_DONE;
+  }
+
+  /* Run the event loop for ms milliseconds. */
+  static void pollEvents(oc_clock_time_t ms)
+  {
+    bool quit = false;
+    oc_ri_add_timed_event_callback_ticks(&quit, quitEvent,
+                                         ms * OC_CLOCK_SECOND / 1000);
+    while (true) {
+      pthread_mutex_lock(&mutex);
+      oc_clock_time_t next_event = oc_main_poll();
+      if (quit) {
+        pthread_mutex_unlock(&mutex);
+        break;
+      }
+      if (next_event == 0) {
+        pthread_cond_wait(&cv, &mutex);
+      } else {
+        struct timespec ts;
+        ts.tv_sec = (next_event / OC_CLOCK_SECOND);
+        ts.tv_nsec = (next_event % OC_CLOCK_SECOND) * 1.e09 / OC_CLOCK_SECOND;
+        pthread_cond_timedwait(&cv, &mutex, &ts);
+      }
+      pthread_mutex_unlock(&mutex);
+    }
+  }
+
+protected:
+  static void SetUpTestCase()
+  {
+    s_handler.init = &appInit;
+    s_handler.signal_event_loop = &signalEventLoop;
+    ASSERT_EQ(0, oc_main_init(&s_handler));
+#ifdef OC_SECURITY
+    /* notifications are only sent in RFNOP */
+    oc_sec_get_pstat(0)->s = OC_DOS_RFNOP;
+#endif /* OC_SECURITY */
+  }
+
+  static void TearDownTestCase() { oc_main_shutdown(); }
+
+  virtual void SetUp()
+  {
+    gets = 0;
+    memset(&ep, 0, sizeof(ep));
+    oc_string_t ep_str;
+    oc_new_string(&ep_str, OBSERVER_ENDPOINT, strlen(OBSERVER_ENDPOINT));
+    ASSERT_EQ(0, oc_string_to_endpoint(&ep_str, &ep, NULL));
+    oc_free_string(&ep_str);
+    collection = oc_new_collection(NULL, COLLECTION_URI, 1, 0);
+    ASSERT_NE(nullptr, collection);
+    oc_resource_bind_resource_type(collection, "oic.wk.col");
+    for (size_t i = 0; i < sizeof(res) / sizeof(res[0]); i++) {
+      char uri[16];
+      snprintf(uri, sizeof(uri), "/batch/%d", (int)i);
+      res[i] = oc_new_resource(NULL, uri, 1, 0);
+      oc_resource_bind_resource_type(res[i], "oic.r.test");
+      oc_resource_bind_resource_interface(res[i], OC_IF_BASELINE);
+      oc_resource_set_default_interface(res[i], OC_IF_BASELINE);
+      oc_resource_set_observable(res[i], true);
+      oc_resource_set_request_handler(res[i], OC_GET, onGet, NULL);
+      ASSERT_TRUE(oc_add_resource(res[i]));
+      oc_collection_add_link(collection, oc_new_link(res[i]));
+    }
+    oc_add_collection(collection);
+  }
+
+  virtual void TearDown()
+  {
+    coap_remove_observer_by_client(&ep);
+    oc_delete_collection(collection);
+    for (size_t i = 0; i < sizeof(res) / sizeof(res[0]); i++) {
+      oc_delete_resource(res[i]);
+    }
+  }
+
+  /* Register ep as an oic.if.b observer of the collection. */
+  coap_observer_t *observeBatch(void)
+  {
+    uint8_t token = 1;
+    coap_packet_t request[1], response[1];
+    coap_udp_init_message(request, COAP_TYPE_CON, COAP_GET, 1);
+    coap_set_token(request, &token, 1);
+    coap_set_header_observe(request, 0);
+    coap_set_header_uri_path(request, COLLECTION_URI, strlen(COLLECTION_URI));
+    coap_udp_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 1);
+    if (coap_observe_handler(request, response, collection, 1024, &ep,
+                             OC_IF_B) < 0) {
+      return nullptr;
+    }
+    coap_observer_t *obs = (coap_observer_t *)oc_list_head(coap_get_observers());
+    for (; obs; obs = obs->next) {
+      if (obs->resource == collection && obs->iface_mask == OC_IF_B) {
+        return obs;
+      }
+    }
+    return nullptr;
+  }
+
+  oc_endpoint_t ep;
+  oc_resource_t *collection;
+  oc_resource_t *res[3];
+};
+
+oc_handler_t TestCollectionBatch::s_handler;
+pthread_mutex_t TestCollectionBatch::mutex;
+pthread_cond_t TestCollectionBatch::cv;
+int TestCollectionBatch::gets;
+
+TEST_F(TestCollectionBatch, Immediate)
+{
+  coap_observer_t *obs = observeBatch();
+  ASSERT_NE(nullptr, obs);
+  int32_t counter = obs->obs_counter;
+
+  oc_notify_observers(res[0]);
+  oc_notify_observers(res[1]);
+  /* one notification per change without an interval */
+  EXPECT_EQ(counter + 2, obs->obs_counter);
+}
+
+TEST_F(TestCollectionBatch, Coalesce)
+{
+  coap_observer_t *obs = observeBatch();
+  ASSERT_NE(nullptr, obs);
+  int32_t counter = obs->obs_counter;
+  oc_collection_set_batch_notify_interval(collection, 1, false);
+
+  oc_notify_observers(res[0]);
+  oc_notify_observers(res[1]);
+  oc_notify_observers(res[0]);
+  /* deferred to the end of the interval */
+  EXPECT_EQ(counter, obs->obs_counter);
+  EXPECT_EQ(0, gets);
+
+  pollEvents(1500);
+  /* a single notification carrying the changed links only */
+  EXPECT_EQ(counter + 1, obs->obs_counter);
+#ifndef OC_SECURITY
+  /* the ACL of a secure build leaves the links out of the batch */
+  EXPECT_EQ(2, gets);
+#endif /* !OC_SECURITY */
+
+  /* the pending marks were cleared with the notification */
+  gets = 0;
+  oc_notify_observers(res[2]);
+  pollEvents(1500);
+  EXPECT_EQ(counter + 2, obs->obs_counter);
+#ifndef OC_SECURITY
+  EXPECT_EQ(1, gets);
+#endif /* !OC_SECURITY */
+}
+
+TEST_F(TestCollectionBatch, FullBatch)
+{
+  coap_observer_t *obs = observeBatch();
+  ASSERT_NE(nullptr, obs);
+  int32_t counter = obs->obs_counter;
+  oc_collection_set_batch_notify_interval(collection, 1, true);
+
+  oc_notify_observers(res[0]);
+  pollEvents(1500);
+  EXPECT_EQ(counter + 1, obs->obs_counter);
+#ifndef OC_SECURITY
+  /* every link is in the payload */
+  EXPECT_EQ(3, gets);
+#endif /* !OC_SECURITY */
+}
+
+TEST_F(TestCollectionBatch, DisableFlushes)
+{
+  coap_observer_t *obs = observeBatch();
+  ASSERT_NE(nullptr, obs);
+  int32_t counter = obs->obs_counter;
+  oc_collection_set_batch_notify_interval(collection, 1, false);
+
+  oc_notify_observers(res[1]);
+  EXPECT_EQ(counter, obs->obs_counter);
+  /* turning the interval off sends what has accumulated right away */
+  oc_collection_set_batch_notify_interval(collection, 0, false);
+  EXPECT_EQ(counter + 1, obs->obs_counter);
+
+  /* and nothing is left scheduled */
+  pollEvents(1500);
+  EXPECT_EQ(counter + 1, obs->obs_counter);
+}
+
+#endif /* OC_SERVER && OC_COLLECTIONS */
@@ -16,12 +16,42 @@
 
 #include "gtest/gtest.h"
 #include <cstdlib>
+#include <unistd.h>
 
 #include "oc_endpoint.h"
 #include "oc_helpers.h"
+#include "port/oc_connectivity.h"
+#include "util/oc_process.h"
+
+#if defined(OC_DNS_LOOKUP) && defined(OC_DNS_CACHE)
+static void
+dnsResolved(void *data)
+{
+  *(bool *)data = true;
+}
+#endif /* OC_DNS_LOOKUP && OC_DNS_CACHE */
+
+/* Domains are resolved in the background and fail to parse until they are
+ * cached, so have them cached first. */
+static void
+resolveDomain(const char *domain)
+{
+#if defined(OC_DNS_LOOKUP) && defined(OC_DNS_CACHE)
+  bool resolved = false;
+  if (oc_dns_lookup_async(domain, dnsResolved, &resolved) == 1) {
+    for (int i = 0; i < 3000 && !resolved; i++) {
+      usleep(10000);
+      oc_process_run();
+    }
+  }
+#else  /* OC_DNS_LOOKUP && OC_DNS_CACHE */
+  (void)domain;
+#endif /* !OC_DNS_LOOKUP || !OC_DNS_CACHE */
+}
 
 TEST(OCEndpoints, StringToEndpoint)
 {
+  resolveDomain("openconnectivity.org");
 #ifdef OC_IPV4
   const char *spu0[1] = { "coaps://10.211.55.3:56789/a/light" };
     for (int i = 0; i < 1; i++) {
@@ -0,0 +1,107 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include <cstring>
+#include <gtest/gtest.h>
+
+#include "util/oc_mem_trace.h"
+
+#ifdef OC_MEMORY_TRACE
+
+static const char *pool_a = "pool_a";
+static const char *pool_b = "pool_b";
+
+class TestMemTrace : public testing::Test
+{
+protected:
+  void SetUp() override { oc_mem_trace_init(); }
+  void TearDown() override { oc_mem_trace_shutdown(); }
+};
+
+TEST_F(TestMemTrace, Totals)
+{
+  char a[16], b[16];
+  oc_mem_trace_alloc("f", pool_a, 16, a);
+  oc_mem_trace_alloc("g", pool_b, 32, b);
+  oc_mem_trace_free("h", pool_a, 16, a);
+
+  oc_mem_trace_stats_t totals;
+  uint32_t untracked = 1;
+  oc_mem_trace_get_totals(&totals, &untracked);
+  EXPECT_EQ(2u, totals.allocs);
+  EXPECT_EQ(1u, totals.frees);
+  EXPECT_EQ(32u, totals.current_bytes);
+  EXPECT_EQ(48u, totals.peak_bytes);
+  EXPECT_EQ(0u, untracked);
+  oc_mem_trace_free("h", pool_b, 32, b);
+}
+
+TEST_F(TestMemTrace, PoolsLargestFirst)
+{
+  char a[16], b[16];
+  oc_mem_trace_alloc("f", pool_a, 16, a);
+  oc_mem_trace_alloc("f", pool_b, 64, b);
+
+  oc_mem_trace_stats_t pools[4];
+  ASSERT_EQ(2u, oc_mem_trace_get_pools(pools, 4));
+  EXPECT_STREQ(pool_b, pools[0].name);
+  EXPECT_EQ(64u, pools[0].current_bytes);
+  EXPECT_STREQ(pool_a, pools[1].name);
+  ASSERT_EQ(1u, oc_mem_trace_get_pools(pools, 1));
+  EXPECT_STREQ(pool_b, pools[0].name);
+  oc_mem_trace_free("f", pool_a, 16, a);
+  oc_mem_trace_free("f", pool_b, 64, b);
+}
+
+TEST_F(TestMemTrace, FreeChargedToAllocatingSite)
+{
+  char a[16];
+  oc_mem_trace_alloc("alloc_site", pool_a, 16, a);
+  oc_mem_trace_free("free_site", pool_a, 16, a);
+
+  oc_mem_trace_stats_t sites[4];
+  size_t count = oc_mem_trace_get_sites(sites, 4);
+  ASSERT_LE(1u, count);
+  bool found = false;
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(sites[i].name, "alloc_site") == 0) {
+      found = true;
+      EXPECT_EQ(1u, sites[i].allocs);
+      EXPECT_EQ(1u, sites[i].frees);
+      EXPECT_EQ(0u, sites[i].current_bytes);
+    }
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST_F(TestMemTrace, SampledEvents)
+{
+  char a[4][16];
+  oc_mem_trace_set_sample_rate(2);
+  for (int i = 0; i < 4; i++) {
+    oc_mem_trace_alloc("f", pool_a, 16, a[i]);
+  }
+  oc_mem_trace_event_t events[8];
+  EXPECT_EQ(2u, oc_mem_trace_get_events(events, 8));
+  EXPECT_EQ(MEM_TRACE_ALLOC, events[0].type);
+  EXPECT_LE(events[0].time, events[1].time);
+  oc_mem_trace_set_sample_rate(0);
+  for (int i = 0; i < 4; i++) {
+    oc_mem_trace_free("f", pool_a, 16, a[i]);
+  }
+}
+
+#endif /* OC_MEMORY_TRACE */
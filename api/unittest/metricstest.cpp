@@ -0,0 +1,161 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include <chrono>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "api/oc_metrics_internal.h"
+
+#ifdef OC_METRICS
+
+#define NUM_THREADS (4)
+#define INCREMENTS_PER_THREAD (10000)
+
+class TestMetrics : public testing::Test
+{
+protected:
+  void SetUp() override { oc_metrics_reset(); }
+};
+
+TEST_F(TestMetrics, CountersSumOverThreads)
+{
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    threads.push_back(std::thread([]() {
+      for (int j = 0; j < INCREMENTS_PER_THREAD; j++) {
+        OC_METRICS_INC(OC_METRICS_COAP_RETRANSMISSIONS);
+      }
+      OC_METRICS_ADD(OC_METRICS_RX_BYTES, 10);
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  oc_metrics_snapshot_t snapshot;
+  oc_metrics_get_snapshot(&snapshot);
+  EXPECT_EQ((uint64_t)NUM_THREADS * INCREMENTS_PER_THREAD,
+            snapshot.counters[OC_METRICS_COAP_RETRANSMISSIONS]);
+  EXPECT_EQ((uint64_t)NUM_THREADS * 10,
+            snapshot.counters[OC_METRICS_RX_BYTES]);
+
+  oc_metrics_reset();
+  oc_metrics_get_snapshot(&snapshot);
+  EXPECT_EQ(0u, snapshot.counters[OC_METRICS_COAP_RETRANSMISSIONS]);
+}
+
+TEST_F(TestMetrics, GaugePeak)
+{
+  OC_METRICS_GAUGE_ADD(OC_METRICS_OBSERVERS, 3);
+  OC_METRICS_GAUGE_ADD(OC_METRICS_OBSERVERS, -2);
+
+  oc_metrics_snapshot_t snapshot;
+  oc_metrics_get_snapshot(&snapshot);
+  EXPECT_EQ(1, snapshot.gauges[OC_METRICS_OBSERVERS]);
+  EXPECT_EQ(3, snapshot.gauge_peaks[OC_METRICS_OBSERVERS]);
+
+  oc_metrics_reset();
+  oc_metrics_get_snapshot(&snapshot);
+  EXPECT_EQ(1, snapshot.gauge_peaks[OC_METRICS_OBSERVERS]);
+  OC_METRICS_GAUGE_ADD(OC_METRICS_OBSERVERS, -1);
+}
+
+TEST_F(TestMetrics, HistogramPercentiles)
+{
+  for (int i = 1; i <= 100; i++) {
+    OC_METRICS_OBSERVE(OC_METRICS_RX_MESSAGE_SIZE, i);
+  }
+  OC_METRICS_OBSERVE(OC_METRICS_RX_MESSAGE_SIZE, 1000);
+
+  oc_metrics_snapshot_t snapshot;
+  oc_metrics_get_snapshot(&snapshot);
+  const oc_metrics_histogram_t *h =
+    &snapshot.histograms[OC_METRICS_RX_MESSAGE_SIZE];
+  EXPECT_EQ(101u, h->count);
+  EXPECT_EQ(5050u + 1000u, h->sum);
+  EXPECT_EQ(1000u, h->max);
+  /* 51st value is 51, in the bucket of 32 to 63 */
+  EXPECT_EQ(63u, oc_metrics_percentile(h, 50));
+  EXPECT_EQ(127u, oc_metrics_percentile(h, 99));
+  EXPECT_EQ(1000u, oc_metrics_percentile(h, 100));
+  EXPECT_EQ(0u, oc_metrics_percentile(
+                  &snapshot.histograms[OC_METRICS_TLS_HANDSHAKE_TIME], 50));
+}
+
+TEST_F(TestMetrics, Names)
+{
+  EXPECT_STREQ("coap_duplicates",
+               oc_metrics_counter_name(OC_METRICS_COAP_DUPLICATES));
+  EXPECT_STREQ("tls_peers", oc_metrics_gauge_name(OC_METRICS_TLS_PEERS));
+  EXPECT_STREQ("event_queue_depth",
+               oc_metrics_histogram_name(OC_METRICS_EVENT_QUEUE_DEPTH));
+  EXPECT_EQ(nullptr, oc_metrics_counter_name(OC_METRICS_NUM_COUNTERS));
+}
+
+#ifdef OC_REQUEST_TRACE
+static void
+slow_request(const oc_metrics_request_trace_t *trace, void *user_data)
+{
+  memcpy(user_data, trace, sizeof(*trace));
+}
+
+TEST_F(TestMetrics, RequestTrace)
+{
+  oc_metrics_request_trace_t report;
+  memset(&report, 0, sizeof(report));
+  oc_metrics_set_slow_request_callback(1000, slow_request, &report);
+
+  oc_clock_time_t trace[OC_METRICS_NUM_STAGES];
+  oc_metrics_trace_start(trace);
+  oc_metrics_trace_stamp(trace, OC_METRICS_STAGE_DEQUEUED);
+  oc_metrics_trace_begin(trace);
+  oc_metrics_trace_request("a/light", 7, 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  oc_metrics_trace_stamp_current(OC_METRICS_STAGE_HANDLED);
+  oc_metrics_trace_end();
+  oc_metrics_set_slow_request_callback(0, NULL, NULL);
+
+  ASSERT_NE(nullptr, report.uri);
+  EXPECT_EQ("a/light", std::string(report.uri, report.uri_len));
+  EXPECT_EQ(1, report.method);
+  EXPECT_GE(report.total, 4000u);
+  EXPECT_EQ(-1, report.stages[OC_METRICS_STAGE_DECRYPTED]);
+  EXPECT_EQ(-1, report.stages[OC_METRICS_STAGE_AUTHORIZED]);
+  EXPECT_LE(report.stages[OC_METRICS_STAGE_ENGINE],
+            report.stages[OC_METRICS_STAGE_HANDLED]);
+  EXPECT_EQ((int64_t)report.total, report.stages[OC_METRICS_STAGE_RESPONDED]);
+
+  oc_metrics_snapshot_t snapshot;
+  oc_metrics_get_snapshot(&snapshot);
+  EXPECT_EQ(1u, snapshot.histograms[OC_METRICS_REQUEST_TIME].count);
+  EXPECT_EQ(1u, snapshot.histograms[OC_METRICS_HANDLER_TIME].count);
+  EXPECT_GE(snapshot.histograms[OC_METRICS_HANDLER_TIME].sum, 4000u);
+  EXPECT_EQ(0u, snapshot.histograms[OC_METRICS_DECRYPT_TIME].count);
+
+  /* messages the stack did not receive are not traced */
+  trace[OC_METRICS_STAGE_RECEIVED] = 0;
+  oc_metrics_trace_begin(trace);
+  oc_metrics_trace_end();
+  oc_metrics_get_snapshot(&snapshot);
+  EXPECT_EQ(1u, snapshot.histograms[OC_METRICS_REQUEST_TIME].count);
+}
+#endif /* OC_REQUEST_TRACE */
+
+#endif /* OC_METRICS */
@@ -0,0 +1,97 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "util/oc_mpsc.h"
+
+#ifdef OC_ATOMICS
+
+#define NUM_PRODUCERS (4)
+#define ITEMS_PER_PRODUCER (10000)
+
+typedef struct item_s
+{
+  struct item_s *next;
+  int producer;
+  int sequence;
+} item_t;
+
+TEST(TestMpscQueue, Fifo)
+{
+  oc_mpsc_queue_t queue;
+  oc_mpsc_init(&queue);
+  EXPECT_EQ(nullptr, oc_mpsc_pop(&queue));
+
+  item_t items[3];
+  for (int i = 0; i < 3; i++) {
+    items[i].sequence = i;
+    oc_mpsc_push(&queue, &items[i]);
+  }
+  for (int i = 0; i < 3; i++) {
+    item_t *item = (item_t *)oc_mpsc_pop(&queue);
+    ASSERT_NE(nullptr, item);
+    EXPECT_EQ(i, item->sequence);
+  }
+  EXPECT_EQ(nullptr, oc_mpsc_pop(&queue));
+
+  /* the queue is reusable once drained */
+  oc_mpsc_push(&queue, &items[0]);
+  EXPECT_EQ(&items[0], oc_mpsc_pop(&queue));
+  EXPECT_EQ(nullptr, oc_mpsc_pop(&queue));
+}
+
+TEST(TestMpscQueue, ConcurrentProducers)
+{
+  oc_mpsc_queue_t queue;
+  oc_mpsc_init(&queue);
+  std::vector<item_t> items(NUM_PRODUCERS * ITEMS_PER_PRODUCER);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < NUM_PRODUCERS; p++) {
+    producers.push_back(std::thread([&queue, &items, p]() {
+      for (int i = 0; i < ITEMS_PER_PRODUCER; i++) {
+        item_t *item = &items[p * ITEMS_PER_PRODUCER + i];
+        item->producer = p;
+        item->sequence = i;
+        oc_mpsc_push(&queue, item);
+      }
+    }));
+  }
+
+  int next_sequence[NUM_PRODUCERS] = { 0 };
+  int received = 0;
+  while (received < NUM_PRODUCERS * ITEMS_PER_PRODUCER) {
+    item_t *item = (item_t *)oc_mpsc_pop(&queue);
+    if (!item) {
+      std::this_thread::yield();
+      continue;
+    }
+    /* items of each producer arrive in the order they were pushed */
+    ASSERT_EQ(next_sequence[item->producer], item->sequence);
+    next_sequence[item->producer]++;
+    received++;
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  EXPECT_EQ(nullptr, oc_mpsc_pop(&queue));
+}
+
+#endif /* OC_ATOMICS */
@@ -0,0 +1,279 @@
+/******************************************************************
+ *
+ * Copyright 2020 Cascoda Ltd All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include <cstring>
+#include <gtest/gtest.h>
+
+#include "messaging/coap/observe.h"
+#include "oc_api.h"
+#include "oc_core_res.h"
+#include "port/oc_clock.h"
+#ifdef OC_SECURITY
+#include "security/oc_pstat.h"
+#endif /* OC_SECURITY */
+
+#if defined(OC_SERVER) && defined(OC_BLOCK_WISE)
+
+/* nothing listens on the discard port, so notifications go nowhere */
+#define OBSERVER_ENDPOINT "coap://[::1]:9"
+
+class TestNotifyScheduler : public testing::Test {
+public:
+  static oc_handler_t s_handler;
+  static pthread_mutex_t mutex;
+  static pthread_cond_t cv;
+  static int gets;
+
+  static int appInit(void)
+  {
+    int result = oc_init_platform("Cascoda", NULL, NULL);
+    result |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                            "ocf.res.1.0.0", NULL, NULL);
+    return result;
+  }
+
+  static void signalEventLoop(void)
+  {
+    pthread_mutex_lock(&mutex);
+    pthread_cond_signal(&cv);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  static void onGet(oc_request_t *request, oc_interface_mask_t iface_mask,
+                    void *user_data)
+  {
+    (void)iface_mask;
+    (void)user_data;
+    gets++;
+    oc_rep_start_root_object();
+    oc_rep_set_int(root, gets, gets);
+    oc_rep_end_root_object();
+    oc_send_response(request, OC_STATUS_OK);
+  }
+
+  static oc_event_callback_retval_t quitEvent(void *data)
+  {
+    *(bool *)data = true;
+    return OC_EVENT_DONE;
+  }
+
+  /* Run the event loop for ms milliseconds. */
+  static void pollEvents(oc_clock_time_t ms)
+  {
+    bool quit = false;
+    oc_ri_add_timed_event_callback_ticks(&quit, quitEvent,
+                                         ms * OC_CLOCK_SECOND / 1000);
+    while (true) {
+      pthread_mutex_lock(&mutex);
+      oc_clock_time_t next_event = oc_main_poll();
+      if (quit) {
+        pthread_mutex_unlock(&mutex);
+        break;
+      }
+      if (next_event == 0) {
+        pthread_cond_wait(&cv, &mutex);
+      } else {
+        struct timespec ts;
+        ts.tv_sec = (next_event / OC_CLOCK_SECOND);
+        ts.tv_nsec = (next_event % OC_CLOCK_SECOND) * 1.e09 / OC_CLOCK_SECOND;
+        pthread_cond_timedwait(&cv, &mutex, &ts);
+      }
+      pthread_mutex_unlock(&mutex);
+    }
+  }
+
+protected:
+  static void SetUpTestCase()
+  {
+    s_handler.init = &appInit;
+    s_handler.signal_event_loop = &signalEventLoop;
+    ASSERT_EQ(0, oc_main_init(&s_handler));
+#ifdef OC_SECURITY
+    /* notifications are only sent in RFNOP */
+    oc_sec_get_pstat(0)->s = OC_DOS_RFNOP;
+#endif /* OC_SECURITY */
+  }
+
+  static void TearDownTestCase() { oc_main_shutdown(); }
+
+  virtual void SetUp()
+  {
+    gets = 0;
+    memset(&ep, 0, sizeof(ep));
+    oc_string_t ep_str;
+    oc_new_string(&ep_str, OBSERVER_ENDPOINT, strlen(OBSERVER_ENDPOINT));
+    ASSERT_EQ(0, oc_string_to_endpoint(&ep_str, &ep, NULL));
+    oc_free_string(&ep_str);
+    for (size_t i = 0; i < sizeof(res) / sizeof(res[0]); i++) {
+      char uri[16];
+      snprintf(uri, sizeof(uri), "/notify/%d", (int)i);
+      res[i] = oc_new_resource(NULL, uri, 1, 0);
+      oc_resource_bind_resource_type(res[i], "oic.r.test");
+      oc_resource_bind_resource_interface(res[i], OC_IF_BASELINE);
+      oc_resource_set_default_interface(res[i], OC_IF_BASELINE);
+      oc_resource_set_discoverable(res[i], true);
+      oc_resource_set_observable(res[i], true);
+      oc_resource_set_request_handler(res[i], OC_GET, onGet, NULL);
+      ASSERT_TRUE(oc_add_resource(res[i]));
+    }
+  }
+
+  virtual void TearDown()
+  {
+    coap_remove_notify_scheduler(&ep);
+    for (size_t i = 0; i < sizeof(res) / sizeof(res[0]); i++) {
+      oc_delete_resource(res[i]);
+    }
+    coap_remove_observer_by_client(&ep);
+  }
+
+  /* Register ep as an observer of resource on iface_mask. */
+  coap_observer_t *observe(oc_resource_t *resource,
+                           oc_interface_mask_t iface_mask, uint8_t token)
+  {
+    coap_packet_t request[1], response[1];
+    coap_udp_init_message(request, COAP_TYPE_CON, COAP_GET, 1);
+    coap_set_token(request, &token, 1);
+    coap_set_header_observe(request, 0);
+    coap_set_header_uri_path(request, oc_string(resource->uri),
+                             oc_string_len(resource->uri));
+    coap_udp_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 1);
+    if (coap_observe_handler(request, response, resource, 1024, &ep,
+                             iface_mask) < 0) {
+      return nullptr;
+    }
+    coap_observer_t *obs = (coap_observer_t *)oc_list_head(coap_get_observers());
+    for (; obs; obs = obs->next) {
+      if (obs->resource == resource && obs->token[0] == token) {
+        return obs;
+      }
+    }
+    return nullptr;
+  }
+
+  oc_endpoint_t ep;
+  oc_resource_t *res[3];
+};
+
+oc_handler_t TestNotifyScheduler::s_handler;
+pthread_mutex_t TestNotifyScheduler::mutex;
+pthread_cond_t TestNotifyScheduler::cv;
+int TestNotifyScheduler::gets;
+
+TEST_F(TestNotifyScheduler, Coalesce)
+{
+  coap_observer_t *obs = observe(res[0], OC_IF_BASELINE, 1);
+  ASSERT_NE(nullptr, obs);
+  int32_t counter = obs->obs_counter;
+  ASSERT_EQ(0, coap_set_notify_scheduler(&ep, 100, 0, 1));
+
+  for (int i = 0; i < 5; i++) {
+    oc_notify_observers(res[0]);
+  }
+  /* deferred to the end of the window */
+  EXPECT_EQ(0, gets);
+  EXPECT_EQ(counter, obs->obs_counter);
+
+  pollEvents(500);
+  /* one notification with the last value */
+  EXPECT_EQ(1, gets);
+  EXPECT_EQ(counter + 1, obs->obs_counter);
+}
+
+TEST_F(TestNotifyScheduler, RateLimit)
+{
+  coap_observer_t *obs[3];
+  int32_t counters[3];
+  for (int i = 0; i < 3; i++) {
+    obs[i] = observe(res[i], OC_IF_BASELINE, (uint8_t)(i + 1));
+    ASSERT_NE(nullptr, obs[i]);
+    counters[i] = obs[i]->obs_counter;
+  }
+  /* no window, 2 notifications per second without a burst */
+  ASSERT_EQ(0, coap_set_notify_scheduler(&ep, 0, 2, 1));
+
+  for (int i = 0; i < 3; i++) {
+    oc_notify_observers(res[i]);
+  }
+  pollEvents(100);
+  EXPECT_EQ(1, gets);
+  EXPECT_EQ(counters[0] + 1, obs[0]->obs_counter);
+  EXPECT_EQ(counters[1], obs[1]->obs_counter);
+  EXPECT_EQ(counters[2], obs[2]->obs_counter);
+
+  /* the others follow one token at a time */
+  pollEvents(1500);
+  EXPECT_EQ(3, gets);
+  EXPECT_EQ(counters[1] + 1, obs[1]->obs_counter);
+  EXPECT_EQ(counters[2] + 1, obs[2]->obs_counter);
+}
+
+TEST_F(TestNotifyScheduler, ScheduledCount)
+{
+  ASSERT_NE(nullptr, observe(res[0], OC_IF_BASELINE, 1));
+  EXPECT_EQ(0, res[0]->num_scheduled_observers);
+
+  /* observers of the endpoint are counted once it gets a scheduler */
+  ASSERT_EQ(0, coap_set_notify_scheduler(&ep, 100, 0, 1));
+  EXPECT_EQ(1, res[0]->num_scheduled_observers);
+  ASSERT_EQ(0, coap_set_notify_scheduler(&ep, 200, 0, 1));
+  EXPECT_EQ(1, res[0]->num_scheduled_observers);
+
+  /* and so are the ones that come later */
+  ASSERT_NE(nullptr, observe(res[1], OC_IF_BASELINE, 2));
+  EXPECT_EQ(1, res[1]->num_scheduled_observers);
+  EXPECT_EQ(0, res[2]->num_scheduled_observers);
+
+  coap_remove_notify_scheduler(&ep);
+  EXPECT_EQ(0, res[0]->num_scheduled_observers);
+  EXPECT_EQ(0, res[1]->num_scheduled_observers);
+
+  ASSERT_EQ(0, coap_set_notify_scheduler(&ep, 100, 0, 1));
+  coap_remove_observer_by_client(&ep);
+  EXPECT_EQ(0, res[0]->num_scheduled_observers);
+  EXPECT_EQ(0, res[1]->num_scheduled_observers);
+}
+
+#ifdef OC_RES_BATCH_SUPPORT
+TEST_F(TestNotifyScheduler, Batch)
+{
+  oc_resource_t *discovery = oc_core_get_resource_by_index(OCF_RES, 0);
+  coap_observer_t *batch = observe(discovery, OC_IF_B, 1);
+  ASSERT_NE(nullptr, batch);
+  coap_observer_t *links = observe(discovery, OC_IF_LL, 2);
+  ASSERT_NE(nullptr, links);
+  int32_t batch_counter = batch->obs_counter;
+  int32_t links_counter = links->obs_counter;
+  ASSERT_EQ(0, coap_set_notify_scheduler(&ep, 100, 0, 1));
+
+  oc_notify_observers(res[0]);
+  oc_notify_observers(res[1]);
+  oc_notify_observers(res[0]);
+  pollEvents(500);
+
+  /* both changes in a single notification to the oic.if.b observer only */
+  EXPECT_EQ(batch_counter + 1, batch->obs_counter);
+  EXPECT_EQ(links_counter, links->obs_counter);
+#ifndef OC_SECURITY
+  /* the ACL of a secure build leaves the links out of the batch */
+  EXPECT_EQ(2, gets);
+#endif /* !OC_SECURITY */
+}
+#endif /* OC_RES_BATCH_SUPPORT */
+
+#endif /* OC_SERVER && OC_BLOCK_WISE */
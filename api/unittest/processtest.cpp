@@ -0,0 +1,210 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "util/oc_process.h"
+
+static std::vector<intptr_t> delivered;
+static std::vector<intptr_t> shed;
+
+OC_PROCESS(test_process, "Test process");
+
+OC_PROCESS_THREAD(test_process, ev, data)
+{
+  OC_PROCESS_BEGIN();
+  while (1) {
+    OC_PROCESS_YIELD();
+    if (ev == OC_PROCESS_EVENT_MSG) {
+      delivered.push_back((intptr_t)data);
+    }
+  }
+  OC_PROCESS_END();
+}
+
+static void
+shed_event(struct oc_process *p, oc_process_event_t ev, oc_process_data_t data)
+{
+  (void)p;
+  (void)ev;
+  shed.push_back((intptr_t)data);
+}
+
+class TestProcess : public testing::Test {
+protected:
+  virtual void SetUp()
+  {
+    delivered.clear();
+    shed.clear();
+    oc_process_init();
+    oc_process_start(&test_process, NULL);
+    oc_process_set_shed_callback(shed_event);
+  }
+
+  virtual void TearDown()
+  {
+    while (oc_process_run()) {
+    }
+    oc_process_set_shed_callback(NULL);
+    oc_process_exit(&test_process);
+    oc_process_shutdown();
+  }
+
+  static int post(intptr_t value, oc_process_priority_t priority)
+  {
+    return oc_process_post_priority(&test_process, OC_PROCESS_EVENT_MSG,
+                                    (oc_process_data_t)value, priority);
+  }
+
+  static void run_all(void)
+  {
+    while (oc_process_run()) {
+    }
+  }
+};
+
+TEST_F(TestProcess, DeliversByPriority)
+{
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(1, OC_PROCESS_PRIORITY_MULTICAST));
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(2, OC_PROCESS_PRIORITY_UNICAST));
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(3, OC_PROCESS_PRIORITY_UNICAST));
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(4, OC_PROCESS_PRIORITY_SECURITY));
+  EXPECT_EQ(OC_PROCESS_ERR_OK, oc_process_post(&test_process,
+                                               OC_PROCESS_EVENT_MSG,
+                                               (oc_process_data_t)5));
+  EXPECT_EQ(5, oc_process_nevents());
+  run_all();
+  std::vector<intptr_t> expected = { 5, 4, 2, 3, 1 };
+  EXPECT_EQ(expected, delivered);
+}
+
+static bool
+equals(oc_process_data_t data, const void *value)
+{
+  return (intptr_t)data == *(const intptr_t *)value;
+}
+
+TEST_F(TestProcess, HasEvent)
+{
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(1, OC_PROCESS_PRIORITY_UNICAST));
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(2, OC_PROCESS_PRIORITY_SECURITY));
+  intptr_t value = 1;
+  EXPECT_TRUE(oc_process_has_event(OC_PROCESS_PRIORITY_UNICAST,
+                                   OC_PROCESS_EVENT_MSG, equals, &value));
+  /* only the given class and event are searched */
+  EXPECT_FALSE(oc_process_has_event(OC_PROCESS_PRIORITY_SECURITY,
+                                    OC_PROCESS_EVENT_MSG, equals, &value));
+  EXPECT_FALSE(oc_process_has_event(OC_PROCESS_PRIORITY_UNICAST,
+                                    OC_PROCESS_EVENT_CONTINUE, equals, &value));
+  value = 2;
+  EXPECT_FALSE(oc_process_has_event(OC_PROCESS_PRIORITY_UNICAST,
+                                    OC_PROCESS_EVENT_MSG, equals, &value));
+
+  /* delivered events are no longer queued */
+  run_all();
+  value = 1;
+  EXPECT_FALSE(oc_process_has_event(OC_PROCESS_PRIORITY_UNICAST,
+                                    OC_PROCESS_EVENT_MSG, equals, &value));
+}
+
+TEST_F(TestProcess, ShedNewest)
+{
+  oc_process_queue_stats_t stats;
+  ASSERT_TRUE(oc_process_get_queue_stats(OC_PROCESS_PRIORITY_UNICAST, &stats));
+  oc_process_num_events_t limit = stats.limit;
+  oc_process_set_queue_limit(OC_PROCESS_PRIORITY_UNICAST, 2,
+                             OC_PROCESS_SHED_NEWEST);
+
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(1, OC_PROCESS_PRIORITY_UNICAST));
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(2, OC_PROCESS_PRIORITY_UNICAST));
+  EXPECT_EQ(OC_PROCESS_ERR_FULL, post(3, OC_PROCESS_PRIORITY_UNICAST));
+  /* other classes are not affected */
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(4, OC_PROCESS_PRIORITY_MULTICAST));
+
+  ASSERT_TRUE(oc_process_get_queue_stats(OC_PROCESS_PRIORITY_UNICAST, &stats));
+  EXPECT_EQ(2u, stats.queued);
+  EXPECT_EQ(2u, stats.peak);
+  EXPECT_EQ(2u, stats.limit);
+  EXPECT_EQ(2u, stats.posted);
+  EXPECT_EQ(1u, stats.dropped);
+
+  run_all();
+  std::vector<intptr_t> expected = { 1, 2, 4 };
+  EXPECT_EQ(expected, delivered);
+  EXPECT_TRUE(shed.empty());
+
+  oc_process_set_queue_limit(OC_PROCESS_PRIORITY_UNICAST, limit,
+                             OC_PROCESS_SHED_NEWEST);
+}
+
+TEST_F(TestProcess, ShedOldest)
+{
+  oc_process_queue_stats_t stats;
+  ASSERT_TRUE(
+    oc_process_get_queue_stats(OC_PROCESS_PRIORITY_MULTICAST, &stats));
+  oc_process_num_events_t limit = stats.limit;
+  oc_process_set_queue_limit(OC_PROCESS_PRIORITY_MULTICAST, 2,
+                             OC_PROCESS_SHED_OLDEST);
+
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(1, OC_PROCESS_PRIORITY_MULTICAST));
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(2, OC_PROCESS_PRIORITY_MULTICAST));
+  EXPECT_EQ(OC_PROCESS_ERR_OK, post(3, OC_PROCESS_PRIORITY_MULTICAST));
+
+  ASSERT_TRUE(
+    oc_process_get_queue_stats(OC_PROCESS_PRIORITY_MULTICAST, &stats));
+  EXPECT_EQ(2u, stats.queued);
+  EXPECT_EQ(3u, stats.posted);
+  EXPECT_EQ(1u, stats.dropped);
+
+  run_all();
+  std::vector<intptr_t> expected_shed = { 1 };
+  EXPECT_EQ(expected_shed, shed);
+  std::vector<intptr_t> expected = { 2, 3 };
+  EXPECT_EQ(expected, delivered);
+
+  oc_process_set_queue_limit(OC_PROCESS_PRIORITY_MULTICAST, limit,
+                             OC_PROCESS_SHED_OLDEST);
+}
+
+#ifdef OC_DYNAMIC_ALLOCATION
+TEST_F(TestProcess, ControlQueueGrows)
+{
+  intptr_t i;
+  for (i = 0; i < 100; i++) {
+    ASSERT_EQ(OC_PROCESS_ERR_OK,
+              oc_process_post(&test_process, OC_PROCESS_EVENT_MSG,
+                              (oc_process_data_t)i));
+    /* keep the ring wrapped around while it grows */
+    if (i % 3 == 0) {
+      oc_process_run();
+    }
+  }
+  run_all();
+  ASSERT_EQ(100u, delivered.size());
+  for (i = 0; i < 100; i++) {
+    EXPECT_EQ(i, delivered[i]);
+  }
+}
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+TEST_F(TestProcess, InvalidPriority)
+{
+  oc_process_queue_stats_t stats;
+  EXPECT_FALSE(oc_process_get_queue_stats(OC_PROCESS_NUM_PRIORITIES, &stats));
+  EXPECT_FALSE(oc_process_get_queue_stats(OC_PROCESS_PRIORITY_CONTROL, NULL));
+  EXPECT_EQ(OC_PROCESS_ERR_FULL, post(1, OC_PROCESS_NUM_PRIORITIES));
+}
@@ -76,7 +76,8 @@ TEST(TestRep, OCRepSetGetDouble)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -133,7 +134,8 @@ TEST(TestRep, OCRepSetGetInt)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -211,7 +213,8 @@ TEST(TestRep, OCRepSetGetUint)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -280,7 +283,8 @@ TEST(TestRep, OCRepSetGetBool)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -355,7 +359,8 @@ TEST(TestRep, OCRepSetGetTextString)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -430,7 +435,8 @@ TEST(TestRep, OCRepSetGetByteString)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -509,7 +515,8 @@ TEST(TestRep, OCRepSetGetIntArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -585,7 +592,8 @@ TEST(TestRep, OCRepAddGetIntArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -655,7 +663,8 @@ TEST(TestRep, OCRepAddGetIntArrayUsingSetKeyAndBeginArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -713,7 +722,8 @@ TEST(TestRep, OCRepSetGetBoolArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -788,7 +798,8 @@ TEST(TestRep, OCRepAddGetBoolArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -846,7 +857,8 @@ TEST(TestRep, OCRepSetGetDoubleArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -930,7 +942,8 @@ TEST(TestRep, OCRepAddGetDoubleArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -1007,7 +1020,8 @@ TEST(TestRep, OCRepSetGetObject)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -1112,7 +1126,8 @@ TEST(TestRep, OCRepSetGetObjectArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -1240,7 +1255,8 @@ TEST(TestRep, OCRepAddGetByteStringArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -1332,7 +1348,8 @@ TEST(TestRep, OCRepSetGetStringArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -1424,7 +1441,8 @@ TEST(TestRep, OCRepAddGetStringArray)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
@@ -1523,7 +1541,8 @@ TEST(TestRep, OCRepRootArrayObject)
   const uint8_t *payload = oc_rep_get_encoder_buf();
   int payload_len = oc_rep_get_encoded_payload_size();
   EXPECT_NE(payload_len, -1);
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                 0 OC_MEMB_TRACE_NAME(rep_objects) };
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
   oc_parse_rep(payload, payload_len, &rep);
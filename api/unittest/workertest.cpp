@@ -0,0 +1,325 @@
+/******************************************************************
+ *
+ * Copyright 2020 Cascoda Ltd All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "api/oc_worker_internal.h"
+#include "oc_api.h"
+#include "port/oc_clock.h"
+#include "port/oc_connectivity.h"
+
+/* the device answers its own requests over loopback, which a secure device
+ * only allows with an anon-clear ACE */
+#if defined(OC_WORKER_THREADS) && defined(OC_SERVER) && defined(OC_CLIENT) && \
+  !defined(OC_SECURITY)
+
+#define WORKER_URI "/worker"
+
+class TestWorker : public testing::Test {
+public:
+  static oc_handler_t s_handler;
+  static pthread_mutex_t mutex;
+  static pthread_cond_t cv;
+  static pthread_t event_loop;
+  static oc_endpoint_t ep;
+
+  /* written by the handlers on the workers */
+  static int64_t value;
+  static int posts;
+  static bool on_worker;
+  static bool hold;
+
+  static int appInit(void)
+  {
+    int result = oc_init_platform("Cascoda", NULL, NULL);
+    result |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                            "ocf.res.1.0.0", NULL, NULL);
+    return result;
+  }
+
+  static void signalEventLoop(void)
+  {
+    pthread_mutex_lock(&mutex);
+    pthread_cond_signal(&cv);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  static void onGet(oc_request_t *request, oc_interface_mask_t iface_mask,
+                    void *user_data)
+  {
+    (void)iface_mask;
+    (void)user_data;
+    oc_rep_start_root_object();
+    oc_rep_set_int(root, value, __atomic_load_n(&value, __ATOMIC_ACQUIRE));
+    oc_rep_end_root_object();
+    oc_send_response(request, OC_STATUS_OK);
+  }
+
+  static void onPost(oc_request_t *request, oc_interface_mask_t iface_mask,
+                     void *user_data)
+  {
+    (void)iface_mask;
+    (void)user_data;
+    __atomic_store_n(&on_worker, !pthread_equal(pthread_self(), event_loop),
+                     __ATOMIC_RELEASE);
+    __atomic_add_fetch(&posts, 1, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&hold, __ATOMIC_ACQUIRE)) {
+      usleep(1000);
+    }
+    int64_t v;
+    if (!oc_rep_get_int(request->request_payload, "value", &v)) {
+      oc_send_response(request, OC_STATUS_BAD_REQUEST);
+      return;
+    }
+    __atomic_store_n(&value, v, __ATOMIC_RELEASE);
+    oc_rep_start_root_object();
+    oc_rep_set_int(root, value, v);
+    oc_rep_end_root_object();
+    oc_send_response(request, OC_STATUS_CHANGED);
+  }
+
+  static oc_event_callback_retval_t quitEvent(void *data)
+  {
+    *(bool *)data = true;
+    return OC_EVENT_DONE;
+  }
+
+  /* Run the event loop until *done reaches n or ms milliseconds passed. */
+  static bool pollUntil(const int *done, int n, oc_clock_time_t ms)
+  {
+    bool quit = false;
+    oc_ri_add_timed_event_callback_ticks(&quit, quitEvent,
+                                         ms * OC_CLOCK_SECOND / 1000);
+    while (true) {
+      pthread_mutex_lock(&mutex);
+      oc_clock_time_t next_event = oc_main_poll();
+      if (quit || __atomic_load_n(done, __ATOMIC_ACQUIRE) >= n) {
+        pthread_mutex_unlock(&mutex);
+        break;
+      }
+      if (next_event == 0) {
+        pthread_cond_wait(&cv, &mutex);
+      } else {
+        struct timespec ts;
+        ts.tv_sec = (next_event / OC_CLOCK_SECOND);
+        ts.tv_nsec = (next_event % OC_CLOCK_SECOND) * 1.e09 / OC_CLOCK_SECOND;
+        pthread_cond_timedwait(&cv, &mutex, &ts);
+      }
+      pthread_mutex_unlock(&mutex);
+    }
+    oc_ri_remove_timed_event_callback(&quit, quitEvent);
+    return __atomic_load_n(done, __ATOMIC_ACQUIRE) >= n;
+  }
+
+  struct Responses
+  {
+    int count;
+    oc_status_t code;
+    int64_t value;
+  };
+
+  static void onResponse(oc_client_response_t *data)
+  {
+    Responses *responses = (Responses *)data->user_data;
+    responses->code = data->code;
+    oc_rep_get_int(data->payload, "value", &responses->value);
+    __atomic_add_fetch(&responses->count, 1, __ATOMIC_ACQ_REL);
+  }
+
+  static bool post(int64_t v, Responses *responses)
+  {
+    if (!oc_init_post(WORKER_URI, &ep, NULL, onResponse, HIGH_QOS,
+                      responses)) {
+      return false;
+    }
+    oc_rep_start_root_object();
+    oc_rep_set_int(root, value, v);
+    oc_rep_end_root_object();
+    return oc_do_post();
+  }
+
+  /* Let the held handlers return after *data microseconds. */
+  static void *release(void *data)
+  {
+    usleep(*(useconds_t *)data);
+    __atomic_store_n(&hold, false, __ATOMIC_RELEASE);
+    return NULL;
+  }
+
+protected:
+  static void SetUpTestCase()
+  {
+    event_loop = pthread_self();
+    s_handler.init = &appInit;
+    s_handler.signal_event_loop = &signalEventLoop;
+    ASSERT_EQ(0, oc_main_init(&s_handler));
+
+    /* the device's own unsecured UDP port, over loopback */
+    oc_endpoint_t *eps = oc_connectivity_get_endpoints(0);
+    for (; eps != NULL; eps = eps->next) {
+      if ((eps->flags & IPV6) && !(eps->flags & (SECURED | TCP))) {
+        break;
+      }
+    }
+    ASSERT_NE(nullptr, eps);
+    memcpy(&ep, eps, sizeof(ep));
+    ep.next = NULL;
+    memset(ep.addr.ipv6.address, 0, sizeof(ep.addr.ipv6.address));
+    ep.addr.ipv6.address[15] = 1;
+    ep.addr.ipv6.scope = 0;
+  }
+
+  static void TearDownTestCase() { oc_main_shutdown(); }
+
+  virtual void SetUp()
+  {
+    value = 0;
+    posts = 0;
+    on_worker = false;
+    hold = false;
+    resource = oc_new_resource(NULL, WORKER_URI, 1, 0);
+    oc_resource_bind_resource_type(resource, "oic.r.test");
+    oc_resource_bind_resource_interface(resource, OC_IF_RW);
+    oc_resource_set_default_interface(resource, OC_IF_RW);
+    oc_resource_set_discoverable(resource, true);
+    oc_resource_set_observable(resource, true);
+    oc_resource_set_concurrent(resource, true);
+    oc_resource_set_request_handler(resource, OC_GET, onGet, NULL);
+    oc_resource_set_request_handler(resource, OC_POST, onPost, NULL);
+    ASSERT_TRUE(oc_add_resource(resource));
+  }
+
+  virtual void TearDown()
+  {
+    if (resource) {
+      oc_delete_resource(resource);
+    }
+  }
+
+  oc_resource_t *resource;
+};
+
+oc_handler_t TestWorker::s_handler;
+pthread_mutex_t TestWorker::mutex;
+pthread_cond_t TestWorker::cv;
+pthread_t TestWorker::event_loop;
+oc_endpoint_t TestWorker::ep;
+int64_t TestWorker::value;
+int TestWorker::posts;
+bool TestWorker::on_worker;
+bool TestWorker::hold;
+
+TEST_F(TestWorker, SeparateResponse)
+{
+  Responses responses = {};
+  ASSERT_TRUE(post(5, &responses));
+  ASSERT_TRUE(pollUntil(&responses.count, 1, 5000));
+
+  /* the handler ran on a worker, which completed the request */
+  EXPECT_TRUE(on_worker);
+  EXPECT_EQ(1, posts);
+  EXPECT_EQ(OC_STATUS_CHANGED, responses.code);
+  EXPECT_EQ(5, responses.value);
+}
+
+TEST_F(TestWorker, NotifyAfterPost)
+{
+  Responses notifications = {};
+  ASSERT_TRUE(oc_do_observe(WORKER_URI, &ep, NULL, onResponse, HIGH_QOS,
+                            &notifications));
+  ASSERT_TRUE(pollUntil(&notifications.count, 1, 5000));
+  EXPECT_EQ(0, notifications.value);
+
+  Responses responses = {};
+  ASSERT_TRUE(post(7, &responses));
+  ASSERT_TRUE(pollUntil(&responses.count, 1, 5000));
+  /* the completed POST notifies the observer of the new value */
+  EXPECT_TRUE(pollUntil(&notifications.count, 2, 5000));
+  EXPECT_EQ(7, notifications.value);
+
+  oc_stop_observe(WORKER_URI, &ep);
+}
+
+TEST_F(TestWorker, DeleteResourceDrains)
+{
+  hold = true;
+  Responses responses = {};
+  ASSERT_TRUE(post(9, &responses));
+  ASSERT_TRUE(pollUntil(&posts, 1, 5000));
+
+  pthread_t releaser;
+  useconds_t delay = 100 * 1000;
+  ASSERT_EQ(0, pthread_create(&releaser, NULL, release, &delay));
+  /* waits for the handler to return and sends its response */
+  EXPECT_TRUE(oc_delete_resource(resource));
+  resource = nullptr;
+  pthread_join(releaser, NULL);
+  EXPECT_EQ(9, __atomic_load_n(&value, __ATOMIC_ACQUIRE));
+
+  ASSERT_TRUE(pollUntil(&responses.count, 1, 5000));
+  EXPECT_EQ(OC_STATUS_CHANGED, responses.code);
+  EXPECT_EQ(9, responses.value);
+}
+
+TEST_F(TestWorker, SlowHandler)
+{
+  hold = true;
+  Responses responses = {};
+  ASSERT_TRUE(post(3, &responses));
+  ASSERT_TRUE(pollUntil(&posts, 1, 5000));
+
+  /* the request is acknowledged once the ACK window has passed and its
+   * response follows separately */
+  pthread_t releaser;
+  useconds_t delay = 2 * 1000000 / OC_CLOCK_SECOND * OC_WORKER_ACK_WINDOW;
+  ASSERT_EQ(0, pthread_create(&releaser, NULL, release, &delay));
+  EXPECT_TRUE(pollUntil(&responses.count, 1, 5000));
+  pthread_join(releaser, NULL);
+  EXPECT_EQ(OC_STATUS_CHANGED, responses.code);
+  EXPECT_EQ(3, responses.value);
+}
+
+TEST_F(TestWorker, QueueFull)
+{
+  hold = true;
+  /* all requests come from the same peer and hence wait on one worker */
+  Responses held = {};
+  for (int i = 0; i < OC_WORKER_QUEUE_DEPTH; i++) {
+    ASSERT_TRUE(post(i, &held));
+  }
+  Responses rejected = {};
+  ASSERT_TRUE(post(OC_WORKER_QUEUE_DEPTH, &rejected));
+
+  /* turned away rather than overtaking the queued requests */
+  ASSERT_TRUE(pollUntil(&rejected.count, 1, 5000));
+  EXPECT_EQ(OC_STATUS_SERVICE_UNAVAILABLE, rejected.code);
+  EXPECT_EQ(0, held.count);
+
+  __atomic_store_n(&hold, false, __ATOMIC_RELEASE);
+  ASSERT_TRUE(pollUntil(&held.count, OC_WORKER_QUEUE_DEPTH, 5000));
+  EXPECT_EQ(OC_STATUS_CHANGED, held.code);
+  /* served in order, so the last value is the last one queued */
+  EXPECT_EQ(OC_WORKER_QUEUE_DEPTH - 1,
+            __atomic_load_n(&value, __ATOMIC_ACQUIRE));
+  EXPECT_EQ(OC_WORKER_QUEUE_DEPTH, posts);
+}
+
+#endif /* OC_WORKER_THREADS && OC_SERVER && OC_CLIENT && !OC_SECURITY */
@@ -0,0 +1,159 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/* Random number and clock microbenchmark.
+ *
+ * Times the port's oc_random_value() and clock functions against the
+ * implementations they replaced: one read() of /dev/urandom per value and
+ * clock_gettime(CLOCK_REALTIME) with a floating point ceil() per reading.
+ * A confirmable client request draws three random values (two for its token,
+ * one for its retransmission timeout) and reads the clock about six times
+ * (client callback, transaction and etimer bookkeeping); the per request
+ * figures are computed from that mix.
+ *
+ * usage: clock_random_bench_linux [iterations]
+ */
+
+#include "oc_clock_util.h"
+#include "port/oc_clock.h"
+#include "port/oc_random.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RANDOM_VALUES_PER_REQUEST (3)
+#define CLOCK_READS_PER_REQUEST (6)
+
+static unsigned long iterations = 1000000;
+static int urandom_fd;
+static volatile uint64_t sink;
+
+static uint64_t
+now_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t
+unbuffered_random_value(void)
+{
+  unsigned int rand = 0;
+  if (read(urandom_fd, &rand, sizeof(rand)) < 0) {
+    return 0;
+  }
+  return rand;
+}
+
+static uint64_t
+buffered_random_value(void)
+{
+  return oc_random_value();
+}
+
+static uint64_t
+realtime_ceil_clock(void)
+{
+  oc_clock_time_t time = 0;
+  struct timespec t;
+  if (clock_gettime(CLOCK_REALTIME, &t) != -1) {
+    time = (oc_clock_time_t)t.tv_sec * OC_CLOCK_SECOND +
+           (oc_clock_time_t)ceil(t.tv_nsec / (1.e09 / OC_CLOCK_SECOND));
+  }
+  return time;
+}
+
+static uint64_t
+realtime_clock(void)
+{
+  return oc_clock_time();
+}
+
+static uint64_t
+monotonic_clock(void)
+{
+  return oc_clock_time_monotonic();
+}
+
+static uint64_t
+loop_clock(void)
+{
+  return oc_clock_loop_time();
+}
+
+static double
+ns_per_call(uint64_t (*func)(void))
+{
+  unsigned long i;
+  uint64_t start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    sink += func();
+  }
+  return (double)(now_ns() - start) / (double)iterations;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if (argc > 1) {
+    iterations = strtoul(argv[1], NULL, 10);
+  }
+  if (iterations == 0) {
+    printf("usage: %s [iterations]\n", argv[0]);
+    return -1;
+  }
+
+  urandom_fd = open("/dev/urandom", O_RDONLY);
+  if (urandom_fd < 0) {
+    printf("could not open /dev/urandom\n");
+    return -1;
+  }
+  oc_random_init();
+  oc_clock_init();
+
+  double random_before = ns_per_call(unbuffered_random_value);
+  double random_after = ns_per_call(buffered_random_value);
+  double clock_before = ns_per_call(realtime_ceil_clock);
+  double clock_realtime = ns_per_call(realtime_clock);
+  double clock_monotonic = ns_per_call(monotonic_clock);
+  /* as seen by the event loop while oc_main_poll() runs */
+  oc_clock_set_loop_time(true);
+  double clock_after = ns_per_call(loop_clock);
+  oc_clock_set_loop_time(false);
+
+  printf("%lu iterations, ns per call\n", iterations);
+  printf("random: read(/dev/urandom) %.1f, oc_random_value %.1f\n",
+         random_before, random_after);
+  printf("clock: realtime+ceil %.1f, oc_clock_time %.1f, "
+         "oc_clock_time_monotonic %.1f, oc_clock_loop_time %.1f\n",
+         clock_before, clock_realtime, clock_monotonic, clock_after);
+
+  double request_before = RANDOM_VALUES_PER_REQUEST * random_before +
+                          CLOCK_READS_PER_REQUEST * clock_before;
+  double request_after = RANDOM_VALUES_PER_REQUEST * random_after +
+                         CLOCK_READS_PER_REQUEST * clock_after;
+  printf("per request (%d random values, %d clock reads): %.1f ns -> %.1f ns\n",
+         RANDOM_VALUES_PER_REQUEST, CLOCK_READS_PER_REQUEST, request_before,
+         request_after);
+
+  oc_random_destroy();
+  close(urandom_fd);
+  return 0;
+}
@@ -0,0 +1,703 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/* End-to-end loopback load generator.
+ *
+ * Forks a server exposing <resources> observable resources and <clients>
+ * client processes, each running its own instance of the stack and so
+ * being a distinct peer with its own (D)TLS session. The clients talk to
+ * the server over the IPv6 loopback interface:
+ *
+ *  get, post  every client keeps one confirmable request outstanding,
+ *             cycling through the resources
+ *  observe    every client observes all resources and the server notifies
+ *             each of them every NOTIFY_INTERVAL_MS; notifications carry
+ *             the monotonic time at which they were encoded
+ *
+ * The clock of a client starts with its first response, so that the
+ * (D)TLS handshake is not part of the figures. Reported are the throughput,
+ * errors, latency percentiles from a log-linear histogram and the peak
+ * resident memory of the server and the clients, with -j as a single JSON
+ * object for tracking trends.
+ *
+ * Plain runs need a build with SECURE=0. For -s the server and the client
+ * identity shared by all clients must be onboarded once, with pairwise
+ * credentials and an ACE granting the client access to the resources: run
+ * "load_generator_linux -s -o" and onboard both devices with the onboarding
+ * tool; their credentials persist in ./load_generator_linux_creds.
+ *
+ * usage: load_generator_linux [-j] [-s] [-o] [-m get|post|observe]
+ *                             [-c clients] [-r resources] [-t seconds]
+ */
+
+#include "oc_api.h"
+#include "port/oc_clock.h"
+#include "port/oc_connectivity.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CLIENTS (128)
+#define MAX_RESOURCES (256)
+#define NOTIFY_INTERVAL_MS (100)
+#define STARTUP_TIMEOUT_SECONDS (10)
+#define CREDS_DIR "./load_generator_linux_creds"
+
+/* latencies in microseconds: exact below 16, then 16 buckets per power of
+ * two, i.e. within 6.25% */
+#define LATENCY_SUB_BUCKETS (16)
+#define LATENCY_BUCKETS ((32 - 3) * LATENCY_SUB_BUCKETS)
+
+typedef enum { LOAD_GET = 0, LOAD_POST, LOAD_OBSERVE } load_mode_t;
+
+static const char *mode_names[] = { "get", "post", "observe" };
+
+typedef struct
+{
+  uint64_t completed;
+  uint64_t errors;
+  uint64_t elapsed_us;
+  uint64_t latency_sum_us;
+  uint64_t latency_max_us;
+  uint64_t latency[LATENCY_BUCKETS];
+} load_result_t;
+
+static load_mode_t mode = LOAD_GET;
+static bool secure;
+static bool onboarding;
+static bool json;
+static int num_clients = 4;
+static int num_resources = 8;
+static int seconds = 10;
+
+static pthread_mutex_t mutex;
+static pthread_cond_t cv;
+static struct timespec ts;
+static volatile sig_atomic_t quit = 0;
+
+static char uris[MAX_RESOURCES][16];
+
+/* server */
+static oc_resource_t *resources[MAX_RESOURCES];
+static int64_t values[MAX_RESOURCES];
+
+/* client */
+static int client_id;
+static oc_endpoint_t server_ep;
+static load_result_t result;
+static bool measuring;
+static uint64_t start_us;
+static uint64_t request_start_us;
+static unsigned long request_count;
+
+static uint64_t
+now_us(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static unsigned int
+latency_bucket(uint64_t us)
+{
+  if (us < LATENCY_SUB_BUCKETS) {
+    return (unsigned int)us;
+  }
+  if (us > UINT32_MAX) {
+    us = UINT32_MAX;
+  }
+  unsigned int msb = 63 - (unsigned int)__builtin_clzll(us);
+  return (msb - 3) * LATENCY_SUB_BUCKETS +
+         (unsigned int)((us >> (msb - 4)) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+static uint64_t
+latency_bucket_upper(unsigned int bucket)
+{
+  if (bucket < LATENCY_SUB_BUCKETS) {
+    return bucket;
+  }
+  unsigned int msb = bucket / LATENCY_SUB_BUCKETS + 3;
+  uint64_t sub = bucket % LATENCY_SUB_BUCKETS;
+  return ((LATENCY_SUB_BUCKETS + sub + 1) << (msb - 4)) - 1;
+}
+
+static uint64_t
+latency_percentile(const load_result_t *r, double percent)
+{
+  uint64_t rank = (uint64_t)((double)r->completed * percent / 100.0 + 0.5);
+  uint64_t seen = 0;
+  unsigned int i;
+  if (rank == 0) {
+    rank = 1;
+  }
+  for (i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += r->latency[i];
+    if (seen >= rank) {
+      uint64_t upper = latency_bucket_upper(i);
+      return (upper < r->latency_max_us) ? upper : r->latency_max_us;
+    }
+  }
+  return r->latency_max_us;
+}
+
+static void
+record_latency(uint64_t us)
+{
+  result.completed++;
+  result.latency_sum_us += us;
+  if (us > result.latency_max_us) {
+    result.latency_max_us = us;
+  }
+  result.latency[latency_bucket(us)]++;
+}
+
+static void
+signal_event_loop(void)
+{
+  pthread_mutex_lock(&mutex);
+  pthread_cond_signal(&cv);
+  pthread_mutex_unlock(&mutex);
+}
+
+void
+handle_signal(int signal)
+{
+  (void)signal;
+  quit = 1;
+  signal_event_loop();
+}
+
+static void
+run_event_loop(void)
+{
+  oc_clock_time_t next_event;
+  while (quit != 1) {
+    next_event = oc_main_poll();
+    if (quit == 1) {
+      break;
+    }
+    pthread_mutex_lock(&mutex);
+    if (next_event == 0) {
+      pthread_cond_wait(&cv, &mutex);
+    } else {
+      ts.tv_sec = (next_event / OC_CLOCK_SECOND);
+      ts.tv_nsec = (next_event % OC_CLOCK_SECOND) * 1.e09 / OC_CLOCK_SECOND;
+      pthread_cond_timedwait(&cv, &mutex, &ts);
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+}
+
+static int
+app_init(void)
+{
+  int ret = oc_init_platform("OCF", NULL, NULL);
+  ret |= oc_add_device("/oic/d", "oic.d.load", "Load", "ocf.1.0.0",
+                       "ocf.res.1.0.0", NULL, NULL);
+  return ret;
+}
+
+static void
+get_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
+            void *user_data)
+{
+  (void)iface_mask;
+  int64_t *value = (int64_t *)user_data;
+  oc_rep_start_root_object();
+  oc_rep_set_int(root, value, *value);
+  oc_rep_set_int(root, t, (int64_t)now_us());
+  oc_rep_end_root_object();
+  oc_send_response(request, OC_STATUS_OK);
+}
+
+static void
+post_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
+             void *user_data)
+{
+  (void)iface_mask;
+  int64_t *value = (int64_t *)user_data;
+  if (!oc_rep_get_int(request->request_payload, "value", value)) {
+    oc_send_response(request, OC_STATUS_BAD_REQUEST);
+    return;
+  }
+  oc_send_response(request, OC_STATUS_CHANGED);
+}
+
+static void
+register_resources(void)
+{
+  int i;
+  for (i = 0; i < num_resources; i++) {
+    oc_resource_t *res = oc_new_resource(NULL, uris[i], 1, 0);
+    oc_resource_bind_resource_type(res, "x.org.iotivity.load");
+    oc_resource_bind_resource_interface(res, OC_IF_RW);
+    oc_resource_set_default_interface(res, OC_IF_RW);
+    oc_resource_set_discoverable(res, true);
+    oc_resource_set_observable(res, true);
+#ifdef OC_SECURITY
+    if (!secure) {
+      oc_resource_make_public(res);
+    }
+#endif /* OC_SECURITY */
+    oc_resource_set_request_handler(res, OC_GET, get_handler, &values[i]);
+    oc_resource_set_request_handler(res, OC_POST, post_handler, &values[i]);
+    oc_add_resource(res);
+    resources[i] = res;
+  }
+}
+
+static oc_event_callback_retval_t
+notify_all(void *data)
+{
+  (void)data;
+  int i;
+  for (i = 0; i < num_resources; i++) {
+    values[i]++;
+    oc_notify_observers(resources[i]);
+  }
+  return OC_EVENT_CONTINUE;
+}
+
+static uint16_t
+server_port(void)
+{
+  oc_endpoint_t *ep = oc_connectivity_get_endpoints(0);
+  for (; ep; ep = ep->next) {
+    if ((ep->flags & IPV6) && !(ep->flags & TCP) &&
+        ((ep->flags & SECURED) != 0) == secure) {
+      return ep->addr.ipv6.port;
+    }
+  }
+  return 0;
+}
+
+static int
+run_server(int port_fd)
+{
+  static const oc_handler_t handler = {.init = app_init,
+                                       .signal_event_loop = signal_event_loop,
+                                       .register_resources =
+                                         register_resources };
+#ifdef OC_STORAGE
+  oc_storage_config(CREDS_DIR "/server");
+#endif /* OC_STORAGE */
+
+  int init = oc_main_init(&handler);
+  uint16_t port = (init < 0) ? 0 : server_port();
+  if (write(port_fd, &port, sizeof(port)) != sizeof(port) || port == 0) {
+    init = -1;
+  }
+  close(port_fd);
+  if (init >= 0) {
+    if (mode == LOAD_OBSERVE && !onboarding) {
+      oc_ri_add_timed_event_callback_ticks(
+        NULL, notify_all, NOTIFY_INTERVAL_MS * OC_CLOCK_SECOND / 1000);
+    }
+    run_event_loop();
+  }
+  oc_main_shutdown();
+  return init < 0 ? -1 : 0;
+}
+
+static oc_event_callback_retval_t
+stop_load(void *data)
+{
+  (void)data;
+  if (measuring) {
+    result.elapsed_us = now_us() - start_us;
+  }
+  quit = 1;
+  return OC_EVENT_DONE;
+}
+
+static void
+start_measuring(uint64_t now)
+{
+  measuring = true;
+  start_us = now;
+  oc_remove_delayed_callback(NULL, stop_load);
+  oc_set_delayed_callback(NULL, stop_load, (uint16_t)seconds);
+}
+
+static void send_request(void);
+
+static oc_event_callback_retval_t
+retry_request(void *data)
+{
+  (void)data;
+  send_request();
+  return OC_EVENT_DONE;
+}
+
+static void
+response_handler(oc_client_response_t *data)
+{
+  uint64_t now = now_us();
+  if (quit == 1) {
+    return;
+  }
+  if (!measuring) {
+    start_measuring(now);
+  } else if (data->code >= OC_STATUS_BAD_REQUEST) {
+    result.errors++;
+  } else {
+    record_latency(now - request_start_us);
+  }
+  send_request();
+}
+
+static void
+send_request(void)
+{
+  const char *uri =
+    uris[(client_id + request_count++) % (unsigned long)num_resources];
+  bool sent = false;
+  request_start_us = now_us();
+  if (mode == LOAD_GET) {
+    sent = oc_do_get(uri, &server_ep, NULL, response_handler, HIGH_QOS, NULL);
+  } else if (oc_init_post(uri, &server_ep, NULL, response_handler, HIGH_QOS,
+                          NULL)) {
+    oc_rep_start_root_object();
+    oc_rep_set_int(root, value, (int64_t)request_count);
+    oc_rep_end_root_object();
+    sent = oc_do_post();
+  }
+  if (!sent) {
+    if (measuring) {
+      result.errors++;
+    }
+    oc_set_delayed_callback(NULL, retry_request, 0);
+  }
+}
+
+static void
+notification_handler(oc_client_response_t *data)
+{
+  uint64_t now = now_us();
+  int64_t t = 0;
+  if (quit == 1) {
+    return;
+  }
+  if (!measuring) {
+    start_measuring(now);
+  } else if (data->code >= OC_STATUS_BAD_REQUEST) {
+    result.errors++;
+  } else if (oc_rep_get_int(data->payload, "t", &t) && (uint64_t)t <= now) {
+    record_latency(now - (uint64_t)t);
+  }
+}
+
+static void
+start_load(void)
+{
+  /* stop if the server never answers */
+  oc_set_delayed_callback(NULL, stop_load,
+                          (uint16_t)(seconds + STARTUP_TIMEOUT_SECONDS));
+  if (mode != LOAD_OBSERVE) {
+    send_request();
+    return;
+  }
+  int i;
+  for (i = 0; i < num_resources; i++) {
+    if (!oc_do_observe(uris[i], &server_ep, NULL, notification_handler,
+                       LOW_QOS, NULL)) {
+      result.errors++;
+    }
+  }
+}
+
+static int
+run_client(uint16_t port, int result_fd)
+{
+  static const oc_handler_t handler = {.init = app_init,
+                                       .signal_event_loop =
+                                         signal_event_loop };
+#ifdef OC_STORAGE
+  /* onboarded clients share one identity */
+  char creds[64];
+  if (secure) {
+    snprintf(creds, sizeof(creds), CREDS_DIR "/client");
+  } else {
+    snprintf(creds, sizeof(creds), CREDS_DIR "/client_%d", client_id);
+  }
+  mkdir(creds, 0755);
+  oc_storage_config(creds);
+#endif /* OC_STORAGE */
+
+  char ep_str[64];
+  snprintf(ep_str, sizeof(ep_str), "%s://[::1]:%u", secure ? "coaps" : "coap",
+           port);
+  oc_string_t ep;
+  oc_new_string(&ep, ep_str, strlen(ep_str));
+  int init = oc_string_to_endpoint(&ep, &server_ep, NULL);
+  oc_free_string(&ep);
+
+  if (init == 0) {
+    init = oc_main_init(&handler);
+  }
+  if (init >= 0) {
+    if (!onboarding) {
+      start_load();
+    }
+    run_event_loop();
+  }
+  oc_main_shutdown();
+
+  if (write(result_fd, &result, sizeof(result)) != sizeof(result)) {
+    init = -1;
+  }
+  close(result_fd);
+  return init < 0 ? -1 : 0;
+}
+
+static bool
+read_full(int fd, void *buf, size_t len)
+{
+  uint8_t *p = (uint8_t *)buf;
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static long
+reap(pid_t pid)
+{
+  struct rusage usage;
+  memset(&usage, 0, sizeof(usage));
+  while (wait4(pid, NULL, 0, &usage) < 0 && errno == EINTR) {
+  }
+  return usage.ru_maxrss;
+}
+
+static void
+report(const load_result_t *total, double throughput, long server_rss_kb,
+       long client_rss_kb)
+{
+  double mean = total->completed
+                  ? (double)total->latency_sum_us / (double)total->completed
+                  : 0;
+  unsigned long long p50 = latency_percentile(total, 50);
+  unsigned long long p90 = latency_percentile(total, 90);
+  unsigned long long p99 = latency_percentile(total, 99);
+  unsigned long long p999 = latency_percentile(total, 99.9);
+  if (json) {
+    printf("{\"benchmark\":\"load\",\"mode\":\"%s\",\"secure\":%s,"
+           "\"clients\":%d,\"resources\":%d,\"seconds\":%d,"
+           "\"completed\":%llu,\"errors\":%llu,\"throughput\":%.1f,"
+           "\"latency_us\":{\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,"
+           "\"p99\":%llu,\"p999\":%llu,\"max\":%llu},"
+           "\"server_rss_kb\":%ld,\"client_rss_kb\":%ld}\n",
+           mode_names[mode], secure ? "true" : "false", num_clients,
+           num_resources, seconds, (unsigned long long)total->completed,
+           (unsigned long long)total->errors, throughput, mean, p50, p90, p99,
+           p999, (unsigned long long)total->latency_max_us, server_rss_kb,
+           client_rss_kb);
+    return;
+  }
+  printf("%s over %s, %d clients, %d resources, %d seconds\n",
+         mode_names[mode], secure ? "DTLS" : "UDP", num_clients, num_resources,
+         seconds);
+  printf("completed: %llu, errors: %llu, throughput: %.1f/s\n",
+         (unsigned long long)total->completed,
+         (unsigned long long)total->errors, throughput);
+  printf("latency: mean %.1f us, p50 %llu us, p90 %llu us, p99 %llu us, "
+         "p99.9 %llu us, max %llu us\n",
+         mean, p50, p90, p99, p999, (unsigned long long)total->latency_max_us);
+  printf("peak rss: server %ld kB, client %ld kB\n", server_rss_kb,
+         client_rss_kb);
+}
+
+static void
+usage(const char *name)
+{
+  printf("usage: %s [-j] [-s] [-o] [-m get|post|observe] [-c clients(1-%d)] "
+         "[-r resources(1-%d)] [-t seconds]\n",
+         name, MAX_CLIENTS, MAX_RESOURCES);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "jsom:c:r:t:")) != -1) {
+    switch (opt) {
+    case 'j':
+      json = true;
+      break;
+    case 's':
+      secure = true;
+      break;
+    case 'o':
+      onboarding = true;
+      break;
+    case 'm':
+      if (strcmp(optarg, "get") == 0) {
+        mode = LOAD_GET;
+      } else if (strcmp(optarg, "post") == 0) {
+        mode = LOAD_POST;
+      } else if (strcmp(optarg, "observe") == 0) {
+        mode = LOAD_OBSERVE;
+      } else {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'c':
+      num_clients = atoi(optarg);
+      break;
+    case 'r':
+      num_resources = atoi(optarg);
+      break;
+    case 't':
+      seconds = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (num_clients < 1 || num_clients > MAX_CLIENTS || num_resources < 1 ||
+      num_resources > MAX_RESOURCES || seconds < 1) {
+    usage(argv[0]);
+    return -1;
+  }
+  if (onboarding) {
+    num_clients = 1;
+  }
+
+  int i;
+  for (i = 0; i < num_resources; i++) {
+    snprintf(uris[i], sizeof(uris[i]), "/load/%d", i);
+  }
+  mkdir(CREDS_DIR, 0755);
+  mkdir(CREDS_DIR "/server", 0755);
+
+  struct sigaction sa;
+  sigfillset(&sa.sa_mask);
+  sa.sa_flags = 0;
+  sa.sa_handler = handle_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&cv, NULL);
+
+  int port_pipe[2];
+  if (pipe(port_pipe) < 0) {
+    printf("pipe failed\n");
+    return -1;
+  }
+  pid_t server = fork();
+  if (server < 0) {
+    printf("fork failed\n");
+    return -1;
+  }
+  if (server == 0) {
+    close(port_pipe[0]);
+    return run_server(port_pipe[1]);
+  }
+  close(port_pipe[1]);
+  uint16_t port = 0;
+  if (!read_full(port_pipe[0], &port, sizeof(port)) || port == 0) {
+    printf("the server has no %s endpoint\n",
+           secure ? "secured UDP, build with SECURE=1"
+                  : "unsecured UDP, build with SECURE=0");
+    kill(server, SIGTERM);
+    reap(server);
+    return -1;
+  }
+  close(port_pipe[0]);
+
+  pid_t clients[MAX_CLIENTS];
+  int result_fds[MAX_CLIENTS];
+  int started = 0;
+  for (i = 0; i < num_clients; i++) {
+    int result_pipe[2];
+    if (pipe(result_pipe) < 0) {
+      break;
+    }
+    clients[i] = fork();
+    if (clients[i] == 0) {
+      close(result_pipe[0]);
+      client_id = i;
+      return run_client(port, result_pipe[1]);
+    }
+    close(result_pipe[1]);
+    if (clients[i] < 0) {
+      close(result_pipe[0]);
+      break;
+    }
+    result_fds[i] = result_pipe[0];
+    started++;
+  }
+
+  load_result_t total, client_result;
+  memset(&total, 0, sizeof(total));
+  double throughput = 0;
+  long client_rss_kb = 0;
+  for (i = 0; i < started; i++) {
+    if (read_full(result_fds[i], &client_result, sizeof(client_result))) {
+      total.completed += client_result.completed;
+      total.errors += client_result.errors;
+      total.latency_sum_us += client_result.latency_sum_us;
+      if (client_result.latency_max_us > total.latency_max_us) {
+        total.latency_max_us = client_result.latency_max_us;
+      }
+      unsigned int b;
+      for (b = 0; b < LATENCY_BUCKETS; b++) {
+        total.latency[b] += client_result.latency[b];
+      }
+      if (client_result.elapsed_us > 0) {
+        throughput += (double)client_result.completed * 1000000 /
+                      (double)client_result.elapsed_us;
+      }
+    }
+    close(result_fds[i]);
+    long rss_kb = reap(clients[i]);
+    if (rss_kb > client_rss_kb) {
+      client_rss_kb = rss_kb;
+    }
+  }
+
+  kill(server, SIGTERM);
+  long server_rss_kb = reap(server);
+
+  if (!onboarding) {
+    report(&total, throughput, server_rss_kb, client_rss_kb);
+  }
+
+  pthread_cond_destroy(&cv);
+  pthread_mutex_destroy(&mutex);
+  return started == num_clients ? 0 : -1;
+}
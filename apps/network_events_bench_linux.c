@@ -0,0 +1,206 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/* Network event handoff contention benchmark.
+ *
+ * Several threads act as network threads: each allocates messages, fills in
+ * an empty CoAP ACK and hands it to the stack with oc_network_event(), as
+ * the receive path of a port does. The event loop runs on the main thread,
+ * waiting on the eventfd from port/oc_event_loop_fd.h. The benchmark ends
+ * once every message has been consumed and its buffer released.
+ *
+ * usage: network_events_bench_linux [threads] [messages per thread]
+ */
+
+#include "oc_api.h"
+#include "oc_buffer.h"
+#include "oc_network_events.h"
+#include "port/oc_event_loop_fd.h"
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_THREADS (64)
+
+typedef struct
+{
+  pthread_t thread;
+  int id;
+  unsigned long sent;
+  unsigned long allocation_failures;
+} producer_t;
+
+static producer_t producers[MAX_THREADS];
+static unsigned long messages_per_thread = 100000;
+static int producers_running;
+
+static int
+app_init(void)
+{
+  int ret = oc_init_platform("OCF", NULL, NULL);
+  ret |= oc_add_device("/oic/d", "oic.d.bench", "Bench", "ocf.1.0.0",
+                       "ocf.res.1.0.0", NULL, NULL);
+  return ret;
+}
+
+static uint64_t
+now_us(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static uint32_t
+buffers_in_use(void)
+{
+  uint32_t in_use = 0;
+  int c;
+  for (c = 0; c < OC_MESSAGE_BUFFER_NUM_CLASSES; c++) {
+    oc_message_buffer_stats_t stats;
+    if (oc_message_buffer_get_stats((oc_message_buffer_class_t)c, &stats)) {
+      in_use += stats.in_use;
+    }
+  }
+  return in_use;
+}
+
+static void *
+producer_func(void *data)
+{
+  producer_t *producer = (producer_t *)data;
+  uint16_t mid = 0;
+
+  while (producer->sent < messages_per_thread) {
+    oc_message_t *message = oc_allocate_message();
+    if (!message) {
+      producer->allocation_failures++;
+      sched_yield();
+      continue;
+    }
+    mid++;
+    message->data[0] = 0x60; /* version 1, ACK, no token */
+    message->data[1] = 0;    /* empty message */
+    message->data[2] = (uint8_t)(mid >> 8);
+    message->data[3] = (uint8_t)mid;
+    message->length = 4;
+    message->endpoint.flags = IPV6;
+    message->endpoint.device = 0;
+    message->endpoint.addr.ipv6.address[15] = 1;
+    message->endpoint.addr.ipv6.port = (uint16_t)(5684 + producer->id);
+    oc_network_event(message);
+    producer->sent++;
+  }
+
+  __atomic_sub_fetch(&producers_running, 1, __ATOMIC_RELEASE);
+  oc_event_loop_fd_signal();
+  return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int num_threads = (argc > 1) ? atoi(argv[1]) : 4;
+  if (argc > 2) {
+    messages_per_thread = strtoul(argv[2], NULL, 10);
+  }
+  if (num_threads < 1 || num_threads > MAX_THREADS) {
+    printf("usage: %s [threads(1-%d)] [messages per thread]\n", argv[0],
+           MAX_THREADS);
+    return -1;
+  }
+
+  int fd = oc_event_loop_fd_open();
+  if (fd < 0) {
+    printf("oc_event_loop_fd_open failed!\n");
+    return -1;
+  }
+
+  static const oc_handler_t handler = {.init = app_init,
+                                       .signal_event_loop =
+                                         oc_event_loop_fd_signal };
+
+#ifdef OC_STORAGE
+  oc_storage_config("./network_events_bench_linux_creds");
+#endif /* OC_STORAGE */
+
+  int init = oc_main_init(&handler);
+  if (init < 0) {
+    printf("oc_main_init failed!(%d)\n", init);
+    oc_event_loop_fd_close();
+    return init;
+  }
+
+  uint32_t idle_in_use = buffers_in_use();
+  unsigned long wakeups = 0;
+  int i, started = 0;
+
+  uint64_t start = now_us();
+  producers_running = num_threads;
+  for (i = 0; i < num_threads; i++) {
+    producers[i].id = i;
+    if (pthread_create(&producers[i].thread, NULL, producer_func,
+                       &producers[i]) != 0) {
+      printf("Failed to create producer thread\n");
+      __atomic_sub_fetch(&producers_running, num_threads - i,
+                         __ATOMIC_RELEASE);
+      break;
+    }
+    started++;
+  }
+
+  for (;;) {
+    oc_clock_time_t next_event = oc_main_poll();
+    if (__atomic_load_n(&producers_running, __ATOMIC_ACQUIRE) == 0 &&
+        buffers_in_use() <= idle_in_use) {
+      break;
+    }
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int timeout = -1;
+    if (next_event > 0) {
+      oc_clock_time_t now = oc_clock_time();
+      timeout = (next_event > now)
+                  ? (int)((next_event - now) * 1000 / OC_CLOCK_SECOND)
+                  : 0;
+    }
+    if (poll(&pfd, 1, timeout) > 0) {
+      wakeups++;
+    }
+    oc_event_loop_fd_clear();
+  }
+  uint64_t elapsed_us = now_us() - start;
+
+  unsigned long sent = 0, allocation_failures = 0;
+  for (i = 0; i < started; i++) {
+    pthread_join(producers[i].thread, NULL);
+    sent += producers[i].sent;
+    allocation_failures += producers[i].allocation_failures;
+  }
+
+  printf("%d threads, %lu messages in %llu us\n", started, sent,
+         (unsigned long long)elapsed_us);
+  printf("throughput: %.1f messages/s\n",
+         (double)sent * 1000000 / (double)elapsed_us);
+  printf("event loop wakeups: %lu, allocation failures: %lu\n", wakeups,
+         allocation_failures);
+
+  oc_main_shutdown();
+  oc_event_loop_fd_close();
+  return 0;
+}
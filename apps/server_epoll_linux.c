@@ -0,0 +1,217 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/* Light server embedded in an epoll based event loop.
+ *
+ * The stack is built with "make EXTERNAL_LOOP=1" and starts no threads: the
+ * epoll loop below watches the sockets of the stack and calls
+ * oc_main_on_readable(), oc_main_on_writable() and oc_main_on_timeout() on
+ * the main thread.
+ */
+
+#include "oc_api.h"
+#include "port/oc_clock.h"
+#include "port/oc_event_loop_fd.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+
+#ifndef OC_EXTERNAL_EVENT_LOOP
+#error "build the stack with EXTERNAL_LOOP=1"
+#endif /* !OC_EXTERNAL_EVENT_LOOP */
+
+#define MAX_EVENTS (16)
+
+static int epoll_fd = -1;
+static int wakeup_fd = -1;
+static volatile sig_atomic_t quit = 0;
+static bool light_state = false;
+
+static int
+app_init(void)
+{
+  int ret = oc_init_platform("Intel", NULL, NULL);
+  ret |= oc_add_device("/oic/d", "oic.d.light", "Epoll light", "ocf.1.0.0",
+                       "ocf.res.1.0.0", NULL, NULL);
+  return ret;
+}
+
+static void
+get_light(oc_request_t *request, oc_interface_mask_t iface_mask,
+          void *user_data)
+{
+  (void)user_data;
+  oc_rep_start_root_object();
+  switch (iface_mask) {
+  case OC_IF_BASELINE:
+    oc_process_baseline_interface(request->resource);
+  /* fall through */
+  case OC_IF_RW:
+    oc_rep_set_boolean(root, state, light_state);
+    break;
+  default:
+    break;
+  }
+  oc_rep_end_root_object();
+  oc_send_response(request, OC_STATUS_OK);
+}
+
+static void
+post_light(oc_request_t *request, oc_interface_mask_t iface_mask,
+           void *user_data)
+{
+  (void)iface_mask;
+  (void)user_data;
+  bool state = light_state;
+  oc_rep_t *rep = request->request_payload;
+  while (rep != NULL) {
+    if (rep->type != OC_REP_BOOL) {
+      oc_send_response(request, OC_STATUS_BAD_REQUEST);
+      return;
+    }
+    state = rep->value.boolean;
+    rep = rep->next;
+  }
+  light_state = state;
+  PRINT("Light state %d\n", light_state);
+  oc_send_response(request, OC_STATUS_CHANGED);
+}
+
+static void
+register_resources(void)
+{
+  oc_resource_t *res = oc_new_resource("lightbulb", "/light/1", 1, 0);
+  oc_resource_bind_resource_type(res, "oic.r.light");
+  oc_resource_bind_resource_interface(res, OC_IF_RW);
+  oc_resource_set_default_interface(res, OC_IF_RW);
+  oc_resource_set_discoverable(res, true);
+  oc_resource_set_request_handler(res, OC_GET, get_light, NULL);
+  oc_resource_set_request_handler(res, OC_POST, post_light, NULL);
+  oc_add_resource(res);
+}
+
+static void
+watch_fd(int fd, unsigned events, void *user_data)
+{
+  (void)user_data;
+  if (events == 0) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    return;
+  }
+  struct epoll_event ev = { 0 };
+  ev.data.fd = fd;
+  ev.events = ((events & OC_FD_READABLE) ? EPOLLIN : 0) |
+              ((events & OC_FD_WRITABLE) ? EPOLLOUT : 0);
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0 && errno == ENOENT) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+static int
+timeout_ms(oc_clock_time_t next_event)
+{
+  if (next_event == 0) {
+    return -1;
+  }
+  oc_clock_time_t now = oc_clock_time();
+  if (next_event <= now) {
+    return 0;
+  }
+  /* round up so that the timer is due when the loop wakes up */
+  return (int)(((next_event - now) * 1000 + OC_CLOCK_SECOND - 1) /
+               OC_CLOCK_SECOND);
+}
+
+static void
+handle_signal(int signal)
+{
+  (void)signal;
+  quit = 1;
+  oc_event_loop_fd_signal();
+}
+
+int
+main(void)
+{
+  struct sigaction sa;
+  sigfillset(&sa.sa_mask);
+  sa.sa_flags = 0;
+  sa.sa_handler = handle_signal;
+  sigaction(SIGINT, &sa, NULL);
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  wakeup_fd = oc_event_loop_fd_open();
+  if (epoll_fd < 0 || wakeup_fd < 0) {
+    PRINT("could not set up the event loop\n");
+    return -1;
+  }
+  struct epoll_event wakeup = { 0 };
+  wakeup.events = EPOLLIN;
+  wakeup.data.fd = wakeup_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &wakeup);
+
+  static const oc_handler_t handler = {.init = app_init,
+                                       .signal_event_loop =
+                                         oc_event_loop_fd_signal,
+                                       .register_resources =
+                                         register_resources };
+
+#ifdef OC_STORAGE
+  oc_storage_config("./server_epoll_linux_creds");
+#endif /* OC_STORAGE */
+
+  oc_set_fd_watch_callback(watch_fd, NULL);
+  int init = oc_main_init(&handler);
+  if (init < 0) {
+    oc_event_loop_fd_close();
+    return init;
+  }
+
+  oc_clock_time_t next_event = oc_main_on_timeout();
+  while (quit != 1) {
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms(next_event));
+    if (n < 0 && errno != EINTR) {
+      break;
+    }
+    bool run_timers = (n <= 0);
+    int i;
+    for (i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == wakeup_fd) {
+        oc_event_loop_fd_clear();
+        run_timers = true;
+        continue;
+      }
+      if (events[i].events & (EPOLLOUT | EPOLLERR)) {
+        next_event = oc_main_on_writable(fd);
+      }
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        next_event = oc_main_on_readable(fd);
+      }
+    }
+    /* due timers, and work signaled through the wakeup descriptor */
+    if (run_timers || (next_event > 0 && next_event <= oc_clock_time())) {
+      next_event = oc_main_on_timeout();
+    }
+  }
+
+  oc_main_shutdown();
+  oc_event_loop_fd_close();
+  return 0;
+}
@@ -16,186 +16,120 @@
  *
  ****************************************************************************/
 
+/* Request processing scaling benchmark.
+ *
+ * The server exposes a concurrent resource whose GET handler burns a
+ * configurable amount of CPU per request. Load generator threads in the same
+ * process each keep one request outstanding over their own UDP socket, so
+ * every one of them is a distinct peer for the stack. Build the stack with
+ * "make WORKERS=<n> SECURE=0" to run the handlers on <n> worker threads, and
+ * without WORKERS to measure the single threaded event loop. Comparing builds
+ * with and without IO_URING=1 measures the receive path of the network
+ * thread.
+ *
+ * usage: server_multithread_linux [clients] [seconds] [work]
+ */
+
 #include "oc_api.h"
-#include "oc_core_res.h"
 #include "port/oc_clock.h"
 #include "port/oc_connectivity.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef OC_WORKER_THREADS
+#define NUM_WORKERS OC_WORKER_THREADS
+#else /* OC_WORKER_THREADS */
+#define NUM_WORKERS 0
+#endif /* !OC_WORKER_THREADS */
+
+#define MAX_CLIENTS (256)
+#define COAP_NON_GET_HEADER (0x54) /* version 1, NON, 4 byte token */
+#define COAP_GET (0x01)
+#define COAP_URI_PATH_BENCH (0xB5) /* option 11, 5 bytes */
 
-// define application specific values.
 static const char *spec_version = "ocf.1.0.0";
 static const char *data_model_version = "ocf.res.1.0.0";
 
-static const char *resource_uri = "/a/light";
-static const char *resource_rt = "core.light";
-static const char *additional_rt = "core.brightlight";
-static const char *resource_name = "Samsung's Light";
+static const char *resource_uri = "/bench";
+static const char *resource_rt = "x.org.iotivity.bench";
 
-static const char *device_rt = "oic.d.light";
-static const char *device_name = "Light";
+static const char *device_rt = "oic.d.bench";
+static const char *device_name = "Bench";
 
-static const char *manufacturer = "Samsung";
+static const char *manufacturer = "OCF";
 
-static bool discoverable = true;
-static bool observable = true;
-
-pthread_mutex_t mutex;
-pthread_cond_t cv;
-struct timespec ts;
-
-pthread_mutex_t app_mutex;
-oc_resource_t *res;
+typedef struct
+{
+  pthread_t thread;
+  uint16_t id;
+  uint64_t completed;
+  uint64_t timeouts;
+  uint64_t latency_sum_us;
+  uint64_t latency_max_us;
+} load_client_t;
 
-int quit = 0;
+static pthread_mutex_t mutex;
+static pthread_cond_t cv;
+static struct timespec ts;
 
-static bool is_separate_response = false;
-static bool state = false;
-int power;
-oc_string_t name;
-static oc_separate_response_t sep_response;
+static volatile sig_atomic_t quit = 0;
+static volatile sig_atomic_t stop_load = 0;
 
-oc_define_interrupt_handler(observe)
-{
-  oc_notify_observers(res);
-}
+static long work = 20000;
+static struct sockaddr_storage server_addr;
+static socklen_t server_addr_len;
+static load_client_t clients[MAX_CLIENTS];
 
 static int
 app_init(void)
 {
-  oc_activate_interrupt_handler(observe);
   int ret = oc_init_platform(manufacturer, NULL, NULL);
   ret |= oc_add_device("/oic/d", device_rt, device_name, spec_version,
                        data_model_version, NULL, NULL);
-  oc_new_string(&name, resource_name, strlen(resource_name));
   return ret;
 }
 
-static oc_event_callback_retval_t
-handle_separate_response(void *data)
-{
-  (void)data;
-  if (sep_response.active) {
-    oc_set_separate_response_buffer(&sep_response);
-    printf("handle_separate_response:\n");
-    oc_rep_start_root_object();
-    oc_rep_set_boolean(root, state, state);
-    oc_rep_set_int(root, power, power);
-    oc_rep_set_text_string(root, name, oc_string(name));
-    oc_rep_end_root_object();
-    oc_send_separate_response(&sep_response, OC_STATUS_OK);
-  }
-  return OC_EVENT_DONE;
-}
-
+/* Runs on a worker thread when the stack is built with OC_WORKER_THREADS, so
+ * it only reads the request and encodes its response.
+ */
 static void
 get_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
             void *user_data)
 {
+  (void)iface_mask;
   (void)user_data;
 
-  printf("get_handler:\n");
-  if (is_separate_response) {
-    oc_indicate_separate_response(request, &sep_response);
-    oc_set_delayed_callback(NULL, &handle_separate_response, 1);
-    return;
+  /* stand-in for the per-request work of a real resource */
+  uint32_t hash = 2166136261u;
+  long i;
+  for (i = 0; i < work; i++) {
+    hash = (hash ^ (uint8_t)i) * 16777619u;
   }
 
   oc_rep_start_root_object();
-  switch (iface_mask) {
-  case OC_IF_BASELINE:
-    oc_process_baseline_interface(request->resource);
-  /* fall through */
-  case OC_IF_RW:
-    oc_rep_set_boolean(root, state, state);
-    oc_rep_set_int(root, power, power);
-    oc_rep_set_text_string(root, name, oc_string(name));
-    break;
-  default:
-    break;
-  }
+  oc_rep_set_int(root, hash, hash);
   oc_rep_end_root_object();
   oc_send_response(request, OC_STATUS_OK);
 }
 
-static void
-post_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
-             void *user_data)
-{
-  (void)iface_mask;
-  (void)user_data;
-  printf("post_handler:\n");
-  printf("  Key : Value\n");
-  oc_rep_t *rep = request->request_payload;
-  while (rep != NULL) {
-    printf("  %s :", oc_string(rep->name));
-    switch (rep->type) {
-    case OC_REP_BOOL:
-      state = rep->value.boolean;
-      printf("%d\n", state);
-      break;
-    case OC_REP_INT:
-      power = (int)rep->value.integer;
-      printf("%d\n", power);
-      break;
-    case OC_REP_STRING:
-      oc_free_string(&name);
-      oc_new_string(&name, oc_string(rep->value.string),
-                    oc_string_len(rep->value.string));
-      break;
-    default:
-      oc_send_response(request, OC_STATUS_BAD_REQUEST);
-      return;
-      break;
-    }
-    rep = rep->next;
-  }
-  oc_send_response(request, OC_STATUS_CHANGED);
-}
-
-static void
-put_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
-            void *user_data)
-{
-  (void)iface_mask;
-  (void)user_data;
-  post_handler(request, iface_mask, user_data);
-}
-
-static void
-change_state(void)
-{
-  state = !state;
-  oc_signal_interrupt_handler(observe);
-}
-
-static void
-change_power(void)
-{
-  power += 5;
-  oc_signal_interrupt_handler(observe);
-}
-
-static void
-change_separate_response_policy(void)
-{
-  is_separate_response = !is_separate_response;
-}
-
 static void
 register_resources(void)
 {
-  res = oc_new_resource(NULL, resource_uri, 2, 0);
+  oc_resource_t *res = oc_new_resource(NULL, resource_uri, 1, 0);
   oc_resource_bind_resource_type(res, resource_rt);
-  oc_resource_bind_resource_type(res, additional_rt);
-  oc_resource_bind_resource_interface(res, OC_IF_RW);
-  oc_resource_set_default_interface(res, OC_IF_RW);
-  oc_resource_set_discoverable(res, discoverable);
-  oc_resource_set_observable(res, observable);
+  oc_resource_bind_resource_interface(res, OC_IF_R);
+  oc_resource_set_default_interface(res, OC_IF_R);
+  oc_resource_set_discoverable(res, true);
+  oc_resource_set_concurrent(res, true);
   oc_resource_set_request_handler(res, OC_GET, get_handler, NULL);
-  oc_resource_set_request_handler(res, OC_PUT, put_handler, NULL);
-  oc_resource_set_request_handler(res, OC_POST, post_handler, NULL);
   oc_add_resource(res);
 }
 
@@ -211,8 +145,7 @@ void
 handle_signal(int signal)
 {
   (void)signal;
-  signal_event_loop();
-  quit = 1;
+  stop_load = 1;
 }
 
 static void *
@@ -222,9 +155,7 @@ process_func(void *data)
   oc_clock_time_t next_event;
 
   while (quit != 1) {
-    pthread_mutex_lock(&app_mutex);
     next_event = oc_main_poll();
-    pthread_mutex_unlock(&app_mutex);
     pthread_mutex_lock(&mutex);
     if (next_event == 0) {
       pthread_cond_wait(&cv, &mutex);
@@ -239,23 +170,119 @@ process_func(void *data)
   pthread_exit(0);
 }
 
-void
-print_menu(void)
+static uint64_t
+now_us(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static bool
+find_server_address(void)
+{
+  oc_endpoint_t *ep = oc_connectivity_get_endpoints(0);
+  for (; ep; ep = ep->next) {
+    if (ep->flags & (SECURED | TCP)) {
+      continue;
+    }
+    memset(&server_addr, 0, sizeof(server_addr));
+    if (ep->flags & IPV6) {
+      struct sockaddr_in6 *addr = (struct sockaddr_in6 *)&server_addr;
+      addr->sin6_family = AF_INET6;
+      addr->sin6_addr = in6addr_loopback;
+      addr->sin6_port = htons(ep->addr.ipv6.port);
+      server_addr_len = sizeof(struct sockaddr_in6);
+      return true;
+    }
+#ifdef OC_IPV4
+    if (ep->flags & IPV4) {
+      struct sockaddr_in *addr = (struct sockaddr_in *)&server_addr;
+      addr->sin_family = AF_INET;
+      addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr->sin_port = htons(ep->addr.ipv4.port);
+      server_addr_len = sizeof(struct sockaddr_in);
+      return true;
+    }
+#endif /* OC_IPV4 */
+  }
+  return false;
+}
+
+static void *
+load_func(void *data)
 {
-  pthread_mutex_lock(&app_mutex);
-  printf("=====================================\n");
-  printf("1. Change my state(%d)\n", state);
-  printf("2. Change my power(%d)\n", power);
-  printf("3. Change separate response policy(%d)\n", is_separate_response);
-  printf("0. Quit\n");
-  printf("=====================================\n");
-  pthread_mutex_unlock(&app_mutex);
+  load_client_t *client = (load_client_t *)data;
+  int sock = socket(server_addr.ss_family, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    printf("client %d: socket failed\n", client->id);
+    return NULL;
+  }
+  struct timeval timeout = { 1, 0 };
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  uint8_t request[16], response[256];
+  uint16_t mid = (uint16_t)(client->id << 8);
+  size_t len = 0;
+  request[len++] = COAP_NON_GET_HEADER;
+  request[len++] = COAP_GET;
+  len += 2; /* message id */
+  request[len++] = (uint8_t)(client->id >> 8);
+  request[len++] = (uint8_t)client->id;
+  len += 2; /* token sequence number */
+  request[len++] = COAP_URI_PATH_BENCH;
+  memcpy(&request[len], "bench", 5);
+  len += 5;
+
+  while (stop_load != 1) {
+    mid++;
+    request[2] = request[6] = (uint8_t)(mid >> 8);
+    request[3] = request[7] = (uint8_t)mid;
+
+    uint64_t start = now_us();
+    if (sendto(sock, request, len, 0, (struct sockaddr *)&server_addr,
+               server_addr_len) < 0) {
+      break;
+    }
+    for (;;) {
+      ssize_t n = recv(sock, response, sizeof(response), 0);
+      if (n < 0) {
+        client->timeouts++;
+        break;
+      }
+      /* skip stale responses to requests that had timed out */
+      if (n >= 8 && (response[0] & 0x0f) == 4 &&
+          memcmp(&response[4], &request[4], 4) == 0) {
+        uint64_t latency = now_us() - start;
+        client->completed++;
+        client->latency_sum_us += latency;
+        if (latency > client->latency_max_us) {
+          client->latency_max_us = latency;
+        }
+        break;
+      }
+    }
+  }
+
+  close(sock);
+  return NULL;
 }
 
 int
-main(void)
+main(int argc, char *argv[])
 {
   int init = 0;
+  int num_clients = (argc > 1) ? atoi(argv[1]) : 8;
+  int seconds = (argc > 2) ? atoi(argv[2]) : 10;
+  if (argc > 3) {
+    work = atol(argv[3]);
+  }
+  if (num_clients < 1 || num_clients > MAX_CLIENTS || seconds < 1) {
+    printf("usage: %s [clients(1-%d)] [seconds] [work]\n", argv[0],
+           MAX_CLIENTS);
+    return -1;
+  }
+
   struct sigaction sa;
   sigfillset(&sa.sa_mask);
   sa.sa_flags = 0;
@@ -275,12 +302,7 @@ main(void)
     printf("pthread_mutex_init failed!\n");
     return -1;
   }
-
-  if (pthread_mutex_init(&app_mutex, NULL) < 0) {
-    printf("pthread_mutex_init failed!\n");
-    pthread_mutex_destroy(&mutex);
-    return -1;
-  }
+  pthread_cond_init(&cv, NULL);
 
   init = oc_main_init(&handler);
   if (init < 0) {
@@ -288,19 +310,10 @@ main(void)
     goto exit;
   }
 
-  size_t device_num = oc_core_get_num_devices();
-  size_t i;
-  for (i = 0; i < device_num; i++) {
-    oc_endpoint_t *ep = oc_connectivity_get_endpoints(i);
-    printf("=== device(%zd) endpoint info. ===\n", i);
-    while (ep) {
-      oc_string_t ep_str;
-      if (oc_endpoint_to_string(ep, &ep_str) == 0) {
-        printf("-> %s\n", oc_string(ep_str));
-        oc_free_string(&ep_str);
-      }
-      ep = ep->next;
-    }
+  if (!find_server_address()) {
+    printf("no unsecured UDP endpoint, build with SECURE=0\n");
+    init = -1;
+    goto exit;
   }
 
   pthread_t thread;
@@ -310,46 +323,56 @@ main(void)
     goto exit;
   }
 
-  int key;
-  while (quit != 1) {
-    print_menu();
-    fflush(stdin);
-    if (!scanf("%d", &key)) {
-      printf("scanf failed!!!!\n");
-      quit = 1;
-      handle_signal(0);
+  printf("%d worker threads, %d clients, %d seconds, work %ld\n", NUM_WORKERS,
+         num_clients, seconds, work);
+
+  int i, started = 0;
+  for (i = 0; i < num_clients; i++) {
+    clients[i].id = (uint16_t)i;
+    if (pthread_create(&clients[i].thread, NULL, load_func, &clients[i]) !=
+        0) {
+      printf("Failed to create client thread\n");
       break;
     }
+    started++;
+  }
 
-    pthread_mutex_lock(&app_mutex);
-    switch (key) {
-    case 1:
-      change_state();
-      break;
-    case 2:
-      change_power();
-      break;
-    case 3:
-      change_separate_response_policy();
-      break;
-    case 0:
-      quit = 1;
-      handle_signal(0);
-      break;
-    default:
-      printf("unsupported command.\n");
-      break;
+  uint64_t start = now_us();
+  while (stop_load != 1 && now_us() - start < (uint64_t)seconds * 1000000) {
+    usleep(100000);
+  }
+  stop_load = 1;
+  uint64_t elapsed_us = now_us() - start;
+
+  uint64_t completed = 0, timeouts = 0, latency_sum = 0, latency_max = 0;
+  for (i = 0; i < started; i++) {
+    pthread_join(clients[i].thread, NULL);
+    completed += clients[i].completed;
+    timeouts += clients[i].timeouts;
+    latency_sum += clients[i].latency_sum_us;
+    if (clients[i].latency_max_us > latency_max) {
+      latency_max = clients[i].latency_max_us;
     }
-    pthread_mutex_unlock(&app_mutex);
   }
 
+  quit = 1;
+  signal_event_loop();
   pthread_join(thread, NULL);
-  printf("pthread_join finish!\n");
+
+  printf("requests: %llu, timeouts: %llu\n", (unsigned long long)completed,
+         (unsigned long long)timeouts);
+  printf("throughput: %.1f requests/s\n",
+         (double)completed * 1000000 / (double)elapsed_us);
+  if (completed > 0) {
+    printf("latency: avg %.1f us, max %llu us\n",
+           (double)latency_sum / (double)completed,
+           (unsigned long long)latency_max);
+  }
 
 exit:
   oc_main_shutdown();
 
+  pthread_cond_destroy(&cv);
   pthread_mutex_destroy(&mutex);
-  pthread_mutex_destroy(&app_mutex);
-  return 0;
+  return init < 0 ? -1 : 0;
 }
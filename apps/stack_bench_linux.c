@@ -0,0 +1,345 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/* Stack microbenchmarks.
+ *
+ * Times the hot paths of a request in isolation, each in a loop over the
+ * same input: serializing and parsing a CoAP request, encoding and parsing
+ * a representation, looking up an application resource by URI among
+ * [resources] others, the access control check of a discovery request
+ * (SECURE builds), allocating from an object pool and from the message
+ * buffers, and arming and cancelling a timed event callback.
+ *
+ * With -j every result is printed as one JSON object per line, for tracking
+ * the figures across builds.
+ *
+ * usage: stack_bench_linux [-j] [iterations] [resources]
+ */
+
+#include "messaging/coap/coap.h"
+#include "oc_api.h"
+#include "oc_buffer.h"
+#include "oc_core_res.h"
+#include "util/oc_memb.h"
+#ifdef OC_SECURITY
+#include "security/oc_acl_internal.h"
+#endif /* OC_SECURITY */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_RESOURCES (1024)
+#define PAYLOAD_SIZE (256)
+#define REQUEST_SIZE (PAYLOAD_SIZE + 64)
+
+typedef struct bench_object_t
+{
+  struct bench_object_t *next;
+  uint8_t data[48];
+} bench_object_t;
+
+OC_MEMB(bench_objects, bench_object_t, 8);
+
+static unsigned long iterations = 100000;
+static int num_resources = 64;
+static bool json;
+static volatile uint64_t sink;
+static int timer_data;
+
+static uint8_t request[REQUEST_SIZE];
+static size_t request_len;
+static uint8_t payload[PAYLOAD_SIZE];
+static int payload_len;
+static char uris[MAX_RESOURCES][16];
+static oc_endpoint_t peer;
+
+static int
+app_init(void)
+{
+  int ret = oc_init_platform("OCF", NULL, NULL);
+  ret |= oc_add_device("/oic/d", "oic.d.bench", "Bench", "ocf.1.0.0",
+                       "ocf.res.1.0.0", NULL, NULL);
+  return ret;
+}
+
+static void
+get_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
+            void *user_data)
+{
+  (void)iface_mask;
+  (void)user_data;
+  oc_send_response(request, OC_STATUS_OK);
+}
+
+static void
+register_resources(void)
+{
+  int i;
+  for (i = 0; i < num_resources; i++) {
+    snprintf(uris[i], sizeof(uris[i]), "/bench/%d", i);
+    oc_resource_t *res = oc_new_resource(NULL, uris[i], 1, 0);
+    oc_resource_bind_resource_type(res, "x.org.iotivity.bench");
+    oc_resource_bind_resource_interface(res, OC_IF_RW);
+    oc_resource_set_default_interface(res, OC_IF_RW);
+    oc_resource_set_request_handler(res, OC_GET, get_handler, NULL);
+    oc_add_resource(res);
+  }
+}
+
+static void
+signal_event_loop(void)
+{
+}
+
+static uint64_t
+now_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void
+report(const char *name, uint64_t elapsed_ns)
+{
+  double ns_per_op = (double)elapsed_ns / (double)iterations;
+  if (json) {
+    printf("{\"benchmark\":\"%s\",\"iterations\":%lu,\"ns_per_op\":%.1f,"
+           "\"ops_per_s\":%.0f}\n",
+           name, iterations, ns_per_op, 1.e9 / ns_per_op);
+  } else {
+    printf("%-20s %10.1f ns/op %12.0f ops/s\n", name, ns_per_op,
+           1.e9 / ns_per_op);
+  }
+}
+
+static size_t
+serialize_request(uint16_t mid)
+{
+  static const uint8_t token[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  coap_packet_t packet[1];
+  coap_udp_init_message(packet, COAP_TYPE_CON, COAP_POST, mid);
+  coap_set_token(packet, token, sizeof(token));
+  coap_set_header_uri_path(packet, uris[num_resources / 2] + 1,
+                           strlen(uris[num_resources / 2]) - 1);
+  coap_set_header_uri_query(packet, "if=oic.if.rw");
+  coap_set_header_content_format(packet, APPLICATION_VND_OCF_CBOR);
+  coap_set_header_accept(packet, APPLICATION_VND_OCF_CBOR);
+  coap_set_payload(packet, payload, (size_t)payload_len);
+  return coap_serialize_message(packet, request);
+}
+
+static void
+bench_coap_serialize(void)
+{
+  unsigned long i;
+  uint64_t start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    sink += serialize_request((uint16_t)i);
+  }
+  report("coap_serialize", now_ns() - start);
+}
+
+static void
+bench_coap_parse(void)
+{
+  uint8_t data[REQUEST_SIZE];
+  coap_packet_t packet[1];
+  unsigned long i;
+  request_len = serialize_request(1);
+  uint64_t start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    /* parsing merges repeated options in place */
+    memcpy(data, request, request_len);
+    sink += coap_udp_parse_message(packet, data, (uint16_t)request_len);
+  }
+  report("coap_parse", now_ns() - start);
+}
+
+static int
+encode_representation(uint8_t *buffer, int size)
+{
+  static const int64_t values[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  oc_rep_new(buffer, size);
+  oc_rep_start_root_object();
+  oc_rep_set_boolean(root, value, true);
+  oc_rep_set_int(root, dimmingSetting, 72);
+  oc_rep_set_double(root, temperature, 21.5);
+  oc_rep_set_text_string(root, name, "living room light");
+  oc_rep_set_int_array(root, samples, values, 8);
+  oc_rep_end_root_object();
+  return oc_rep_get_encoded_payload_size();
+}
+
+static void
+bench_rep_encode(void)
+{
+  uint8_t buffer[PAYLOAD_SIZE];
+  unsigned long i;
+  uint64_t start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    sink += (uint64_t)encode_representation(buffer, sizeof(buffer));
+  }
+  report("rep_encode", now_ns() - start);
+}
+
+static void
+bench_rep_parse(void)
+{
+  unsigned long i;
+  uint64_t start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    oc_rep_t *rep = NULL;
+    sink += (uint64_t)oc_parse_rep(payload, payload_len, &rep);
+    oc_free_rep(rep);
+  }
+  report("rep_parse", now_ns() - start);
+}
+
+static void
+bench_resource_lookup(void)
+{
+  unsigned long i;
+  uint64_t start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    /* URI paths of requests come without the leading slash */
+    const char *uri = uris[i % (unsigned long)num_resources] + 1;
+    sink += (uintptr_t)oc_ri_get_app_resource_by_uri(uri, strlen(uri), 0);
+  }
+  report("resource_lookup", now_ns() - start);
+}
+
+#ifdef OC_SECURITY
+static void
+bench_acl_check(void)
+{
+  oc_resource_t *resource = oc_core_get_resource_by_index(OCF_RES, 0);
+  unsigned long i;
+  uint64_t start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    sink += oc_sec_check_acl(OC_GET, resource, &peer);
+  }
+  report("acl_check", now_ns() - start);
+}
+#endif /* OC_SECURITY */
+
+static void
+bench_memb_alloc(void)
+{
+  unsigned long i;
+  uint64_t start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    bench_object_t *object = (bench_object_t *)oc_memb_alloc(&bench_objects);
+    sink += (uintptr_t)object;
+    oc_memb_free(&bench_objects, object);
+  }
+  report("memb_alloc_free", now_ns() - start);
+}
+
+static void
+bench_message_alloc(void)
+{
+  unsigned long i;
+  uint64_t start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    oc_message_t *message = oc_allocate_message();
+    sink += (uintptr_t)message;
+    if (message) {
+      oc_message_unref(message);
+    }
+  }
+  report("message_alloc_free", now_ns() - start);
+}
+
+static oc_event_callback_retval_t
+timer_callback(void *data)
+{
+  (void)data;
+  return OC_EVENT_DONE;
+}
+
+static void
+bench_timers(void)
+{
+  unsigned long i;
+  uint64_t start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    oc_ri_add_timed_event_callback_ticks(&timer_data, timer_callback,
+                                         OC_CLOCK_SECOND);
+    oc_ri_remove_timed_event_callback(&timer_data, timer_callback);
+  }
+  report("timer_set_cancel", now_ns() - start);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int arg = 1;
+  if (argc > arg && strcmp(argv[arg], "-j") == 0) {
+    json = true;
+    arg++;
+  }
+  if (argc > arg) {
+    iterations = strtoul(argv[arg++], NULL, 10);
+  }
+  if (argc > arg) {
+    num_resources = atoi(argv[arg++]);
+  }
+  if (iterations == 0 || num_resources < 1 || num_resources > MAX_RESOURCES) {
+    printf("usage: %s [-j] [iterations] [resources(1-%d)]\n", argv[0],
+           MAX_RESOURCES);
+    return -1;
+  }
+
+  static const oc_handler_t handler = {.init = app_init,
+                                       .signal_event_loop = signal_event_loop,
+                                       .register_resources =
+                                         register_resources };
+
+#ifdef OC_STORAGE
+  oc_storage_config("./stack_bench_linux_creds");
+#endif /* OC_STORAGE */
+
+  int init = oc_main_init(&handler);
+  if (init < 0) {
+    printf("oc_main_init failed!(%d)\n", init);
+    return init;
+  }
+
+  payload_len = encode_representation(payload, sizeof(payload));
+  peer.flags = IPV6;
+  peer.addr.ipv6.address[15] = 1;
+  peer.addr.ipv6.port = 5683;
+
+  if (!json) {
+    printf("%lu iterations, %d resources\n", iterations, num_resources);
+  }
+  bench_coap_serialize();
+  bench_coap_parse();
+  bench_rep_encode();
+  bench_rep_parse();
+  bench_resource_lookup();
+#ifdef OC_SECURITY
+  bench_acl_check();
+#endif /* OC_SECURITY */
+  bench_memb_alloc();
+  bench_message_alloc();
+  bench_timers();
+
+  oc_main_shutdown();
+  return 0;
+}
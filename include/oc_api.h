@@ -247,6 +247,84 @@ int oc_main_init(const oc_handler_t *handler);
 
 oc_clock_time_t oc_main_poll(void);
 
+#ifdef OC_EXTERNAL_EVENT_LOOP
+/**
+ * @defgroup doc_module_tag_external_loop External event loop
+ *
+ * When built with OC_EXTERNAL_EVENT_LOOP the stack starts no network threads.
+ * A host event loop (epoll, libuv, io_uring, ...) watches the sockets of the
+ * stack instead and calls the entry points below on the thread that called
+ * oc_main_init(); receiving, processing and sending then all run on that
+ * thread.
+ *
+ * The stack announces its file descriptors through the callback given to
+ * oc_set_fd_watch_callback(), as they are opened, closed or change the events
+ * they wait for. Watch them level triggered.
+ *
+ * Every entry point runs all pending work and returns the absolute time of
+ * the next timer of the stack, as oc_main_poll() does, or 0 if there is
+ * none. Call oc_main_on_timeout() when that time is reached, after
+ * oc_main_init(), and whenever the signal_event_loop callback of the
+ * oc_handler_t runs, e.g. by also watching the descriptor from
+ * port/oc_event_loop_fd.h.
+ *
+ * Example:
+ * ```
+ * static void
+ * watch_fd(int fd, unsigned events, void *user_data)
+ * {
+ *   int epfd = *(int *)user_data;
+ *   struct epoll_event ev = { 0 };
+ *   ev.data.fd = fd;
+ *   ev.events = ((events & OC_FD_READABLE) ? EPOLLIN : 0) |
+ *               ((events & OC_FD_WRITABLE) ? EPOLLOUT : 0);
+ *   if (events == 0) {
+ *     epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+ *   } else if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+ *     epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+ *   }
+ * }
+ * ```
+ * @{
+ */
+
+/**
+ * Set the callback announcing the file descriptors the host loop must watch.
+ *
+ * May be called before or after oc_main_init(); a new callback is told about
+ * every descriptor that is open at that time.
+ *
+ * @param[in] cb callback, see oc_fd_watch_cb_t
+ * @param[in] user_data context pointer passed to cb
+ */
+void oc_set_fd_watch_callback(oc_fd_watch_cb_t cb, void *user_data);
+
+/**
+ * Handle a readable file descriptor announced by the fd watch callback.
+ *
+ * @param[in] fd the readable descriptor
+ * @return absolute time of the next timer, 0 if there is none
+ */
+oc_clock_time_t oc_main_on_readable(int fd);
+
+/**
+ * Handle a writable file descriptor announced by the fd watch callback.
+ *
+ * @param[in] fd the writable descriptor
+ * @return absolute time of the next timer, 0 if there is none
+ */
+oc_clock_time_t oc_main_on_writable(int fd);
+
+/**
+ * Run the timers that are due and all other pending work of the stack.
+ *
+ * @return absolute time of the next timer, 0 if there is none
+ */
+oc_clock_time_t oc_main_on_timeout(void);
+
+/** @} */
+#endif /* OC_EXTERNAL_EVENT_LOOP */
+
 /**
  * Shutdown and free all stack related resources
  */
@@ -953,6 +1031,27 @@ void oc_collection_remove_link(oc_resource_t *collection, oc_link_t *link);
  */
 oc_link_t *oc_collection_get_links(oc_resource_t *collection);
 
+/**
+ * Coalesce batch interface notifications of a collection.
+ *
+ * By default every change to a linked resource results in an immediate
+ * `oic.if.b` notification to the observers of the collection. With a non-zero
+ * interval the changed links are marked and a single notification is sent
+ * when the interval expires, carrying either only the links that changed
+ * since the last notification or the full batch.
+ *
+ * @param[in,out] collection Collection to configure. Does nothing if NULL.
+ * @param[in] interval_seconds Coalescing interval in seconds. 0 restores
+ *                             immediate notifications.
+ * @param[in] full_batch If true, send the full batch instead of only the
+ *                       changed links.
+ *
+ * @see oc_notify_observers
+ */
+void oc_collection_set_batch_notify_interval(oc_resource_t *collection,
+                                             uint16_t interval_seconds,
+                                             bool full_batch);
+
 /**
  * Adds a collection to the list of collections.
  *
@@ -1079,6 +1178,33 @@ void oc_resource_set_observable(oc_resource_t *resource, bool state);
 void oc_resource_set_periodic_observable(oc_resource_t *resource,
                                          uint16_t seconds);
 
+/**
+ * Allow the request handlers of a resource to run on a worker thread.
+ *
+ * When the stack is built with OC_WORKER_THREADS, requests to a concurrent
+ * resource are handed to one of the worker threads. A response that is ready
+ * within OC_WORKER_ACK_WINDOW is piggy-backed on the ACK of a confirmable
+ * request, later ones are sent as separate responses. Requests from the same
+ * peer are always served by the same worker, and hence in order; once
+ * OC_WORKER_QUEUE_DEPTH of them are pending, further ones are answered with
+ * 5.03 Service Unavailable. Without OC_WORKER_THREADS the handlers keep
+ * running on the thread calling oc_main_poll().
+ *
+ * The handlers of a concurrent resource may run on several threads at the
+ * same time. They must only read the request, encode the response with the
+ * oc_rep_* macros and complete it with oc_send_response(),
+ * oc_send_response_raw() or oc_ignore_request(). Any other call into the
+ * stack must be deferred to the event loop, e.g. through an interrupt
+ * handler.
+ *
+ * @param[in] resource the resource whose handlers are thread-safe
+ * @param[in] state true to run the handlers on worker threads, false to run
+ *                  them on the event loop
+ *
+ * @see oc_signal_interrupt_handler
+ */
+void oc_resource_set_concurrent(oc_resource_t *resource, bool state);
+
 /**
  * Specify a request_callback for GET, PUT, POST, and DELETE methods
  *
@@ -1115,6 +1241,45 @@ void oc_resource_set_request_handler(oc_resource_t *resource,
                                      oc_request_callback_t callback,
                                      void *user_data);
 
+#ifdef OC_BLOCK_WISE
+/**
+ * Serve GET requests to a resource from a stream producer.
+ *
+ * Instead of encoding the whole representation into a response buffer, the
+ * producer is asked for one block at a time when the client requests it with
+ * the Block2 option. Memory use is therefore bounded by the block size and
+ * the representation may exceed OC_MAX_APP_DATA_SIZE.
+ *
+ * The producer must return the same content for a given offset for the
+ * duration of a transfer, or call oc_resource_stream_changed() when the
+ * representation changes. Streamed resources cannot be observed.
+ *
+ * @param[in] resource the resource the producer will be registered to
+ * @param[in] producer the callback invoked for each requested block
+ * @param[in] content_format the Content-Format of the representation
+ * @param[in] user_data context pointer that is passed to the producer
+ *
+ * @see oc_do_get_stream
+ */
+void oc_resource_set_stream_handler(oc_resource_t *resource,
+                                    oc_stream_producer_t producer,
+                                    oc_content_format_t content_format,
+                                    void *user_data);
+
+/**
+ * Signal that the streamed representation of a resource changed.
+ *
+ * Every block carries an ETag for the representation it was produced from.
+ * This gives the representation a new ETag, so that clients in the middle of
+ * a transfer fail instead of mixing blocks of the old and new content.
+ *
+ * @param[in] resource the resource with a stream producer
+ *
+ * @see oc_resource_set_stream_handler
+ */
+void oc_resource_stream_changed(oc_resource_t *resource);
+#endif /* OC_BLOCK_WISE */
+
 void oc_resource_set_properties_cbs(oc_resource_t *resource,
                                     oc_get_properties_cb_t get_properties,
                                     void *get_propr_user_data,
@@ -1641,6 +1806,38 @@ bool oc_do_ip_discovery_all_at_endpoint(oc_discovery_all_handler_t handler,
 bool oc_do_get(const char *uri, oc_endpoint_t *endpoint, const char *query,
                oc_response_handler_t handler, oc_qos_t qos, void *user_data);
 
+#ifdef OC_BLOCK_WISE
+/**
+ * Issue a GET request and receive the response as a stream of chunks
+ *
+ * The handler is invoked once per received block, in order, with the raw
+ * chunk in `_payload`/`_payload_len` and its position in `offset`. The
+ * `payload` is not parsed. `more` is false on the final invocation, which is
+ * also the one that reports errors. Only a single block is held in memory,
+ * so the representation may exceed OC_MAX_APP_DATA_SIZE.
+ *
+ * A block whose ETag differs from the first block's was produced from a
+ * changed representation. The transfer then ends with
+ * OC_STATUS_SERVICE_UNAVAILABLE and no payload, and may be started again.
+ *
+ * @param[in] uri the uri of the resource
+ * @param[in] endpoint the endpoint of the server
+ * @param[in] query a query parameter that will be sent to the server's
+ *                  oc_request_callback_t.
+ * @param[in] handler function invoked for each chunk of the response
+ * @param[in] qos the quality of service current options are HIGH_QOS or LOW_QOS
+ * @param[in] user_data context pointer that will be sent to the
+ *                      oc_response_handler_t
+ *
+ * @return True if the client successfully dispatched the CoAP GET request
+ *
+ * @see oc_resource_set_stream_handler
+ */
+bool oc_do_get_stream(const char *uri, oc_endpoint_t *endpoint,
+                      const char *query, oc_response_handler_t handler,
+                      oc_qos_t qos, void *user_data);
+#endif /* OC_BLOCK_WISE */
+
 /**
  * Issue a DELETE request to delete a resource
  *
@@ -29,6 +29,26 @@
 extern "C" {
 #endif
 
+/* Number of blocks a client keeps in flight when fetching a payload with
+ * Block2. Blocks may then arrive out of order and are reassembled in place.
+ * Requires the block size to stay constant for the duration of a transfer.
+ */
+#ifndef OC_BLOCK_WISE_WINDOW
+#define OC_BLOCK_WISE_WINDOW (1)
+#endif /* OC_BLOCK_WISE_WINDOW */
+
+/* Number of Block1 blocks a client sends ahead of the last acknowledged
+ * block. Only enable for peers that accept out-of-order Block1 transfers.
+ */
+#ifndef OC_BLOCK_WISE_BLOCK1_WINDOW
+#define OC_BLOCK_WISE_BLOCK1_WINDOW (1)
+#endif /* OC_BLOCK_WISE_BLOCK1_WINDOW */
+
+#if OC_BLOCK_WISE_WINDOW < 1 || OC_BLOCK_WISE_WINDOW > 32 ||                   \
+  OC_BLOCK_WISE_BLOCK1_WINDOW < 1 || OC_BLOCK_WISE_BLOCK1_WINDOW > 32
+#error "block-wise windows must be between 1 and 32 blocks"
+#endif
+
 typedef enum {
   OC_BLOCKWISE_CLIENT = 0,
   OC_BLOCKWISE_SERVER
@@ -43,6 +63,12 @@ typedef struct oc_blockwise_state_s
   oc_blockwise_role_t role;
   uint32_t payload_size;
   uint32_t next_block_offset;
+  uint32_t received_end;   /* end of the furthest block received */
+  uint32_t blocks_ahead;   /* blocks received beyond next_block_offset */
+  uint32_t expected_size;  /* size announced by the peer, if any */
+  uint16_t block_size;     /* size of the blocks being received */
+  bool last_block_received;
+  oc_clock_time_t start_time;
   uint8_t ref_count;
 #ifdef OC_DYNAMIC_ALLOCATION
 #ifdef OC_APP_DATA_BUFFER_POOL
@@ -58,6 +84,7 @@ typedef struct oc_blockwise_state_s
   uint8_t token_len;
   uint16_t mid;
   void *client_cb;
+  uint32_t next_request_offset;
 #endif /* OC_CLIENT */
 } oc_blockwise_state_t;
 
@@ -76,6 +103,16 @@ typedef struct oc_blockwise_response_state_s
 #endif /* OC_CLIENT */
 } oc_blockwise_response_state_t;
 
+typedef struct oc_blockwise_stats_t
+{
+  uint32_t blocks_received;
+  uint32_t blocks_out_of_order;
+  uint32_t blocks_duplicate;
+  uint32_t transfers_completed;
+  uint64_t bytes_completed;
+  oc_clock_time_t transfer_time; /* total duration of completed transfers */
+} oc_blockwise_stats_t;
+
 oc_blockwise_state_t *oc_blockwise_find_request_buffer_by_mid(uint16_t mid);
 
 oc_blockwise_state_t *oc_blockwise_find_response_buffer_by_mid(uint16_t mid);
@@ -124,6 +161,21 @@ bool oc_blockwise_handle_block(oc_blockwise_state_t *buffer,
                                const uint8_t *incoming_block,
                                uint32_t incoming_block_size);
 
+/* Records that the block ending the payload has been received. */
+void oc_blockwise_handle_last_block(oc_blockwise_state_t *buffer);
+
+/* True once every block up to and including the last one was received. */
+bool oc_blockwise_transfer_complete(const oc_blockwise_state_t *buffer);
+
+/* Sets the payload size of a completely received transfer and updates the
+ * transfer statistics.
+ */
+void oc_blockwise_finish_transfer(oc_blockwise_state_t *buffer);
+
+void oc_blockwise_get_stats(oc_blockwise_stats_t *stats);
+
+void oc_blockwise_reset_stats(void);
+
 void oc_blockwise_scrub_buffers(bool all);
 
 void oc_blockwise_scrub_buffers_for_client_cb(void *cb);
@@ -31,12 +31,79 @@ extern "C"
 
 OC_PROCESS_NAME(message_buffer_handler);
 oc_message_t *oc_allocate_message(void);
+
+/* Allocates an incoming message whose buffer holds at least size bytes. */
+oc_message_t *oc_allocate_message_sized(size_t size);
 void oc_set_buffers_avail_cb(oc_memb_buffers_avail_callback_t cb);
 
 oc_message_t *oc_allocate_message_from_pool(struct oc_memb *pool);
 
 oc_message_t *oc_internal_allocate_outgoing_message(void);
 
+/* Allocates an outgoing message whose buffer holds at least size bytes. */
+oc_message_t *oc_internal_allocate_outgoing_message_sized(size_t size);
+
+/* Moves the payload of message into the smallest buffer class that fits its
+ * length. Must only be called while no one else holds a pointer into the
+ * message data.
+ */
+void oc_message_shrink_buffer(oc_message_t *message);
+
+/* Unused bytes of the buffer of message in front of its data. Always 0 unless
+ * data points into a separately allocated buffer (OC_DYNAMIC_ALLOCATION
+ * without OC_INOUT_BUFFER_SIZE).
+ */
+size_t oc_message_headroom(const oc_message_t *message);
+
+/* Bytes of the buffer of message past data + length. */
+size_t oc_message_tailroom(const oc_message_t *message);
+
+/* Moves the start of the data of an empty message len bytes into its buffer,
+ * turning them into headroom, so that a header can later be written in front
+ * of a payload encoded further on. Returns false if the buffer does not allow
+ * it, in which case the message is left untouched.
+ */
+bool oc_message_reserve(oc_message_t *message, size_t len);
+
+typedef struct oc_message_copy_stats_t
+{
+  uint32_t messages;        /* messages released */
+  uint32_t copied_messages; /* released messages whose payload was copied */
+  uint32_t copies;          /* payload copies, including transient buffers */
+  size_t bytes;             /* bytes copied */
+} oc_message_copy_stats_t;
+
+/* Accounts for len bytes of the payload of message copied into another
+ * buffer. message may be NULL for a buffer that is not a pooled message.
+ */
+void oc_message_count_copy(oc_message_t *message, size_t len);
+
+void oc_message_get_copy_stats(oc_message_copy_stats_t *stats);
+void oc_message_reset_copy_stats(void);
+
+#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
+typedef enum {
+  OC_MESSAGE_BUFFER_SMALL = 0,
+  OC_MESSAGE_BUFFER_MEDIUM,
+  OC_MESSAGE_BUFFER_LARGE, /* OC_PDU_SIZE */
+  OC_MESSAGE_BUFFER_NUM_CLASSES
+} oc_message_buffer_class_t;
+
+typedef struct oc_message_buffer_stats_t
+{
+  size_t buffer_size;   /* capacity of the buffers in this class */
+  uint32_t allocations; /* buffers handed out */
+  uint32_t recycled;    /* allocations served from the free list */
+  uint32_t in_use;      /* buffers currently held by messages */
+  uint32_t peak_in_use; /* high-water mark of in_use */
+  size_t peak_bytes;    /* peak_in_use * buffer_size */
+} oc_message_buffer_stats_t;
+
+bool oc_message_buffer_get_stats(oc_message_buffer_class_t buffer_class,
+                                 oc_message_buffer_stats_t *stats);
+void oc_message_buffer_reset_stats(void);
+#endif /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
+
 void oc_message_add_ref(oc_message_t *message);
 void oc_message_unref(oc_message_t *message);
 
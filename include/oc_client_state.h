@@ -44,6 +44,8 @@ typedef struct
   oc_content_format_t content_format;
   oc_status_t code;
   int observe_option;
+  size_t offset; /* position of _payload within a streamed response */
+  bool more;     /* further chunks of a streamed response follow */
 } oc_client_response_t;
 
 typedef enum {
@@ -88,12 +90,22 @@ typedef struct oc_client_cb_t
   bool stop_multicast_receive;
   uint8_t ref_count;
   uint8_t separate;
+#ifdef OC_BLOCK_WISE
+  bool stream;
+  uint32_t stream_offset;
+  uint8_t stream_etag[COAP_ETAG_LEN]; /* ETag of the first block */
+  uint8_t stream_etag_len;
+#endif /* OC_BLOCK_WISE */
 } oc_client_cb_t;
 
 #ifdef OC_BLOCK_WISE
 bool oc_ri_invoke_client_cb(void *response,
                             oc_blockwise_state_t **response_state,
                             oc_client_cb_t *cb, oc_endpoint_t *endpoint);
+
+bool oc_ri_invoke_client_stream_cb(void *response, oc_client_cb_t *cb,
+                                   oc_endpoint_t *endpoint, uint32_t offset,
+                                   bool more);
 #else  /* OC_BLOCK_WISE */
 bool oc_ri_invoke_client_cb(void *response, oc_client_cb_t *cb,
                             oc_endpoint_t *endpoint);
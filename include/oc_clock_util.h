@@ -20,8 +20,13 @@
 #define OC_CLOCK_UTIL_H
 
 #include "oc_config.h"
+#include <stdbool.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 size_t oc_clock_time_rfc3339(char *out_buf, size_t out_buf_len);
 
 size_t oc_clock_encode_time_rfc3339(oc_clock_time_t time, char *out_buf,
@@ -30,4 +35,25 @@ size_t oc_clock_encode_time_rfc3339(oc_clock_time_t time, char *out_buf,
 oc_clock_time_t oc_clock_parse_time_rfc3339(const char *in_buf,
                                             size_t in_buf_len);
 
+/**
+ * Monotonic time for code running on the event loop.
+ *
+ * While oc_main_poll() runs, this is the oc_clock_time_monotonic() reading
+ * taken when its current iteration started, shared by the timers, sessions
+ * and transfers handled in that iteration. Outside of oc_main_poll() the
+ * clock is read on every call. Threads other than the one running
+ * oc_main_poll() should call oc_clock_time_monotonic() instead.
+ *
+ * @return the monotonic time, measured in system ticks
+ */
+oc_clock_time_t oc_clock_loop_time(void);
+
+/* Take a fresh reading for the next event loop iteration, or stop caching
+ * it once oc_main_poll() returns. */
+void oc_clock_set_loop_time(bool in_loop);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* OC_CLOCK_UTIL_H */
@@ -104,10 +104,17 @@ typedef struct oc_cloud_context_t
   oc_link_t *rd_published_resources;
   oc_link_t *rd_delete_resources;
   bool rd_delete_all;
+  oc_clock_time_t rd_publish_time;
+  uint8_t rd_retry_count;
+  bool rd_retry_pending;
 
   oc_resource_t *cloud_conf;
 
   bool cloud_manager;
+
+  uint16_t notify_window_ms;
+  uint16_t notify_rate;
+  uint16_t notify_burst;
 } oc_cloud_context_t;
 
 oc_cloud_context_t *oc_cloud_get_context(size_t device);
@@ -132,6 +139,25 @@ int oc_cloud_discover_resources(oc_cloud_context_t *ctx,
                                 oc_discovery_all_handler_t handler,
                                 void *user_data);
 
+/**
+  @brief Coalesce and rate-limit observe notifications sent to the cloud.
+
+  Changes to a resource observed by the cloud are collected for window_ms
+  milliseconds and only its latest representation is sent. Notifications are
+  then paced by a token bucket allowing rate notifications per second with
+  bursts of up to burst notifications. If the cloud observes /oic/res with
+  oic.if.b, all changed resources are sent in a single batch notification.
+  Passing 0 for both window_ms and rate restores immediate notifications.
+  @param ctx cloud context of the device
+  @param window_ms coalescing window in milliseconds
+  @param rate notifications per second, 0 for no rate limit
+  @param burst maximum number of notifications sent back-to-back
+  @return Returns 0 on success, -1 on failure.
+*/
+int oc_cloud_set_notification_policy(oc_cloud_context_t *ctx,
+                                     uint16_t window_ms, uint16_t rate,
+                                     uint16_t burst);
+
 int oc_cloud_provision_conf_resource(oc_cloud_context_t *ctx,
                                      const char *server,
                                      const char *access_token,
@@ -41,6 +41,7 @@ struct oc_link_s
   int64_t ins;
   oc_string_array_t rel;
   OC_LIST_STRUCT(params);
+  bool notify_pending;
 };
 
 typedef struct oc_rt_t
@@ -63,16 +64,21 @@ struct oc_collection_s
   oc_request_handler_t put_handler;
   oc_request_handler_t post_handler;
   oc_request_handler_t delete_handler;
+  oc_stream_handler_t stream_handler;
   oc_properties_cb_t get_properties;
   oc_properties_cb_t set_properties;
   double tag_pos_rel[3];
   oc_pos_description_t tag_pos_desc;
   oc_enum_t tag_pos_func;
   uint8_t num_observers;
+  uint8_t num_scheduled_observers;
   uint8_t num_links;
   OC_LIST_STRUCT(mandatory_rts);
   OC_LIST_STRUCT(supported_rts);
   OC_LIST_STRUCT(links);
+  uint16_t batch_notify_interval;
+  bool batch_notify_full;
+  bool batch_notify_scheduled;
 };
 
 void oc_link_set_interfaces(oc_link_t *link,
@@ -84,6 +90,8 @@ bool oc_handle_collection_request(oc_method_t method, oc_request_t *request,
 oc_collection_t *oc_collection_alloc(void);
 void oc_collection_free(oc_collection_t *collection);
 
+bool oc_collection_defer_batch_notification(oc_collection_t *collection,
+                                           oc_resource_t *resource);
 oc_collection_t *oc_get_next_collection_with_link(oc_resource_t *resource,
                                                   oc_collection_t *start);
 oc_collection_t *oc_get_collection_by_uri(const char *uri_path,
@@ -19,6 +19,7 @@
 #ifndef OC_DISCOVERY_H
 #define OC_DISCOVERY_H
 
+#include "oc_ri.h"
 #include <stddef.h>
 
 #ifdef __cplusplus
@@ -28,6 +29,18 @@ extern "C"
 
 void oc_create_discovery_resource(int resource_idx, size_t device);
 
+#ifdef OC_RES_BATCH_SUPPORT
+/**
+  @brief Encode the oic.if.b link of a single resource into a links array.
+  @param links_array encoder of the links array being built
+  @param resource the resource whose representation is embedded
+  @param endpoint the endpoint of the requester, used for the ACL check
+*/
+void oc_discovery_process_batch_response(CborEncoder *links_array,
+                                         oc_resource_t *resource,
+                                         oc_endpoint_t *endpoint);
+#endif /* OC_RES_BATCH_SUPPORT */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,204 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/**
+  @file
+
+  Runtime metrics of the stack internals, available when built with
+  OC_METRICS (or "make METRICS=1").
+
+  Counters only increase, gauges track a current value and its peak, and
+  histograms count observed values in power of two buckets. Updates are
+  aggregated per thread and summed when a snapshot is taken.
+
+  With OC_REQUEST_TRACE (or "make REQUEST_TRACE=1") every inbound message
+  also carries the monotonic time at which it passed each stage of the
+  stack, and the time spent between stages feeds the latency histograms.
+*/
+#ifndef OC_METRICS_H
+#define OC_METRICS_H
+
+#include "oc_config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(OC_REQUEST_TRACE) && !defined(OC_METRICS)
+#error "OC_REQUEST_TRACE reports through the metrics, define OC_METRICS"
+#endif /* OC_REQUEST_TRACE && !OC_METRICS */
+
+/* Number of histogram buckets; bucket 0 counts zero values and bucket i
+ * values from 2^(i-1) up to 2^i - 1, the last one anything larger. */
+#ifndef OC_METRICS_HISTOGRAM_BUCKETS
+#define OC_METRICS_HISTOGRAM_BUCKETS (20)
+#endif /* !OC_METRICS_HISTOGRAM_BUCKETS */
+
+typedef enum {
+  OC_METRICS_RX_UDP = 0,       /* inbound datagrams */
+  OC_METRICS_RX_TCP,           /* inbound TCP messages */
+  OC_METRICS_RX_SECURED,       /* inbound messages to be decrypted */
+  OC_METRICS_RX_BYTES,         /* bytes of all inbound messages */
+  OC_METRICS_RX_SHED,          /* inbound messages shed from full queues */
+  OC_METRICS_TX_UDP,           /* outbound unicast datagrams */
+  OC_METRICS_TX_TCP,           /* outbound TCP messages */
+  OC_METRICS_TX_SECURED,       /* outbound messages to be encrypted */
+  OC_METRICS_TX_MULTICAST,     /* outbound multicast requests */
+  OC_METRICS_TX_BYTES,         /* bytes of all outbound messages */
+  OC_METRICS_BUFFER_EXHAUSTED, /* message buffer allocation failures */
+  OC_METRICS_COAP_RETRANSMISSIONS,
+  OC_METRICS_COAP_TIMEOUTS,   /* confirmable messages never acknowledged */
+  OC_METRICS_COAP_DUPLICATES, /* duplicate requests dropped */
+  OC_METRICS_EVENTS_DROPPED,  /* events refused or shed by full queues */
+  OC_METRICS_TLS_HANDSHAKES,  /* (D)TLS handshakes started */
+  OC_METRICS_TLS_HANDSHAKES_COMPLETED,
+  OC_METRICS_TLS_HANDSHAKES_FAILED, /* peers removed while handshaking */
+  OC_METRICS_NUM_COUNTERS
+} oc_metrics_counter_t;
+
+typedef enum {
+  OC_METRICS_PROCESS_EVENTS = 0, /* events queued for the event loop */
+  OC_METRICS_OBSERVERS,          /* registered observers */
+  OC_METRICS_TLS_PEERS,          /* (D)TLS sessions, established or not */
+  OC_METRICS_NUM_GAUGES
+} oc_metrics_gauge_t;
+
+typedef enum {
+  OC_METRICS_RX_MESSAGE_SIZE = 0, /* bytes */
+  OC_METRICS_TX_MESSAGE_SIZE,     /* bytes */
+  OC_METRICS_EVENT_QUEUE_DEPTH,   /* events queued, sampled on every post */
+  OC_METRICS_TLS_HANDSHAKE_TIME,  /* milliseconds */
+  /* microseconds an inbound message took to reach each stage from the one
+   * it passed before, in stage order, then from reception to the response;
+   * only fed with OC_REQUEST_TRACE */
+  OC_METRICS_NETWORK_QUEUE_TIME,
+  OC_METRICS_DISPATCH_TIME,
+  OC_METRICS_DECRYPT_TIME,
+  OC_METRICS_ENGINE_QUEUE_TIME,
+  OC_METRICS_AUTHORIZATION_TIME,
+  OC_METRICS_HANDLER_TIME,
+  OC_METRICS_RESPONSE_TIME,
+  OC_METRICS_REQUEST_TIME,
+  OC_METRICS_NUM_HISTOGRAMS
+} oc_metrics_histogram_id_t;
+
+/* Stages an inbound message passes, in order */
+typedef enum {
+  OC_METRICS_STAGE_RECEIVED = 0, /* handed to the stack by a network thread */
+  OC_METRICS_STAGE_DEQUEUED,     /* taken off the network event queue */
+  OC_METRICS_STAGE_DISPATCHED,   /* routed by the message buffer handler */
+  OC_METRICS_STAGE_DECRYPTED,    /* decrypted by (D)TLS */
+  OC_METRICS_STAGE_ENGINE,       /* taken up by the CoAP engine */
+  OC_METRICS_STAGE_AUTHORIZED,   /* access to the resource checked */
+  OC_METRICS_STAGE_HANDLED,      /* entity handler returned */
+  OC_METRICS_STAGE_RESPONDED,    /* response serialized and queued */
+  OC_METRICS_NUM_STAGES
+} oc_metrics_stage_t;
+
+typedef struct oc_metrics_request_trace_t
+{
+  const char *uri; /* not terminated, NULL for messages other than requests */
+  size_t uri_len;
+  int method;      /* oc_method_t of a request */
+  uint64_t total;  /* microseconds from reception to the response */
+  /* microseconds from reception to each stage, -1 for stages not passed */
+  int64_t stages[OC_METRICS_NUM_STAGES];
+} oc_metrics_request_trace_t;
+
+typedef void (*oc_metrics_slow_request_cb_t)(
+  const oc_metrics_request_trace_t *trace, void *user_data);
+
+typedef struct oc_metrics_histogram_t
+{
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[OC_METRICS_HISTOGRAM_BUCKETS];
+} oc_metrics_histogram_t;
+
+typedef struct oc_metrics_snapshot_t
+{
+  uint64_t counters[OC_METRICS_NUM_COUNTERS];
+  int64_t gauges[OC_METRICS_NUM_GAUGES];
+  int64_t gauge_peaks[OC_METRICS_NUM_GAUGES];
+  oc_metrics_histogram_t histograms[OC_METRICS_NUM_HISTOGRAMS];
+} oc_metrics_snapshot_t;
+
+/**
+ * Sum the per thread metrics into a snapshot.
+ *
+ * Updates made while the snapshot is taken may or may not be included.
+ *
+ * @param[out] snapshot the metrics
+ */
+void oc_metrics_get_snapshot(oc_metrics_snapshot_t *snapshot);
+
+/**
+ * Zero all counters and histograms and lower the gauge peaks to their
+ * current values.
+ */
+void oc_metrics_reset(void);
+
+/**
+ * Estimate a percentile of a histogram.
+ *
+ * @param histogram the histogram
+ * @param percent percentile to estimate, from 0 to 100
+ *
+ * @return the upper bound of the bucket holding the percentile, capped by
+ * the largest value observed; 0 for an empty histogram
+ */
+uint64_t oc_metrics_percentile(const oc_metrics_histogram_t *histogram,
+                               unsigned int percent);
+
+/**
+ * Names of the metrics as reported by the oc/metrics resource.
+ */
+const char *oc_metrics_counter_name(oc_metrics_counter_t counter);
+const char *oc_metrics_gauge_name(oc_metrics_gauge_t gauge);
+const char *oc_metrics_histogram_name(oc_metrics_histogram_id_t histogram);
+const char *oc_metrics_stage_name(oc_metrics_stage_t stage);
+
+/**
+ * Report the traces of inbound messages that took at least threshold
+ * microseconds from reception to their response, when built with
+ * OC_REQUEST_TRACE.
+ *
+ * The callback runs on the event loop right after the response was queued.
+ * The response of a handler that completes a request later, e.g. on a
+ * worker thread, is not part of its trace.
+ *
+ * @param threshold microseconds, 0 to stop reporting
+ * @param cb called with each slow trace, NULL to print them with
+ * oc_metrics_print_request_trace()
+ * @param user_data passed to cb
+ */
+void oc_metrics_set_slow_request_callback(uint64_t threshold,
+                                          oc_metrics_slow_request_cb_t cb,
+                                          void *user_data);
+
+/**
+ * Print a request trace, one line per stage passed.
+ */
+void oc_metrics_print_request_trace(const oc_metrics_request_trace_t *trace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_METRICS_H */
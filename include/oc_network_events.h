@@ -54,6 +54,12 @@ typedef struct oc_message_s oc_message_t;
 
 void oc_network_event(oc_message_t *message);
 
+#ifdef OC_EXTERNAL_EVENT_LOOP
+/* Hand over a message received on the thread driving the stack, see
+ * oc_main_on_readable(). */
+void oc_network_event_in_loop(oc_message_t *message);
+#endif /* OC_EXTERNAL_EVENT_LOOP */
+
 void oc_network_interface_event(oc_interface_event_t event);
 
 #ifdef __cplusplus
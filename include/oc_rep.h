@@ -31,8 +31,15 @@
 extern "C" {
 #endif
 
-extern CborEncoder g_encoder, root_map, links_array;
-extern int g_err;
+#ifdef OC_WORKER_THREADS
+/* Request handlers may run on worker threads, each encoding its own payload */
+#define OC_REP_THREAD_LOCAL __thread
+#else /* OC_WORKER_THREADS */
+#define OC_REP_THREAD_LOCAL
+#endif /* !OC_WORKER_THREADS */
+
+extern OC_REP_THREAD_LOCAL CborEncoder g_encoder, root_map, links_array;
+extern OC_REP_THREAD_LOCAL int g_err;
 
 /**
  * Initialize the buffer used to hold the cbor encoded data
@@ -37,6 +37,7 @@ typedef enum {
   OC_OBSERVABLE = (1 << 1),
   OC_SECURE = (1 << 4),
   OC_PERIODIC = (1 << 6),
+  OC_CONCURRENT = (1 << 8), /* internal, not advertised in the "p" bitmap */
 } oc_resource_properties_t;
 
 typedef enum {
@@ -127,6 +128,12 @@ typedef enum {
 #ifdef OC_MNT
   OCF_MNT,
 #endif /* OC_MNT */
+#ifdef OC_MEMORY_TRACE
+  OCF_MEM_TRACE,
+#endif /* OC_MEMORY_TRACE */
+#ifdef OC_METRICS
+  OCF_METRICS,
+#endif /* OC_METRICS */
 #ifdef OC_CLOUD
   OCF_COAPCLOUDCONF,
 #endif /* OC_CLOUD */
@@ -181,6 +188,23 @@ typedef bool (*oc_set_properties_cb_t)(oc_resource_t *, oc_rep_t *, void *);
 typedef void (*oc_get_properties_cb_t)(oc_resource_t *, oc_interface_mask_t,
                                        void *);
 
+/**
+ * Produces the part of a streamed representation that starts at offset.
+ * Returns the number of bytes written to buffer (at most buffer_size), or -1
+ * on failure. Sets *last when the returned chunk ends the representation.
+ */
+typedef int (*oc_stream_producer_t)(oc_resource_t *resource, size_t offset,
+                                    uint8_t *buffer, size_t buffer_size,
+                                    bool *last, void *user_data);
+
+typedef struct oc_stream_handler_s
+{
+  oc_stream_producer_t cb;
+  oc_content_format_t content_format;
+  void *user_data;
+  uint32_t etag; /* ETag of the current representation */
+} oc_stream_handler_t;
+
 typedef struct oc_properties_cb_t
 {
   union {
@@ -204,12 +228,14 @@ struct oc_resource_s
   oc_request_handler_t put_handler;
   oc_request_handler_t post_handler;
   oc_request_handler_t delete_handler;
+  oc_stream_handler_t stream_handler;
   oc_properties_cb_t get_properties;
   oc_properties_cb_t set_properties;
   double tag_pos_rel[3];
   oc_pos_description_t tag_pos_desc;
   oc_enum_t tag_func_desc;
   uint8_t num_observers;
+  uint8_t num_scheduled_observers;
 #ifdef OC_COLLECTIONS
   uint8_t num_links;
 #endif /* OC_COLLECTIONS */
@@ -260,6 +286,30 @@ oc_resource_t *oc_ri_get_app_resource_by_uri(const char *uri, size_t uri_len,
 
 oc_resource_t *oc_ri_get_app_resources(void);
 
+/**
+ * Selects the logical device a request received on a shared transport is
+ * meant for: the device named by a "di" or "anchor" (ocf://<di>) query
+ * parameter, else the device hosting an application resource at uri, else
+ * device. A uri hosted by several devices selects device if it is one of
+ * them, else the lowest numbered one. Every device has its own core and
+ * security resources, so requests to those reach the device the transport
+ * belongs to unless they name another one with "di". Secured requests are
+ * not routed: they stay on the device their session is bound to.
+ */
+size_t oc_ri_get_request_device(size_t device, const char *uri, size_t uri_len,
+                                const char *query, size_t query_len);
+
+#ifdef OC_BLOCK_WISE
+/**
+ * Fills response with the block of resource's streamed representation that
+ * the Block2 option of the GET request asks for, writing the payload to
+ * buffer. Returns false if the producer fails.
+ */
+bool oc_ri_produce_stream_block(void *request, void *response,
+                                oc_resource_t *resource, uint16_t block2_size,
+                                uint8_t *buffer);
+#endif /* OC_BLOCK_WISE */
+
 #ifdef OC_SERVER
 oc_resource_t *oc_ri_alloc_resource(void);
 bool oc_ri_add_resource(oc_resource_t *resource);
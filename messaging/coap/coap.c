@@ -1081,7 +1081,10 @@ coap_serialize_message(void *packet, uint8_t *buffer)
       *option = 0xFF;
       ++option;
     }
-    memmove(option, coap_pkt->payload, coap_pkt->payload_len);
+    /* a payload serialized in place already follows the header */
+    if (option != coap_pkt->payload) {
+      memmove(option, coap_pkt->payload, coap_pkt->payload_len);
+    }
   } else {
     /* an error occurred: caller must check for !=0 */
     OC_WRN("Serialized header length %u exceeds COAP_MAX_HEADER_SIZE %u",
@@ -1103,6 +1106,58 @@ exit:
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+/* Length of all that coap_serialize_message() writes ahead of the payload */
+static size_t
+coap_serialized_header_length(void *packet)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+  size_t option_length = coap_serialize_options(coap_pkt, NULL);
+  size_t header_length = option_length + coap_pkt->token_len;
+  if (coap_pkt->payload_len > 0) {
+    header_length += COAP_PAYLOAD_MARKER_LEN;
+  }
+#ifdef OC_TCP
+  if (coap_pkt->transport_type == COAP_TRANSPORT_TCP) {
+    uint8_t num_extended_length_bytes = 0, len = 0;
+    size_t extended_len = 0;
+    coap_tcp_compute_message_length(coap_pkt, option_length,
+                                    &num_extended_length_bytes, &len,
+                                    &extended_len);
+    return header_length + COAP_TCP_DEFAULT_HEADER_LEN +
+           num_extended_length_bytes;
+  }
+#endif /* OC_TCP */
+  return header_length + COAP_HEADER_LEN;
+}
+/*---------------------------------------------------------------------------*/
+size_t
+coap_serialize_message_into(void *packet, oc_message_t *message)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+  message->length = 0;
+  if (coap_pkt->code && coap_pkt->payload_len > 0) {
+    /* a payload encoded into the buffer of message, typically at
+     * COAP_MAX_HEADER_SIZE, stays where it is and the header goes in front */
+    size_t tailroom = oc_message_tailroom(message);
+    if (coap_pkt->payload >= message->data &&
+        coap_pkt->payload + coap_pkt->payload_len <=
+          message->data + tailroom) {
+      size_t offset = (size_t)(coap_pkt->payload - message->data);
+      size_t header_length = coap_serialized_header_length(coap_pkt);
+      if (header_length <= COAP_MAX_HEADER_SIZE && header_length < offset) {
+        oc_message_reserve(message, offset - header_length);
+      }
+    }
+  }
+  uint8_t *header = message->data;
+  message->length = coap_serialize_message(coap_pkt, header);
+  if (message->length > 0 && coap_pkt->payload_len > 0 &&
+      coap_pkt->payload != header + message->length - coap_pkt->payload_len) {
+    oc_message_count_copy(message, coap_pkt->payload_len);
+  }
+  return message->length;
+}
+/*---------------------------------------------------------------------------*/
 void
 coap_send_message(oc_message_t *message)
 {
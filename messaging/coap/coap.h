@@ -227,6 +227,10 @@ uint16_t coap_get_mid(void);
 void coap_udp_init_message(void *packet, coap_message_type_t type, uint8_t code,
                        uint16_t mid);
 size_t coap_serialize_message(void *packet, uint8_t *buffer);
+/* Serializes packet into the data of message and sets its length. A payload
+ * that was encoded into the buffer of message is not moved where the buffer
+ * has room for headroom, see oc_message_reserve(). */
+size_t coap_serialize_message_into(void *packet, oc_message_t *message);
 void coap_send_message(oc_message_t *message);
 coap_status_t coap_udp_parse_message(void *request, uint8_t *data,
                                  uint16_t data_len);
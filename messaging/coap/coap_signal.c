@@ -46,7 +46,7 @@ coap_send_signal_message(oc_endpoint_t *endpoint, coap_packet_t *packet)
 
   memcpy(&message->endpoint, endpoint, sizeof(oc_endpoint_t));
 
-  message->length = coap_serialize_message(packet, message->data);
+  message->length = coap_serialize_message_into(packet, message);
   oc_send_message(message);
 
   return 1;
@@ -109,7 +109,7 @@ coap_send_ping_message(oc_endpoint_t *endpoint, uint8_t custody_option,
   if (!t) {
     return 0;
   }
-  t->message->length = coap_serialize_message(ping_pkt, t->message->data);
+  t->message->length = coap_serialize_message_into(ping_pkt, t->message);
 
   OC_DBG("send ping signal message.");
   coap_send_transaction(t);
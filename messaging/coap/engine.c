@@ -51,6 +51,7 @@
 #include <string.h>
 
 #include "api/oc_events.h"
+#include "api/oc_metrics_internal.h"
 #include "oc_api.h"
 #include "oc_buffer.h"
 
@@ -77,7 +78,7 @@ OC_PROCESS(coap_engine, "CoAP Engine");
 extern bool oc_ri_invoke_coap_entity_handler(
   void *request, void *response, oc_blockwise_state_t **request_state,
   oc_blockwise_state_t **response_state, uint16_t block2_size,
-  oc_endpoint_t *endpoint);
+  uint8_t *buffer, oc_endpoint_t *endpoint);
 #else  /* OC_BLOCK_WISE */
 extern bool oc_ri_invoke_coap_entity_handler(void *request, void *response,
                                              uint8_t *buffer,
@@ -96,6 +97,7 @@ check_if_duplicate(uint16_t mid, uint8_t device)
   for (i = 0; i < OC_REQUEST_HISTORY_SIZE; i++) {
     if (history[i] == mid && history_dev[i] == device) {
       OC_DBG("dropping duplicate request");
+      OC_METRICS_INC(OC_METRICS_COAP_DUPLICATES);
       return true;
     }
   }
@@ -110,7 +112,8 @@ coap_send_empty_response(coap_message_type_t type, uint16_t mid,
   OC_DBG("CoAP send empty message: mid=%u, code=%u", mid, code);
   coap_packet_t msg[1]; // empty response
   coap_udp_init_message(msg, type, code, mid);
-  oc_message_t *message = oc_internal_allocate_outgoing_message();
+  oc_message_t *message =
+    oc_internal_allocate_outgoing_message_sized(COAP_HEADER_LEN + token_len);
   if (message) {
     memcpy(&message->endpoint, endpoint, sizeof(*endpoint));
     if (token && token_len > 0) {
@@ -154,6 +157,197 @@ coap_audit_log(oc_message_t *msg)
 }
 #endif /* OC_SECURITY */
 
+#if defined(OC_SERVER) && defined(OC_BLOCK_WISE)
+static bool
+is_stream_resource(const char *href, size_t href_len, size_t device)
+{
+  oc_resource_t *resource =
+    oc_ri_get_app_resource_by_uri(href, href_len, device);
+  return resource && resource->stream_handler.cb;
+}
+#endif /* OC_SERVER && OC_BLOCK_WISE */
+
+#if defined(OC_CLIENT) && defined(OC_BLOCK_WISE)
+/* Starts a confirmable request of client_cb for another block, over TCP if
+ * endpoint is a TCP endpoint.
+ */
+static void
+coap_init_block_request(coap_packet_t *request,
+                        const oc_client_cb_t *client_cb,
+                        const oc_endpoint_t *endpoint)
+{
+#ifdef OC_TCP
+  if (endpoint->flags & TCP) {
+    coap_tcp_init_message(request, client_cb->method);
+    /* not sent over TCP, but the transaction is kept by message ID */
+    request->mid = coap_get_mid();
+    return;
+  }
+#else  /* OC_TCP */
+  (void)endpoint;
+#endif /* !OC_TCP */
+  coap_udp_init_message(request, COAP_TYPE_CON, client_cb->method,
+                        coap_get_mid());
+}
+
+static bool
+coap_send_block_request(oc_client_cb_t *client_cb, const uint8_t *token,
+                        uint8_t token_len, coap_packet_t *request,
+                        oc_endpoint_t *endpoint)
+{
+  coap_transaction_t *t = coap_new_transaction(request->mid, endpoint);
+  if (!t) {
+    return false;
+  }
+  coap_set_header_uri_path(request, oc_string(client_cb->uri),
+                           oc_string_len(client_cb->uri));
+  if (oc_string_len(client_cb->query) > 0) {
+    coap_set_header_uri_query(request, oc_string(client_cb->query));
+  }
+  coap_set_header_accept(request, APPLICATION_VND_OCF_CBOR);
+  coap_set_token(request, token, token_len);
+  t->message->length = coap_serialize_message_into(request, t->message);
+  if (t->message->length == 0) {
+    coap_clear_transaction(t);
+    return false;
+  }
+  coap_send_transaction(t);
+  return true;
+}
+
+/* Sends the Block1 blocks that fit in the window following the last
+ * acknowledged block. The last block is held back until all blocks before
+ * it were acknowledged.
+ */
+static int
+coap_send_block1_window(oc_client_cb_t *client_cb,
+                        oc_blockwise_state_t *request_buffer,
+                        uint32_t acked_offset, uint16_t block_size,
+                        const coap_packet_t *message, oc_endpoint_t *endpoint)
+{
+  uint32_t window_end = acked_offset + OC_BLOCK_WISE_BLOCK1_WINDOW * block_size;
+  uint32_t last_offset = 0;
+  if (request_buffer->payload_size > 0) {
+    last_offset =
+      ((request_buffer->payload_size - 1) / block_size) * block_size;
+  }
+  if (request_buffer->block_size != block_size) {
+    /* the server picked another block size; continue from its position */
+    request_buffer->block_size = block_size;
+    request_buffer->next_block_offset = acked_offset;
+  }
+  uint32_t offset = request_buffer->next_block_offset;
+  if (offset < acked_offset) {
+    offset = acked_offset;
+  }
+  int sent = 0;
+  while (offset < window_end && offset < request_buffer->payload_size) {
+    if (offset == last_offset && offset != acked_offset) {
+      break;
+    }
+    uint32_t payload_size = 0;
+    const void *payload = oc_blockwise_dispatch_block(
+      request_buffer, offset, block_size, &payload_size);
+    if (!payload) {
+      break;
+    }
+    coap_packet_t request[1];
+    coap_init_block_request(request, client_cb, endpoint);
+    uint8_t more =
+      (request_buffer->next_block_offset < request_buffer->payload_size) ? 1
+                                                                          : 0;
+    coap_set_header_block1(request, offset / block_size, more, block_size);
+    coap_set_header_content_format(request, APPLICATION_VND_OCF_CBOR);
+    coap_set_payload(request, payload, payload_size);
+    if (!coap_send_block_request(client_cb, message->token,
+                                 message->token_len, request, endpoint)) {
+      request_buffer->next_block_offset = offset;
+      break;
+    }
+    request_buffer->mid = request->mid;
+    sent++;
+    offset = request_buffer->next_block_offset;
+  }
+  return sent;
+}
+
+/* Requests the Block2 blocks that fit in the window following the received
+ * part of the payload. Without a size announced by the server only the next
+ * block is requested.
+ */
+static int
+coap_request_block2_window(oc_client_cb_t *client_cb,
+                           oc_blockwise_state_t *response_buffer,
+                           uint16_t block_size, const coap_packet_t *message,
+                           oc_endpoint_t *endpoint)
+{
+  if (response_buffer->expected_size <= response_buffer->next_block_offset) {
+    response_buffer->expected_size = 0;
+  }
+  uint32_t window_end =
+    response_buffer->next_block_offset + OC_BLOCK_WISE_WINDOW * block_size;
+  uint32_t last_offset = 0;
+  if (response_buffer->expected_size > 0) {
+    last_offset =
+      ((response_buffer->expected_size - 1) / block_size) * block_size;
+  } else {
+    window_end = response_buffer->next_block_offset + block_size;
+  }
+  uint32_t offset = response_buffer->next_request_offset;
+  if (offset < response_buffer->next_block_offset) {
+    offset = response_buffer->next_block_offset;
+  }
+
+  oc_blockwise_response_state_t *response_state =
+    (oc_blockwise_response_state_t *)response_buffer;
+  if (response_state->observe_seq != -1 &&
+      (response_buffer->token_len == 0 ||
+       response_buffer->token_len != message->token_len ||
+       memcmp(response_buffer->token, message->token, message->token_len) !=
+         0)) {
+    /* follow-up requests of a notification use their own token */
+    int i = 0;
+    uint32_t r;
+    while (i < COAP_TOKEN_LEN) {
+      r = oc_random_value();
+      memcpy(response_buffer->token + i, &r, sizeof(r));
+      i += sizeof(r);
+    }
+    response_buffer->token_len = (uint8_t)i;
+  }
+  const uint8_t *token = message->token;
+  uint8_t token_len = message->token_len;
+  if (response_state->observe_seq != -1) {
+    token = response_buffer->token;
+    token_len = response_buffer->token_len;
+  }
+
+  int requested = 0;
+  while (offset < window_end && offset < (uint32_t)OC_MAX_APP_DATA_SIZE) {
+    if (response_buffer->expected_size > 0 &&
+        (offset >= response_buffer->expected_size ||
+         (offset == last_offset &&
+          offset != response_buffer->next_block_offset))) {
+      break;
+    }
+    coap_packet_t request[1];
+    coap_init_block_request(request, client_cb, endpoint);
+    coap_set_header_block2(request, offset / block_size, 0, block_size);
+    if (!coap_send_block_request(client_cb, token, token_len, request,
+                                 endpoint)) {
+      break;
+    }
+    response_buffer->mid = request->mid;
+    requested++;
+    offset += block_size;
+  }
+  if (offset > response_buffer->next_request_offset) {
+    response_buffer->next_request_offset = offset;
+  }
+  return requested;
+}
+#endif /* OC_CLIENT && OC_BLOCK_WISE */
+
 /*---------------------------------------------------------------------------*/
 /*- Internal API ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -277,6 +471,36 @@ coap_receive(oc_message_t *msg)
 #endif
       const char *href;
       size_t href_len = coap_get_header_uri_path(message, &href);
+#if defined(OC_SHARED_TRANSPORT) && defined(OC_SERVER)
+      /* Multicast requests were already copied to every device. A secured
+       * session is bound to the device whose credentials authenticated the
+       * peer, and may not reach another device by naming it with "di".
+       */
+      if (msg->endpoint.flags & SECURED) {
+        const char *query = NULL;
+        size_t query_len = coap_get_header_uri_query(message, &query);
+        if (oc_ri_get_request_device(msg->endpoint.device, NULL, 0, query,
+                                     query_len) != msg->endpoint.device) {
+          OC_ERR("secured request for another device");
+          if (msg->endpoint.flags & TCP) {
+            coap_send_empty_response(COAP_TYPE_NON, 0, message->token,
+                                     message->token_len, UNAUTHORIZED_4_01,
+                                     &msg->endpoint);
+          } else {
+            coap_send_empty_response(
+              message->type == COAP_TYPE_CON ? COAP_TYPE_ACK : COAP_TYPE_NON,
+              message->mid, message->token, message->token_len,
+              UNAUTHORIZED_4_01, &msg->endpoint);
+          }
+          return UNAUTHORIZED_4_01;
+        }
+      } else if (!(msg->endpoint.flags & MULTICAST)) {
+        const char *query = NULL;
+        size_t query_len = coap_get_header_uri_query(message, &query);
+        msg->endpoint.device = oc_ri_get_request_device(
+          msg->endpoint.device, href, href_len, query, query_len);
+      }
+#endif /* OC_SHARED_TRANSPORT && OC_SERVER */
 #ifdef OC_TCP
       if (msg->endpoint.flags & TCP) {
         coap_tcp_init_message(response, CONTENT_2_05);
@@ -345,13 +569,25 @@ coap_receive(oc_message_t *msg)
             if (oc_blockwise_handle_block(
                   request_buffer, block1_offset, incoming_block,
                   MIN((uint16_t)incoming_block_len, block1_size))) {
-              if (block1_more) {
+              if (!block1_more) {
+                oc_blockwise_handle_last_block(request_buffer);
+              }
+              if (!oc_blockwise_transfer_complete(request_buffer)) {
+                request_buffer->ref_count = 1;
+                if (!block1_more) {
+                  OC_DBG("last block arrived ahead of earlier blocks");
+                  if (message->type == COAP_TYPE_CON) {
+                    coap_send_empty_response(COAP_TYPE_ACK, message->mid, NULL,
+                                             0, 0, &msg->endpoint);
+                  }
+                  coap_status_code = CLEAR_TRANSACTION;
+                  goto send_message;
+                }
                 OC_DBG(
                   "more blocks expected; issuing request for the next block");
                 response->code = CONTINUE_2_31;
                 coap_set_header_block1(response, block1_num, block1_more,
                                        block1_size);
-                request_buffer->ref_count = 1;
                 goto send_message;
               } else {
                 OC_DBG("received all blocks for payload");
@@ -362,11 +598,9 @@ coap_receive(oc_message_t *msg)
                 coap_udp_init_message(response, COAP_TYPE_CON, CONTENT_2_05,
                                       coap_get_mid());
                 transaction->mid = response->mid;
-                coap_set_header_block1(response, block1_num, block1_more,
-                                       block1_size);
+                coap_set_header_block1(response, block1_num, 0, block1_size);
                 coap_set_header_accept(response, APPLICATION_VND_OCF_CBOR);
-                request_buffer->payload_size =
-                  request_buffer->next_block_offset;
+                oc_blockwise_finish_transfer(request_buffer);
                 request_buffer->ref_count = 0;
                 goto request_handler;
               }
@@ -380,8 +614,8 @@ coap_receive(oc_message_t *msg)
             href, href_len, &msg->endpoint, message->code, message->uri_query,
             message->uri_query_len, OC_BLOCKWISE_SERVER);
 
-          if (response_buffer && (response_buffer->next_block_offset -
-                                  block2_offset) > block2_size) {
+          if (response_buffer && block2_num == 0 &&
+              response_buffer->next_block_offset > block2_size) {
             oc_blockwise_free_response_buffer(response_buffer);
             response_buffer = NULL;
           }
@@ -448,7 +682,16 @@ coap_receive(oc_message_t *msg)
                 }
               }
               goto request_handler;
-            } else {
+            }
+#ifdef OC_SERVER
+            else if (message->code == COAP_GET &&
+                     is_stream_resource(href, href_len,
+                                        msg->endpoint.device)) {
+              OC_DBG("continuing streamed response");
+              goto request_handler;
+            }
+#endif /* OC_SERVER */
+            else {
               OC_ERR("initiating block-wise transfer with request for "
                      "block_num > 0");
             }
@@ -522,9 +765,10 @@ coap_receive(oc_message_t *msg)
 #endif /* !OC_BLOCK_WISE */
 #ifdef OC_BLOCK_WISE
       request_handler:
-        if (oc_ri_invoke_coap_entity_handler(message, response, &request_buffer,
-                                             &response_buffer, block2_size,
-                                             &msg->endpoint)) {
+        if (oc_ri_invoke_coap_entity_handler(
+              message, response, &request_buffer, &response_buffer,
+              block2_size, transaction->message->data + COAP_MAX_HEADER_SIZE,
+              &msg->endpoint)) {
 #else  /* OC_BLOCK_WISE */
         if (oc_ri_invoke_coap_entity_handler(message, response,
                                              transaction->message->data +
@@ -532,6 +776,13 @@ coap_receive(oc_message_t *msg)
                                              &msg->endpoint)) {
 #endif /* !OC_BLOCK_WISE */
 #ifdef OC_BLOCK_WISE
+#ifdef OC_SERVER
+          if (message->code == COAP_GET &&
+              is_stream_resource(href, href_len, msg->endpoint.device)) {
+            OC_DBG("streamed response; block was produced in place");
+            goto send_message;
+          }
+#endif /* OC_SERVER */
           uint32_t payload_size = 0;
 #ifdef OC_TCP
           if (msg->endpoint.flags & TCP) {
@@ -610,6 +861,33 @@ coap_receive(oc_message_t *msg)
 
 #ifdef OC_CLIENT
 #ifdef OC_BLOCK_WISE
+      if (client_cb && client_cb->stream && message->code != 0) {
+        uint32_t offset = block2 ? block2_offset : 0;
+        if (offset != client_cb->stream_offset) {
+          OC_DBG("dropping out-of-sequence block of streamed response");
+          goto send_message;
+        }
+        const uint8_t *chunk;
+        client_cb->stream_offset += (uint32_t)coap_get_payload(message, &chunk);
+        bool more = !error_response && block2 && block2_more;
+        oc_ri_invoke_client_stream_cb(message, client_cb, &msg->endpoint,
+                                      offset, more);
+        if (more && oc_ri_is_client_cb_valid(client_cb)) {
+          OC_DBG("requesting next block of streamed response");
+          coap_packet_t request[1];
+          coap_init_block_request(request, client_cb, &msg->endpoint);
+          coap_set_header_block2(request, block2_num + 1, 0, block2_size);
+          if (coap_send_block_request(client_cb, client_cb->token,
+                                      client_cb->token_len, request,
+                                      &msg->endpoint)) {
+            client_cb->mid = request->mid;
+          } else {
+            oc_ri_free_client_cbs_by_mid(client_cb->mid);
+          }
+        }
+        goto send_message;
+      }
+
       if (client_cb) {
         request_buffer = oc_blockwise_find_request_buffer_by_client_cb(
           &msg->endpoint, client_cb);
@@ -625,14 +903,23 @@ coap_receive(oc_message_t *msg)
         OC_DBG("found request buffer for uri %s",
                oc_string(request_buffer->href));
         client_cb = (oc_client_cb_t *)request_buffer->client_cb;
-        uint32_t payload_size = 0;
-        const void *payload = 0;
 
-        if (block1) {
-          payload = oc_blockwise_dispatch_block(request_buffer,
-                                                block1_offset + block1_size,
-                                                block1_size, &payload_size);
+        if (block1 && message->code == CONTINUE_2_31) {
+          uint32_t acked_offset = block1_offset + block1_size;
+          if (coap_send_block1_window(client_cb, request_buffer, acked_offset,
+                                      block1_size, message,
+                                      &msg->endpoint) > 0 ||
+              request_buffer->next_block_offset > acked_offset) {
+            OC_DBG("dispatched next blocks");
+            goto send_message;
+          }
+          request_buffer->ref_count = 0;
+        } else if (block1) {
+          OC_DBG("received final response to block-wise request");
+          request_buffer->ref_count = 0;
         } else {
+          uint32_t payload_size = 0;
+          const void *payload = 0;
           OC_DBG("initiating block-wise transfer with block1 option");
           uint32_t peer_mtu = 0;
           if (coap_get_header_size1(message, (uint32_t *)&peer_mtu) == 1) {
@@ -643,37 +930,34 @@ coap_receive(oc_message_t *msg)
           payload = oc_blockwise_dispatch_block(request_buffer, 0, block1_size,
                                                 &payload_size);
           request_buffer->ref_count = 1;
-        }
-        if (payload) {
-          OC_DBG("dispatching next block");
-          transaction = coap_new_transaction(response_mid, &msg->endpoint);
-          if (transaction) {
-            coap_udp_init_message(response, COAP_TYPE_CON, client_cb->method,
-                                  response_mid);
-            uint8_t more =
-              (request_buffer->next_block_offset < request_buffer->payload_size)
-                ? 1
-                : 0;
-            coap_set_header_uri_path(response, oc_string(client_cb->uri),
-                                     oc_string_len(client_cb->uri));
-            coap_set_payload(response, payload, payload_size);
-            if (block1) {
-              coap_set_header_block1(response, block1_num + 1, more,
-                                     block1_size);
-            } else {
+          if (payload) {
+            OC_DBG("dispatching next block");
+            transaction = coap_new_transaction(response_mid, &msg->endpoint);
+            if (transaction) {
+              coap_udp_init_message(response, COAP_TYPE_CON, client_cb->method,
+                                    response_mid);
+              uint8_t more = (request_buffer->next_block_offset <
+                              request_buffer->payload_size)
+                               ? 1
+                               : 0;
+              coap_set_header_uri_path(response, oc_string(client_cb->uri),
+                                       oc_string_len(client_cb->uri));
+              coap_set_payload(response, payload, payload_size);
               coap_set_header_block1(response, 0, more, block1_size);
               coap_set_header_size1(response, request_buffer->payload_size);
+              if (oc_string_len(client_cb->query) > 0) {
+                coap_set_header_uri_query(response,
+                                          oc_string(client_cb->query));
+              }
+              coap_set_header_accept(response, APPLICATION_VND_OCF_CBOR);
+              coap_set_header_content_format(response,
+                                             APPLICATION_VND_OCF_CBOR);
+              request_buffer->mid = response_mid;
+              goto send_message;
             }
-            if (oc_string_len(client_cb->query) > 0) {
-              coap_set_header_uri_query(response, oc_string(client_cb->query));
-            }
-            coap_set_header_accept(response, APPLICATION_VND_OCF_CBOR);
-            coap_set_header_content_format(response, APPLICATION_VND_OCF_CBOR);
-            request_buffer->mid = response_mid;
-            goto send_message;
+          } else {
+            request_buffer->ref_count = 0;
           }
-        } else {
-          request_buffer->ref_count = 0;
         }
       }
 
@@ -721,25 +1005,25 @@ coap_receive(oc_message_t *msg)
                                       incoming_block,
                                       (uint32_t)incoming_block_len)) {
           OC_DBG("processing incoming block");
-          if (block2 && block2_more) {
-            OC_DBG("issuing request for next block");
-            transaction = coap_new_transaction(response_mid, &msg->endpoint);
-            if (transaction) {
-              coap_udp_init_message(response, COAP_TYPE_CON, client_cb->method,
-                                    response_mid);
-              response_buffer->mid = response_mid;
-              coap_set_header_accept(response, APPLICATION_VND_OCF_CBOR);
-              coap_set_header_block2(response, block2_num + 1, 0, block2_size);
-              coap_set_header_uri_path(response, oc_string(client_cb->uri),
-                                       oc_string_len(client_cb->uri));
-              if (oc_string_len(client_cb->query) > 0) {
-                coap_set_header_uri_query(response,
-                                          oc_string(client_cb->query));
-              }
+          if (!block2 || !block2_more) {
+            oc_blockwise_handle_last_block(response_buffer);
+          }
+          if (block2 && !oc_blockwise_transfer_complete(response_buffer)) {
+            uint32_t size2 = 0;
+            if (coap_get_header_size2(message, &size2) == 1 &&
+                size2 <= (uint32_t)OC_MAX_APP_DATA_SIZE) {
+              response_buffer->expected_size = size2;
+            }
+            OC_DBG("issuing requests for next blocks");
+            if (coap_request_block2_window(client_cb, response_buffer,
+                                           block2_size, message,
+                                           &msg->endpoint) > 0 ||
+                response_buffer->next_request_offset >
+                  response_buffer->next_block_offset) {
               goto send_message;
             }
           }
-          response_buffer->payload_size = response_buffer->next_block_offset;
+          oc_blockwise_finish_transfer(response_buffer);
         }
       }
 
@@ -847,7 +1131,7 @@ send_message:
 #endif /* OC_CLIENT && OC_BLOCK_WISE */
     }
     transaction->message->length =
-      coap_serialize_message(response, transaction->message->data);
+      coap_serialize_message_into(response, transaction->message);
     if (transaction->message->length > 0) {
       coap_send_transaction(transaction);
     } else {
@@ -885,7 +1169,9 @@ OC_PROCESS_THREAD(coap_engine, ev, data)
     OC_PROCESS_YIELD();
 
     if (ev == oc_events[INBOUND_RI_EVENT]) {
+      OC_METRICS_TRACE_BEGIN((oc_message_t *)data);
       coap_receive(data);
+      OC_METRICS_TRACE_END();
 
       oc_message_unref(data);
     } else if (ev == OC_PROCESS_EVENT_TIMER) {
@@ -54,6 +54,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "api/oc_metrics_internal.h"
 #include "oc_buffer.h"
 #ifdef OC_SECURITY
 #include "security/oc_acl_internal.h"
@@ -69,6 +70,8 @@
 #endif /* OC_COLLECTIONS */
 
 #include "oc_coap.h"
+#include "oc_core_res.h"
+#include "oc_discovery.h"
 #include "oc_endpoint.h"
 #include "oc_rep.h"
 #include "oc_ri.h"
@@ -78,6 +81,8 @@ int32_t observe_counter = 3;
 OC_LIST(observers_list);
 OC_MEMB(observers_memb, coap_observer_t, COAP_MAX_OBSERVERS);
 
+static void remove_pending_notifications(const oc_resource_t *resource);
+static bool has_notify_scheduler(const oc_endpoint_t *endpoint);
 /*---------------------------------------------------------------------------*/
 /*- Internal API ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -133,6 +138,9 @@ add_observer(oc_resource_t *resource, oc_endpoint_t *endpoint,
     o->block2_size = block2_size;
 #endif /* OC_BLOCK_WISE */
     resource->num_observers++;
+    if (has_notify_scheduler(endpoint)) {
+      resource->num_scheduled_observers++;
+    }
 #ifdef OC_DYNAMIC_ALLOCATION
     OC_DBG("Adding observer (%u) for /%s [0x%02X%02X]",
            oc_list_length(observers_list) + 1, oc_string(o->url), o->token[0],
@@ -143,6 +151,7 @@ add_observer(oc_resource_t *resource, oc_endpoint_t *endpoint,
            oc_string(o->url), o->token[0], o->token[1]);
 #endif /* !OC_DYNAMIC_ALLOCATION */
     oc_list_add(observers_list, o);
+    OC_METRICS_GAUGE_ADD(OC_METRICS_OBSERVERS, 1);
     return dup;
   }
   OC_WRN("insufficient memory to add new observer");
@@ -198,9 +207,13 @@ coap_remove_observer(coap_observer_t *o)
   }
 #endif /* OC_BLOCK_WISE */
   o->resource->num_observers--;
+  if (has_notify_scheduler(&o->endpoint)) {
+    o->resource->num_scheduled_observers--;
+  }
   oc_free_string(&o->url);
   oc_list_remove(observers_list, o);
   oc_memb_free(&observers_memb, o);
+  OC_METRICS_GAUGE_ADD(OC_METRICS_OBSERVERS, -1);
 }
 void
 coap_free_all_observers(void)
@@ -283,6 +296,8 @@ coap_remove_observer_by_resource(const oc_resource_t *rsc)
   int removed = 0;
   coap_observer_t *obs = (coap_observer_t *)oc_list_head(observers_list), *next;
 
+  remove_pending_notifications(rsc);
+
   while (obs) {
     next = obs->next;
     if ((obs->resource == rsc) &&
@@ -413,7 +428,7 @@ coap_notify_collection_observers(oc_resource_t *resource,
       obs->last_mid = transaction->mid;
       notification->mid = transaction->mid;
       transaction->message->length =
-        coap_serialize_message(notification, transaction->message->data);
+        coap_serialize_message_into(notification, transaction->message);
       if (transaction->message->length > 0) {
         coap_send_transaction(transaction);
       } else {
@@ -536,6 +551,50 @@ coap_notify_collection_links_list(oc_collection_t *collection)
   return 0;
 }
 
+int
+coap_notify_collection_changed_links(oc_collection_t *collection)
+{
+  oc_link_t *link = (oc_link_t *)oc_list_head(collection->links);
+  while (link && !(link->notify_pending && link->resource)) {
+    link = link->next;
+  }
+  if (!link) {
+    return 0;
+  }
+#ifndef OC_DYNAMIC_ALLOCATION
+  uint8_t buffer[OC_MAX_APP_DATA_SIZE];
+#else  /* !OC_DYNAMIC_ALLOCATION */
+  uint8_t *buffer = malloc(OC_MAX_APP_DATA_SIZE);
+  if (!buffer) {
+    OC_WRN(
+      "coap_notify_collection_changed_links: out of memory allocating buffer");
+    return -1;
+  }
+#endif /* OC_DYNAMIC_ALLOCATION */
+  oc_request_t request = { 0 };
+  oc_response_t response = { 0 };
+  response.separate_response = 0;
+  oc_response_buffer_t response_buffer;
+  response_buffer.buffer = buffer;
+  response_buffer.buffer_size = (uint16_t)OC_MAX_APP_DATA_SIZE;
+  response.response_buffer = &response_buffer;
+  request.response = &response;
+  request.request_payload = NULL;
+  oc_rep_new(response_buffer.buffer, response_buffer.buffer_size);
+
+  request.resource = (oc_resource_t *)collection;
+
+  /* selects the given resource and every other link marked pending */
+  oc_handle_collection_request(OC_GET, &request, OC_IF_B, link->resource);
+  coap_notify_collection_observers(request.resource, &response_buffer, OC_IF_B);
+
+#ifdef OC_DYNAMIC_ALLOCATION
+  if (buffer)
+    free(buffer);
+#endif /* OC_DYNAMIC_ALLOCATION */
+  return 0;
+}
+
 static int
 coap_notify_collections(oc_resource_t *resource)
 {
@@ -567,6 +626,10 @@ coap_notify_collections(oc_resource_t *resource)
   for (collection = oc_get_next_collection_with_link(resource, NULL);
        collection != NULL && collection->num_observers > 0;
        collection = oc_get_next_collection_with_link(resource, collection)) {
+    if (oc_collection_defer_batch_notification(collection, resource)) {
+      OC_DBG("coap_notify_collections: deferred batch notification");
+      continue;
+    }
     OC_DBG("coap_notify_collections: Issue GET request to collection for "
            "resource");
 
@@ -612,7 +675,7 @@ coap_remove_observers_on_dos_change(size_t device, bool reset)
       if (transaction) {
         notification->mid = transaction->mid;
         transaction->message->length =
-          coap_serialize_message(notification, transaction->message->data);
+          coap_serialize_message_into(notification, transaction->message);
         if (transaction->message->length > 0) {
           coap_send_transaction(transaction);
         } else {
@@ -629,27 +692,394 @@ coap_remove_observers_on_dos_change(size_t device, bool reset)
 }
 #endif /* OC_SECURITY */
 
-int
-coap_notify_observers(oc_resource_t *resource,
-                      oc_response_buffer_t *response_buf,
-                      oc_endpoint_t *endpoint)
+/*---------------------------------------------------------------------------*/
+/*- Notification scheduling -------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+/* Observers reached through an endpoint with a notification scheduler (such
+ * as the cloud session) are not notified synchronously. Changed resources are
+ * queued once per endpoint, so the last value wins, and are flushed at the end
+ * of the coalescing window at a rate bounded by a token bucket. When the
+ * endpoint observes /oic/res with oic.if.b, all changed resources are sent to
+ * it in a single batch notification.
+ */
+typedef struct coap_pending_notification_s
 {
-  if (!resource) {
-    OC_WRN("coap_notify_observers: no resource passed; returning");
-    return 0;
+  struct coap_pending_notification_s *next;
+  oc_resource_t *resource;
+  bool batched;
+} coap_pending_notification_t;
+
+typedef struct coap_notify_scheduler_s
+{
+  struct coap_notify_scheduler_s *next;
+  oc_endpoint_t endpoint;
+  oc_clock_time_t window;
+  oc_clock_time_t last_refill;
+  uint16_t rate;
+  uint16_t burst;
+  uint16_t tokens;
+  bool scheduled;
+  OC_LIST_STRUCT(pending);
+} coap_notify_scheduler_t;
+
+OC_LIST(notify_schedulers);
+OC_MEMB(notify_schedulers_s, coap_notify_scheduler_t, OC_MAX_NUM_DEVICES);
+OC_MEMB(pending_notifications_s, coap_pending_notification_t,
+        COAP_MAX_OBSERVERS);
+
+static void notify_resource_observers(oc_resource_t *resource,
+                                      oc_response_buffer_t *response_buf,
+                                      oc_endpoint_t *endpoint,
+                                      oc_interface_mask_t iface_mask);
+
+static coap_notify_scheduler_t *
+find_notify_scheduler(const oc_endpoint_t *endpoint)
+{
+  coap_notify_scheduler_t *s =
+    (coap_notify_scheduler_t *)oc_list_head(notify_schedulers);
+  while (s != NULL && oc_endpoint_compare(&s->endpoint, endpoint) != 0) {
+    s = s->next;
   }
+  return s;
+}
+
+static bool
+has_notify_scheduler(const oc_endpoint_t *endpoint)
+{
+  return find_notify_scheduler(endpoint) != NULL;
+}
+
+/* Keep num_scheduled_observers of every resource observed through endpoint
+ * in step as its scheduler comes and goes.
+ */
+static void
+count_scheduled_observers(const oc_endpoint_t *endpoint, int delta)
+{
+  coap_observer_t *obs = (coap_observer_t *)oc_list_head(observers_list);
+  for (; obs != NULL; obs = obs->next) {
+    if (oc_endpoint_compare(&obs->endpoint, endpoint) == 0) {
+      obs->resource->num_scheduled_observers =
+        (uint8_t)(obs->resource->num_scheduled_observers + delta);
+    }
+  }
+}
+
+static coap_observer_t *
+find_observer(const oc_resource_t *resource, const oc_endpoint_t *endpoint)
+{
+  coap_observer_t *obs = (coap_observer_t *)oc_list_head(observers_list);
+  while (obs != NULL && (obs->resource != resource ||
+                         oc_endpoint_compare(&obs->endpoint, endpoint) != 0)) {
+    obs = obs->next;
+  }
+  return obs;
+}
+
+static coap_observer_t *
+find_batch_observer(coap_notify_scheduler_t *s)
+{
+#ifdef OC_RES_BATCH_SUPPORT
+  oc_resource_t *res =
+    oc_core_get_resource_by_index(OCF_RES, s->endpoint.device);
+  coap_observer_t *obs = (coap_observer_t *)oc_list_head(observers_list);
+  for (; obs != NULL; obs = obs->next) {
+    if (obs->resource == res && obs->iface_mask == OC_IF_B &&
+        oc_endpoint_compare(&obs->endpoint, &s->endpoint) == 0) {
+      return obs;
+    }
+  }
+#else  /* OC_RES_BATCH_SUPPORT */
+  (void)s;
+#endif /* !OC_RES_BATCH_SUPPORT */
+  return NULL;
+}
+
+static bool
+has_immediate_observers(const oc_resource_t *resource)
+{
+#ifdef OC_COLLECTIONS
+  /* collections are never deferred to a scheduler */
+  if (oc_check_if_collection((oc_resource_t *)resource)) {
+    return resource->num_observers > 0;
+  }
+#endif /* OC_COLLECTIONS */
+  return resource->num_observers > resource->num_scheduled_observers;
+}
+
+static void
+refill_notify_tokens(coap_notify_scheduler_t *s)
+{
+  oc_clock_time_t now = oc_clock_loop_time();
+  if (s->rate == 0 || s->tokens >= s->burst) {
+    s->tokens = s->burst;
+    s->last_refill = now;
+    return;
+  }
+  oc_clock_time_t earned = (now - s->last_refill) * s->rate / OC_CLOCK_SECOND;
+  if (earned > 0) {
+    s->last_refill += earned * OC_CLOCK_SECOND / s->rate;
+    s->tokens = (earned >= (oc_clock_time_t)(s->burst - s->tokens))
+                  ? s->burst
+                  : (uint16_t)(s->tokens + earned);
+  }
+}
+
+static bool
+take_notify_token(coap_notify_scheduler_t *s)
+{
+  if (s->rate == 0) {
+    return true;
+  }
+  if (s->tokens == 0) {
+    return false;
+  }
+  s->tokens--;
+  return true;
+}
+
+static void
+free_pending_notification(coap_notify_scheduler_t *s,
+                          coap_pending_notification_t *p)
+{
+  oc_list_remove(s->pending, p);
+  oc_memb_free(&pending_notifications_s, p);
+}
+
+#ifdef OC_RES_BATCH_SUPPORT
+static void
+send_batch_notification(coap_notify_scheduler_t *s, coap_observer_t *obs)
+{
+#ifndef OC_DYNAMIC_ALLOCATION
+  uint8_t buffer[OC_MAX_APP_DATA_SIZE];
+#else  /* !OC_DYNAMIC_ALLOCATION */
+  uint8_t *buffer = malloc(OC_MAX_APP_DATA_SIZE);
+  if (!buffer) {
+    OC_WRN("send_batch_notification: out of memory allocating buffer");
+    return;
+  }
+#endif /* OC_DYNAMIC_ALLOCATION */
+  oc_response_buffer_t response_buffer;
+  response_buffer.buffer = buffer;
+  response_buffer.buffer_size = (uint16_t)OC_MAX_APP_DATA_SIZE;
+  oc_rep_new(response_buffer.buffer, response_buffer.buffer_size);
+
+  CborEncoder encoder;
+  oc_rep_start_links_array();
+  memcpy(&encoder, &g_encoder, sizeof(CborEncoder));
+  coap_pending_notification_t *p =
+    (coap_pending_notification_t *)oc_list_head(s->pending);
+  for (; p != NULL; p = p->next) {
+    if (!p->batched) {
+      oc_discovery_process_batch_response(&links_array, p->resource,
+                                          &s->endpoint);
+    }
+  }
+  memcpy(&g_encoder, &encoder, sizeof(CborEncoder));
+  oc_rep_end_links_array();
+
+  int response_length = oc_rep_get_encoded_payload_size();
+  if (response_length > 0) {
+    response_buffer.response_length = (uint16_t)response_length;
+    response_buffer.code = oc_status_code(OC_STATUS_OK);
+    response_buffer.content_format = APPLICATION_VND_OCF_CBOR;
+    OC_DBG("send_batch_notification: notifying batch observer");
+    /* observers of /oic/res on other interfaces expect their own format */
+    notify_resource_observers(obs->resource, &response_buffer, &s->endpoint,
+                              OC_IF_B);
+    for (p = (coap_pending_notification_t *)oc_list_head(s->pending); p;
+         p = p->next) {
+      p->batched = true;
+    }
+  }
+
+#ifdef OC_DYNAMIC_ALLOCATION
+  free(buffer);
+#endif /* OC_DYNAMIC_ALLOCATION */
+}
+#endif /* OC_RES_BATCH_SUPPORT */
+
+static oc_event_callback_retval_t
+flush_notifications(void *data)
+{
+  coap_notify_scheduler_t *s = (coap_notify_scheduler_t *)data;
+  s->scheduled = false;
+  refill_notify_tokens(s);
 
 #ifdef OC_SECURITY
-  oc_sec_pstat_t *ps = oc_sec_get_pstat(resource->device);
+  oc_sec_pstat_t *ps = oc_sec_get_pstat(s->endpoint.device);
   if (ps->s != OC_DOS_RFNOP) {
-    OC_WRN("coap_notify_observers: device not in RFNOP; skipping notification");
-    return 0;
+    goto reschedule;
   }
 #endif /* OC_SECURITY */
 
+#ifdef OC_RES_BATCH_SUPPORT
+  coap_observer_t *batch_obs = find_batch_observer(s);
+  if (batch_obs) {
+    coap_pending_notification_t *p =
+      (coap_pending_notification_t *)oc_list_head(s->pending);
+    while (p != NULL && p->batched) {
+      p = p->next;
+    }
+    if (p && take_notify_token(s)) {
+      send_batch_notification(s, batch_obs);
+    }
+  }
+#endif /* OC_RES_BATCH_SUPPORT */
+
+  coap_pending_notification_t *p =
+    (coap_pending_notification_t *)oc_list_head(s->pending);
+  while (p != NULL) {
+    coap_pending_notification_t *next = p->next;
+    if (find_observer(p->resource, &s->endpoint)) {
+      if (!take_notify_token(s)) {
+        break;
+      }
+      notify_resource_observers(p->resource, NULL, &s->endpoint, 0);
+      free_pending_notification(s, p);
+    } else if (p->batched || !find_batch_observer(s)) {
+      free_pending_notification(s, p);
+    }
+    p = next;
+  }
+
+#ifdef OC_SECURITY
+reschedule:
+#endif /* OC_SECURITY */
+  if (oc_list_length(s->pending) > 0) {
+    /* Out of tokens, retry once the next one has been earned */
+    oc_clock_time_t ticks = s->window;
+    if (s->rate > 0 && OC_CLOCK_SECOND / s->rate > ticks) {
+      ticks = OC_CLOCK_SECOND / s->rate;
+    }
+    oc_ri_add_timed_event_callback_ticks(s, flush_notifications,
+                                         ticks > 0 ? ticks : 1);
+    s->scheduled = true;
+  }
+  return OC_EVENT_DONE;
+}
+
+static void
+schedule_notifications(oc_resource_t *resource)
+{
+#ifdef OC_COLLECTIONS
+  if (oc_check_if_collection(resource)) {
+    return;
+  }
+#endif /* OC_COLLECTIONS */
+  coap_notify_scheduler_t *s =
+    (coap_notify_scheduler_t *)oc_list_head(notify_schedulers);
+  for (; s != NULL; s = s->next) {
+    if (s->endpoint.device != resource->device) {
+      continue;
+    }
+    if (!find_observer(resource, &s->endpoint) &&
+        (!(resource->properties & OC_DISCOVERABLE) || !find_batch_observer(s))) {
+      continue;
+    }
+    coap_pending_notification_t *p =
+      (coap_pending_notification_t *)oc_list_head(s->pending);
+    while (p != NULL && p->resource != resource) {
+      p = p->next;
+    }
+    if (p) {
+      /* Already queued, the flush reads the latest representation */
+      p->batched = false;
+    } else {
+      p = oc_memb_alloc(&pending_notifications_s);
+      if (!p) {
+        OC_WRN("insufficient memory to queue notification");
+        continue;
+      }
+      p->resource = resource;
+      p->batched = false;
+      oc_list_add(s->pending, p);
+    }
+    if (!s->scheduled) {
+      oc_ri_add_timed_event_callback_ticks(s, flush_notifications, s->window);
+      s->scheduled = true;
+    }
+  }
+}
+
+static void
+remove_pending_notifications(const oc_resource_t *resource)
+{
+  coap_notify_scheduler_t *s =
+    (coap_notify_scheduler_t *)oc_list_head(notify_schedulers);
+  for (; s != NULL; s = s->next) {
+    coap_pending_notification_t *p =
+      (coap_pending_notification_t *)oc_list_head(s->pending);
+    while (p != NULL) {
+      coap_pending_notification_t *next = p->next;
+      if (p->resource == resource) {
+        free_pending_notification(s, p);
+      }
+      p = next;
+    }
+  }
+}
+
+int
+coap_set_notify_scheduler(oc_endpoint_t *endpoint, uint16_t window_ms,
+                          uint16_t rate, uint16_t burst)
+{
+  if (!endpoint) {
+    return -1;
+  }
+  coap_notify_scheduler_t *s = find_notify_scheduler(endpoint);
+  if (!s) {
+    s = oc_memb_alloc(&notify_schedulers_s);
+    if (!s) {
+      OC_WRN("insufficient memory to add notification scheduler");
+      return -1;
+    }
+    memcpy(&s->endpoint, endpoint, sizeof(oc_endpoint_t));
+    s->endpoint.next = NULL;
+    s->scheduled = false;
+    OC_LIST_STRUCT_INIT(s, pending);
+    oc_list_add(notify_schedulers, s);
+    count_scheduled_observers(endpoint, 1);
+  }
+  s->window = (oc_clock_time_t)window_ms * OC_CLOCK_SECOND / 1000;
+  s->rate = rate;
+  s->burst = burst > 0 ? burst : 1;
+  s->tokens = s->burst;
+  s->last_refill = oc_clock_loop_time();
+  return 0;
+}
+
+void
+coap_remove_notify_scheduler(oc_endpoint_t *endpoint)
+{
+  coap_notify_scheduler_t *s = find_notify_scheduler(endpoint);
+  if (!s) {
+    return;
+  }
+  oc_ri_remove_timed_event_callback(s, flush_notifications);
+  coap_pending_notification_t *p =
+    (coap_pending_notification_t *)oc_list_pop(s->pending);
+  while (p != NULL) {
+    oc_memb_free(&pending_notifications_s, p);
+    p = (coap_pending_notification_t *)oc_list_pop(s->pending);
+  }
+  oc_list_remove(notify_schedulers, s);
+  oc_memb_free(&notify_schedulers_s, s);
+  count_scheduled_observers(endpoint, -1);
+}
+/*---------------------------------------------------------------------------*/
+/* Notify the observers of resource, only those reached through endpoint if
+ * not NULL and only those observing on iface_mask if not 0.
+ */
+static void
+notify_resource_observers(oc_resource_t *resource,
+                          oc_response_buffer_t *response_buf,
+                          oc_endpoint_t *endpoint,
+                          oc_interface_mask_t iface_mask)
+{
   bool resource_is_collection = false;
   coap_observer_t *obs = NULL;
-  if (resource->num_observers > 0) {
+  if (resource->num_observers > 0 &&
+      (endpoint || has_immediate_observers(resource))) {
 #ifdef OC_BLOCK_WISE
     oc_blockwise_state_t *response_state = NULL;
 #endif /* OC_BLOCK_WISE */
@@ -712,6 +1142,16 @@ coap_notify_observers(oc_resource_t *resource,
         obs = obs->next;
         continue;
       }
+      if (iface_mask != 0 && obs->iface_mask != iface_mask) {
+        obs = obs->next;
+        continue;
+      }
+      /* notification deferred to the endpoint's scheduler */
+      if (!endpoint && !resource_is_collection &&
+          find_notify_scheduler(&obs->endpoint)) {
+        obs = obs->next;
+        continue;
+      }
       if (response.separate_response != NULL) {
         coap_packet_t req[1];
 #ifdef OC_TCP
@@ -836,7 +1276,7 @@ coap_notify_observers(oc_resource_t *resource,
             obs->last_mid = transaction->mid;
             notification->mid = transaction->mid;
             transaction->message->length =
-              coap_serialize_message(notification, transaction->message->data);
+              coap_serialize_message_into(notification, transaction->message);
             if (transaction->message->length > 0) {
               coap_send_transaction(transaction);
             } else {
@@ -857,6 +1297,31 @@ coap_notify_observers(oc_resource_t *resource,
   else {
     OC_WRN("coap_notify_observers: no observers");
   }
+}
+
+int
+coap_notify_observers(oc_resource_t *resource,
+                      oc_response_buffer_t *response_buf,
+                      oc_endpoint_t *endpoint)
+{
+  if (!resource) {
+    OC_WRN("coap_notify_observers: no resource passed; returning");
+    return 0;
+  }
+
+#ifdef OC_SECURITY
+  oc_sec_pstat_t *ps = oc_sec_get_pstat(resource->device);
+  if (ps->s != OC_DOS_RFNOP) {
+    OC_WRN("coap_notify_observers: device not in RFNOP; skipping notification");
+    return 0;
+  }
+#endif /* OC_SECURITY */
+
+  if (!response_buf && !endpoint) {
+    schedule_notifications(resource);
+  }
+
+  notify_resource_observers(resource, response_buf, endpoint, 0);
 
 #ifdef OC_COLLECTIONS
   int num_links = 0;
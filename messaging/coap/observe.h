@@ -96,6 +96,7 @@ int coap_notify_observers(oc_resource_t *resource,
                           oc_endpoint_t *endpoint);
 int coap_notify_collection_links_list(oc_collection_t *collection);
 int coap_notify_collection_batch(oc_collection_t *collection);
+int coap_notify_collection_changed_links(oc_collection_t *collection);
 int coap_notify_collection_baseline(oc_collection_t *collection);
 
 #ifdef OC_BLOCK_WISE
@@ -110,6 +111,10 @@ int coap_observe_handler(void *request, void *response, oc_resource_t *resource,
 
 int coap_remove_observers_on_dos_change(size_t device, bool reset);
 
+int coap_set_notify_scheduler(oc_endpoint_t *endpoint, uint16_t window_ms,
+                              uint16_t rate, uint16_t burst);
+void coap_remove_notify_scheduler(oc_endpoint_t *endpoint);
+
 #ifdef __cplusplus
 }
 #endif
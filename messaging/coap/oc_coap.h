@@ -29,6 +29,7 @@ struct oc_separate_response_s
 {
   OC_LIST_STRUCT(requests);
   int active;
+  int defer_ack; /* confirmable requests are not ACKed on acceptance */
 #ifdef OC_DYNAMIC_ALLOCATION
   uint8_t *buffer;
 #else  /* OC_DYNAMIC_ALLOCATION */
@@ -72,6 +72,9 @@ OC_MEMB(separate_requests, coap_separate_t, OC_MAX_NUM_CONCURRENT_REQUESTS);
  * for a separate response or otherwise cannot execute the resource handler,
  * this function will respond with 5.03 Service Unavailable. The client can
  * then retry later.
+ *
+ * If defer_ack is set on the handle, the ACK of a confirmable request is held
+ * back so that the response can still be piggy-backed on it.
  */
 #ifdef OC_BLOCK_WISE
 int
@@ -134,29 +137,17 @@ coap_separate_accept(void *request, oc_separate_response_t *separate_response,
 
   separate_store->observe = observe;
 
-  /* send separate ACK for CON */
-  if (coap_req->type == COAP_TYPE_CON) {
+  if (coap_req->type == COAP_TYPE_CON && separate_response->defer_ack) {
+    /* hold back the ACK, see coap_separate_ack() */
+    separate_store->type = COAP_TYPE_ACK;
+    separate_store->mid = coap_req->mid;
+  } else if (coap_req->type == COAP_TYPE_CON) {
+    /* send separate ACK for CON */
     OC_DBG("Sending ACK for separate response");
     coap_packet_t ack[1];
     /* ACK with empty code (0) */
     coap_udp_init_message(ack, COAP_TYPE_ACK, 0, coap_req->mid);
-    oc_message_t *message = oc_internal_allocate_outgoing_message();
-    if (message != NULL) {
-      memcpy(&message->endpoint, endpoint, sizeof(oc_endpoint_t));
-      message->length = coap_serialize_message(ack, message->data);
-      bool success = false;
-      if (message->length > 0) {
-        coap_send_message(message);
-        success = true;
-      }
-      if (message->ref_count == 0) {
-        oc_message_unref(message);
-      }
-      if (!success) {
-        coap_separate_clear(separate_response, separate_store);
-        return 0;
-      }
-    } else {
+    if (!coap_separate_send_ack(ack, endpoint)) {
       coap_separate_clear(separate_response, separate_store);
       return 0;
     }
@@ -165,6 +156,42 @@ coap_separate_accept(void *request, oc_separate_response_t *separate_response,
   return 1;
 }
 /*----------------------------------------------------------------------------*/
+int
+coap_separate_send_ack(void *ack, oc_endpoint_t *endpoint)
+{
+  oc_message_t *message = oc_internal_allocate_outgoing_message();
+  if (message == NULL) {
+    return 0;
+  }
+  memcpy(&message->endpoint, endpoint, sizeof(oc_endpoint_t));
+  message->length = coap_serialize_message_into(ack, message);
+  int success = 0;
+  if (message->length > 0) {
+    coap_send_message(message);
+    success = 1;
+  }
+  if (message->ref_count == 0) {
+    oc_message_unref(message);
+  }
+  return success;
+}
+/*----------------------------------------------------------------------------*/
+void
+coap_separate_ack(oc_separate_response_t *separate_response)
+{
+  coap_separate_t *separate_store = oc_list_head(separate_response->requests);
+  for (; separate_store != NULL; separate_store = separate_store->next) {
+    if (separate_store->type != COAP_TYPE_ACK) {
+      continue;
+    }
+    OC_DBG("Sending deferred ACK for separate response");
+    coap_packet_t ack[1];
+    coap_udp_init_message(ack, COAP_TYPE_ACK, 0, separate_store->mid);
+    coap_separate_send_ack(ack, &separate_store->endpoint);
+    separate_store->type = COAP_TYPE_NON;
+  }
+}
+/*----------------------------------------------------------------------------*/
 void
 coap_separate_resume(void *response, coap_separate_t *separate_store,
                      uint8_t code, uint16_t mid)
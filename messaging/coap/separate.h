@@ -61,6 +61,7 @@ typedef struct coap_separate
 {
   struct coap_separate *next;
   coap_message_type_t type;
+  uint16_t mid; /* of a request whose ACK is held back */
   uint8_t token_len;
   uint8_t token[COAP_TOKEN_LEN];
   uint16_t block2_size;
@@ -81,6 +82,11 @@ int coap_separate_accept(void *request,
                          oc_endpoint_t *endpoint, int observe);
 #endif /* OC_BLOCK_WISE */
 
+/* Send an ACK outside of any transaction. */
+int coap_separate_send_ack(void *ack, oc_endpoint_t *endpoint);
+/* Send the empty ACKs held back for the requests of a handle whose defer_ack
+ * is set. Until then its response is piggy-backed on those ACKs. */
+void coap_separate_ack(oc_separate_response_t *separate_response);
 void coap_separate_resume(void *response, coap_separate_t *separate_store,
                           uint8_t code, uint16_t mid);
 void coap_separate_clear(oc_separate_response_t *separate_response,
@@ -47,6 +47,7 @@
 
 #include "transactions.h"
 #include "api/oc_main.h"
+#include "api/oc_metrics_internal.h"
 #include "observe.h"
 #include "oc_buffer.h"
 #include "util/oc_list.h"
@@ -142,6 +143,7 @@ coap_send_transaction(coap_transaction_t *t)
            (oc_clock_time_t)COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
         OC_DBG("Initial interval %d", (int)t->retrans_timer.timer.interval);
       } else {
+        OC_METRICS_INC(OC_METRICS_COAP_RETRANSMISSIONS);
         t->retrans_timer.timer.interval <<= 1; /* double */
         OC_DBG("Doubled %d", (int)t->retrans_timer.timer.interval);
       }
@@ -158,6 +160,7 @@ coap_send_transaction(coap_transaction_t *t)
     } else {
       /* timed out */
       OC_WRN("Timeout");
+      OC_METRICS_INC(OC_METRICS_COAP_TIMEOUTS);
 #ifdef OC_SERVER
       /* remove observers */
       coap_remove_observer_by_client(&t->message->endpoint);
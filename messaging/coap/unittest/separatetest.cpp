@@ -0,0 +1,126 @@
+/******************************************************************
+ *
+ * Copyright 2020 Cascoda Ltd All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+
+#include "coap.h"
+#include "oc_api.h"
+#include "oc_coap.h"
+#include "separate.h"
+
+#ifdef OC_SERVER
+
+/* nothing listens on the discard port */
+#define CLIENT_ENDPOINT "coap://[::1]:9"
+#define REQUEST_URI "/separate"
+#define REQUEST_MID (0x1234)
+
+class TestSeparate : public testing::Test {
+public:
+  static oc_handler_t s_handler;
+
+  static int appInit(void)
+  {
+    int result = oc_init_platform("Cascoda", NULL, NULL);
+    result |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                            "ocf.res.1.0.0", NULL, NULL);
+    return result;
+  }
+
+  static void signalEventLoop(void) {}
+
+protected:
+  static void SetUpTestCase()
+  {
+    s_handler.init = &appInit;
+    s_handler.signal_event_loop = &signalEventLoop;
+    ASSERT_EQ(0, oc_main_init(&s_handler));
+  }
+
+  static void TearDownTestCase() { oc_main_shutdown(); }
+
+  virtual void SetUp()
+  {
+    memset(&ep, 0, sizeof(ep));
+    oc_string_t ep_str;
+    oc_new_string(&ep_str, CLIENT_ENDPOINT, strlen(CLIENT_ENDPOINT));
+    ASSERT_EQ(0, oc_string_to_endpoint(&ep_str, &ep, NULL));
+    oc_free_string(&ep_str);
+    memset(&handle, 0, sizeof(handle));
+  }
+
+  virtual void TearDown()
+  {
+    coap_separate_t *cur = (coap_separate_t *)oc_list_head(handle.requests);
+    while (cur != NULL) {
+      coap_separate_t *next = cur->next;
+      coap_separate_clear(&handle, cur);
+      cur = next;
+    }
+#ifdef OC_DYNAMIC_ALLOCATION
+    free(handle.buffer);
+#endif /* OC_DYNAMIC_ALLOCATION */
+  }
+
+  /* Accept a confirmable request for a separate response. */
+  int accept(void)
+  {
+    uint8_t token = 1;
+    coap_packet_t request[1];
+    coap_udp_init_message(request, COAP_TYPE_CON, COAP_GET, REQUEST_MID);
+    coap_set_token(request, &token, 1);
+    coap_set_header_uri_path(request, REQUEST_URI, strlen(REQUEST_URI));
+#ifdef OC_BLOCK_WISE
+    return coap_separate_accept(request, &handle, &ep, 2, OC_BLOCK_SIZE);
+#else  /* OC_BLOCK_WISE */
+    return coap_separate_accept(request, &handle, &ep, 2);
+#endif /* !OC_BLOCK_WISE */
+  }
+
+  oc_endpoint_t ep;
+  oc_separate_response_t handle;
+};
+
+oc_handler_t TestSeparate::s_handler;
+
+TEST_F(TestSeparate, AckOnAccept)
+{
+  ASSERT_EQ(1, accept());
+  coap_separate_t *store = (coap_separate_t *)oc_list_head(handle.requests);
+  ASSERT_NE(nullptr, store);
+  /* acknowledged right away, the response follows on its own */
+  EXPECT_EQ(COAP_TYPE_NON, store->type);
+}
+
+TEST_F(TestSeparate, DeferredAck)
+{
+  handle.defer_ack = 1;
+  ASSERT_EQ(1, accept());
+  coap_separate_t *store = (coap_separate_t *)oc_list_head(handle.requests);
+  ASSERT_NE(nullptr, store);
+  /* the response would be piggy-backed on the request's ACK */
+  EXPECT_EQ(COAP_TYPE_ACK, store->type);
+  EXPECT_EQ(REQUEST_MID, store->mid);
+
+  coap_separate_ack(&handle);
+  EXPECT_EQ(COAP_TYPE_NON, store->type);
+}
+
+#endif /* OC_SERVER */
@@ -16,7 +16,6 @@
 
 #include "port/oc_clock.h"
 #include "port/oc_log.h"
-#include <math.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -31,7 +30,21 @@ oc_clock_time(void)
   struct timespec t;
   if (clock_gettime(CLOCK_REALTIME, &t) != -1) {
     time = (oc_clock_time_t)t.tv_sec * OC_CLOCK_SECOND +
-           (oc_clock_time_t)ceil(t.tv_nsec / (1.e09 / OC_CLOCK_SECOND));
+           ((oc_clock_time_t)t.tv_nsec * OC_CLOCK_SECOND + 999999999) /
+             1000000000;
+  }
+  return time;
+}
+
+oc_clock_time_t
+oc_clock_time_monotonic(void)
+{
+  oc_clock_time_t time = 0;
+  struct timespec t;
+  if (clock_gettime(CLOCK_MONOTONIC, &t) != -1) {
+    time = (oc_clock_time_t)t.tv_sec * OC_CLOCK_SECOND +
+           ((oc_clock_time_t)t.tv_nsec * OC_CLOCK_SECOND + 999999999) /
+             1000000000;
   }
   return time;
 }
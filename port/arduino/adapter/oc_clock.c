@@ -42,6 +42,12 @@ oc_clock_time(void)
     return time * OC_CLOCK_CONF_TICKS_PER_SECOND;
 }
 
+oc_clock_time_t
+oc_clock_time_monotonic(void)
+{
+    return (oc_clock_time_t)millis() * OC_CLOCK_CONF_TICKS_PER_SECOND / 1000;
+}
+
 unsigned long
 oc_clock_seconds(void)
 {
@@ -0,0 +1,75 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "port/oc_event_loop_fd.h"
+#include "port/oc_log.h"
+#include "util/oc_atomic.h"
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static int event_loop_fd = -1;
+/* set from the first wakeup until the event loop clears the fd */
+static int wakeup_pending;
+
+int
+oc_event_loop_fd_open(void)
+{
+  if (event_loop_fd < 0) {
+    event_loop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_loop_fd < 0) {
+      OC_ERR("could not create eventfd %d", errno);
+    }
+    wakeup_pending = 0;
+  }
+  return event_loop_fd;
+}
+
+void
+oc_event_loop_fd_signal(void)
+{
+  if (event_loop_fd < 0 || oc_atomic_exchange(&wakeup_pending, 1) != 0) {
+    return;
+  }
+  uint64_t one = 1;
+  if (write(event_loop_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+    OC_ERR("could not signal eventfd %d", errno);
+  }
+}
+
+void
+oc_event_loop_fd_clear(void)
+{
+  if (event_loop_fd < 0) {
+    return;
+  }
+  uint64_t count;
+  /* read before clearing the flag: a wakeup arriving in between is covered
+   * by the oc_main_poll() that follows */
+  while (read(event_loop_fd, &count, sizeof(count)) < 0 && errno == EINTR)
+    ;
+  oc_atomic_store(&wakeup_pending, 0);
+}
+
+void
+oc_event_loop_fd_close(void)
+{
+  if (event_loop_fd >= 0) {
+    close(event_loop_fd);
+    event_loop_fd = -1;
+  }
+}
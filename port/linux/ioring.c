@@ -0,0 +1,170 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifdef OC_IO_URING
+#include "ioring.h"
+#include "util/oc_atomic.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef OC_ATOMICS
+#error "OC_IO_URING requires atomic operations"
+#endif /* !OC_ATOMICS */
+
+int
+oc_ioring_init(oc_ioring_t *ring, unsigned entries)
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  memset(ring, 0, sizeof(*ring));
+
+  ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (ring->fd < 0) {
+    return -1;
+  }
+
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size =
+    p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cq_ring_size > ring->sq_ring_size) {
+      ring->sq_ring_size = ring->cq_ring_size;
+    }
+    ring->cq_ring_size = ring->sq_ring_size;
+  }
+
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ring == MAP_FAILED) {
+    goto error;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_ring = ring->sq_ring;
+  } else {
+    ring->cq_ring =
+      mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ring == MAP_FAILED) {
+      ring->cq_ring = NULL;
+      goto error;
+    }
+  }
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes =
+    (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring->fd,
+                                IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    ring->sqes = NULL;
+    goto error;
+  }
+
+  uint8_t *sq = (uint8_t *)ring->sq_ring, *cq = (uint8_t *)ring->cq_ring;
+  ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+  ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  ring->sq_entries = p.sq_entries;
+  ring->sqe_tail = *ring->sq_tail;
+
+  /* submission entries are used in ring order */
+  unsigned i;
+  for (i = 0; i < p.sq_entries; i++) {
+    ring->sq_array[i] = i;
+  }
+  return 0;
+
+error:
+  if (ring->sq_ring && ring->sq_ring != MAP_FAILED) {
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+  close(ring->fd);
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+  return -1;
+}
+
+void
+oc_ioring_destroy(oc_ioring_t *ring)
+{
+  if (ring->fd < 0) {
+    return;
+  }
+  if (ring->sqes) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  munmap(ring->sq_ring, ring->sq_ring_size);
+  close(ring->fd);
+  ring->fd = -1;
+}
+
+struct io_uring_sqe *
+oc_ioring_get_sqe(oc_ioring_t *ring)
+{
+  unsigned head = oc_atomic_load(ring->sq_head);
+  if (ring->sqe_tail - head >= ring->sq_entries) {
+    return NULL;
+  }
+  struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & *ring->sq_mask];
+  ring->sqe_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int
+oc_ioring_submit_and_wait(oc_ioring_t *ring, unsigned wait_nr)
+{
+  /* publish the prepared entries before the kernel reads the tail */
+  oc_atomic_store(ring->sq_tail, ring->sqe_tail);
+  unsigned flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+  int ret;
+  do {
+    unsigned to_submit = ring->sqe_tail - oc_atomic_load(ring->sq_head);
+    ret = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr,
+                       flags, NULL, 0);
+  } while (ret < 0 && errno == EINTR);
+  return ret;
+}
+
+struct io_uring_cqe *
+oc_ioring_peek_cqe(oc_ioring_t *ring)
+{
+  unsigned head = *ring->cq_head;
+  if (head == oc_atomic_load(ring->cq_tail)) {
+    return NULL;
+  }
+  return &ring->cqes[head & *ring->cq_mask];
+}
+
+void
+oc_ioring_cqe_seen(oc_ioring_t *ring)
+{
+  oc_atomic_store(ring->cq_head, *ring->cq_head + 1);
+}
+#else  /* OC_IO_URING */
+typedef int dummy_declaration;
+#endif /* !OC_IO_URING */
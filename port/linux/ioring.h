@@ -0,0 +1,65 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef IORING_H
+#define IORING_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Minimal io_uring instance driven through the raw system calls, so that
+ * the port does not depend on liburing. Only the thread that set it up may
+ * use it.
+ */
+typedef struct
+{
+  int fd;
+  unsigned sq_entries;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned sqe_tail; /* SQEs handed out, submitted on the next enter */
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size, sqes_size;
+} oc_ioring_t;
+
+/* Returns 0 on success, -1 if the kernel does not provide io_uring. */
+int oc_ioring_init(oc_ioring_t *ring, unsigned entries);
+
+void oc_ioring_destroy(oc_ioring_t *ring);
+
+/* Next free submission entry, zeroed; NULL if the queue is full. */
+struct io_uring_sqe *oc_ioring_get_sqe(oc_ioring_t *ring);
+
+/* Submit all prepared entries and wait for at least wait_nr completions. */
+int oc_ioring_submit_and_wait(oc_ioring_t *ring, unsigned wait_nr);
+
+/* Oldest unseen completion, or NULL. */
+struct io_uring_cqe *oc_ioring_peek_cqe(oc_ioring_t *ring);
+
+void oc_ioring_cqe_seen(oc_ioring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IORING_H */
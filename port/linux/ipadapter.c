@@ -23,10 +23,13 @@
 #include "oc_core_res.h"
 #include "oc_endpoint.h"
 #include "oc_network_monitor.h"
+#include "oc_signal_event_loop.h"
 #include "port/oc_assert.h"
 #include "port/oc_connectivity.h"
+#include "util/oc_atomic.h"
 #include <arpa/inet.h>
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <ifaddrs.h>
 #include <linux/netlink.h>
@@ -36,8 +39,18 @@
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/select.h>
+#ifdef OC_IO_URING
+#ifdef OC_EXTERNAL_EVENT_LOOP
+#error "OC_IO_URING runs the network threads, unlike OC_EXTERNAL_EVENT_LOOP"
+#endif /* OC_EXTERNAL_EVENT_LOOP */
+#include "ioring.h"
+#include <poll.h>
+#include <sys/epoll.h>
+#endif /* OC_IO_URING */
 #include <sys/un.h>
 #include <unistd.h>
 
@@ -67,7 +80,73 @@ bool ifchange_initialized;
 OC_LIST(ip_contexts);
 OC_MEMB(ip_context_s, ip_context_t, OC_MAX_NUM_DEVICES);
 
-OC_MEMB(device_eps, oc_endpoint_t, 8 * OC_MAX_NUM_DEVICES); // fix
+/* Addresses of the IP interfaces, loaded with a dump when connectivity is
+ * initialized and kept up to date from the RTM_NEWADDR and RTM_DELADDR
+ * messages of ifchange_sock. Only changed with the network event handler
+ * mutex held.
+ */
+typedef struct ip_address_t
+{
+  struct ip_address_t *next;
+  int if_index;
+  uint8_t family;
+  uint8_t scope;
+  uint8_t addr[16];
+} ip_address_t;
+
+OC_LIST(ip_addresses);
+OC_MEMB(ip_address_s, ip_address_t, OC_MAX_IP_ADDRESSES);
+
+/* Set while a dump reloads the addresses, the endpoint lists are not rebuilt
+ * from a partial one.
+ */
+static bool ifchange_dumping;
+
+/* Endpoints of a device. A published list never changes: new addresses
+ * publish a new list, so that oc_connectivity_get_endpoints() hands it out
+ * without locking. A replaced list is retired until no reader holds it.
+ */
+typedef struct ip_endpoints_t
+{
+  struct ip_endpoints_t *next;
+  OC_LIST_STRUCT(eps);
+} ip_endpoints_t;
+
+/* Each thread calling oc_connectivity_get_endpoints() claims a reader slot.
+ * The slot holds, per device, the list last handed to the thread until it
+ * asks again for that device or exits. So at most one retired list per reader
+ * and device outlives a refresh. A thread finding no free slot pins every
+ * retired list from then on.
+ */
+#ifdef OC_ATOMICS
+#define ENDPOINTS_LOAD(ptr) oc_atomic_load(ptr)
+#define ENDPOINTS_STORE(ptr, value) oc_atomic_store(ptr, value)
+#else /* OC_ATOMICS */
+/* with the network event handler mutex held */
+#define ENDPOINTS_LOAD(ptr) (*(ptr))
+#define ENDPOINTS_STORE(ptr, value) (*(ptr) = (value))
+#endif /* !OC_ATOMICS */
+
+static int endpoints_reader_used[OC_MAX_ENDPOINTS_READERS];
+static int endpoints_untracked;
+static pthread_key_t endpoints_reader_key;
+static pthread_once_t endpoints_reader_once = PTHREAD_ONCE_INIT;
+static bool endpoints_reader_key_created;
+
+/* published lists, one per device held by each reader and the one being
+ * built */
+#define ENDPOINTS_LISTS                                                        \
+  (OC_MAX_NUM_DEVICES * (OC_MAX_ENDPOINTS_READERS + 1) + 1)
+
+OC_LIST(retired_endpoints);
+OC_MEMB(ip_endpoints_s, ip_endpoints_t, ENDPOINTS_LISTS);
+OC_MEMB(device_eps, oc_endpoint_t, 8 * ENDPOINTS_LISTS);
+
+static void free_address_cache(void);
+static void free_retired_endpoints(bool all);
+#if defined(OC_DNS_LOOKUP) && defined(OC_DNS_CACHE)
+static void dns_resolver_shutdown(void);
+#endif /* OC_DNS_LOOKUP && OC_DNS_CACHE */
 
 #ifdef OC_NETWORK_MONITOR
 /**
@@ -221,6 +300,11 @@ oc_network_event_handler_mutex_destroy(void)
 {
   ifchange_initialized = false;
   close(ifchange_sock);
+  free_address_cache();
+  free_retired_endpoints(true);
+#if defined(OC_DNS_LOOKUP) && defined(OC_DNS_CACHE)
+  dns_resolver_shutdown();
+#endif /* OC_DNS_LOOKUP && OC_DNS_CACHE */
 #ifdef OC_NETWORK_MONITOR
   remove_all_ip_interface();
   remove_all_network_interface_cbs();
@@ -244,6 +328,30 @@ get_ip_context_for_device(size_t device)
   return dev;
 }
 
+/* Returns the context whose sockets carry the traffic of device. */
+static ip_context_t *
+get_transport_context_for_device(size_t device)
+{
+  ip_context_t *dev = get_ip_context_for_device(device);
+#ifdef OC_SHARED_TRANSPORT
+  if (dev && dev->transport) {
+    return dev->transport;
+  }
+#endif /* OC_SHARED_TRANSPORT */
+  return dev;
+}
+
+static bool
+owns_transport(const ip_context_t *dev)
+{
+#ifdef OC_SHARED_TRANSPORT
+  return dev->transport == NULL;
+#else  /* OC_SHARED_TRANSPORT */
+  (void)dev;
+  return true;
+#endif /* !OC_SHARED_TRANSPORT */
+}
+
 #ifdef OC_IPV4
 static int
 add_mcast_sock_to_ipv4_mcast_group(int mcast_sock, const struct in_addr *local,
@@ -361,340 +469,642 @@ configure_mcast_socket(int mcast_sock, int sa_family)
   return ret;
 }
 
-static void
-get_interface_addresses(ip_context_t *dev, unsigned char family, uint16_t port,
-                        bool secure, bool tcp)
-{
-  struct
-  {
-    struct nlmsghdr nlhdr;
-    struct ifaddrmsg addrmsg;
-  } request;
-  struct nlmsghdr *response;
-
-  memset(&request, 0, sizeof(request));
-  request.nlhdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
-  request.nlhdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_ROOT;
-  request.nlhdr.nlmsg_type = RTM_GETADDR;
-  request.addrmsg.ifa_family = family;
+#define NETLINK_BUFFER_SIZE (16384)
 
-  int nl_sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-  if (nl_sock < 0) {
-    return;
+static bool
+parse_address(struct nlmsghdr *msg, ip_address_t *address, bool *temporary)
+{
+  struct ifaddrmsg *ifa = (struct ifaddrmsg *)NLMSG_DATA(msg);
+  size_t addr_len;
+#ifdef OC_IPV4
+  if (ifa->ifa_family == AF_INET) {
+    addr_len = 4;
+  } else
+#endif /* OC_IPV4 */
+    if (ifa->ifa_family == AF_INET6) {
+    addr_len = 16;
+  } else {
+    return false;
   }
 
-  if (send(nl_sock, &request, request.nlhdr.nlmsg_len, 0) < 0) {
-    close(nl_sock);
-    return;
+  memset(address, 0, sizeof(ip_address_t));
+  address->if_index = (int)ifa->ifa_index;
+  address->family = ifa->ifa_family;
+  address->scope = ifa->ifa_scope;
+  uint32_t flags = ifa->ifa_flags;
+  bool found = false;
+  struct rtattr *attr = (struct rtattr *)IFA_RTA(ifa);
+  int att_len = IFA_PAYLOAD(msg);
+  while (RTA_OK(attr, att_len)) {
+    if (attr->rta_type == IFA_ADDRESS && RTA_PAYLOAD(attr) >= addr_len) {
+      memcpy(address->addr, RTA_DATA(attr), addr_len);
+      found = true;
+    } else if (attr->rta_type == IFA_FLAGS &&
+               RTA_PAYLOAD(attr) >= sizeof(uint32_t)) {
+      memcpy(&flags, RTA_DATA(attr), sizeof(uint32_t));
+    }
+    attr = RTA_NEXT(attr, att_len);
   }
+  *temporary = (flags & IFA_F_TEMPORARY) != 0;
+  return found;
+}
 
-  fd_set rfds;
-  FD_ZERO(&rfds);
-  FD_SET(nl_sock, &rfds);
+static ip_address_t *
+find_address(const ip_address_t *address)
+{
+  ip_address_t *cached = oc_list_head(ip_addresses);
+  while (cached != NULL &&
+         (cached->if_index != address->if_index ||
+          cached->family != address->family ||
+          memcmp(cached->addr, address->addr, sizeof(address->addr)) != 0)) {
+    cached = cached->next;
+  }
+  return cached;
+}
 
-  if (select(FD_SETSIZE, &rfds, NULL, NULL, NULL) < 0) {
-    close(nl_sock);
-    return;
+/* Apply an RTM_NEWADDR or RTM_DELADDR message to the address cache, returns
+ * whether the cache changed. Temporary addresses and those of host scope
+ * are never advertised, so they are not cached.
+ */
+static bool
+update_address_cache(struct nlmsghdr *msg)
+{
+  ip_address_t address;
+  bool temporary;
+  if (!parse_address(msg, &address, &temporary)) {
+    return false;
+  }
+  ip_address_t *cached = find_address(&address);
+  if (msg->nlmsg_type == RTM_DELADDR || temporary ||
+      address.scope >= RT_SCOPE_HOST) {
+    if (!cached) {
+      return false;
+    }
+    oc_list_remove(ip_addresses, cached);
+    oc_memb_free(&ip_address_s, cached);
+    return true;
+  }
+  if (cached) {
+    if (cached->scope == address.scope) {
+      return false;
+    }
+    cached->scope = address.scope;
+    return true;
   }
+  cached = (ip_address_t *)oc_memb_alloc(&ip_address_s);
+  if (!cached) {
+    OC_WRN("no room to cache an address of interface %d", address.if_index);
+    return false;
+  }
+  memcpy(cached, &address, sizeof(ip_address_t));
+  oc_list_add(ip_addresses, cached);
+  return true;
+}
 
-  int prev_interface_index = -1;
-  bool done = false;
-  while (!done) {
-    int guess = 512, response_len;
-    do {
-      guess <<= 1;
-      uint8_t dummy[guess];
-      response_len = recv(nl_sock, dummy, guess, MSG_PEEK);
-      if (response_len < 0) {
-        close(nl_sock);
-        return;
-      }
-    } while (response_len == guess);
+static void
+free_address_cache(void)
+{
+  ip_address_t *address = oc_list_pop(ip_addresses);
+  while (address != NULL) {
+    oc_memb_free(&ip_address_s, address);
+    address = oc_list_pop(ip_addresses);
+  }
+}
 
-    uint8_t buffer[response_len];
-    response_len = recv(nl_sock, buffer, response_len, 0);
-    if (response_len < 0) {
-      close(nl_sock);
-      return;
+/* Only the first address of a family on each interface is advertised. */
+static bool
+first_address_of_interface(const ip_address_t *address)
+{
+  const ip_address_t *cached = oc_list_head(ip_addresses);
+  for (; cached != address; cached = cached->next) {
+    if (cached->family == address->family &&
+        cached->if_index == address->if_index) {
+      return false;
     }
+  }
+  return true;
+}
 
-    response = (struct nlmsghdr *)buffer;
-    if (response->nlmsg_type == NLMSG_ERROR) {
-      close(nl_sock);
-      return;
+static bool
+add_endpoints(ip_endpoints_t *endpoints, size_t device, uint8_t family,
+              uint16_t port, bool secure, bool tcp)
+{
+  const ip_address_t *address = oc_list_head(ip_addresses);
+  for (; address != NULL; address = address->next) {
+    if (address->family != family || !first_address_of_interface(address)) {
+      continue;
     }
-
-    while (NLMSG_OK(response, response_len)) {
-      if (response->nlmsg_type == NLMSG_DONE) {
-        done = true;
-        break;
-      }
-      oc_endpoint_t ep;
-      memset(&ep, 0, sizeof(oc_endpoint_t));
-      bool include = false;
-      struct ifaddrmsg *addrmsg = (struct ifaddrmsg *)NLMSG_DATA(response);
-      if (addrmsg->ifa_scope < RT_SCOPE_HOST) {
-        if ((int)addrmsg->ifa_index == prev_interface_index) {
-          goto next_ifaddr;
-        }
-        ep.interface_index = addrmsg->ifa_index;
-        include = true;
-        struct rtattr *attr = (struct rtattr *)IFA_RTA(addrmsg);
-        int att_len = IFA_PAYLOAD(response);
-        while (RTA_OK(attr, att_len)) {
-          if (attr->rta_type == IFA_ADDRESS) {
+    oc_endpoint_t *ep = (oc_endpoint_t *)oc_memb_alloc(&device_eps);
+    if (!ep) {
+      return false;
+    }
+    memset(ep, 0, sizeof(oc_endpoint_t));
+    ep->device = device;
+    ep->interface_index = address->if_index;
 #ifdef OC_IPV4
-            if (family == AF_INET) {
-              memcpy(ep.addr.ipv4.address, RTA_DATA(attr), 4);
-              ep.flags = IPV4;
-            } else
+    if (family == AF_INET) {
+      memcpy(ep->addr.ipv4.address, address->addr, 4);
+      ep->addr.ipv4.port = port;
+      ep->flags = IPV4;
+    } else
 #endif /* OC_IPV4 */
-              if (family == AF_INET6) {
-              memcpy(ep.addr.ipv6.address, RTA_DATA(attr), 16);
-              ep.flags = IPV6;
-            }
-          } else if (attr->rta_type == IFA_FLAGS) {
-            if (*(uint32_t *)(RTA_DATA(attr)) & IFA_F_TEMPORARY) {
-              include = false;
-            }
-          }
-          attr = RTA_NEXT(attr, att_len);
-        }
+    {
+      memcpy(ep->addr.ipv6.address, address->addr, 16);
+      ep->addr.ipv6.port = port;
+      if (address->scope == RT_SCOPE_LINK) {
+        ep->addr.ipv6.scope = (uint8_t)address->if_index;
       }
-      if (include) {
-        prev_interface_index = addrmsg->ifa_index;
-        if (addrmsg->ifa_scope == RT_SCOPE_LINK && family == AF_INET6) {
-          ep.addr.ipv6.scope = addrmsg->ifa_index;
-        }
-        if (secure) {
-          ep.flags |= SECURED;
-        }
-#ifdef OC_IPV4
-        if (family == AF_INET) {
-          ep.addr.ipv4.port = port;
-        } else
-#endif /* OC_IPV4 */
-          if (family == AF_INET6) {
-          ep.addr.ipv6.port = port;
-        }
+      ep->flags = IPV6;
+    }
+    if (secure) {
+      ep->flags |= SECURED;
+    }
 #ifdef OC_TCP
-        if (tcp) {
-          ep.flags |= TCP;
-        }
+    if (tcp) {
+      ep->flags |= TCP;
+    }
 #else
-        (void)tcp;
+    (void)tcp;
 #endif /* OC_TCP */
-        oc_endpoint_t *new_ep = oc_memb_alloc(&device_eps);
-        if (!new_ep) {
-          close(nl_sock);
-          return;
-        }
-        memcpy(new_ep, &ep, sizeof(oc_endpoint_t));
-        oc_list_add(dev->eps, new_ep);
-      }
-
-    next_ifaddr:
-      response = NLMSG_NEXT(response, response_len);
-    }
+    oc_list_add(endpoints->eps, ep);
   }
-  close(nl_sock);
+  return true;
 }
 
-static void
-free_endpoints_list(ip_context_t *dev)
+static bool
+add_device_endpoints(ip_endpoints_t *endpoints, const ip_context_t *dev)
 {
-  oc_endpoint_t *ep = oc_list_pop(dev->eps);
-
-  while (ep != NULL) {
-    oc_memb_free(&device_eps, ep);
-    ep = oc_list_pop(dev->eps);
+#ifdef OC_SHARED_TRANSPORT
+  if (dev->transport) {
+    /* same addresses and ports as the owning context, for this device */
+    const ip_endpoints_t *owner = dev->transport->endpoints;
+    const oc_endpoint_t *ep = owner ? oc_list_head(owner->eps) : NULL;
+    for (; ep != NULL; ep = ep->next) {
+      oc_endpoint_t *new_ep = (oc_endpoint_t *)oc_memb_alloc(&device_eps);
+      if (!new_ep) {
+        return false;
+      }
+      memcpy(new_ep, ep, sizeof(oc_endpoint_t));
+      new_ep->next = NULL;
+      new_ep->device = dev->device;
+      oc_list_add(endpoints->eps, new_ep);
+    }
+    return true;
   }
-}
-
-static void
-refresh_endpoints_list(ip_context_t *dev)
-{
-  free_endpoints_list(dev);
+#endif /* OC_SHARED_TRANSPORT */
 
-  get_interface_addresses(dev, AF_INET6, dev->port, false, false);
+  size_t device = dev->device;
+  if (!add_endpoints(endpoints, device, AF_INET6, dev->port, false, false)) {
+    return false;
+  }
 #ifdef OC_SECURITY
-  get_interface_addresses(dev, AF_INET6, dev->dtls_port, true, false);
+  if (!add_endpoints(endpoints, device, AF_INET6, dev->dtls_port, true,
+                     false)) {
+    return false;
+  }
 #endif /* OC_SECURITY */
 #ifdef OC_IPV4
-  get_interface_addresses(dev, AF_INET, dev->port4, false, false);
+  if (!add_endpoints(endpoints, device, AF_INET, dev->port4, false, false)) {
+    return false;
+  }
 #ifdef OC_SECURITY
-  get_interface_addresses(dev, AF_INET, dev->dtls4_port, true, false);
+  if (!add_endpoints(endpoints, device, AF_INET, dev->dtls4_port, true,
+                     false)) {
+    return false;
+  }
 #endif /* OC_SECURITY */
 #endif /* OC_IPV4 */
 
 #ifdef OC_TCP
-  get_interface_addresses(dev, AF_INET6, dev->tcp.port, false, true);
+  if (!add_endpoints(endpoints, device, AF_INET6, dev->tcp.port, false,
+                     true)) {
+    return false;
+  }
 #ifdef OC_SECURITY
-  get_interface_addresses(dev, AF_INET6, dev->tcp.tls_port, true, true);
+  if (!add_endpoints(endpoints, device, AF_INET6, dev->tcp.tls_port, true,
+                     true)) {
+    return false;
+  }
 #endif /* OC_SECURITY */
 #ifdef OC_IPV4
-  get_interface_addresses(dev, AF_INET, dev->tcp.port4, false, true);
+  if (!add_endpoints(endpoints, device, AF_INET, dev->tcp.port4, false,
+                     true)) {
+    return false;
+  }
 #ifdef OC_SECURITY
-  get_interface_addresses(dev, AF_INET, dev->tcp.tls4_port, true, true);
+  if (!add_endpoints(endpoints, device, AF_INET, dev->tcp.tls4_port, true,
+                     true)) {
+    return false;
+  }
 #endif /* OC_SECURITY */
 #endif /* OC_IPV4 */
 #endif /* OC_TCP */
+  return true;
 }
 
-oc_endpoint_t *
-oc_connectivity_get_endpoints(size_t device)
+static void
+free_endpoints(ip_endpoints_t *endpoints)
 {
-  ip_context_t *dev = get_ip_context_for_device(device);
+  oc_endpoint_t *ep = oc_list_pop(endpoints->eps);
+  while (ep != NULL) {
+    oc_memb_free(&device_eps, ep);
+    ep = oc_list_pop(endpoints->eps);
+  }
+  oc_memb_free(&ip_endpoints_s, endpoints);
+}
 
-  if (!dev) {
-    return NULL;
+/* Whether a reader may still hold the retired list endpoints. */
+static bool
+endpoints_held(const ip_endpoints_t *endpoints)
+{
+  if (ENDPOINTS_LOAD(&endpoints_untracked)) {
+    return true;
   }
+  ip_context_t *dev = oc_list_head(ip_contexts);
+  for (; dev != NULL; dev = dev->next) {
+    int i;
+    for (i = 0; i < OC_MAX_ENDPOINTS_READERS; i++) {
+      if (ENDPOINTS_LOAD(&dev->readers[i]) == endpoints) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
 
-  if (oc_list_length(dev->eps) == 0) {
-    oc_network_event_handler_mutex_lock();
+static void
+free_retired_endpoints(bool all)
+{
+#ifdef OC_ATOMICS
+  /* a reader that missed the exchange retiring a list shows in its slot */
+  oc_atomic_fence();
+#endif /* OC_ATOMICS */
+  ip_endpoints_t *endpoints = oc_list_head(retired_endpoints), *next;
+  while (endpoints != NULL) {
+    next = endpoints->next;
+    if (all || !endpoints_held(endpoints)) {
+      oc_list_remove(retired_endpoints, endpoints);
+      free_endpoints(endpoints);
+    }
+    endpoints = next;
+  }
+}
+
+/* Replace the published endpoint list of dev, NULL to withdraw it. Called
+ * with the network event handler mutex held.
+ */
+static void
+publish_endpoints(ip_context_t *dev, ip_endpoints_t *endpoints)
+{
+#ifdef OC_ATOMICS
+  ip_endpoints_t *old = oc_atomic_exchange(&dev->endpoints, endpoints);
+#else  /* OC_ATOMICS */
+  ip_endpoints_t *old = dev->endpoints;
+  dev->endpoints = endpoints;
+#endif /* !OC_ATOMICS */
+  if (old) {
+    oc_list_add(retired_endpoints, old);
+    free_retired_endpoints(false);
+  }
+}
+
+/* Build and publish the endpoint list of dev from the address cache. Called
+ * with the network event handler mutex held.
+ */
+static void
+refresh_endpoints_list(ip_context_t *dev)
+{
+  /* readers may have moved on since the last refresh */
+  free_retired_endpoints(false);
+  ip_endpoints_t *endpoints =
+    (ip_endpoints_t *)oc_memb_alloc(&ip_endpoints_s);
+  if (endpoints) {
+    OC_LIST_STRUCT_INIT(endpoints, eps);
+    if (add_device_endpoints(endpoints, dev)) {
+      publish_endpoints(dev, endpoints);
+      return;
+    }
+    free_endpoints(endpoints);
+  }
+  OC_WRN("no memory for the endpoints of device %zd, keeping the old ones",
+         dev->device);
+}
+
+void
+oc_ip_refresh_endpoints(void)
+{
+  /* owning contexts come first, so shared devices copy fresh lists */
+  oc_network_event_handler_mutex_lock();
+  ip_context_t *dev = oc_list_head(ip_contexts);
+  for (; dev != NULL; dev = dev->next) {
     refresh_endpoints_list(dev);
-    oc_network_event_handler_mutex_unlock();
   }
+  oc_network_event_handler_mutex_unlock();
+}
 
-  return oc_list_head(dev->eps);
+/* Withdraw the endpoint list of dev, it is freed with the retired ones, and
+ * free dev.
+ */
+static void
+remove_ip_context(ip_context_t *dev)
+{
+  oc_network_event_handler_mutex_lock();
+  publish_endpoints(dev, NULL);
+  oc_list_remove(ip_contexts, dev);
+  oc_network_event_handler_mutex_unlock();
+  oc_memb_free(&ip_context_s, dev);
 }
 
-/* Called after network interface up/down events.
- * This function reconfigures IPv6/v4 multicast sockets for
- * all logical devices.
+/* Give up the reader slot of an exiting thread. */
+static void
+release_endpoints_reader(void *data)
+{
+  int slot = (int)((intptr_t)data - 1);
+  /* the devices only come and go with the mutex held */
+  oc_network_event_handler_mutex_lock();
+  ip_context_t *dev = oc_list_head(ip_contexts);
+  for (; dev != NULL; dev = dev->next) {
+    ENDPOINTS_STORE(&dev->readers[slot], NULL);
+  }
+  ENDPOINTS_STORE(&endpoints_reader_used[slot], 0);
+  oc_network_event_handler_mutex_unlock();
+}
+
+static void
+create_endpoints_reader_key(void)
+{
+  endpoints_reader_key_created =
+    (pthread_key_create(&endpoints_reader_key, release_endpoints_reader) == 0);
+}
+
+/* Reader slot of the calling thread, claimed on its first read, -1 if none
+ * is free. Called with the network event handler mutex held in builds
+ * without OC_ATOMICS.
  */
 static int
-process_interface_change_event(void)
+endpoints_reader_slot(void)
 {
-  int ret = 0, i, num_devices = oc_core_get_num_devices();
-  struct nlmsghdr *response = NULL;
-
-  int guess = 512, response_len;
-  do {
-    guess <<= 1;
-    uint8_t dummy[guess];
-    response_len = recv(ifchange_sock, dummy, guess, MSG_PEEK);
-    if (response_len < 0) {
-      OC_ERR("reading payload size from netlink interface");
-      return -1;
+  pthread_once(&endpoints_reader_once, create_endpoints_reader_key);
+  if (!endpoints_reader_key_created) {
+    return -1;
+  }
+  intptr_t slot = (intptr_t)pthread_getspecific(endpoints_reader_key);
+  if (slot > 0) {
+    return (int)slot - 1;
+  }
+  int i;
+  for (i = 0; i < OC_MAX_ENDPOINTS_READERS; i++) {
+#ifdef OC_ATOMICS
+    int unused = 0;
+    if (!oc_atomic_compare_exchange(&endpoints_reader_used[i], &unused, 1)) {
+      continue;
     }
-  } while (response_len == guess);
+#else  /* OC_ATOMICS */
+    if (endpoints_reader_used[i]) {
+      continue;
+    }
+    endpoints_reader_used[i] = 1;
+#endif /* !OC_ATOMICS */
+    if (pthread_setspecific(endpoints_reader_key, (void *)(intptr_t)(i + 1)) !=
+        0) {
+      ENDPOINTS_STORE(&endpoints_reader_used[i], 0);
+      break;
+    }
+    return i;
+  }
+  if (!ENDPOINTS_LOAD(&endpoints_untracked)) {
+    OC_WRN("more than %d threads read the endpoints, retired lists are kept",
+           OC_MAX_ENDPOINTS_READERS);
+    ENDPOINTS_STORE(&endpoints_untracked, 1);
+  }
+  return -1;
+}
 
-  uint8_t buffer[response_len];
-  response_len = recv(ifchange_sock, buffer, response_len, 0);
-  if (response_len < 0) {
-    OC_ERR("reading payload from netlink interface");
-    return -1;
+oc_endpoint_t *
+oc_connectivity_get_endpoints(size_t device)
+{
+  ip_context_t *dev = get_ip_context_for_device(device);
+
+  if (!dev) {
+    return NULL;
   }
 
-  response = (struct nlmsghdr *)buffer;
-  if (response->nlmsg_type == NLMSG_ERROR) {
-    OC_ERR("caught NLMSG_ERROR in payload from netlink interface");
+#ifdef OC_ATOMICS
+  ip_endpoints_t *endpoints;
+  int slot = endpoints_reader_slot();
+  if (slot < 0) {
+    oc_atomic_fence();
+    endpoints = oc_atomic_load(&dev->endpoints);
+  } else {
+    /* hold the list in the slot before the publisher could retire it and
+     * look at the slots */
+    do {
+      endpoints = oc_atomic_load(&dev->endpoints);
+      oc_atomic_store(&dev->readers[slot], endpoints);
+      oc_atomic_fence();
+    } while (endpoints != oc_atomic_load(&dev->endpoints));
+  }
+#else  /* OC_ATOMICS */
+  oc_network_event_handler_mutex_lock();
+  int slot = endpoints_reader_slot();
+  ip_endpoints_t *endpoints = dev->endpoints;
+  if (slot >= 0) {
+    dev->readers[slot] = endpoints;
+  }
+  oc_network_event_handler_mutex_unlock();
+#endif /* !OC_ATOMICS */
+
+  return endpoints ? oc_list_head(endpoints->eps) : NULL;
+}
+
+/* Ask for a dump of all addresses, which replaces the address cache. */
+static int
+request_interface_addresses(void)
+{
+  struct
+  {
+    struct nlmsghdr nlhdr;
+    struct ifaddrmsg addrmsg;
+  } request;
+
+  memset(&request, 0, sizeof(request));
+  request.nlhdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+  request.nlhdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.nlhdr.nlmsg_type = RTM_GETADDR;
+  request.addrmsg.ifa_family = AF_UNSPEC;
+
+  if (send(ifchange_sock, &request, request.nlhdr.nlmsg_len, 0) < 0) {
+    OC_ERR("requesting addresses from netlink interface %d", errno);
     return -1;
   }
+  oc_network_event_handler_mutex_lock();
+  free_address_cache();
+  oc_network_event_handler_mutex_unlock();
+  ifchange_dumping = true;
+  return 0;
+}
 
-  bool if_state_changed = false;
+/* Join the multicast groups on a new address and report interfaces that go
+ * up or down.
+ */
+static int
+handle_address_notification(struct nlmsghdr *msg)
+{
+  int ret = 0;
+  struct ifaddrmsg *ifa = (struct ifaddrmsg *)NLMSG_DATA(msg);
+  if (msg->nlmsg_type == RTM_DELADDR) {
+#ifdef OC_NETWORK_MONITOR
+    if (remove_ip_interface(ifa->ifa_index)) {
+      oc_network_interface_event(NETWORK_INTERFACE_DOWN);
+    }
+#endif /* OC_NETWORK_MONITOR */
+    return 0;
+  }
 
-  while (NLMSG_OK(response, response_len)) {
-    if (response->nlmsg_type == RTM_NEWADDR) {
-      struct ifaddrmsg *ifa = (struct ifaddrmsg *)NLMSG_DATA(response);
-      if (ifa) {
 #ifdef OC_NETWORK_MONITOR
-        if (add_ip_interface(ifa->ifa_index)) {
-          oc_network_interface_event(NETWORK_INTERFACE_UP);
-        }
+  if (add_ip_interface(ifa->ifa_index)) {
+    oc_network_interface_event(NETWORK_INTERFACE_UP);
+  }
 #endif /* OC_NETWORK_MONITOR */
-        struct rtattr *attr = (struct rtattr *)IFA_RTA(ifa);
-        int att_len = IFA_PAYLOAD(response);
-        while (RTA_OK(attr, att_len)) {
-          if (attr->rta_type == IFA_ADDRESS) {
+  struct rtattr *attr = (struct rtattr *)IFA_RTA(ifa);
+  int att_len = IFA_PAYLOAD(msg);
+  for (; RTA_OK(attr, att_len); attr = RTA_NEXT(attr, att_len)) {
+    if (attr->rta_type != IFA_ADDRESS) {
+      continue;
+    }
+    ip_context_t *dev = oc_list_head(ip_contexts);
+    for (; dev != NULL; dev = dev->next) {
+      if (!owns_transport(dev)) {
+        continue;
+      }
 #ifdef OC_IPV4
-            if (ifa->ifa_family == AF_INET) {
-              for (i = 0; i < num_devices; i++) {
-                ip_context_t *dev = get_ip_context_for_device(i);
-                ret += add_mcast_sock_to_ipv4_mcast_group(
-                  dev->mcast4_sock, RTA_DATA(attr), ifa->ifa_index);
-              }
-            } else
+      if (ifa->ifa_family == AF_INET) {
+        ret += add_mcast_sock_to_ipv4_mcast_group(
+          dev->mcast4_sock, RTA_DATA(attr), ifa->ifa_index);
+      } else
 #endif /* OC_IPV4 */
-              if (ifa->ifa_family == AF_INET6 &&
-                  ifa->ifa_scope == RT_SCOPE_LINK) {
-              for (i = 0; i < num_devices; i++) {
-                ip_context_t *dev = get_ip_context_for_device(i);
-                ret += add_mcast_sock_to_ipv6_mcast_group(dev->mcast_sock,
-                                                          ifa->ifa_index);
-              }
-            }
-          }
-          attr = RTA_NEXT(attr, att_len);
-        }
-      }
-      if_state_changed = true;
-    } else if (response->nlmsg_type == RTM_DELADDR) {
-      struct ifaddrmsg *ifa = (struct ifaddrmsg *)NLMSG_DATA(response);
-      if (ifa) {
-#ifdef OC_NETWORK_MONITOR
-        if (remove_ip_interface(ifa->ifa_index)) {
-          oc_network_interface_event(NETWORK_INTERFACE_DOWN);
-        }
-#endif /* OC_NETWORK_MONITOR */
+        if (ifa->ifa_family == AF_INET6 && ifa->ifa_scope == RT_SCOPE_LINK) {
+        ret += add_mcast_sock_to_ipv6_mcast_group(dev->mcast_sock,
+                                                  ifa->ifa_index);
       }
-      if_state_changed = true;
-    }
-    response = NLMSG_NEXT(response, response_len);
-  }
-
-  if (if_state_changed) {
-    for (i = 0; i < num_devices; i++) {
-      ip_context_t *dev = get_ip_context_for_device(i);
-      oc_network_event_handler_mutex_lock();
-      refresh_endpoints_list(dev);
-      oc_network_event_handler_mutex_unlock();
     }
   }
-
   return ret;
 }
 
+/* Receive and apply one batch of netlink messages. Returns 0 when none was
+ * pending, 1 after a batch and -1 on errors.
+ */
 static int
-recv_msg(int sock, uint8_t *recv_buf, int recv_buf_size,
-         oc_endpoint_t *endpoint, bool multicast)
+receive_interface_changes(int flags, bool *changed)
 {
-  struct sockaddr_storage client;
-  struct iovec iovec[1];
-  struct msghdr msg;
-  char msg_control[CMSG_LEN(sizeof(struct sockaddr_storage))];
+  static uint32_t buffer[NETLINK_BUFFER_SIZE / sizeof(uint32_t)];
 
-  iovec[0].iov_base = recv_buf;
-  iovec[0].iov_len = (size_t)recv_buf_size;
-
-  msg.msg_name = &client;
-  msg.msg_namelen = sizeof(client);
+  ssize_t len = recv(ifchange_sock, buffer, sizeof(buffer), flags | MSG_TRUNC);
+  if (len < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return 0;
+    }
+    if (errno != ENOBUFS) {
+      OC_ERR("reading payload from netlink interface %d", errno);
+      return -1;
+    }
+  }
+  if (len < 0 || (size_t)len > sizeof(buffer)) {
+    /* changes were lost, a running dump will catch up with them */
+    OC_WRN("missed network interface changes, reloading the addresses");
+    if (!ifchange_dumping && request_interface_addresses() < 0) {
+      return -1;
+    }
+    return 1;
+  }
 
-  msg.msg_iov = iovec;
-  msg.msg_iovlen = 1;
+  int ret = 1;
+  int msg_len = (int)len;
+  struct nlmsghdr *msg = (struct nlmsghdr *)buffer;
+  for (; NLMSG_OK(msg, msg_len); msg = NLMSG_NEXT(msg, msg_len)) {
+    if (msg->nlmsg_type == NLMSG_DONE) {
+      if (ifchange_dumping) {
+        ifchange_dumping = false;
+        *changed = true;
+      }
+    } else if (msg->nlmsg_type == NLMSG_ERROR) {
+      OC_ERR("caught NLMSG_ERROR in payload from netlink interface");
+      ifchange_dumping = false;
+      ret = -1;
+    } else if (msg->nlmsg_type == RTM_NEWADDR ||
+               msg->nlmsg_type == RTM_DELADDR) {
+      /* replies to a dump come in multipart messages */
+      if (!(msg->nlmsg_flags & NLM_F_MULTI) &&
+          handle_address_notification(msg) < 0) {
+        ret = -1;
+      }
+      oc_network_event_handler_mutex_lock();
+      if (update_address_cache(msg)) {
+        *changed = true;
+      }
+      oc_network_event_handler_mutex_unlock();
+    }
+  }
+  return ret;
+}
 
-  msg.msg_control = msg_control;
-  msg.msg_controllen = sizeof(msg_control);
+/* Load the address cache, before the network threads start. */
+static int
+load_interface_addresses(void)
+{
+  bool changed = false;
+  if (request_interface_addresses() < 0) {
+    return -1;
+  }
+  while (ifchange_dumping) {
+    if (receive_interface_changes(0, &changed) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
 
-  msg.msg_flags = 0;
+/* Called after network interface up/down events.
+ * This function applies the pending address changes to the address cache,
+ * reconfigures IPv6/v4 multicast sockets for all logical devices and
+ * publishes their new endpoint lists.
+ */
+static int
+process_interface_change_event(void)
+{
+  int ret = 0, n;
+  bool changed = false;
 
-  int ret = recvmsg(sock, &msg, 0);
+  while ((n = receive_interface_changes(MSG_DONTWAIT, &changed)) != 0) {
+    if (n < 0) {
+      ret = -1;
+      break;
+    }
+  }
 
-  if (ret < 0 || (msg.msg_flags & MSG_TRUNC) || (msg.msg_flags & MSG_CTRUNC)) {
-    OC_ERR("recvmsg returned with an error: %d", errno);
-    return -1;
+  if (changed && !ifchange_dumping) {
+    oc_ip_refresh_endpoints();
   }
 
+  return ret;
+}
+
+/* Fill in the source of a datagram and the interface it arrived on from the
+ * address and packet info returned with it by recvmsg().
+ */
+static int
+parse_recv_msg(struct msghdr *msg, oc_endpoint_t *endpoint, bool multicast)
+{
   struct cmsghdr *cmsg;
-  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != 0; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg != 0; cmsg = CMSG_NXTHDR(msg, cmsg)) {
     if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
-      if (msg.msg_namelen != sizeof(struct sockaddr_in6)) {
+      if (msg->msg_namelen != sizeof(struct sockaddr_in6)) {
         OC_ERR("anciliary data contains invalid source address");
         return -1;
       }
       /* Set source address of packet in endpoint structure */
-      struct sockaddr_in6 *c6 = (struct sockaddr_in6 *)&client;
+      struct sockaddr_in6 *c6 = (struct sockaddr_in6 *)msg->msg_name;
       memcpy(endpoint->addr.ipv6.address, c6->sin6_addr.s6_addr,
              sizeof(c6->sin6_addr.s6_addr));
       endpoint->addr.ipv6.scope = c6->sin6_scope_id;
@@ -719,12 +1129,12 @@ recv_msg(int sock, uint8_t *recv_buf, int recv_buf_size,
     }
 #ifdef OC_IPV4
     else if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_PKTINFO) {
-      if (msg.msg_namelen != sizeof(struct sockaddr_in)) {
+      if (msg->msg_namelen != sizeof(struct sockaddr_in)) {
         OC_ERR("anciliary data contains invalid source address");
         return -1;
       }
       struct in_pktinfo *pktinfo = (struct in_pktinfo *)CMSG_DATA(cmsg);
-      struct sockaddr_in *c4 = (struct sockaddr_in *)&client;
+      struct sockaddr_in *c4 = (struct sockaddr_in *)msg->msg_name;
       memcpy(endpoint->addr.ipv4.address, &c4->sin_addr.s_addr,
              sizeof(c4->sin_addr.s_addr));
       endpoint->addr.ipv4.port = ntohs(c4->sin_port);
@@ -739,25 +1149,78 @@ recv_msg(int sock, uint8_t *recv_buf, int recv_buf_size,
 #endif /* OC_IPV4 */
   }
 
+  return 0;
+}
+
+static int
+recv_msg(int sock, uint8_t *recv_buf, int recv_buf_size,
+         oc_endpoint_t *endpoint, bool multicast)
+{
+  struct sockaddr_storage client;
+  struct iovec iovec[1];
+  struct msghdr msg;
+  char msg_control[CMSG_LEN(sizeof(struct sockaddr_storage))];
+
+  iovec[0].iov_base = recv_buf;
+  iovec[0].iov_len = (size_t)recv_buf_size;
+
+  msg.msg_name = &client;
+  msg.msg_namelen = sizeof(client);
+
+  msg.msg_iov = iovec;
+  msg.msg_iovlen = 1;
+
+  msg.msg_control = msg_control;
+  msg.msg_controllen = sizeof(msg_control);
+
+  msg.msg_flags = 0;
+
+#ifdef OC_EXTERNAL_EVENT_LOOP
+  /* never block the host loop on a spurious readiness report */
+  int ret = recvmsg(sock, &msg, MSG_DONTWAIT);
+#else  /* OC_EXTERNAL_EVENT_LOOP */
+  int ret = recvmsg(sock, &msg, 0);
+#endif /* !OC_EXTERNAL_EVENT_LOOP */
+
+  if (ret < 0 || (msg.msg_flags & MSG_TRUNC) || (msg.msg_flags & MSG_CTRUNC)) {
+    OC_ERR("recvmsg returned with an error: %d", errno);
+    return -1;
+  }
+
+  if (parse_recv_msg(&msg, endpoint, multicast) < 0) {
+    return -1;
+  }
+
   return ret;
 }
 
-static void
+bool
+oc_ip_fd_set(int fd, fd_set *set)
+{
+  if (fd < 0 || fd >= FD_SETSIZE) {
+    return false;
+  }
+  FD_SET(fd, set);
+  return true;
+}
+
+static bool
 oc_udp_add_socks_to_fd_set(ip_context_t *dev)
 {
-  FD_SET(dev->server_sock, &dev->rfds);
-  FD_SET(dev->mcast_sock, &dev->rfds);
+  bool added = oc_ip_fd_set(dev->server_sock, &dev->rfds);
+  added = oc_ip_fd_set(dev->mcast_sock, &dev->rfds) && added;
 #ifdef OC_SECURITY
-  FD_SET(dev->secure_sock, &dev->rfds);
+  added = oc_ip_fd_set(dev->secure_sock, &dev->rfds) && added;
 #endif /* OC_SECURITY */
 
 #ifdef OC_IPV4
-  FD_SET(dev->server4_sock, &dev->rfds);
-  FD_SET(dev->mcast4_sock, &dev->rfds);
+  added = oc_ip_fd_set(dev->server4_sock, &dev->rfds) && added;
+  added = oc_ip_fd_set(dev->mcast4_sock, &dev->rfds) && added;
 #ifdef OC_SECURITY
-  FD_SET(dev->secure4_sock, &dev->rfds);
+  added = oc_ip_fd_set(dev->secure4_sock, &dev->rfds) && added;
 #endif /* OC_SECURITY */
 #endif /* OC_IPV4 */
+  return added;
 }
 
 static adapter_receive_state_t
@@ -800,50 +1263,819 @@ oc_udp_receive_message(ip_context_t *dev, fd_set *fds, oc_message_t *message)
     return ADAPTER_STATUS_RECEIVE;
   }
 
-  if (FD_ISSET(dev->mcast4_sock, fds)) {
-    int count = recv_msg(dev->mcast4_sock, message->data, OC_PDU_SIZE,
-                         &message->endpoint, true);
-    if (count < 0) {
-      return ADAPTER_STATUS_ERROR;
+  if (FD_ISSET(dev->mcast4_sock, fds)) {
+    int count = recv_msg(dev->mcast4_sock, message->data, OC_PDU_SIZE,
+                         &message->endpoint, true);
+    if (count < 0) {
+      return ADAPTER_STATUS_ERROR;
+    }
+    message->length = (size_t)count;
+    message->endpoint.flags = IPV4 | MULTICAST;
+    FD_CLR(dev->mcast4_sock, fds);
+    return ADAPTER_STATUS_RECEIVE;
+  }
+#endif /* OC_IPV4 */
+
+#ifdef OC_SECURITY
+  if (FD_ISSET(dev->secure_sock, fds)) {
+    int count = recv_msg(dev->secure_sock, message->data, OC_PDU_SIZE,
+                         &message->endpoint, false);
+    if (count < 0) {
+      return ADAPTER_STATUS_ERROR;
+    }
+    message->length = (size_t)count;
+    message->endpoint.flags = IPV6 | SECURED;
+    message->encrypted = 1;
+    FD_CLR(dev->secure_sock, fds);
+    return ADAPTER_STATUS_RECEIVE;
+  }
+#ifdef OC_IPV4
+  if (FD_ISSET(dev->secure4_sock, fds)) {
+    int count = recv_msg(dev->secure4_sock, message->data, OC_PDU_SIZE,
+                         &message->endpoint, false);
+    if (count < 0) {
+      return ADAPTER_STATUS_ERROR;
+    }
+    message->length = (size_t)count;
+    message->endpoint.flags = IPV4 | SECURED;
+    message->encrypted = 1;
+    FD_CLR(dev->secure4_sock, fds);
+    return ADAPTER_STATUS_RECEIVE;
+  }
+#endif /* OC_IPV4 */
+#endif /* OC_SECURITY */
+
+  return ADAPTER_STATUS_NONE;
+}
+
+#ifdef OC_SHARED_TRANSPORT
+/* Every device answers multicast requests on its own, so each device sharing
+ * this transport receives its own copy of the message.
+ */
+static void
+dispatch_multicast_to_shared_devices(ip_context_t *dev, oc_message_t *message)
+{
+  ip_context_t *shared = oc_list_head(ip_contexts);
+  for (; shared != NULL; shared = shared->next) {
+    if (shared->transport != dev) {
+      continue;
+    }
+    oc_message_t *copy = oc_allocate_message();
+    if (!copy) {
+      OC_WRN("no buffer to deliver multicast message to device %zd",
+             shared->device);
+      return;
+    }
+    memcpy(&copy->endpoint, &message->endpoint, sizeof(oc_endpoint_t));
+    copy->endpoint.device = shared->device;
+    memcpy(copy->data, message->data, message->length);
+    copy->length = message->length;
+#ifdef OC_EXTERNAL_EVENT_LOOP
+    oc_network_event_in_loop(copy);
+#else  /* OC_EXTERNAL_EVENT_LOOP */
+    oc_network_event(copy);
+#endif /* !OC_EXTERNAL_EVENT_LOOP */
+  }
+}
+#endif /* OC_SHARED_TRANSPORT */
+
+/* Returns false if some socket cannot be watched. */
+static bool
+add_socks_to_fd_set(ip_context_t *dev)
+{
+  bool added = true;
+  FD_ZERO(&dev->rfds);
+  /* Monitor network interface changes on the platform from only the 0th logical
+   * device
+   */
+  if (dev->device == 0) {
+    added = oc_ip_fd_set(ifchange_sock, &dev->rfds);
+  }
+
+  added = oc_udp_add_socks_to_fd_set(dev) && added;
+#ifdef OC_TCP
+  added = oc_tcp_add_socks_to_fd_set(dev) && added;
+#endif /* OC_TCP */
+  return added;
+}
+
+/* Receive from the n sockets of dev that are ready to read in setfds. */
+static void
+process_readable_fds(ip_context_t *dev, fd_set *setfds, int n)
+{
+  int i;
+  for (i = 0; i < n; i++) {
+    if (dev->device == 0) {
+      if (FD_ISSET(ifchange_sock, setfds)) {
+        if (process_interface_change_event() < 0) {
+          OC_WRN("caught errors while handling a network interface change");
+        }
+        FD_CLR(ifchange_sock, setfds);
+        continue;
+      }
+    }
+
+    oc_message_t *message = oc_allocate_message();
+
+    if (!message) {
+      break;
+    }
+
+    message->endpoint.device = dev->device;
+
+    if (oc_udp_receive_message(dev, setfds, message) ==
+        ADAPTER_STATUS_RECEIVE) {
+      goto common;
+    }
+#ifdef OC_TCP
+    if (oc_tcp_receive_message(dev, setfds, message) ==
+        ADAPTER_STATUS_RECEIVE) {
+      goto common;
+    }
+#endif /* OC_TCP */
+
+    oc_message_unref(message);
+    continue;
+
+  common:
+#ifdef OC_DEBUG
+    PRINT("Incoming message of size %zd bytes from ", message->length);
+    PRINTipaddr(message->endpoint);
+    PRINT("\n\n");
+#endif /* OC_DEBUG */
+
+#ifdef OC_SHARED_TRANSPORT
+    if (message->endpoint.flags & MULTICAST) {
+      dispatch_multicast_to_shared_devices(dev, message);
+    }
+#endif /* OC_SHARED_TRANSPORT */
+#ifdef OC_EXTERNAL_EVENT_LOOP
+    oc_network_event_in_loop(message);
+#else  /* OC_EXTERNAL_EVENT_LOOP */
+    oc_network_event(message);
+#endif /* !OC_EXTERNAL_EVENT_LOOP */
+  }
+}
+
+#ifdef OC_EXTERNAL_EVENT_LOOP
+static oc_fd_watch_cb_t fd_watch_cb;
+static void *fd_watch_data;
+/* descriptors the host loop was last told about, all below FD_SETSIZE as
+ * oc_ip_fd_set() and the TCP adapter refuse the others */
+static fd_set watched_rfds, watched_wfds;
+
+static void
+or_fd_sets(fd_set *dst, const fd_set *src)
+{
+  unsigned char *d = (unsigned char *)dst;
+  const unsigned char *s = (const unsigned char *)src;
+  size_t i;
+  for (i = 0; i < sizeof(fd_set); i++) {
+    d[i] |= s[i];
+  }
+}
+
+static void
+watch_fd(int fd, unsigned events)
+{
+  if (events & OC_FD_READABLE) {
+    FD_SET(fd, &watched_rfds);
+  } else {
+    FD_CLR(fd, &watched_rfds);
+  }
+  if (events & OC_FD_WRITABLE) {
+    FD_SET(fd, &watched_wfds);
+  } else {
+    FD_CLR(fd, &watched_wfds);
+  }
+  if (fd_watch_cb) {
+    fd_watch_cb(fd, events, fd_watch_data);
+  }
+}
+
+void
+oc_ip_unwatch_fd(ip_context_t *dev, int fd)
+{
+  (void)dev;
+  if (fd >= 0 && fd < FD_SETSIZE &&
+      (FD_ISSET(fd, &watched_rfds) || FD_ISSET(fd, &watched_wfds))) {
+    watch_fd(fd, 0);
+  }
+}
+
+static void
+unwatch_context_fds(ip_context_t *dev)
+{
+  int fd;
+  for (fd = 0; fd < FD_SETSIZE; fd++) {
+    if (FD_ISSET(fd, &dev->rfds)
+#ifdef OC_TCP
+        || FD_ISSET(fd, &dev->tcp.wfds)
+#endif /* OC_TCP */
+    ) {
+      oc_ip_unwatch_fd(dev, fd);
+    }
+  }
+}
+
+oc_clock_time_t
+oc_connectivity_update_fd_watches(void)
+{
+  fd_set rfds, wfds;
+  FD_ZERO(&rfds);
+  FD_ZERO(&wfds);
+  bool timeout_pending = false;
+
+  ip_context_t *dev = oc_list_head(ip_contexts);
+  for (; dev != NULL; dev = dev->next) {
+    if (!owns_transport(dev)) {
+      continue;
+    }
+    or_fd_sets(&rfds, &dev->rfds);
+#ifdef OC_TCP
+    or_fd_sets(&wfds, &dev->tcp.wfds);
+    timeout_pending = timeout_pending || oc_tcp_timeout_pending(dev);
+#endif /* OC_TCP */
+  }
+
+  if (memcmp(&rfds, &watched_rfds, sizeof(fd_set)) != 0 ||
+      memcmp(&wfds, &watched_wfds, sizeof(fd_set)) != 0) {
+    int fd;
+    for (fd = 0; fd < FD_SETSIZE; fd++) {
+      bool r = FD_ISSET(fd, &rfds) != 0, w = FD_ISSET(fd, &wfds) != 0;
+      if (r != (FD_ISSET(fd, &watched_rfds) != 0) ||
+          w != (FD_ISSET(fd, &watched_wfds) != 0)) {
+        watch_fd(fd, (r ? OC_FD_READABLE : 0) | (w ? OC_FD_WRITABLE : 0));
+      }
+    }
+  }
+
+  /* TCP connection attempts and partially received messages expire on the
+   * same period as with select() */
+  return timeout_pending
+           ? oc_clock_time() + SELECT_TIMEOUT_SEC * OC_CLOCK_SECOND
+           : 0;
+}
+
+void
+oc_connectivity_set_fd_watch_callback(oc_fd_watch_cb_t cb, void *user_data)
+{
+  fd_watch_cb = cb;
+  fd_watch_data = user_data;
+  /* report every descriptor to the new callback */
+  FD_ZERO(&watched_rfds);
+  FD_ZERO(&watched_wfds);
+  oc_connectivity_update_fd_watches();
+}
+
+static ip_context_t *
+get_ip_context_for_fd(int fd)
+{
+  ip_context_t *dev = oc_list_head(ip_contexts);
+  for (; dev != NULL; dev = dev->next) {
+    if (owns_transport(dev) && FD_ISSET(fd, &dev->rfds)) {
+      return dev;
+    }
+  }
+  return NULL;
+}
+
+void
+oc_connectivity_on_readable(int fd)
+{
+  if (fd < 0 || fd >= FD_SETSIZE) {
+    return;
+  }
+  ip_context_t *dev = get_ip_context_for_fd(fd);
+  if (!dev) {
+    return;
+  }
+  fd_set setfds;
+  FD_ZERO(&setfds);
+  FD_SET(fd, &setfds);
+  process_readable_fds(dev, &setfds, 1);
+}
+
+void
+oc_connectivity_on_writable(int fd)
+{
+#ifdef OC_TCP
+  if (fd < 0 || fd >= FD_SETSIZE) {
+    return;
+  }
+  ip_context_t *dev = oc_list_head(ip_contexts);
+  for (; dev != NULL; dev = dev->next) {
+    if (owns_transport(dev) && FD_ISSET(fd, &dev->tcp.wfds)) {
+      fd_set wsetfds;
+      FD_ZERO(&wsetfds);
+      FD_SET(fd, &wsetfds);
+      oc_tcp_process_writable(dev, &wsetfds);
+      return;
+    }
+  }
+#else  /* OC_TCP */
+  (void)fd;
+#endif /* !OC_TCP */
+}
+
+void
+oc_connectivity_on_timeout(void)
+{
+#ifdef OC_TCP
+  ip_context_t *dev = oc_list_head(ip_contexts);
+  for (; dev != NULL; dev = dev->next) {
+    if (owns_transport(dev)) {
+      /* expires connection attempts and partially received messages that
+       * ran out of time */
+      fd_set wsetfds;
+      FD_ZERO(&wsetfds);
+      oc_tcp_process_writable(dev, &wsetfds);
+    }
+  }
+#endif /* OC_TCP */
+}
+#else  /* OC_EXTERNAL_EVENT_LOOP */
+#ifdef OC_IO_URING
+#ifndef OC_IORING_RECV_DEPTH
+#ifdef OC_DYNAMIC_ALLOCATION
+#define OC_IORING_RECV_DEPTH (4)
+#else /* OC_DYNAMIC_ALLOCATION */
+#define OC_IORING_RECV_DEPTH (1)
+#endif /* !OC_DYNAMIC_ALLOCATION */
+#endif /* !OC_IORING_RECV_DEPTH */
+#if OC_IORING_RECV_DEPTH < 1 || OC_IORING_RECV_DEPTH > 16
+#error "OC_IORING_RECV_DEPTH must be between 1 and 16"
+#endif /* OC_IORING_RECV_DEPTH < 1 || OC_IORING_RECV_DEPTH > 16 */
+
+#define IORING_MAX_UDP_SOCKS (6)
+#define IORING_MAX_RECVS (IORING_MAX_UDP_SOCKS * OC_IORING_RECV_DEPTH)
+#define IORING_MAX_EPOLL_EVENTS (16)
+/* retry period while no message can be allocated for a receive */
+#define IORING_RETRY_MS (10)
+
+/* user_data of the requests that do not complete into a receive */
+#define IORING_POLL_TAG (1)
+#define IORING_TIMEOUT_TAG (2)
+#define IORING_CANCEL_TAG (3)
+#define IORING_RETRY_TAG (4)
+
+/* A datagram receive straight into the buffer of an incoming message, which
+ * is handed to the stack as it is once the datagram arrives. Each receive
+ * holds one message of the pool while it waits.
+ */
+typedef struct
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct sockaddr_storage client;
+  char control[CMSG_LEN(sizeof(struct sockaddr_storage))];
+  oc_message_t *message;
+  int sock;
+  enum transport_flags flags;
+  bool pending;
+} ioring_recv_t;
+
+typedef struct
+{
+  oc_ioring_t ring;
+  ioring_recv_t recvs[IORING_MAX_RECVS];
+  int num_recvs;
+  int inflight;
+  bool poll_armed;
+  bool retry_armed;
+  struct __kernel_timespec timeout, retry;
+} ioring_loop_t;
+
+void
+oc_ip_unwatch_fd(ip_context_t *dev, int fd)
+{
+  if (dev->epoll_fd >= 0 && fd >= 0 && fd < FD_SETSIZE &&
+      (FD_ISSET(fd, &dev->epoll_rfds) || FD_ISSET(fd, &dev->epoll_wfds))) {
+    epoll_ctl(dev->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    FD_CLR(fd, &dev->epoll_rfds);
+    FD_CLR(fd, &dev->epoll_wfds);
+  }
+}
+
+void
+oc_ip_fd_changed(ip_context_t *dev, int fd)
+{
+  if (dev->num_epoll_dirty < OC_IORING_MAX_DIRTY_FDS) {
+    dev->epoll_dirty[dev->num_epoll_dirty] = fd;
+  }
+  /* one past the capacity means that some changes were not recorded */
+  if (dev->num_epoll_dirty <= OC_IORING_MAX_DIRTY_FDS) {
+    dev->num_epoll_dirty++;
+  }
+}
+
+static void
+ioring_add_recvs(ip_context_t *dev, ioring_loop_t *loop, int sock,
+                 enum transport_flags flags)
+{
+  int i;
+  for (i = 0; i < OC_IORING_RECV_DEPTH; i++) {
+    ioring_recv_t *r = &loop->recvs[loop->num_recvs];
+    memset(r, 0, sizeof(ioring_recv_t));
+    r->sock = sock;
+    r->flags = flags;
+    loop->num_recvs++;
+  }
+  /* marked as registered so that the epoll mirror leaves them to the ring */
+  FD_SET(sock, &dev->epoll_rfds);
+}
+
+static bool
+ioring_arm_recv(ioring_loop_t *loop, ioring_recv_t *r)
+{
+  if (!r->message) {
+    r->message = oc_allocate_message();
+    if (!r->message) {
+      return false;
+    }
+  }
+  struct io_uring_sqe *sqe = oc_ioring_get_sqe(&loop->ring);
+  if (!sqe) {
+    return false;
+  }
+  r->iov.iov_base = r->message->data;
+  r->iov.iov_len = oc_message_tailroom(r->message);
+  memset(&r->msg, 0, sizeof(struct msghdr));
+  r->msg.msg_name = &r->client;
+  r->msg.msg_namelen = sizeof(r->client);
+  r->msg.msg_iov = &r->iov;
+  r->msg.msg_iovlen = 1;
+  r->msg.msg_control = r->control;
+  r->msg.msg_controllen = sizeof(r->control);
+
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = r->sock;
+  sqe->addr = (uintptr_t)&r->msg;
+  sqe->len = 1;
+  sqe->user_data = (uintptr_t)r;
+  r->pending = true;
+  loop->inflight++;
+  return true;
+}
+
+/* Poll the epoll instance holding every descriptor that is not received
+ * through the ring. With a timeout, a linked timeout ends the poll early.
+ */
+static bool
+ioring_arm_poll(ip_context_t *dev, ioring_loop_t *loop, long timeout_ms)
+{
+  struct io_uring_sqe *sqe = oc_ioring_get_sqe(&loop->ring);
+  if (!sqe) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = dev->epoll_fd;
+  sqe->poll_events = POLLIN;
+  sqe->user_data = IORING_POLL_TAG;
+  loop->poll_armed = true;
+  loop->inflight++;
+  if (timeout_ms > 0) {
+    struct io_uring_sqe *link = oc_ioring_get_sqe(&loop->ring);
+    if (link) {
+      sqe->flags |= IOSQE_IO_LINK;
+      loop->timeout.tv_sec = timeout_ms / 1000;
+      loop->timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+      link->opcode = IORING_OP_LINK_TIMEOUT;
+      link->addr = (uintptr_t)&loop->timeout;
+      link->len = 1;
+      link->user_data = IORING_TIMEOUT_TAG;
+      loop->inflight++;
+    }
+  }
+  return true;
+}
+
+/* Wake up the loop to retry allocating messages for received datagrams. */
+static void
+ioring_arm_retry(ioring_loop_t *loop)
+{
+  struct io_uring_sqe *sqe = oc_ioring_get_sqe(&loop->ring);
+  if (!sqe) {
+    return;
+  }
+  loop->retry.tv_sec = 0;
+  loop->retry.tv_nsec = IORING_RETRY_MS * 1000000L;
+  sqe->opcode = IORING_OP_TIMEOUT;
+  sqe->addr = (uintptr_t)&loop->retry;
+  sqe->len = 1;
+  sqe->user_data = IORING_RETRY_TAG;
+  loop->retry_armed = true;
+  loop->inflight++;
+}
+
+static void
+ioring_update_fd(ip_context_t *dev, int fd)
+{
+  if (fd < 0 || fd >= FD_SETSIZE) {
+    return;
+  }
+  bool r = FD_ISSET(fd, &dev->rfds) != 0;
+#ifdef OC_TCP
+  bool w = FD_ISSET(fd, &dev->tcp.wfds) != 0;
+#else  /* OC_TCP */
+  bool w = false;
+#endif /* !OC_TCP */
+  bool was_r = FD_ISSET(fd, &dev->epoll_rfds) != 0;
+  bool was_w = FD_ISSET(fd, &dev->epoll_wfds) != 0;
+  if (r == was_r && w == was_w) {
+    return;
+  }
+  struct epoll_event event;
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = (r ? EPOLLIN : 0) | (w ? EPOLLOUT : 0);
+  event.data.fd = fd;
+  int op = (!r && !w) ? EPOLL_CTL_DEL
+                      : ((was_r || was_w) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+  if (epoll_ctl(dev->epoll_fd, op, fd, &event) < 0 && op != EPOLL_CTL_DEL) {
+    OC_WRN("epoll_ctl failed for descriptor %d: %d", fd, errno);
+    return;
+  }
+  if (r) {
+    FD_SET(fd, &dev->epoll_rfds);
+  } else {
+    FD_CLR(fd, &dev->epoll_rfds);
+  }
+  if (w) {
+    FD_SET(fd, &dev->epoll_wfds);
+  } else {
+    FD_CLR(fd, &dev->epoll_wfds);
+  }
+}
+
+/* Mirror the changes to the read and write interest of the network thread
+ * into epoll. Only the descriptors recorded by oc_ip_fd_changed() are looked
+ * at, unless more changed than could be recorded.
+ */
+static void
+ioring_update_epoll(ip_context_t *dev)
+{
+#ifdef OC_TCP
+  pthread_mutex_lock(&dev->tcp.mutex);
+#endif /* OC_TCP */
+  int i;
+  if (dev->num_epoll_dirty > OC_IORING_MAX_DIRTY_FDS) {
+    for (i = 0; i < FD_SETSIZE; i++) {
+      ioring_update_fd(dev, i);
+    }
+  } else {
+    for (i = 0; i < dev->num_epoll_dirty; i++) {
+      ioring_update_fd(dev, dev->epoll_dirty[i]);
+    }
+  }
+  dev->num_epoll_dirty = 0;
+#ifdef OC_TCP
+  pthread_mutex_unlock(&dev->tcp.mutex);
+#endif /* OC_TCP */
+}
+
+static void
+ioring_process_polled_fds(ip_context_t *dev)
+{
+  struct epoll_event events[IORING_MAX_EPOLL_EVENTS];
+  int n = epoll_wait(dev->epoll_fd, events, IORING_MAX_EPOLL_EVENTS, 0);
+  fd_set setfds, wsetfds;
+  FD_ZERO(&setfds);
+  FD_ZERO(&wsetfds);
+  int i, nread = 0;
+  for (i = 0; i < n; i++) {
+    int fd = events[i].data.fd;
+    /* errors wake up both directions, as they do with select() */
+    bool error = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+    if ((events[i].events & EPOLLIN) ||
+        (error && FD_ISSET(fd, &dev->epoll_rfds))) {
+      FD_SET(fd, &setfds);
+      nread++;
+    }
+    if ((events[i].events & EPOLLOUT) ||
+        (error && FD_ISSET(fd, &dev->epoll_wfds))) {
+      FD_SET(fd, &wsetfds);
+    }
+  }
+
+  if (FD_ISSET(dev->shutdown_pipe[0], &setfds)) {
+    char buf;
+    // write to pipe shall not block - so read the byte we wrote
+    if (read(dev->shutdown_pipe[0], &buf, 1) < 0) {
+      // intentionally left blank
+    }
+    FD_CLR(dev->shutdown_pipe[0], &setfds);
+    nread--;
+  }
+
+  if (dev->terminate) {
+    return;
+  }
+
+#ifdef OC_TCP
+  oc_tcp_process_writable(dev, &wsetfds);
+#endif /* OC_TCP */
+
+  process_readable_fds(dev, &setfds, nread);
+}
+
+/* Hand the message r received length bytes into to the stack. */
+static void
+ioring_deliver(ip_context_t *dev, ioring_recv_t *r, size_t length)
+{
+  oc_message_t *message = r->message;
+  message->endpoint.device = dev->device;
+  if (parse_recv_msg(&r->msg, &message->endpoint,
+                     (r->flags & MULTICAST) != 0) < 0) {
+    /* the message is kept for the next receive */
+    return;
+  }
+  r->message = NULL;
+  message->length = length;
+  message->endpoint.flags = r->flags;
+#ifdef OC_SECURITY
+  if (r->flags & SECURED) {
+    message->encrypted = 1;
+  }
+#endif /* OC_SECURITY */
+
+#ifdef OC_DEBUG
+  PRINT("Incoming message of size %zd bytes from ", message->length);
+  PRINTipaddr(message->endpoint);
+  PRINT("\n\n");
+#endif /* OC_DEBUG */
+
+#ifdef OC_SHARED_TRANSPORT
+  if (message->endpoint.flags & MULTICAST) {
+    dispatch_multicast_to_shared_devices(dev, message);
+  }
+#endif /* OC_SHARED_TRANSPORT */
+  oc_network_event(message);
+}
+
+static void
+ioring_complete_recv(ip_context_t *dev, ioring_loop_t *loop, ioring_recv_t *r,
+                     int res)
+{
+  r->pending = false;
+  loop->inflight--;
+  if (res == -ECANCELED) {
+    return;
+  }
+  if (res < 0 || (r->msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+    OC_ERR("recvmsg returned with an error: %d", -res);
+    return;
+  }
+  if (!dev->terminate) {
+    ioring_deliver(dev, r, (size_t)res);
+  }
+}
+
+static void
+ioring_reap(ip_context_t *dev, ioring_loop_t *loop)
+{
+  bool polled = false;
+  struct io_uring_cqe *cqe;
+  while ((cqe = oc_ioring_peek_cqe(&loop->ring)) != NULL) {
+    uint64_t user_data = cqe->user_data;
+    int res = cqe->res;
+    oc_ioring_cqe_seen(&loop->ring);
+    if (user_data == IORING_POLL_TAG) {
+      loop->poll_armed = false;
+      loop->inflight--;
+      polled = true;
+    } else if (user_data == IORING_TIMEOUT_TAG) {
+      loop->inflight--;
+    } else if (user_data == IORING_RETRY_TAG) {
+      loop->retry_armed = false;
+      loop->inflight--;
+    } else if (user_data != IORING_CANCEL_TAG) {
+      ioring_complete_recv(dev, loop, (ioring_recv_t *)(uintptr_t)user_data,
+                           res);
+    }
+  }
+  /* runs on expired polls too, to expire connection attempts */
+  if (polled && !dev->terminate) {
+    ioring_process_polled_fds(dev);
+  }
+}
+
+static void
+ioring_cancel_all(ioring_loop_t *loop)
+{
+  int i;
+  for (i = 0; i < loop->num_recvs; i++) {
+    if (loop->recvs[i].pending) {
+      struct io_uring_sqe *sqe = oc_ioring_get_sqe(&loop->ring);
+      if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = (uintptr_t)&loop->recvs[i];
+        sqe->user_data = IORING_CANCEL_TAG;
+      }
+    }
+  }
+  if (loop->poll_armed) {
+    /* cancelling the poll also ends its linked timeout */
+    struct io_uring_sqe *sqe = oc_ioring_get_sqe(&loop->ring);
+    if (sqe) {
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->addr = IORING_POLL_TAG;
+      sqe->user_data = IORING_CANCEL_TAG;
+    }
+  }
+  if (loop->retry_armed) {
+    struct io_uring_sqe *sqe = oc_ioring_get_sqe(&loop->ring);
+    if (sqe) {
+      sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+      sqe->addr = IORING_RETRY_TAG;
+      sqe->user_data = IORING_CANCEL_TAG;
+    }
+  }
+}
+
+/* Network thread on io_uring: every UDP socket keeps OC_IORING_RECV_DEPTH
+ * receives in flight into incoming messages, and one poll of an epoll
+ * instance covers the netlink socket, the pipes and the TCP sockets. Returns
+ * false without running if io_uring is not available.
+ */
+static bool
+ioring_event_loop(ip_context_t *dev)
+{
+  ioring_loop_t loop;
+  memset(&loop, 0, sizeof(ioring_loop_t));
+  /* one entry per receive, the poll, its timeout and the retry timer; the
+   * cancels at shutdown fit after a submit */
+  if (dev->epoll_fd < 0 ||
+      oc_ioring_init(&loop.ring, IORING_MAX_RECVS + 3) < 0) {
+    return false;
+  }
+
+  ioring_add_recvs(dev, &loop, dev->server_sock, IPV6);
+  ioring_add_recvs(dev, &loop, dev->mcast_sock, IPV6 | MULTICAST);
+#ifdef OC_SECURITY
+  ioring_add_recvs(dev, &loop, dev->secure_sock, IPV6 | SECURED);
+#endif /* OC_SECURITY */
+#ifdef OC_IPV4
+  ioring_add_recvs(dev, &loop, dev->server4_sock, IPV4);
+  ioring_add_recvs(dev, &loop, dev->mcast4_sock, IPV4 | MULTICAST);
+#ifdef OC_SECURITY
+  ioring_add_recvs(dev, &loop, dev->secure4_sock, IPV4 | SECURED);
+#endif /* OC_SECURITY */
+#endif /* OC_IPV4 */
+
+  while (dev->terminate != 1) {
+    bool starved = false;
+    int i;
+    for (i = 0; i < loop.num_recvs; i++) {
+      ioring_recv_t *r = &loop.recvs[i];
+      if (!r->pending && !ioring_arm_recv(&loop, r)) {
+        starved = true;
+      }
+    }
+
+    ioring_update_epoll(dev);
+    if (!loop.poll_armed) {
+      long timeout_ms = 0;
+#ifdef OC_TCP
+      if (oc_tcp_timeout_pending(dev)) {
+        /* wake up periodically to expire connection attempts and partially
+         * received messages */
+        timeout_ms = SELECT_TIMEOUT_SEC * 1000;
+      }
+#endif /* OC_TCP */
+      ioring_arm_poll(dev, &loop, timeout_ms);
+    }
+    if (starved && !loop.retry_armed) {
+      ioring_arm_retry(&loop);
+    }
+
+    if (oc_ioring_submit_and_wait(&loop.ring, 1) < 0) {
+      OC_ERR("io_uring_enter failed %d", errno);
+      break;
     }
-    message->length = (size_t)count;
-    message->endpoint.flags = IPV4 | MULTICAST;
-    FD_CLR(dev->mcast4_sock, fds);
-    return ADAPTER_STATUS_RECEIVE;
+    ioring_reap(dev, &loop);
   }
-#endif /* OC_IPV4 */
 
-#ifdef OC_SECURITY
-  if (FD_ISSET(dev->secure_sock, fds)) {
-    int count = recv_msg(dev->secure_sock, message->data, OC_PDU_SIZE,
-                         &message->endpoint, false);
-    if (count < 0) {
-      return ADAPTER_STATUS_ERROR;
+  /* The kernel may write into the messages until their receives complete,
+   * so they are only released once every cancellation has been reaped. */
+  ioring_cancel_all(&loop);
+  while (loop.inflight > 0) {
+    if (oc_ioring_submit_and_wait(&loop.ring, 1) < 0) {
+      OC_ERR("io_uring_enter failed %d, leaving the receive messages", errno);
+      oc_ioring_destroy(&loop.ring);
+      return true;
     }
-    message->length = (size_t)count;
-    message->endpoint.flags = IPV6 | SECURED;
-    message->encrypted = 1;
-    FD_CLR(dev->secure_sock, fds);
-    return ADAPTER_STATUS_RECEIVE;
+    ioring_reap(dev, &loop);
   }
-#ifdef OC_IPV4
-  if (FD_ISSET(dev->secure4_sock, fds)) {
-    int count = recv_msg(dev->secure4_sock, message->data, OC_PDU_SIZE,
-                         &message->endpoint, false);
-    if (count < 0) {
-      return ADAPTER_STATUS_ERROR;
+  int i;
+  for (i = 0; i < loop.num_recvs; i++) {
+    if (loop.recvs[i].message) {
+      oc_message_unref(loop.recvs[i].message);
     }
-    message->length = (size_t)count;
-    message->endpoint.flags = IPV4 | SECURED;
-    message->encrypted = 1;
-    FD_CLR(dev->secure4_sock, fds);
-    return ADAPTER_STATUS_RECEIVE;
   }
-#endif /* OC_IPV4 */
-#endif /* OC_SECURITY */
-
-  return ADAPTER_STATUS_NONE;
+  oc_ioring_destroy(&loop.ring);
+  return true;
 }
+#endif /* OC_IO_URING */
 
 static void *
 network_event_thread(void *data)
@@ -851,25 +2083,29 @@ network_event_thread(void *data)
   ip_context_t *dev = (ip_context_t *)data;
 
   fd_set setfds;
-  FD_ZERO(&dev->rfds);
-  /* Monitor network interface changes on the platform from only the 0th logical
-   * device
-   */
-  if (dev->device == 0) {
-    FD_SET(ifchange_sock, &dev->rfds);
-  }
-  FD_SET(dev->shutdown_pipe[0], &dev->rfds);
 
-  oc_udp_add_socks_to_fd_set(dev);
-#ifdef OC_TCP
-  oc_tcp_add_socks_to_fd_set(dev);
-#endif /* OC_TCP */
+#ifdef OC_IO_URING
+  if (ioring_event_loop(dev)) {
+    pthread_exit(NULL);
+    return NULL;
+  }
+  OC_WRN("io_uring is not available, polling the sockets with select()");
+#endif /* OC_IO_URING */
 
-  int i, n;
+  int n;
 
   while (dev->terminate != 1) {
     setfds = dev->rfds;
+#ifdef OC_TCP
+    fd_set wsetfds = dev->tcp.wfds;
+    struct timeval timeout = { SELECT_TIMEOUT_SEC, 0 };
+    /* wake up periodically to expire connection attempts and partially
+     * received messages */
+    n = select(FD_SETSIZE, &setfds, &wsetfds, NULL,
+               oc_tcp_timeout_pending(dev) ? &timeout : NULL);
+#else  /* OC_TCP */
     n = select(FD_SETSIZE, &setfds, NULL, NULL, NULL);
+#endif /* !OC_TCP */
 
     if (FD_ISSET(dev->shutdown_pipe[0], &setfds)) {
       char buf;
@@ -883,52 +2119,16 @@ network_event_thread(void *data)
       break;
     }
 
-    for (i = 0; i < n; i++) {
-      if (dev->device == 0) {
-        if (FD_ISSET(ifchange_sock, &setfds)) {
-          if (process_interface_change_event() < 0) {
-            OC_WRN("caught errors while handling a network interface change");
-          }
-          FD_CLR(ifchange_sock, &setfds);
-          continue;
-        }
-      }
-
-      oc_message_t *message = oc_allocate_message();
-
-      if (!message) {
-        break;
-      }
-
-      message->endpoint.device = dev->device;
-
-      if (oc_udp_receive_message(dev, &setfds, message) ==
-          ADAPTER_STATUS_RECEIVE) {
-        goto common;
-      }
 #ifdef OC_TCP
-      if (oc_tcp_receive_message(dev, &setfds, message) ==
-          ADAPTER_STATUS_RECEIVE) {
-        goto common;
-      }
+    n -= oc_tcp_process_writable(dev, &wsetfds);
 #endif /* OC_TCP */
 
-      oc_message_unref(message);
-      continue;
-
-    common:
-#ifdef OC_DEBUG
-      PRINT("Incoming message of size %zd bytes from ", message->length);
-      PRINTipaddr(message->endpoint);
-      PRINT("\n\n");
-#endif /* OC_DEBUG */
-
-      oc_network_event(message);
-    }
+    process_readable_fds(dev, &setfds, n);
   }
   pthread_exit(NULL);
   return NULL;
 }
+#endif /* !OC_EXTERNAL_EVENT_LOOP */
 
 static int
 send_msg(int sock, struct sockaddr_storage *receiver, oc_message_t *message)
@@ -1046,7 +2246,8 @@ oc_send_buffer(oc_message_t *message)
   }
   int send_sock = -1;
 
-  ip_context_t *dev = get_ip_context_for_device(message->endpoint.device);
+  ip_context_t *dev =
+    get_transport_context_for_device(message->endpoint.device);
 
   if (!dev) {
     return -1;
@@ -1100,7 +2301,8 @@ oc_send_discovery_request(oc_message_t *message)
          sizeof(message->endpoint.addr_local));
   message->endpoint.interface_index = 0;
 
-  ip_context_t *dev = get_ip_context_for_device(message->endpoint.device);
+  ip_context_t *dev =
+    get_transport_context_for_device(message->endpoint.device);
 
 #define IN6_IS_ADDR_MC_REALM_LOCAL(addr)                                       \
   IN6_IS_ADDR_MULTICAST(addr) && ((((const uint8_t *)(addr))[1] & 0x0f) == 0x03)
@@ -1396,15 +2598,48 @@ oc_connectivity_init(size_t device)
   if (!dev) {
     oc_abort("Insufficient memory");
   }
-  oc_list_add(ip_contexts, dev);
+#ifdef OC_IO_URING
+  dev->epoll_fd = -1;
+#endif /* OC_IO_URING */
+#ifdef OC_SHARED_TRANSPORT
+  ip_context_t *transport = oc_list_head(ip_contexts);
+  while (transport && transport->transport) {
+    transport = transport->next;
+  }
+  dev->transport = transport;
+#endif /* OC_SHARED_TRANSPORT */
   dev->device = device;
-  OC_LIST_STRUCT_INIT(dev, eps);
+  dev->endpoints = NULL;
+  memset(dev->readers, 0, sizeof(dev->readers));
+  oc_network_event_handler_mutex_lock();
+  oc_list_add(ip_contexts, dev);
+  oc_network_event_handler_mutex_unlock();
+
+#ifdef OC_SHARED_TRANSPORT
+  if (dev->transport) {
+    OC_DBG("device %zd shares the transport of device %zd", device,
+           transport->device);
+    oc_network_event_handler_mutex_lock();
+    refresh_endpoints_list(dev);
+    oc_network_event_handler_mutex_unlock();
+    return 0;
+  }
+#endif /* OC_SHARED_TRANSPORT */
 
   if (pipe(dev->shutdown_pipe) < 0) {
     OC_ERR("shutdown pipe: %d", errno);
     return -1;
   }
 
+#ifdef OC_IO_URING
+  /* without it the network thread falls back to select() */
+  dev->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  FD_ZERO(&dev->epoll_rfds);
+  FD_ZERO(&dev->epoll_wfds);
+  /* the first update registers every descriptor */
+  dev->num_epoll_dirty = OC_IORING_MAX_DIRTY_FDS + 1;
+#endif /* OC_IO_URING */
+
   memset(&dev->mcast, 0, sizeof(struct sockaddr_storage));
   memset(&dev->server, 0, sizeof(struct sockaddr_storage));
 
@@ -1586,6 +2821,10 @@ oc_connectivity_init(size_t device)
       OC_ERR("binding netlink socket %d", errno);
       return -1;
     }
+    if (load_interface_addresses() < 0) {
+      OC_ERR("loading the addresses of the network interfaces");
+      return -1;
+    }
 #ifdef OC_NETWORK_MONITOR
     if (!check_new_ip_interfaces()) {
       OC_ERR("checking new IP interfaces failed.");
@@ -1595,11 +2834,29 @@ oc_connectivity_init(size_t device)
     ifchange_initialized = true;
   }
 
+  oc_network_event_handler_mutex_lock();
+  refresh_endpoints_list(dev);
+  oc_network_event_handler_mutex_unlock();
+
+#ifdef OC_EXTERNAL_EVENT_LOOP
+  /* no network thread, the host loop watches the sockets */
+  if (!add_socks_to_fd_set(dev)) {
+    OC_ERR("socket descriptors out of the range of fd_set");
+    return -1;
+  }
+  oc_connectivity_update_fd_watches();
+#else  /* OC_EXTERNAL_EVENT_LOOP */
+  if (!add_socks_to_fd_set(dev) ||
+      !oc_ip_fd_set(dev->shutdown_pipe[0], &dev->rfds)) {
+    OC_ERR("socket descriptors out of the range of fd_set");
+    return -1;
+  }
   if (pthread_create(&dev->event_thread, NULL, &network_event_thread, dev) !=
       0) {
     OC_ERR("creating network polling thread");
     return -1;
   }
+#endif /* !OC_EXTERNAL_EVENT_LOOP */
 
   OC_DBG("Successfully initialized connectivity for device %zd", device);
 
@@ -1610,10 +2867,33 @@ void
 oc_connectivity_shutdown(size_t device)
 {
   ip_context_t *dev = get_ip_context_for_device(device);
+  if (!dev) {
+    return;
+  }
+#ifdef OC_SHARED_TRANSPORT
+  if (dev->transport) {
+    remove_ip_context(dev);
+    OC_DBG("oc_connectivity_shutdown for shared device %zd", device);
+    return;
+  }
+  /* devices still sharing this transport go down with it */
+  ip_context_t *shared = oc_list_head(ip_contexts), *next;
+  while (shared != NULL) {
+    next = shared->next;
+    if (shared->transport == dev) {
+      remove_ip_context(shared);
+    }
+    shared = next;
+  }
+#endif /* OC_SHARED_TRANSPORT */
+#ifdef OC_EXTERNAL_EVENT_LOOP
+  unwatch_context_fds(dev);
+#else  /* OC_EXTERNAL_EVENT_LOOP */
   dev->terminate = 1;
   if (write(dev->shutdown_pipe[1], "\n", 1) < 0) {
     OC_WRN("cannot wakeup network thread");
   }
+#endif /* !OC_EXTERNAL_EVENT_LOOP */
 
   close(dev->server_sock);
   close(dev->mcast_sock);
@@ -1634,15 +2914,20 @@ oc_connectivity_shutdown(size_t device)
   oc_tcp_connectivity_shutdown(dev);
 #endif /* OC_TCP */
 
+#ifndef OC_EXTERNAL_EVENT_LOOP
   pthread_join(dev->event_thread, NULL);
+#endif /* !OC_EXTERNAL_EVENT_LOOP */
+
+#ifdef OC_IO_URING
+  if (dev->epoll_fd >= 0) {
+    close(dev->epoll_fd);
+  }
+#endif /* OC_IO_URING */
 
   close(dev->shutdown_pipe[1]);
   close(dev->shutdown_pipe[0]);
 
-  free_endpoints_list(dev);
-
-  oc_list_remove(ip_contexts, dev);
-  oc_memb_free(&ip_context_s, dev);
+  remove_ip_context(dev);
 
   OC_DBG("oc_connectivity_shutdown for device %zd", device);
 }
@@ -1652,7 +2937,7 @@ void
 oc_connectivity_end_session(oc_endpoint_t *endpoint)
 {
   if (endpoint->flags & TCP) {
-    ip_context_t *dev = get_ip_context_for_device(endpoint->device);
+    ip_context_t *dev = get_transport_context_for_device(endpoint->device);
     if (dev) {
       oc_tcp_end_session(dev, endpoint);
     }
@@ -1661,108 +2946,500 @@ oc_connectivity_end_session(oc_endpoint_t *endpoint)
 #endif /* OC_TCP */
 
 #ifdef OC_DNS_LOOKUP
+/* RFC 1035, section 2.3.4 */
+#define DNS_MAX_DOMAIN_LEN (254)
+
+/* The first address of each family of a domain */
+typedef struct oc_dns_result_t
+{
+  bool has_ipv6;
+  bool has_ipv4;
+  union dev_addr ipv6;
+  union dev_addr ipv4;
+} oc_dns_result_t;
+
+/* A single query asks for both families, and getaddrinfo() sorts the
+ * addresses as per RFC 6724, so the first address of each family is kept.
+ * oc_parse_endpoint_string() falls back from IPv6 to IPv4 only when the
+ * domain has no IPv6 address: there are no staggered connection attempts,
+ * and the other addresses of a family are never tried.
+ */
+static void
+resolve_domain(const char *domain, oc_dns_result_t *result)
+{
+  struct addrinfo hints, *info = NULL, *ai;
+  memset(result, 0, sizeof(oc_dns_result_t));
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  int ret = getaddrinfo(domain, NULL, &hints, &info);
+  if (ret != 0) {
+    OC_DBG("resolving %s: %s", domain, gai_strerror(ret));
+    return;
+  }
+  for (ai = info; ai != NULL; ai = ai->ai_next) {
+    if (ai->ai_family == AF_INET6 && !result->has_ipv6) {
+      struct sockaddr_in6 *r = (struct sockaddr_in6 *)ai->ai_addr;
+      memcpy(result->ipv6.ipv6.address, r->sin6_addr.s6_addr,
+             sizeof(r->sin6_addr.s6_addr));
+      result->ipv6.ipv6.scope = (uint8_t)r->sin6_scope_id;
+      result->has_ipv6 = true;
+    }
+#ifdef OC_IPV4
+    else if (ai->ai_family == AF_INET && !result->has_ipv4) {
+      struct sockaddr_in *r = (struct sockaddr_in *)ai->ai_addr;
+      memcpy(result->ipv4.ipv4.address, &r->sin_addr.s_addr,
+             sizeof(r->sin_addr.s_addr));
+      result->has_ipv4 = true;
+    }
+#endif /* OC_IPV4 */
+  }
+  freeaddrinfo(info);
+}
+
+static int
+pick_address(const oc_dns_result_t *result, enum transport_flags flags,
+             union dev_addr *addr)
+{
+  if ((flags & IPV6) && result->has_ipv6) {
+    memcpy(addr, &result->ipv6, sizeof(union dev_addr));
+    return 0;
+  }
+  if (!(flags & IPV6) && result->has_ipv4) {
+    memcpy(addr, &result->ipv4, sizeof(union dev_addr));
+    return 0;
+  }
+  return -1;
+}
+
 #ifdef OC_DNS_CACHE
+/* Resolved domains are cached, and misses are resolved on a helper thread
+ * so that no lookup blocks the event loop. oc_dns_lookup() answers a miss
+ * with -1 at once, oc_dns_lookup_async() calls back on the event loop once
+ * the result is cached. getaddrinfo() does not report the TTLs of the
+ * records, so resolved entries live for OC_DNS_CACHE_TTL and failed ones for
+ * OC_DNS_NEGATIVE_TTL seconds. An expired address is still handed out while
+ * the domain is resolved again in the background.
+ */
+#ifndef OC_DNS_CACHE_SIZE
+#define OC_DNS_CACHE_SIZE (8)
+#endif /* !OC_DNS_CACHE_SIZE */
+#ifndef OC_DNS_CACHE_TTL
+#define OC_DNS_CACHE_TTL (300)
+#endif /* !OC_DNS_CACHE_TTL */
+#ifndef OC_DNS_NEGATIVE_TTL
+#define OC_DNS_NEGATIVE_TTL (30)
+#endif /* !OC_DNS_NEGATIVE_TTL */
+#ifndef OC_DNS_MAX_WAITERS
+#define OC_DNS_MAX_WAITERS (4)
+#endif /* !OC_DNS_MAX_WAITERS */
+
 typedef struct oc_dns_cache_t
 {
-  struct oc_dns_cache_t *next;
-  oc_string_t domain;
-  union dev_addr addr;
+  struct oc_dns_cache_t *next; /* in its hash bucket */
+  oc_clock_time_t expires;
+  oc_clock_time_t used;
+  bool pending; /* queued or being resolved, must not be freed */
+  oc_dns_result_t result;
+  char domain[DNS_MAX_DOMAIN_LEN + 1];
 } oc_dns_cache_t;
 
-OC_MEMB(dns_s, oc_dns_cache_t, 1);
-OC_LIST(dns_cache);
+/* A lookup for the helper thread, which only reads the domain of its entry
+ * and fills in the result. */
+typedef struct oc_dns_job_t
+{
+  struct oc_dns_job_t *next;
+  oc_dns_cache_t *entry;
+  oc_dns_result_t result;
+} oc_dns_job_t;
+
+typedef struct oc_dns_waiter_t
+{
+  struct oc_dns_waiter_t *next;
+  oc_dns_cache_t *entry;
+  oc_dns_lookup_cb_t cb;
+  void *user_data;
+} oc_dns_waiter_t;
+
+/* The cache, the waiters and the pools are guarded by dns_cache_mutex */
+OC_MEMB(dns_s, oc_dns_cache_t, OC_DNS_CACHE_SIZE);
+OC_MEMB(dns_jobs_s, oc_dns_job_t, OC_DNS_CACHE_SIZE);
+OC_MEMB(dns_waiters_s, oc_dns_waiter_t, OC_DNS_MAX_WAITERS);
+static void *dns_buckets[OC_DNS_CACHE_SIZE];
+static size_t dns_entries; /* bounded with dynamic allocation as well */
+OC_LIST(dns_waiters);
+static pthread_mutex_t dns_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Shared with the helper thread, guarded by dns_mutex */
+static pthread_t dns_thread;
+static pthread_mutex_t dns_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dns_cond = PTHREAD_COND_INITIALIZER;
+OC_LIST(dns_jobs);
+OC_LIST(dns_completed);
+static bool dns_terminate;
+static bool dns_running;
+
+OC_PROCESS(oc_dns_events, "");
+
+static oc_list_t
+dns_bucket(const char *domain)
+{
+  /* FNV-1a, domains compare without case */
+  uint32_t hash = 2166136261u;
+  for (; *domain != '\0'; domain++) {
+    hash = (hash ^ (uint8_t)tolower((unsigned char)*domain)) * 16777619u;
+  }
+  return (oc_list_t)&dns_buckets[hash % OC_DNS_CACHE_SIZE];
+}
 
 static oc_dns_cache_t *
 oc_dns_lookup_cache(const char *domain)
 {
-  if (oc_list_length(dns_cache) == 0) {
+  oc_dns_cache_t *c = (oc_dns_cache_t *)oc_list_head(dns_bucket(domain));
+  while (c != NULL && strcasecmp(c->domain, domain) != 0) {
+    c = c->next;
+  }
+  return c;
+}
+
+/* Free the least recently used entry that is not being resolved. */
+static bool
+oc_dns_evict(void)
+{
+  oc_dns_cache_t *lru = NULL;
+  size_t i;
+  for (i = 0; i < OC_DNS_CACHE_SIZE; i++) {
+    oc_dns_cache_t *c = (oc_dns_cache_t *)dns_buckets[i];
+    for (; c != NULL; c = c->next) {
+      if (!c->pending && (!lru || c->used < lru->used)) {
+        lru = c;
+      }
+    }
+  }
+  if (!lru) {
+    return false;
+  }
+  oc_list_remove(dns_bucket(lru->domain), lru);
+  oc_memb_free(&dns_s, lru);
+  dns_entries--;
+  return true;
+}
+
+static oc_dns_cache_t *
+oc_dns_cache_domain(const char *domain)
+{
+  if (dns_entries >= OC_DNS_CACHE_SIZE && !oc_dns_evict()) {
     return NULL;
   }
-  oc_dns_cache_t *c = (oc_dns_cache_t *)oc_list_head(dns_cache);
-  while (c) {
-    if (strlen(domain) == oc_string_len(c->domain) &&
-        memcmp(domain, oc_string(c->domain), oc_string_len(c->domain)) == 0) {
-      return c;
+  oc_dns_cache_t *c = (oc_dns_cache_t *)oc_memb_alloc(&dns_s);
+  if (!c) {
+    return NULL;
+  }
+  dns_entries++;
+  memset(c, 0, sizeof(oc_dns_cache_t));
+  strcpy(c->domain, domain);
+  oc_list_add(dns_bucket(domain), c);
+  return c;
+}
+
+static bool
+has_address(const oc_dns_cache_t *c)
+{
+  return c->result.has_ipv6 || c->result.has_ipv4;
+}
+
+static void
+store_result(oc_dns_cache_t *c, const oc_dns_result_t *result,
+             oc_clock_time_t now)
+{
+  memcpy(&c->result, result, sizeof(oc_dns_result_t));
+  c->expires =
+    now + (oc_clock_time_t)(has_address(c) ? OC_DNS_CACHE_TTL
+                                           : OC_DNS_NEGATIVE_TTL) *
+            OC_CLOCK_SECOND;
+}
+
+static void *
+dns_resolver_thread(void *data)
+{
+  (void)data;
+  pthread_mutex_lock(&dns_mutex);
+  while (!dns_terminate) {
+    oc_dns_job_t *job = (oc_dns_job_t *)oc_list_pop(dns_jobs);
+    if (!job) {
+      pthread_cond_wait(&dns_cond, &dns_mutex);
+      continue;
     }
-    c = c->next;
+    pthread_mutex_unlock(&dns_mutex);
+
+    resolve_domain(job->entry->domain, &job->result);
+
+    pthread_mutex_lock(&dns_mutex);
+    oc_list_add(dns_completed, job);
+    oc_process_poll(&(oc_dns_events));
+    _oc_signal_event_loop();
   }
+  pthread_mutex_unlock(&dns_mutex);
   return NULL;
 }
 
-static int
-oc_dns_cache_domain(const char *domain, union dev_addr *addr)
+static void
+complete_lookups(void)
 {
-  oc_dns_cache_t *c = (oc_dns_cache_t *)oc_memb_alloc(&dns_s);
-  if (c) {
-    oc_new_string(&c->domain, domain, strlen(domain));
-    memcpy(&c->addr, addr, sizeof(union dev_addr));
-    oc_list_add(dns_cache, c);
-    return 0;
+  pthread_mutex_lock(&dns_mutex);
+  oc_dns_job_t *job = (oc_dns_job_t *)oc_list_pop(dns_completed);
+  pthread_mutex_unlock(&dns_mutex);
+  while (job != NULL) {
+    /* the waiters run without the lock, they may look the domain up */
+    oc_dns_waiter_t *fired = NULL;
+    pthread_mutex_lock(&dns_cache_mutex);
+    oc_dns_cache_t *c = job->entry;
+    c->pending = false;
+    store_result(c, &job->result, oc_clock_time_monotonic());
+    oc_memb_free(&dns_jobs_s, job);
+    oc_dns_waiter_t *w = (oc_dns_waiter_t *)oc_list_head(dns_waiters), *next;
+    for (; w != NULL; w = next) {
+      next = w->next;
+      if (w->entry == c) {
+        oc_list_remove(dns_waiters, w);
+        w->next = fired;
+        fired = w;
+      }
+    }
+    pthread_mutex_unlock(&dns_cache_mutex);
+
+    while (fired != NULL) {
+      w = fired;
+      fired = w->next;
+      w->cb(w->user_data);
+      pthread_mutex_lock(&dns_cache_mutex);
+      oc_memb_free(&dns_waiters_s, w);
+      pthread_mutex_unlock(&dns_cache_mutex);
+    }
+
+    pthread_mutex_lock(&dns_mutex);
+    job = (oc_dns_job_t *)oc_list_pop(dns_completed);
+    pthread_mutex_unlock(&dns_mutex);
   }
-  return -1;
 }
 
-void
-oc_dns_clear_cache(void)
+OC_PROCESS_THREAD(oc_dns_events, ev, data)
+{
+  (void)ev;
+  (void)data;
+  OC_PROCESS_POLLHANDLER(complete_lookups());
+  OC_PROCESS_BEGIN();
+  while (oc_process_is_running(&(oc_dns_events))) {
+    OC_PROCESS_YIELD();
+  }
+  OC_PROCESS_END();
+}
+
+/* Hand c to the helper thread, called with dns_cache_mutex held. */
+static void
+oc_dns_resolve(oc_dns_cache_t *c)
+{
+  if (!dns_running) {
+    dns_terminate = false;
+    if (pthread_create(&dns_thread, NULL, dns_resolver_thread, NULL) != 0) {
+      OC_ERR("could not start the DNS resolver thread");
+      return;
+    }
+    oc_process_start(&oc_dns_events, NULL);
+    dns_running = true;
+  }
+  oc_dns_job_t *job = (oc_dns_job_t *)oc_memb_alloc(&dns_jobs_s);
+  if (!job) {
+    return;
+  }
+  memset(job, 0, sizeof(oc_dns_job_t));
+  job->entry = c;
+  c->pending = true;
+  pthread_mutex_lock(&dns_mutex);
+  oc_list_add(dns_jobs, job);
+  pthread_cond_signal(&dns_cond);
+  pthread_mutex_unlock(&dns_mutex);
+}
+
+static int
+dns_lookup(const char *domain, union dev_addr *addr, enum transport_flags flags)
 {
-  oc_dns_cache_t *c = (oc_dns_cache_t *)oc_list_pop(dns_cache);
-  while (c) {
-    oc_free_string(&c->domain);
-    oc_memb_free(&dns_s, c);
-    c = (oc_dns_cache_t *)oc_list_pop(dns_cache);
+  oc_clock_time_t now = oc_clock_time_monotonic();
+  int ret;
+  pthread_mutex_lock(&dns_cache_mutex);
+  oc_dns_cache_t *c = oc_dns_lookup_cache(domain);
+  if (c && (c->expires > now || has_address(c))) {
+    c->used = now;
+    if (c->expires <= now && !c->pending) {
+      oc_dns_resolve(c);
+    }
+    ret = pick_address(&c->result, flags, addr);
+    pthread_mutex_unlock(&dns_cache_mutex);
+    return ret;
+  }
+  /* a miss, answered once the helper thread has cached the domain */
+  if (!c) {
+    c = oc_dns_cache_domain(domain);
   }
+  if (!c) {
+    OC_WRN("no room to cache %s", domain);
+  } else {
+    c->used = now;
+    if (!c->pending) {
+      oc_dns_resolve(c);
+    }
+  }
+  pthread_mutex_unlock(&dns_cache_mutex);
+  return -1;
 }
-#endif /* OC_DNS_CACHE */
 
 int
-oc_dns_lookup(const char *domain, oc_string_t *addr, enum transport_flags flags)
+oc_dns_lookup_async(const char *domain, oc_dns_lookup_cb_t cb, void *user_data)
 {
-  if (!domain || !addr) {
-    OC_ERR("Error of input parameters");
+  if (!domain || !cb || strlen(domain) > DNS_MAX_DOMAIN_LEN) {
     return -1;
   }
+  oc_clock_time_t now = oc_clock_time_monotonic();
   int ret = -1;
-  union dev_addr a;
-
-#ifdef OC_DNS_CACHE
+  pthread_mutex_lock(&dns_cache_mutex);
   oc_dns_cache_t *c = oc_dns_lookup_cache(domain);
-
   if (!c) {
-#endif /* OC_DNS_CACHE */
-    memset(&a, 0, sizeof(union dev_addr));
-
-    struct addrinfo hints, *result = NULL;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = (flags & IPV6) ? AF_INET6 : AF_INET;
-    hints.ai_socktype = (flags & TCP) ? SOCK_STREAM : SOCK_DGRAM;
-    ret = getaddrinfo(domain, NULL, &hints, &result);
-
-    if (ret == 0) {
-      if (flags & IPV6) {
-        struct sockaddr_in6 *r = (struct sockaddr_in6 *)result->ai_addr;
-        memcpy(a.ipv6.address, r->sin6_addr.s6_addr,
-               sizeof(r->sin6_addr.s6_addr));
-        a.ipv6.port = ntohs(r->sin6_port);
-        a.ipv6.scope = r->sin6_scope_id;
-      }
-#ifdef OC_IPV4
-      else {
-        struct sockaddr_in *r = (struct sockaddr_in *)result->ai_addr;
-        memcpy(a.ipv4.address, &r->sin_addr.s_addr, sizeof(r->sin_addr.s_addr));
-        a.ipv4.port = ntohs(r->sin_port);
-      }
-#endif /* OC_IPV4 */
-#ifdef OC_DNS_CACHE
-      oc_dns_cache_domain(domain, &a);
-#endif /* OC_DNS_CACHE */
+    c = oc_dns_cache_domain(domain);
+    if (!c) {
+      OC_WRN("no room to cache %s", domain);
+      goto done;
     }
-    freeaddrinfo(result);
-#ifdef OC_DNS_CACHE
-  } else {
+  }
+  c->used = now;
+  if (c->expires > now) {
+    ret = 0;
+    goto done;
+  }
+  if (!c->pending) {
+    oc_dns_resolve(c);
+    if (!c->pending) {
+      goto done;
+    }
+  }
+  if (has_address(c)) {
+    /* served while it is refreshed */
     ret = 0;
-    memcpy(&a, &c->addr, sizeof(union dev_addr));
+    goto done;
+  }
+  oc_dns_waiter_t *w = (oc_dns_waiter_t *)oc_list_head(dns_waiters);
+  while (w != NULL && (w->entry != c || w->cb != cb ||
+                       w->user_data != user_data)) {
+    w = w->next;
+  }
+  if (!w) {
+    w = (oc_dns_waiter_t *)oc_memb_alloc(&dns_waiters_s);
+    if (!w) {
+      goto done;
+    }
+    w->entry = c;
+    w->cb = cb;
+    w->user_data = user_data;
+    oc_list_add(dns_waiters, w);
+  }
+  ret = 1;
+done:
+  pthread_mutex_unlock(&dns_cache_mutex);
+  return ret;
+}
+
+void
+oc_dns_cancel_lookup(oc_dns_lookup_cb_t cb, void *user_data)
+{
+  pthread_mutex_lock(&dns_cache_mutex);
+  oc_dns_waiter_t *w = (oc_dns_waiter_t *)oc_list_head(dns_waiters), *next;
+  while (w != NULL) {
+    next = w->next;
+    if (w->cb == cb && w->user_data == user_data) {
+      oc_list_remove(dns_waiters, w);
+      oc_memb_free(&dns_waiters_s, w);
+    }
+    w = next;
+  }
+  pthread_mutex_unlock(&dns_cache_mutex);
+}
+
+static void
+free_dns_entries(bool pending)
+{
+  size_t i;
+  for (i = 0; i < OC_DNS_CACHE_SIZE; i++) {
+    oc_dns_cache_t *c = (oc_dns_cache_t *)dns_buckets[i], *next;
+    while (c != NULL) {
+      next = c->next;
+      if (pending || !c->pending) {
+        oc_list_remove((oc_list_t)&dns_buckets[i], c);
+        oc_memb_free(&dns_s, c);
+        dns_entries--;
+      }
+      c = next;
+    }
+  }
+}
+
+void
+oc_dns_clear_cache(void)
+{
+  /* lookups in flight complete into their entries */
+  pthread_mutex_lock(&dns_cache_mutex);
+  free_dns_entries(false);
+  pthread_mutex_unlock(&dns_cache_mutex);
+}
+
+static void
+dns_resolver_shutdown(void)
+{
+  if (dns_running) {
+    /* waits for a lookup the thread is running */
+    pthread_mutex_lock(&dns_mutex);
+    dns_terminate = true;
+    pthread_cond_signal(&dns_cond);
+    pthread_mutex_unlock(&dns_mutex);
+    pthread_join(dns_thread, NULL);
+    oc_process_exit(&oc_dns_events);
+    dns_running = false;
+  }
+  oc_dns_job_t *job = (oc_dns_job_t *)oc_list_pop(dns_jobs);
+  while (job != NULL) {
+    oc_memb_free(&dns_jobs_s, job);
+    job = (oc_dns_job_t *)oc_list_pop(dns_jobs);
+  }
+  job = (oc_dns_job_t *)oc_list_pop(dns_completed);
+  while (job != NULL) {
+    oc_memb_free(&dns_jobs_s, job);
+    job = (oc_dns_job_t *)oc_list_pop(dns_completed);
+  }
+  oc_dns_waiter_t *w = (oc_dns_waiter_t *)oc_list_pop(dns_waiters);
+  while (w != NULL) {
+    oc_memb_free(&dns_waiters_s, w);
+    w = (oc_dns_waiter_t *)oc_list_pop(dns_waiters);
+  }
+  free_dns_entries(true);
+}
+#else  /* OC_DNS_CACHE */
+static int
+dns_lookup(const char *domain, union dev_addr *addr, enum transport_flags flags)
+{
+  oc_dns_result_t result;
+  resolve_domain(domain, &result);
+  return pick_address(&result, flags, addr);
+}
+#endif /* !OC_DNS_CACHE */
+
+int
+oc_dns_lookup(const char *domain, oc_string_t *addr, enum transport_flags flags)
+{
+  if (!domain || !addr || strlen(domain) > DNS_MAX_DOMAIN_LEN) {
+    OC_ERR("Error of input parameters");
+    return -1;
   }
-#endif /* OC_DNS_CACHE */
+  union dev_addr a;
+  memset(&a, 0, sizeof(union dev_addr));
+  int ret = dns_lookup(domain, &a, flags);
 
   if (ret == 0) {
     char address[INET6_ADDRSTRLEN + 2] = { 0 };
@@ -19,6 +19,7 @@
 #ifndef IPCONTEXT_H
 #define IPCONTEXT_H
 
+#include "oc_config.h"
 #include "oc_endpoint.h"
 #include <pthread.h>
 #include <stdint.h>
@@ -30,6 +31,17 @@ extern "C"
 {
 #endif
 
+#ifdef OC_IO_URING
+/* interest changes of a network thread recorded between two of its updates of
+ * epoll */
+#define OC_IORING_MAX_DIRTY_FDS (16)
+#endif /* OC_IO_URING */
+
+/* Threads reading the endpoint lists, see oc_connectivity_get_endpoints() */
+#ifndef OC_MAX_ENDPOINTS_READERS
+#define OC_MAX_ENDPOINTS_READERS (8)
+#endif /* !OC_MAX_ENDPOINTS_READERS */
+
 typedef enum {
   ADAPTER_STATUS_NONE = 0, /* Nothing happens */
   ADAPTER_STATUS_ACCEPT,   /* Receiving no meaningful data */
@@ -59,13 +71,18 @@ typedef struct tcp_context_t
 #endif /* OC_SECURITY */
 #endif /* OC_IPV4 */
   int connect_pipe[2];
+  fd_set wfds; /* sessions connecting or with queued output */
   pthread_mutex_t mutex;
 } tcp_context_t;
 #endif
 
+struct ip_endpoints_t;
+
 typedef struct ip_context_t {
   struct ip_context_t *next;
-  OC_LIST_STRUCT(eps);
+  struct ip_endpoints_t *endpoints; /* published endpoint list */
+  /* list last handed to the thread in each reader slot */
+  struct ip_endpoints_t *readers[OC_MAX_ENDPOINTS_READERS];
   struct sockaddr_storage mcast;
   struct sockaddr_storage server;
   int mcast_sock;
@@ -96,8 +113,46 @@ typedef struct ip_context_t {
   size_t device;
   fd_set rfds;
   int shutdown_pipe[2];
+#ifdef OC_IO_URING
+  /* polled through the ring for everything but the UDP sockets, and the
+   * descriptors registered with it */
+  int epoll_fd;
+  fd_set epoll_rfds, epoll_wfds;
+  /* descriptors whose interest changed since epoll was last updated, guarded
+   * by the TCP mutex; more than OC_IORING_MAX_DIRTY_FDS changes update every
+   * descriptor */
+  int epoll_dirty[OC_IORING_MAX_DIRTY_FDS];
+  int num_epoll_dirty;
+#endif /* OC_IO_URING */
+#ifdef OC_SHARED_TRANSPORT
+  /* context owning the sockets and network thread this device shares, NULL
+   * for the context that owns them */
+  struct ip_context_t *transport;
+#endif /* OC_SHARED_TRANSPORT */
 } ip_context_t;
 
+#ifdef OC_IO_URING
+/* Note that the read or write interest of fd changed in the rfds of dev or the
+ * wfds of its TCP context. Called with the TCP mutex held.
+ */
+void oc_ip_fd_changed(ip_context_t *dev, int fd);
+#endif /* OC_IO_URING */
+
+/* Add fd to set. An fd_set only holds descriptors below FD_SETSIZE, others
+ * cannot be watched and are refused. Returns false if fd was refused.
+ */
+bool oc_ip_fd_set(int fd, fd_set *set);
+
+/* Rebuild and publish the endpoint lists of all devices from the address
+ * cache, as after an address change.
+ */
+void oc_ip_refresh_endpoints(void);
+
+#if defined(OC_EXTERNAL_EVENT_LOOP) || defined(OC_IO_URING)
+/* Stop watching a descriptor of dev about to be closed. */
+void oc_ip_unwatch_fd(ip_context_t *dev, int fd);
+#endif /* OC_EXTERNAL_EVENT_LOOP || OC_IO_URING */
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,11 +19,76 @@ typedef uint64_t oc_clock_time_t;
 /* Maximum wait time for select function */
 #define SELECT_TIMEOUT_SEC (1)
 
+/* Maximum number of outbound messages queued per TCP session */
+//#define OC_TCP_MAX_QUEUED_MESSAGES (8)
+
 /* Add support for passing network up/down events to the app */
 #define OC_NETWORK_MONITOR
 /* Add support for passing TCP/TLS/DTLS session connection events to the app */
 #define OC_SESSION_EVENTS
 
+/* Share one socket set and network thread among all logical devices */
+//#define OC_SHARED_TRANSPORT
+
+/* Start no network threads and let a host event loop watch the sockets, see
+ * oc_main_on_readable(), or run "make" with EXTERNAL_LOOP=1
+ */
+//#define OC_EXTERNAL_EVENT_LOOP
+
+/* Receive on the network threads through io_uring rather than select(), or
+ * run "make" with IO_URING=1. Only UDP is received through the ring; the TCP
+ * sockets are still polled through epoll. Off by default; "make
+ * bench-io-uring" compares the throughput of both builds.
+ */
+//#define OC_IO_URING
+/* Receives kept in flight on each UDP socket with OC_IO_URING, each straight
+ * into an incoming message it holds while it waits (1 to 16)
+ */
+//#define OC_IORING_RECV_DEPTH (4)
+
+/* Number of threads running request handlers of concurrent resources, or run
+ * "make" with WORKERS=<n>
+ */
+//#define OC_WORKER_THREADS (4)
+/* Maximum number of requests waiting for each worker thread */
+//#define OC_WORKER_QUEUE_DEPTH (16)
+
+/* Number of threads running (D)TLS handshakes off the event loop, or run
+ * "make" with TLS_WORKERS=<n>
+ */
+//#define OC_TLS_HANDSHAKE_THREADS (2)
+/* Maximum number of handshakes waiting or running on those threads; further
+ * handshakes run on the event loop */
+//#define OC_TLS_HANDSHAKE_QUEUE_DEPTH (16)
+/* Number of certificate validation results kept, keyed by certificate hash */
+//#define OC_CERTS_VALIDATION_CACHE_SIZE (16)
+
+/* Maximum number of queued inbound handshake, unicast and multicast events;
+ * once a class is full its oldest (multicast) or newest (others) event is
+ * shed, see oc_process_set_queue_limit()
+ */
+//#define OC_PROCESS_MAX_SECURITY_EVENTS (16)
+//#define OC_PROCESS_MAX_UNICAST_EVENTS (64)
+//#define OC_PROCESS_MAX_MULTICAST_EVENTS (16)
+
+/* Counters, gauges and histograms of the stack internals, see oc_metrics.h
+ * and oc/metrics, or run "make" with METRICS=1
+ */
+//#define OC_METRICS
+/* Number of threads whose metrics are kept apart before they share */
+//#define OC_METRICS_SHARDS (8)
+/* Per stage timestamps of inbound requests, needs OC_METRICS; or run "make"
+ * with REQUEST_TRACE=1 */
+//#define OC_REQUEST_TRACE
+
+/* Memory profiler, run "make" with MEMTRACE=1; exposes oc/memtrace */
+/* Number of call sites, pools and live allocations tracked */
+//#define OC_MEM_TRACE_SITES (128)
+//#define OC_MEM_TRACE_POOLS (64)
+//#define OC_MEM_TRACE_LIVE (1024)
+/* Record one in this many allocations and frees for oc/memtrace */
+//#define OC_MEM_TRACE_SAMPLE_RATE (0)
+
 /* Add support for software update */
 //#define OC_SOFTWARE_UPDATE or run "make" with SWUPDATE=1
 /* Add support for the oic.if.create interface in Collections */
@@ -34,6 +99,9 @@ typedef uint64_t oc_clock_time_t;
 #define OC_RES_BATCH_SUPPORT
 /* Add support for dns lookup to the endpoint */
 #define OC_DNS_LOOKUP
+/* Cache lookups and resolve misses on a helper thread, so that a lookup
+ * never blocks. See ipadapter.c for OC_DNS_CACHE_SIZE, OC_DNS_CACHE_TTL and
+ * OC_DNS_NEGATIVE_TTL */
 #define OC_DNS_CACHE
 //#define OC_DNS_LOOKUP_IPV6
 
@@ -41,6 +109,13 @@ typedef uint64_t oc_clock_time_t;
 #ifdef OC_DYNAMIC_ALLOCATION
 #define OC_COLLECTIONS
 #define OC_BLOCK_WISE
+/* Number of Block2 requests a client keeps in flight, from 1 (the default)
+ * to 32. Blocks may then arrive out of order, see oc_blockwise.h */
+//#define OC_BLOCK_WISE_WINDOW (4)
+/* Number of Block1 blocks a client sends ahead of the last acknowledged one,
+ * from 1 (the default) to 32. Only for servers that accept out-of-order
+ * Block1 transfers */
+//#define OC_BLOCK_WISE_BLOCK1_WINDOW (4)
 
 #else /* OC_DYNAMIC_ALLOCATION */
 /* List of constraints below for a build that does not employ dynamic
@@ -89,6 +164,12 @@ typedef uint64_t oc_clock_time_t;
 /* Maximum number of interfaces for IP adapter */
 #define OC_MAX_IP_INTERFACES (2)
 
+/* Maximum number of cached addresses of the IP interfaces */
+#define OC_MAX_IP_ADDRESSES (8)
+
+/* Maximum number of threads reading the endpoint lists */
+#define OC_MAX_ENDPOINTS_READERS (2)
+
 /* Maximum number of callbacks for Network interface event monitoring */
 #define OC_MAX_NETWORK_INTERFACE_CBS (2)
 
@@ -18,15 +18,71 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-static int urandom_fd;
+/* Values are handed out of a pool filled from the kernel's CSPRNG, so that
+ * tokens, message IDs and ETags do not cost a system call each. Every refill
+ * draws fresh output from the kernel, which reseeds itself, and handed out
+ * bytes are wiped from the pool. A forked child discards the pool so it does
+ * not repeat its parent's values.
+ */
+#define RANDOM_POOL_SIZE (256)
+
+static unsigned char pool[RANDOM_POOL_SIZE];
+static size_t pool_pos = RANDOM_POOL_SIZE;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int urandom_fd = -1;
+
+static void
+discard_pool(void)
+{
+  memset(pool, 0, sizeof(pool));
+  pool_pos = sizeof(pool);
+}
+
+static ssize_t
+read_entropy(unsigned char *buf, size_t len)
+{
+#ifdef SYS_getrandom
+  ssize_t ret = syscall(SYS_getrandom, buf, len, 0);
+  if (ret >= 0 || errno != ENOSYS) {
+    return ret;
+  }
+#endif /* SYS_getrandom */
+  return read(urandom_fd, buf, len);
+}
+
+static bool
+fill_pool(void)
+{
+  size_t filled = 0;
+  while (filled < sizeof(pool)) {
+    ssize_t ret = read_entropy(pool + filled, sizeof(pool) - filled);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    filled += (size_t)ret;
+  }
+  pool_pos = 0;
+  return true;
+}
 
 void
 oc_random_init(void)
 {
+  static bool atfork_registered;
+  if (!atfork_registered) {
+    atfork_registered = pthread_atfork(NULL, NULL, discard_pool) == 0;
+  }
   urandom_fd = open("/dev/urandom", O_RDONLY);
 }
 
@@ -34,16 +90,24 @@ unsigned int
 oc_random_value(void)
 {
   unsigned int rand = 0;
-  int ret = read(urandom_fd, &rand, sizeof(rand));
-  assert(ret != -1);
-#ifndef DEBUG
-  (void)ret;
-#endif
+  pthread_mutex_lock(&pool_mutex);
+  bool available = pool_pos + sizeof(rand) <= sizeof(pool) || fill_pool();
+  assert(available);
+  if (available) {
+    memcpy(&rand, pool + pool_pos, sizeof(rand));
+    memset(pool + pool_pos, 0, sizeof(rand));
+    pool_pos += sizeof(rand);
+  }
+  pthread_mutex_unlock(&pool_mutex);
   return rand;
 }
 
 void
 oc_random_destroy(void)
 {
+  pthread_mutex_lock(&pool_mutex);
+  discard_pool();
+  pthread_mutex_unlock(&pool_mutex);
   close(urandom_fd);
+  urandom_fd = -1;
 }
@@ -22,7 +22,9 @@
 #include "api/oc_session_events_internal.h"
 #include "ipcontext.h"
 #include "messaging/coap/coap.h"
+#include "oc_buffer.h"
 #include "oc_endpoint.h"
+#include "oc_network_events.h"
 #include "oc_session_events.h"
 #include "port/oc_assert.h"
 #include "util/oc_memb.h"
@@ -33,6 +35,7 @@
 #include <ifaddrs.h>
 #include <net/if.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #ifdef OC_TCP
@@ -41,13 +44,33 @@
 
 #define TLS_HEADER_SIZE 5
 
-#define DEFAULT_RECEIVE_SIZE                                                   \
-  (COAP_TCP_DEFAULT_HEADER_LEN + COAP_TCP_MAX_EXTENDED_LENGTH_LEN)
-
-#define LIMIT_RETRY_CONNECT 5
+/* Upper bound on messages framed from one session per readiness event, so a
+ * peer that keeps its socket saturated cannot starve the other sockets.
+ */
+#define TCP_MAX_MESSAGES_PER_EVENT 8
 
 #define TCP_CONNECT_TIMEOUT 5
 
+/* Seconds a session may sit on a partially received message without any
+ * further data before it is closed */
+#ifndef OC_TCP_RECEIVE_TIMEOUT
+#define OC_TCP_RECEIVE_TIMEOUT (5)
+#endif /* !OC_TCP_RECEIVE_TIMEOUT */
+
+/* Longest length header: the TLS record header, or the first byte and up to
+ * 4 extended length bytes of CoAP over TCP */
+#define TCP_MAX_HEADER_SIZE TLS_HEADER_SIZE
+
+/* Maximum number of outbound messages waiting on a single session */
+#ifndef OC_TCP_MAX_QUEUED_MESSAGES
+#define OC_TCP_MAX_QUEUED_MESSAGES (8)
+#endif /* !OC_TCP_MAX_QUEUED_MESSAGES */
+
+/* Maximum number of queued messages written by one sendmsg() call */
+#define TCP_MAX_IOVEC 8
+
+typedef enum { TCP_STATE_CONNECTING, TCP_STATE_CONNECTED } tcp_session_state_t;
+
 typedef struct tcp_session
 {
   struct tcp_session *next;
@@ -55,11 +78,53 @@ typedef struct tcp_session
   oc_endpoint_t endpoint;
   int sock;
   tcp_csm_state_t csm_state;
+  tcp_session_state_t state;
+  oc_clock_time_t connect_deadline;
+  OC_LIST_STRUCT(send_q); /* copies of messages not yet fully written */
+  size_t send_offset;     /* bytes of the head of send_q already written */
+  bool congested;
+  uint8_t rx_header[TCP_MAX_HEADER_SIZE]; /* length header being read */
+  size_t rx_header_length;
+  oc_message_t *rx_message; /* allocated once the length header is complete */
+  size_t rx_total_length;
+  oc_clock_time_t rx_deadline; /* idle limit of a partially received message */
 } tcp_session_t;
 
 OC_LIST(session_list);
 OC_MEMB(tcp_session_s, tcp_session_t, OC_MAX_TCP_PEERS);
 
+static oc_tcp_backpressure_cb_t backpressure_cb;
+
+static void
+signal_network_thread(ip_context_t *dev)
+{
+#ifdef OC_EXTERNAL_EVENT_LOOP
+  /* the host loop learns about new descriptors once the current entry point
+   * returns, see oc_connectivity_update_fd_watches() */
+  (void)dev;
+#else  /* OC_EXTERNAL_EVENT_LOOP */
+  ssize_t len = 0;
+  do {
+    uint8_t dummy_value = 0xef;
+    len = write(dev->tcp.connect_pipe[1], &dummy_value, 1);
+  } while (len == -1 && errno == EINTR);
+#endif /* !OC_EXTERNAL_EVENT_LOOP */
+}
+
+/* Called with the mutex held after sock was added to or removed from the rfds
+ * or wfds of dev.
+ */
+static void
+fd_interest_changed(ip_context_t *dev, int sock)
+{
+#ifdef OC_IO_URING
+  oc_ip_fd_changed(dev, sock);
+#else  /* OC_IO_URING */
+  (void)dev;
+  (void)sock;
+#endif /* !OC_IO_URING */
+}
+
 static int
 configure_tcp_socket(int sock, struct sockaddr_storage *sock_info)
 {
@@ -140,21 +205,21 @@ get_interface_index(int sock)
   return interface_index;
 }
 
-void
+bool
 oc_tcp_add_socks_to_fd_set(ip_context_t *dev)
 {
-  FD_SET(dev->tcp.server_sock, &dev->rfds);
+  bool added = oc_ip_fd_set(dev->tcp.server_sock, &dev->rfds);
 #ifdef OC_SECURITY
-  FD_SET(dev->tcp.secure_sock, &dev->rfds);
+  added = oc_ip_fd_set(dev->tcp.secure_sock, &dev->rfds) && added;
 #endif /* OC_SECURITY */
 
 #ifdef OC_IPV4
-  FD_SET(dev->tcp.server4_sock, &dev->rfds);
+  added = oc_ip_fd_set(dev->tcp.server4_sock, &dev->rfds) && added;
 #ifdef OC_SECURITY
-  FD_SET(dev->tcp.secure4_sock, &dev->rfds);
+  added = oc_ip_fd_set(dev->tcp.secure4_sock, &dev->rfds) && added;
 #endif /* OC_SECURITY */
 #endif /* OC_IPV4 */
-  FD_SET(dev->tcp.connect_pipe[0], &dev->rfds);
+  return oc_ip_fd_set(dev->tcp.connect_pipe[0], &dev->rfds) && added;
 }
 
 static void
@@ -162,33 +227,49 @@ free_tcp_session(tcp_session_t *session)
 {
   oc_list_remove(session_list, session);
 
-  if (!oc_session_events_is_ongoing()) {
+  /* a session that never finished connecting was never announced */
+  if (session->state == TCP_STATE_CONNECTED &&
+      !oc_session_events_is_ongoing()) {
     oc_session_end_event(&session->endpoint);
   }
 
   FD_CLR(session->sock, &session->dev->rfds);
+  FD_CLR(session->sock, &session->dev->tcp.wfds);
 
-  ssize_t len = 0;
-  do {
-    uint8_t dummy_value = 0xef;
-    len = write(session->dev->tcp.connect_pipe[1], &dummy_value, 1);
-  } while (len == -1 && errno == EINTR);
+  signal_network_thread(session->dev);
 
+#if defined(OC_EXTERNAL_EVENT_LOOP) || defined(OC_IO_URING)
+  /* the descriptor number may be reused before the next update */
+  oc_ip_unwatch_fd(session->dev, session->sock);
+#endif /* OC_EXTERNAL_EVENT_LOOP || OC_IO_URING */
   close(session->sock);
 
+  if (session->rx_message) {
+    oc_message_unref(session->rx_message);
+  }
+
+  oc_message_t *message = (oc_message_t *)oc_list_pop(session->send_q);
+  if (message) {
+    OC_WRN("dropping queued messages of closed TCP session");
+  }
+  while (message) {
+    oc_message_unref(message);
+    message = (oc_message_t *)oc_list_pop(session->send_q);
+  }
+
   oc_memb_free(&tcp_session_s, session);
 
   OC_DBG("freed TCP session");
 }
 
-static int
+static tcp_session_t *
 add_new_session(int sock, ip_context_t *dev, oc_endpoint_t *endpoint,
-                tcp_csm_state_t state)
+                tcp_csm_state_t csm_state, tcp_session_state_t state)
 {
   tcp_session_t *session = oc_memb_alloc(&tcp_session_s);
   if (!session) {
     OC_ERR("could not allocate new TCP session object");
-    return -1;
+    return NULL;
   }
 
   endpoint->interface_index = get_interface_index(sock);
@@ -197,17 +278,24 @@ add_new_session(int sock, ip_context_t *dev, oc_endpoint_t *endpoint,
   memcpy(&session->endpoint, endpoint, sizeof(oc_endpoint_t));
   session->endpoint.next = NULL;
   session->sock = sock;
-  session->csm_state = state;
+  session->csm_state = csm_state;
+  session->state = state;
+  session->rx_header_length = 0;
+  session->rx_message = NULL;
+  session->rx_total_length = 0;
+  OC_LIST_STRUCT_INIT(session, send_q);
+  session->send_offset = 0;
+  session->congested = false;
 
   oc_list_add(session_list, session);
 
-  if (!(endpoint->flags & SECURED)) {
+  if (state == TCP_STATE_CONNECTED && !(endpoint->flags & SECURED)) {
     oc_session_start_event((oc_endpoint_t *)endpoint);
   }
 
   OC_DBG("recorded new TCP session");
 
-  return 0;
+  return session;
 }
 
 static int
@@ -222,6 +310,12 @@ accept_new_session(ip_context_t *dev, int fd, fd_set *setfds,
     OC_ERR("failed to accept incoming TCP connection");
     return -1;
   }
+  if (new_socket >= FD_SETSIZE) {
+    OC_ERR("refused TCP connection, descriptor %d cannot be watched",
+           new_socket);
+    close(new_socket);
+    return -1;
+  }
   OC_DBG("accepted incomming TCP connection");
 
   if (endpoint->flags & IPV6) {
@@ -241,23 +335,40 @@ accept_new_session(ip_context_t *dev, int fd, fd_set *setfds,
 
   FD_CLR(fd, setfds);
 
-  if (add_new_session(new_socket, dev, endpoint, CSM_NONE) < 0) {
+  if (!add_new_session(new_socket, dev, endpoint, CSM_NONE,
+                       TCP_STATE_CONNECTED)) {
     OC_ERR("could not record new TCP session");
     close(new_socket);
     return -1;
   }
 
   FD_SET(new_socket, &dev->rfds);
+  fd_interest_changed(dev, new_socket);
 
   return 0;
 }
 
+static int
+compare_session_endpoint(const oc_endpoint_t *session_endpoint,
+                         const oc_endpoint_t *endpoint)
+{
+#ifdef OC_SHARED_TRANSPORT
+  /* a session carries the traffic of every device sharing the transport */
+  oc_endpoint_t ep;
+  memcpy(&ep, endpoint, sizeof(oc_endpoint_t));
+  ep.device = session_endpoint->device;
+  return oc_endpoint_compare(session_endpoint, &ep);
+#else  /* OC_SHARED_TRANSPORT */
+  return oc_endpoint_compare(session_endpoint, endpoint);
+#endif /* !OC_SHARED_TRANSPORT */
+}
+
 static tcp_session_t *
 find_session_by_endpoint(oc_endpoint_t *endpoint)
 {
   tcp_session_t *session = oc_list_head(session_list);
   while (session != NULL &&
-         oc_endpoint_compare(&session->endpoint, endpoint) != 0) {
+         compare_session_endpoint(&session->endpoint, endpoint) != 0) {
     session = session->next;
   }
 
@@ -293,20 +404,160 @@ get_ready_to_read_session(fd_set *setfds)
 }
 
 static size_t
-get_total_length_from_header(oc_message_t *message, oc_endpoint_t *endpoint)
+get_total_length_from_header(const uint8_t *header, oc_endpoint_t *endpoint)
 {
   size_t total_length = 0;
   if (endpoint->flags & SECURED) {
     //[3][4] bytes in tls header are tls payload length
-    total_length =
-      TLS_HEADER_SIZE + (size_t)((message->data[3] << 8) | message->data[4]);
+    total_length = TLS_HEADER_SIZE + (size_t)((header[3] << 8) | header[4]);
   } else {
-    total_length = coap_tcp_get_packet_size(message->data);
+    total_length = coap_tcp_get_packet_size(header);
   }
 
   return total_length;
 }
 
+static size_t
+get_header_length(const uint8_t *header, size_t length,
+                  oc_endpoint_t *endpoint)
+{
+  if (endpoint->flags & SECURED) {
+    return TLS_HEADER_SIZE;
+  }
+  if (length < COAP_TCP_DEFAULT_HEADER_LEN) {
+    return COAP_TCP_DEFAULT_HEADER_LEN;
+  }
+  uint8_t tcp_len =
+    (COAP_TCP_HEADER_LEN_MASK & header[0]) >> COAP_TCP_HEADER_LEN_POSITION;
+  if (tcp_len < COAP_TCP_EXTENDED_LENGTH_1) {
+    return COAP_TCP_DEFAULT_HEADER_LEN;
+  }
+  /* first byte followed by 1, 2 or 4 extended length bytes */
+  return 1 + ((size_t)1 << (tcp_len - COAP_TCP_EXTENDED_LENGTH_1));
+}
+
+static bool
+receive_pending(tcp_session_t *session)
+{
+  return session->rx_header_length > 0 || session->rx_message != NULL;
+}
+
+/* Reads what the socket has of the length header of the next message into
+ * the session. Returns the result of recv().
+ */
+static ssize_t
+receive_session_header(tcp_session_t *session)
+{
+  size_t header_length = get_header_length(
+    session->rx_header, session->rx_header_length, &session->endpoint);
+  ssize_t count =
+    recv(session->sock, session->rx_header + session->rx_header_length,
+         header_length - session->rx_header_length, MSG_DONTWAIT);
+  if (count > 0) {
+    session->rx_header_length += (size_t)count;
+  }
+  return count;
+}
+
+/* Reads whatever is available on the session socket without blocking and
+ * feeds it through the framing state machine. Every message completed along
+ * the way is handed to the network event queue. Between messages the session
+ * holds no buffer; one is allocated only when a length header is complete.
+ */
+static adapter_receive_state_t
+receive_session_messages(tcp_session_t *session)
+{
+  int num_messages = 0;
+
+  while (num_messages < TCP_MAX_MESSAGES_PER_EVENT) {
+    oc_message_t *rx = session->rx_message;
+    if (!rx && session->rx_header_length > 0 &&
+        session->rx_header_length ==
+          get_header_length(session->rx_header, session->rx_header_length,
+                            &session->endpoint)) {
+      session->rx_total_length =
+        get_total_length_from_header(session->rx_header, &session->endpoint);
+      if (session->rx_total_length >
+          (unsigned)(OC_MAX_APP_DATA_SIZE + COAP_MAX_HEADER_SIZE)) {
+        OC_ERR("total receive length(%zd) is bigger than max pdu size(%ld)",
+               session->rx_total_length,
+               (long)(OC_MAX_APP_DATA_SIZE + COAP_MAX_HEADER_SIZE));
+        free_tcp_session(session);
+        return ADAPTER_STATUS_ERROR;
+      }
+      OC_DBG("tcp packet total length : %zd bytes.", session->rx_total_length);
+      rx = oc_allocate_message_sized(session->rx_total_length);
+      if (!rx) {
+        OC_WRN("no buffer to receive TCP message; retrying on next event");
+        break;
+      }
+      memcpy(rx->data, session->rx_header, session->rx_header_length);
+      rx->length = session->rx_header_length;
+      session->rx_message = rx;
+    }
+
+    if (!rx || rx->length < session->rx_total_length) {
+      ssize_t count;
+      if (rx) {
+        count = recv(session->sock, rx->data + rx->length,
+                     session->rx_total_length - rx->length, MSG_DONTWAIT);
+      } else {
+        count = receive_session_header(session);
+      }
+      if (count < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        }
+        OC_ERR("recv error! %d", errno);
+        free_tcp_session(session);
+        return ADAPTER_STATUS_ERROR;
+      } else if (count == 0) {
+        OC_DBG("peer closed TCP session\n");
+        free_tcp_session(session);
+        return ADAPTER_STATUS_NONE;
+      }
+
+      OC_DBG("recv(): %zd bytes.", count);
+      session->rx_deadline =
+        oc_clock_time() + OC_TCP_RECEIVE_TIMEOUT * OC_CLOCK_SECOND;
+      if (!rx) {
+        continue;
+      }
+      rx->length += (size_t)count;
+      if (rx->length < session->rx_total_length) {
+        continue;
+      }
+    }
+
+    memcpy(&rx->endpoint, &session->endpoint, sizeof(oc_endpoint_t));
+#ifdef OC_SECURITY
+    if (rx->endpoint.flags & SECURED) {
+      rx->encrypted = 1;
+    }
+#endif /* OC_SECURITY */
+    session->rx_header_length = 0;
+    session->rx_message = NULL;
+    session->rx_total_length = 0;
+    num_messages++;
+
+#ifdef OC_DEBUG
+    PRINT("Incoming message of size %zd bytes from ", rx->length);
+    PRINTipaddr(rx->endpoint);
+    PRINT("\n\n");
+#endif /* OC_DEBUG */
+#ifdef OC_EXTERNAL_EVENT_LOOP
+    oc_network_event_in_loop(rx);
+#else  /* OC_EXTERNAL_EVENT_LOOP */
+    oc_network_event(rx);
+#endif /* !OC_EXTERNAL_EVENT_LOOP */
+  }
+
+  return ADAPTER_STATUS_NONE;
+}
+
 adapter_receive_state_t
 oc_tcp_receive_message(ip_context_t *dev, fd_set *fds, oc_message_t *message)
 {
@@ -374,55 +625,8 @@ oc_tcp_receive_message(ip_context_t *dev, fd_set *fds, oc_message_t *message)
     ret_with_code(ADAPTER_STATUS_NONE);
   }
 
-  // receive message.
-  size_t total_length = 0;
-  size_t want_read = DEFAULT_RECEIVE_SIZE;
-  message->length = 0;
-  do {
-    int count =
-      recv(session->sock, message->data + message->length, want_read, 0);
-    if (count < 0) {
-      OC_ERR("recv error! %d", errno);
-
-      free_tcp_session(session);
-
-      ret_with_code(ADAPTER_STATUS_ERROR);
-    } else if (count == 0) {
-      OC_DBG("peer closed TCP session\n");
-
-      free_tcp_session(session);
-
-      ret_with_code(ADAPTER_STATUS_NONE);
-    }
-
-    OC_DBG("recv(): %d bytes.", count);
-    message->length += (size_t)count;
-    want_read -= (size_t)count;
-
-    if (total_length == 0) {
-      total_length = get_total_length_from_header(message, &session->endpoint);
-      if (total_length >
-          (unsigned)(OC_MAX_APP_DATA_SIZE + COAP_MAX_HEADER_SIZE)) {
-        OC_ERR("total receive length(%ld) is bigger than max pdu size(%ld)",
-               total_length, (OC_MAX_APP_DATA_SIZE + COAP_MAX_HEADER_SIZE));
-        OC_ERR("It may occur buffer overflow.");
-        ret_with_code(ADAPTER_STATUS_ERROR);
-      }
-      OC_DBG("tcp packet total length : %ld bytes.", total_length);
-
-      want_read = total_length - (size_t)count;
-    }
-  } while (total_length > message->length);
-
-  memcpy(&message->endpoint, &session->endpoint, sizeof(oc_endpoint_t));
-#ifdef OC_SECURITY
-  if (message->endpoint.flags & SECURED) {
-    message->encrypted = 1;
-  }
-#endif /* OC_SECURITY */
-
   FD_CLR(session->sock, fds);
-  ret = ADAPTER_STATUS_RECEIVE;
+  ret = receive_session_messages(session);
 
 oc_tcp_receive_message_done:
   pthread_mutex_unlock(&dev->tcp.mutex);
@@ -441,182 +645,307 @@ oc_tcp_end_session(ip_context_t *dev, oc_endpoint_t *endpoint)
   pthread_mutex_unlock(&dev->tcp.mutex);
 }
 
-static int
-get_session_socket(oc_endpoint_t *endpoint)
+static tcp_session_t *
+initiate_new_session(ip_context_t *dev, oc_endpoint_t *endpoint,
+                     const struct sockaddr_storage *receiver)
 {
   int sock = -1;
-  tcp_session_t *session = find_session_by_endpoint(endpoint);
-  if (!session) {
-    return -1;
+  if (endpoint->flags & IPV6) {
+    sock = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+#ifdef OC_IPV4
+  } else if (endpoint->flags & IPV4) {
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+#endif
   }
 
-  sock = session->sock;
-  return sock;
-}
-
-static int
-connect_nonb(int sockfd, const struct sockaddr *r, int r_len, int nsec)
-{
-  int flags, n, error;
-  socklen_t len;
-  fd_set rset, wset;
-  struct timeval tval;
+  if (sock < 0) {
+    OC_ERR("could not create socket for new TCP session");
+    return NULL;
+  }
+  if (sock >= FD_SETSIZE) {
+    OC_ERR("too many descriptors open for a new TCP session");
+    close(sock);
+    return NULL;
+  }
 
-  flags = fcntl(sockfd, F_GETFL, 0);
-  if (flags < 0) {
-    return -1;
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+    OC_ERR("could not set TCP socket non-blocking %d", errno);
+    close(sock);
+    return NULL;
   }
 
-  error = fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
-  if (error < 0) {
-    return -1;
+  tcp_session_state_t state = TCP_STATE_CONNECTED;
+  if (connect(sock, (const struct sockaddr *)receiver, sizeof(*receiver)) <
+      0) {
+    if (errno != EINPROGRESS) {
+      OC_ERR("could not initiate TCP connection %d", errno);
+      close(sock);
+      return NULL;
+    }
+    state = TCP_STATE_CONNECTING;
   }
 
-  error = 0;
-  if ((n = connect(sockfd, (struct sockaddr *)r, r_len)) < 0) {
-    if (errno != EINPROGRESS)
-      return -1;
+  tcp_session_t *session =
+    add_new_session(sock, dev, endpoint, CSM_SENT, state);
+  if (!session) {
+    OC_ERR("could not record new TCP session");
+    close(sock);
+    return NULL;
   }
 
-  /* Do whatever we want while the connect is taking place. */
-  if (n == 0) {
-    goto done; /* connect completed immediately */
+  FD_SET(sock, &dev->rfds);
+  if (state == TCP_STATE_CONNECTING) {
+    session->connect_deadline =
+      oc_clock_time() + TCP_CONNECT_TIMEOUT * OC_CLOCK_SECOND;
+    FD_SET(sock, &dev->tcp.wfds);
+    OC_DBG("TCP connection in progress");
+  } else {
+    OC_DBG("successfully initiated TCP connection");
   }
+  fd_interest_changed(dev, sock);
 
-  FD_ZERO(&rset);
-  FD_SET(sockfd, &rset);
-  wset = rset;
-  tval.tv_sec = nsec;
-  tval.tv_usec = 0;
+  signal_network_thread(dev);
 
-  if ((n = select(sockfd + 1, &rset, &wset, NULL, nsec ? &tval : NULL)) == 0) {
-    /* timeout */
-    errno = ETIMEDOUT;
-    return -1;
-  }
+  OC_DBG("signaled network event thread to monitor the newly added session\n");
 
-  if (FD_ISSET(sockfd, &rset) || FD_ISSET(sockfd, &wset)) {
-    len = sizeof(error);
-    if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
-      return -1; /* Solaris pending error */
-  } else {
-    OC_DBG("select error: sockfd not set");
-    return -1;
+  return session;
+}
+
+static void
+set_congested(tcp_session_t *session, bool congested)
+{
+  if (session->congested == congested) {
+    return;
+  }
+  session->congested = congested;
+  OC_DBG("TCP session %s", congested ? "congested" : "drained");
+  if (backpressure_cb) {
+    backpressure_cb(&session->endpoint, congested);
   }
+}
 
-done:
-  if (error < 0) {
-    close(sockfd); /* just in case */
-    errno = error;
+static int
+enqueue_message(tcp_session_t *session, oc_message_t *message, size_t offset)
+{
+  if (oc_list_length(session->send_q) >= OC_TCP_MAX_QUEUED_MESSAGES) {
+    OC_WRN("TCP session send queue full; dropping message");
+    set_congested(session, true);
     return -1;
-  } else {
-    error = fcntl(sockfd, F_SETFL, flags); /* restore file status flags */
-    if (error < 0) {
-      return -1;
+  }
+  /* the caller may own message on its stack, so the unsent part is copied */
+  oc_message_t *copy =
+    oc_internal_allocate_outgoing_message_sized(message->length - offset);
+  if (!copy) {
+    OC_WRN("no buffer to queue TCP message");
+    /* only a queue that drains can clear the congestion again */
+    if (oc_list_length(session->send_q) > 0) {
+      set_congested(session, true);
     }
+    return -1;
+  }
+  memcpy(&copy->endpoint, &message->endpoint, sizeof(oc_endpoint_t));
+  memcpy(copy->data, message->data + offset, message->length - offset);
+  oc_message_count_copy(copy, message->length - offset);
+  copy->length = message->length - offset;
+  oc_list_add(session->send_q, copy);
+  if (oc_list_length(session->send_q) >= OC_TCP_MAX_QUEUED_MESSAGES) {
+    set_congested(session, true);
   }
   return 0;
 }
 
+/* Writes as much of the send queue as the socket accepts, gathering several
+ * queued messages into a single sendmsg() call.
+ */
 static int
-initiate_new_session(ip_context_t *dev, oc_endpoint_t *endpoint,
-                     const struct sockaddr_storage *receiver)
+flush_send_queue(tcp_session_t *session)
 {
-  int sock = -1;
-  uint8_t retry_cnt = 0;
-
-  while (retry_cnt < LIMIT_RETRY_CONNECT) {
-    if (endpoint->flags & IPV6) {
-      sock = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
-#ifdef OC_IPV4
-    } else if (endpoint->flags & IPV4) {
-      sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-#endif
+  while (oc_list_length(session->send_q) > 0) {
+    struct iovec iov[TCP_MAX_IOVEC];
+    int iovcnt = 0;
+    size_t offset = session->send_offset;
+    oc_message_t *message = (oc_message_t *)oc_list_head(session->send_q);
+    while (message && iovcnt < TCP_MAX_IOVEC) {
+      iov[iovcnt].iov_base = message->data + offset;
+      iov[iovcnt].iov_len = message->length - offset;
+      iovcnt++;
+      offset = 0;
+      message = message->next;
     }
 
-    if (sock < 0) {
-      OC_ERR("could not create socket for new TCP session");
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(struct msghdr));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    ssize_t sent = sendmsg(session->sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+      }
+      OC_WRN("sendmsg() returned errno %d", errno);
       return -1;
     }
-
-    socklen_t receiver_size = sizeof(*receiver);
-    int ret = 0;
-    if ((ret = connect_nonb(sock, (struct sockaddr *)receiver, receiver_size,
-                            TCP_CONNECT_TIMEOUT)) == 0) {
-      break;
+    OC_DBG("Sent %zd queued bytes", sent);
+
+    size_t remaining = (size_t)sent;
+    message = (oc_message_t *)oc_list_head(session->send_q);
+    while (message && remaining >= message->length - session->send_offset) {
+      remaining -= message->length - session->send_offset;
+      session->send_offset = 0;
+      oc_list_remove(session->send_q, message);
+      oc_message_unref(message);
+      message = (oc_message_t *)oc_list_head(session->send_q);
     }
-
-    close(sock);
-    retry_cnt++;
-    OC_DBG("connect fail with %d. retry(%d)", ret, retry_cnt);
-  }
-
-  if (retry_cnt >= LIMIT_RETRY_CONNECT) {
-    OC_ERR("could not initiate TCP connection");
-    return -1;
-  }
-
-  OC_DBG("successfully initiated TCP connection");
-
-  if (add_new_session(sock, dev, endpoint, CSM_SENT) < 0) {
-    OC_ERR("could not record new TCP session");
-    close(sock);
-    return -1;
+    session->send_offset += remaining;
   }
-
-  FD_SET(sock, &dev->rfds);
-
-  ssize_t len = 0;
-  do {
-    uint8_t dummy_value = 0xef;
-    len = write(dev->tcp.connect_pipe[1], &dummy_value, 1);
-  } while (len == -1 && errno == EINTR);
-
-  OC_DBG("signaled network event thread to monitor the newly added session\n");
-
-  return sock;
+  set_congested(session, false);
+  return 0;
 }
 
 int
 oc_tcp_send_buffer(ip_context_t *dev, oc_message_t *message,
                    const struct sockaddr_storage *receiver)
 {
+  int ret = -1;
   pthread_mutex_lock(&dev->tcp.mutex);
-  int send_sock = get_session_socket(&message->endpoint);
-
-  size_t bytes_sent = 0;
-  if (send_sock < 0) {
-    if ((send_sock = initiate_new_session(dev, &message->endpoint, receiver)) <
-        0) {
+  tcp_session_t *session = find_session_by_endpoint(&message->endpoint);
+  if (!session) {
+    session = initiate_new_session(dev, &message->endpoint, receiver);
+    if (!session) {
       OC_ERR("could not initiate new TCP session");
       goto oc_tcp_send_buffer_done;
     }
   }
 
-  send_sock = get_session_socket(&message->endpoint);
-  if (send_sock < 0) {
-    goto oc_tcp_send_buffer_done;
+  size_t bytes_sent = 0;
+  if (session->state == TCP_STATE_CONNECTED &&
+      oc_list_length(session->send_q) == 0) {
+    do {
+      ssize_t send_len = send(session->sock, message->data + bytes_sent,
+                              message->length - bytes_sent,
+                              MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (send_len < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        }
+        OC_WRN("send() returned errno %d", errno);
+        free_tcp_session(session);
+        goto oc_tcp_send_buffer_done;
+      }
+      bytes_sent += (size_t)send_len;
+    } while (bytes_sent < message->length);
+    OC_DBG("Sent %zd bytes", bytes_sent);
   }
 
-  do {
-    ssize_t send_len = send(send_sock, message->data + bytes_sent,
-                            message->length - bytes_sent, MSG_NOSIGNAL);
-    if (send_len < 0) {
-      OC_WRN("send() returned errno %d", errno);
+  if (bytes_sent < message->length) {
+    if (enqueue_message(session, message, bytes_sent) < 0) {
+      if (bytes_sent > 0) {
+        /* a partially written message cannot be abandoned mid-stream */
+        free_tcp_session(session);
+      }
       goto oc_tcp_send_buffer_done;
     }
-    bytes_sent += send_len;
-  } while (bytes_sent < message->length);
+    FD_SET(session->sock, &dev->tcp.wfds);
+    fd_interest_changed(dev, session->sock);
+    signal_network_thread(dev);
+  }
+  ret = (int)message->length;
 
-  OC_DBG("Sent %zd bytes", bytes_sent);
 oc_tcp_send_buffer_done:
   pthread_mutex_unlock(&dev->tcp.mutex);
+  return ret;
+}
 
-  if (bytes_sent == 0) {
-    return -1;
+int
+oc_tcp_process_writable(ip_context_t *dev, fd_set *wfds)
+{
+  int handled = 0;
+  pthread_mutex_lock(&dev->tcp.mutex);
+  oc_clock_time_t now = oc_clock_time();
+  tcp_session_t *session = (tcp_session_t *)oc_list_head(session_list), *next;
+  while (session != NULL) {
+    next = session->next;
+    if (session->dev != dev) {
+      session = next;
+      continue;
+    }
+    if (receive_pending(session) && now >= session->rx_deadline) {
+      OC_ERR("timed out receiving TCP message");
+      if (FD_ISSET(session->sock, wfds)) {
+        FD_CLR(session->sock, wfds);
+        handled++;
+      }
+      free_tcp_session(session);
+      session = next;
+      continue;
+    }
+    if (!FD_ISSET(session->sock, wfds)) {
+      if (session->state == TCP_STATE_CONNECTING &&
+          now >= session->connect_deadline) {
+        OC_ERR("timed out connecting TCP session");
+        free_tcp_session(session);
+      }
+      session = next;
+      continue;
+    }
+    FD_CLR(session->sock, wfds);
+    handled++;
+
+    if (session->state == TCP_STATE_CONNECTING) {
+      int error = 0;
+      socklen_t len = sizeof(error);
+      if (getsockopt(session->sock, SOL_SOCKET, SO_ERROR, &error, &len) < 0 ||
+          error != 0) {
+        OC_ERR("could not connect TCP session %d", error);
+        free_tcp_session(session);
+        session = next;
+        continue;
+      }
+      OC_DBG("successfully connected TCP session");
+      session->state = TCP_STATE_CONNECTED;
+      if (!(session->endpoint.flags & SECURED)) {
+        oc_session_start_event(&session->endpoint);
+      }
+    }
+
+    if (flush_send_queue(session) < 0) {
+      free_tcp_session(session);
+    } else if (oc_list_length(session->send_q) == 0) {
+      FD_CLR(session->sock, &dev->tcp.wfds);
+      fd_interest_changed(dev, session->sock);
+    }
+    session = next;
+  }
+  pthread_mutex_unlock(&dev->tcp.mutex);
+  return handled;
+}
+
+bool
+oc_tcp_timeout_pending(ip_context_t *dev)
+{
+  bool pending = false;
+  pthread_mutex_lock(&dev->tcp.mutex);
+  tcp_session_t *session = (tcp_session_t *)oc_list_head(session_list);
+  while (session != NULL && !pending) {
+    pending = (session->dev == dev && (session->state == TCP_STATE_CONNECTING ||
+                                       receive_pending(session)));
+    session = session->next;
   }
+  pthread_mutex_unlock(&dev->tcp.mutex);
+  return pending;
+}
 
-  return bytes_sent;
+void
+oc_tcp_set_backpressure_cb(oc_tcp_backpressure_cb_t cb)
+{
+  backpressure_cb = cb;
 }
 
 #ifdef OC_IPV4
@@ -695,6 +1024,8 @@ oc_tcp_connectivity_init(ip_context_t *dev)
     oc_abort("error initializing TCP adapter mutex");
   }
 
+  FD_ZERO(&dev->tcp.wfds);
+
   memset(&dev->tcp.server, 0, sizeof(struct sockaddr_storage));
   struct sockaddr_in6 *l = (struct sockaddr_in6 *)&dev->tcp.server;
   l->sin6_family = AF_INET6;
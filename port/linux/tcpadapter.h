@@ -36,13 +36,17 @@ void oc_tcp_connectivity_shutdown(ip_context_t *dev);
 int oc_tcp_send_buffer(ip_context_t *dev, oc_message_t *message,
                        const struct sockaddr_storage *receiver);
 
-void oc_tcp_add_socks_to_fd_set(ip_context_t *dev);
+bool oc_tcp_add_socks_to_fd_set(ip_context_t *dev);
 
 void oc_tcp_set_session_fds(fd_set *fds);
 
 adapter_receive_state_t oc_tcp_receive_message(ip_context_t *dev, fd_set *fds,
                                                oc_message_t *message);
 
+int oc_tcp_process_writable(ip_context_t *dev, fd_set *wfds);
+
+bool oc_tcp_timeout_pending(ip_context_t *dev);
+
 void oc_tcp_end_session(ip_context_t *dev, oc_endpoint_t *endpoint);
 
 #ifdef __cplusplus
@@ -89,6 +89,17 @@ void oc_clock_init(void);
  */
 oc_clock_time_t oc_clock_time(void);
 
+/**
+ * Get the current monotonic clock time.
+ *
+ * Unlike oc_clock_time(), this time does not jump when the system time is
+ * set. It counts from an unspecified point, so it is only meaningful for
+ * measuring intervals.
+ *
+ * \return The current monotonic clock time, measured in system ticks.
+ */
+oc_clock_time_t oc_clock_time_monotonic(void);
+
 /**
  * Get the current value of the platform seconds.
  *
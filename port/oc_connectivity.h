@@ -22,8 +22,12 @@
 #include "messaging/coap/conf.h"
 #include "oc_config.h"
 #include "oc_endpoint.h"
+#ifdef OC_REQUEST_TRACE
+#include "oc_metrics.h"
+#endif /* OC_REQUEST_TRACE */
 #include "oc_network_events.h"
 #include "oc_session_events.h"
+#include "port/oc_clock.h"
 #include "port/oc_log.h"
 #include "util/oc_process.h"
 #include <stdint.h>
@@ -101,6 +105,8 @@ struct oc_message_s
   uint8_t data[OC_INOUT_BUFFER_SIZE];
 #else  /* OC_INOUT_BUFFER_SIZE */
   uint8_t *data;
+  uint8_t buffer_class; /* size class of data, see oc_buffer.h */
+  uint16_t headroom;    /* unused bytes of the buffer in front of data */
 #endif /* !OC_INOUT_BUFFER_SIZE */
 #else  /* OC_DYNAMIC_ALLOCATION */
   uint8_t data[OC_PDU_SIZE];
@@ -111,6 +117,11 @@ struct oc_message_s
 #ifdef OC_SECURITY
   uint8_t encrypted;
 #endif
+  uint8_t copies; /* times the payload was copied, see oc_buffer.h */
+#ifdef OC_REQUEST_TRACE
+  /* when the message passed each stage, see oc_metrics.h */
+  oc_clock_time_t trace[OC_METRICS_NUM_STAGES];
+#endif /* OC_REQUEST_TRACE */
 };
 
 int oc_send_buffer(oc_message_t *message);
@@ -123,14 +134,59 @@ void oc_send_discovery_request(oc_message_t *message);
 
 void oc_connectivity_end_session(oc_endpoint_t *endpoint);
 
+typedef void (*oc_dns_lookup_cb_t)(void *user_data);
+
 #ifdef OC_DNS_LOOKUP
+/**
+ * Resolve domain to an address of the family in flags.
+ *
+ * With OC_DNS_CACHE this never blocks: a domain that is not cached yet is
+ * resolved on a helper thread and -1 is returned meanwhile, so callers such
+ * as oc_string_to_endpoint() fail until the result is cached. Use
+ * oc_dns_lookup_async() to learn when to try again. Without OC_DNS_CACHE the
+ * domain is resolved on the calling thread.
+ *
+ * Cached addresses are kept for OC_DNS_CACHE_TTL seconds (300 by default)
+ * and failures for OC_DNS_NEGATIVE_TTL seconds (30 by default), whatever
+ * the TTLs of the DNS records, which getaddrinfo() does not report. Only the
+ * first address of each family is kept.
+ *
+ * @return 0 and the address in addr, -1 on a miss or an error
+ */
 int oc_dns_lookup(const char *domain, oc_string_t *addr,
                   enum transport_flags flags);
 #ifdef OC_DNS_CACHE
 void oc_dns_clear_cache(void);
+
+/**
+ * Look domain up and be called back once it is cached. A domain that is not
+ * cached is resolved on a helper thread, and oc_dns_lookup() answers from
+ * the cache once cb has been called.
+ *
+ * @param domain the domain to resolve
+ * @param cb called on the event loop when the lookup completes
+ * @param user_data passed to cb
+ *
+ * @return 0 if the domain is cached and oc_dns_lookup() will not block, 1 if
+ * cb will be called, -1 on error
+ */
+int oc_dns_lookup_async(const char *domain, oc_dns_lookup_cb_t cb,
+                        void *user_data);
+
+void oc_dns_cancel_lookup(oc_dns_lookup_cb_t cb, void *user_data);
 #endif /* OC_DNS_CACHE */
 #endif /* OC_DNS_LOOKUP */
 
+/**
+ * Endpoints of device. The list is handed out without copying. It stays
+ * valid until the calling thread asks again for the endpoints of the same
+ * device, or exits, even if the addresses change meanwhile. The lists of
+ * different devices can be held at the same time.
+ *
+ * @param device the device index
+ *
+ * @return the head of the list, NULL if device has no endpoints
+ */
 oc_endpoint_t *oc_connectivity_get_endpoints(size_t device);
 
 void handle_network_interface_event_callback(oc_interface_event_t event);
@@ -144,8 +200,51 @@ typedef enum { CSM_NONE, CSM_SENT, CSM_DONE, CSM_ERROR = 255 } tcp_csm_state_t;
 
 tcp_csm_state_t oc_tcp_get_csm_state(oc_endpoint_t *endpoint);
 int oc_tcp_update_csm_state(oc_endpoint_t *endpoint, tcp_csm_state_t csm);
+
+/**
+ * Callback invoked when the outbound queue of a TCP session fills up
+ * (congested is true) or has been completely written out again (congested is
+ * false). Messages sent to a congested session are dropped. The callback
+ * runs on the thread that changed the queue and must not send messages.
+ */
+typedef void (*oc_tcp_backpressure_cb_t)(const oc_endpoint_t *endpoint,
+                                         bool congested);
+
+void oc_tcp_set_backpressure_cb(oc_tcp_backpressure_cb_t cb);
 #endif /* OC_TCP */
 
+#ifdef OC_EXTERNAL_EVENT_LOOP
+/**
+ * Interest of the host event loop in a file descriptor of the stack.
+ */
+typedef enum {
+  OC_FD_READABLE = 1 << 0,
+  OC_FD_WRITABLE = 1 << 1
+} oc_fd_events_t;
+
+/**
+ * Callback invoked when the stack starts or stops watching a file descriptor,
+ * or changes the events it waits for. events is a combination of
+ * oc_fd_events_t, 0 when the host loop must stop watching fd; in that case fd
+ * is still open but is closed right after the callback returns. The callback
+ * must not call back into the stack.
+ */
+typedef void (*oc_fd_watch_cb_t)(int fd, unsigned events, void *user_data);
+
+/* Port side of oc_set_fd_watch_callback() and oc_main_on_readable(),
+ * oc_main_on_writable() and oc_main_on_timeout(). */
+void oc_connectivity_set_fd_watch_callback(oc_fd_watch_cb_t cb,
+                                           void *user_data);
+void oc_connectivity_on_readable(int fd);
+void oc_connectivity_on_writable(int fd);
+void oc_connectivity_on_timeout(void);
+
+/* Report file descriptor changes to the fd watch callback. Returns the time
+ * by which oc_connectivity_on_timeout() must run, or 0 if the port has no
+ * pending timeouts. */
+oc_clock_time_t oc_connectivity_update_fd_watches(void);
+#endif /* OC_EXTERNAL_EVENT_LOOP */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,67 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+/**
+  @file
+*/
+#ifndef OC_EVENT_LOOP_FD_H
+#define OC_EVENT_LOOP_FD_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Open a file descriptor that becomes readable whenever the stack needs
+ * oc_main_poll() to run, for apps that wait in poll()/epoll() instead of on a
+ * condition variable. Implemented by ports with eventfd(2) (Linux).
+ *
+ * Use oc_event_loop_fd_signal() as the signal_event_loop callback. Wakeups
+ * from any number of threads are coalesced into a single write until the
+ * event loop calls oc_event_loop_fd_clear().
+ *
+ * Example:
+ * ```
+ * int fd = oc_event_loop_fd_open();
+ * while (!quit) {
+ *   oc_clock_time_t next_event = oc_main_poll();
+ *   struct pollfd pfd = { fd, POLLIN, 0 };
+ *   poll(&pfd, 1, next_event ? timeout_ms(next_event) : -1);
+ *   oc_event_loop_fd_clear();
+ * }
+ * ```
+ *
+ * @return the file descriptor, or -1 on error
+ */
+int oc_event_loop_fd_open(void);
+
+/**
+ * Signal the event loop; safe to call from any thread.
+ */
+void oc_event_loop_fd_signal(void);
+
+/**
+ * Consume pending wakeups. Must be followed by a call to oc_main_poll().
+ */
+void oc_event_loop_fd_clear(void);
+
+void oc_event_loop_fd_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_EVENT_LOOP_FD_H */
@@ -60,3 +60,24 @@ TEST_F(TestClock, oc_clock_wait)
     int seconds = (cur_stamp - prev_stamp) / OC_CLOCK_SECOND;
     EXPECT_EQ(1, seconds);
 }
+
+TEST_F(TestClock, oc_clock_time_monotonic)
+{
+    oc_clock_time_t prev_stamp = oc_clock_time_monotonic();
+    oc_clock_wait(OC_CLOCK_SECOND / 1000);
+    oc_clock_time_t cur_stamp = oc_clock_time_monotonic();
+
+    EXPECT_NE(0, prev_stamp);
+    EXPECT_LT(prev_stamp, cur_stamp);
+}
+
+TEST_F(TestClock, oc_clock_loop_time)
+{
+    oc_clock_set_loop_time(true);
+    oc_clock_time_t loop_stamp = oc_clock_loop_time();
+    oc_clock_wait(OC_CLOCK_SECOND / 1000);
+    EXPECT_EQ(loop_stamp, oc_clock_loop_time());
+
+    oc_clock_set_loop_time(false);
+    EXPECT_LT(loop_stamp, oc_clock_loop_time());
+}
@@ -18,13 +18,23 @@
  *
  ******************************************************************/
 
+#include <arpa/inet.h>
+#include <cerrno>
 #include <cstdlib>
 #include <string>
+#include <vector>
 #include <gtest/gtest.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 extern "C" {
     #include "port/oc_connectivity.h"
     #include "oc_network_monitor.h"
+    #include "ipcontext.h"
 }
 
 static const size_t device = 0;
@@ -60,6 +70,85 @@ TEST_F(TestConnectivity, oc_connectivity_get_endpoints)
     EXPECT_NE(NULL, ep);
 }
 
+static bool endpoints_churn_done;
+
+/* Walk the endpoint list over and over, it must stay as it was first read. */
+static void *read_endpoints(void *data)
+{
+    size_t *reads = (size_t *)data;
+    std::vector<oc_endpoint_t> first;
+    oc_endpoint_t *ep = oc_connectivity_get_endpoints(device);
+    for (; ep != NULL; ep = ep->next) {
+        first.push_back(*ep);
+    }
+    while (!__atomic_load_n(&endpoints_churn_done, __ATOMIC_ACQUIRE)) {
+        size_t n = 0;
+        ep = oc_connectivity_get_endpoints(device);
+        for (; ep != NULL && n < first.size(); ep = ep->next, n++) {
+            if (ep->flags != first[n].flags ||
+                memcmp(&ep->addr, &first[n].addr, sizeof(ep->addr)) != 0) {
+                break;
+            }
+        }
+        EXPECT_TRUE(ep == NULL && n == first.size());
+        __atomic_add_fetch(reads, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+TEST_F(TestConnectivity, oc_connectivity_get_endpoints_churn)
+{
+    endpoints_churn_done = false;
+    size_t reads = 0;
+    pthread_t reader;
+    ASSERT_EQ(0, pthread_create(&reader, NULL, read_endpoints, &reads));
+
+    /* until the reader walked the lists a good many times */
+    for (int i = 0;
+         i < 1000 || __atomic_load_n(&reads, __ATOMIC_RELAXED) < 1000; i++) {
+        oc_endpoint_t *old_eps = oc_connectivity_get_endpoints(device);
+        ASSERT_NE(nullptr, old_eps);
+        oc_ip_refresh_endpoints();
+        /* still holding the old list, so a new one was allocated: retired
+         * lists do not pile up until the pools run dry */
+        ASSERT_NE(old_eps, oc_connectivity_get_endpoints(device));
+    }
+
+    __atomic_store_n(&endpoints_churn_done, true, __ATOMIC_RELEASE);
+    pthread_join(reader, NULL);
+}
+
+TEST_F(TestConnectivity, oc_connectivity_get_endpoints_of_two_devices)
+{
+    const size_t other = device + 1;
+    ASSERT_EQ(0, oc_connectivity_init(other));
+
+    oc_endpoint_t *held = oc_connectivity_get_endpoints(device);
+    ASSERT_NE(nullptr, held);
+    std::vector<oc_endpoint_t> first;
+    oc_endpoint_t *ep = held;
+    for (; ep != NULL; ep = ep->next) {
+        first.push_back(*ep);
+    }
+    /* reading the other device must not let go of the first list */
+    ASSERT_NE(nullptr, oc_connectivity_get_endpoints(other));
+    oc_ip_refresh_endpoints();
+    oc_ip_refresh_endpoints();
+    EXPECT_NE(held, oc_connectivity_get_endpoints(other));
+
+    size_t n = 0;
+    for (ep = held; ep != NULL && n < first.size(); ep = ep->next, n++) {
+        if (ep->flags != first[n].flags ||
+            memcmp(&ep->addr, &first[n].addr, sizeof(ep->addr)) != 0) {
+            break;
+        }
+    }
+    EXPECT_TRUE(ep == NULL && n == first.size());
+    EXPECT_NE(held, oc_connectivity_get_endpoints(device));
+
+    oc_connectivity_shutdown(other);
+}
+
 static void interface_event_handler(oc_interface_event_t event)
 {
     EXPECT_EQ(NETWORK_INTERFACE_UP, event);
@@ -133,6 +222,86 @@ TEST_F(TestConnectivity, handle_session_event_callback)
     EXPECT_EQ(true, is_callback_received);
 }
 
+#ifdef OC_DNS_CACHE
+static void dns_resolved(void *data)
+{
+    *(bool *)data = true;
+}
+
+/* background lookups complete on the event loop */
+static void wait_for_dns_lookup(bool *resolved)
+{
+    for (int i = 0; i < 3000 && !*resolved; i++) {
+        usleep(10000);
+        oc_process_run();
+    }
+}
+
+#ifdef OC_IPV4
+TEST_F(TestConnectivity, oc_dns_lookup_misses_while_resolving)
+{
+    oc_dns_clear_cache();
+    oc_string_t addr;
+    /* the miss is answered at once and resolved in the background */
+    EXPECT_EQ(-1, oc_dns_lookup("localhost", &addr, IPV4));
+    bool resolved = false;
+    ASSERT_EQ(1, oc_dns_lookup_async("localhost", dns_resolved, &resolved));
+    wait_for_dns_lookup(&resolved);
+    EXPECT_TRUE(resolved);
+
+    ASSERT_EQ(0, oc_dns_lookup("localhost", &addr, IPV4));
+    EXPECT_STREQ("127.0.0.1", oc_string(addr));
+    oc_free_string(&addr);
+}
+
+TEST_F(TestConnectivity, oc_dns_lookup_async)
+{
+    oc_dns_clear_cache();
+    bool resolved = false;
+    ASSERT_EQ(1, oc_dns_lookup_async("localhost", dns_resolved, &resolved));
+    wait_for_dns_lookup(&resolved);
+    EXPECT_TRUE(resolved);
+
+    EXPECT_EQ(0, oc_dns_lookup_async("localhost", dns_resolved, &resolved));
+    oc_string_t addr;
+    ASSERT_EQ(0, oc_dns_lookup("localhost", &addr, IPV4));
+    EXPECT_STREQ("127.0.0.1", oc_string(addr));
+    oc_free_string(&addr);
+}
+
+TEST_F(TestConnectivity, oc_dns_cancel_lookup)
+{
+    oc_dns_clear_cache();
+    bool cancelled = false;
+    bool resolved = false;
+    ASSERT_EQ(1, oc_dns_lookup_async("localhost", dns_resolved, &cancelled));
+    ASSERT_EQ(1, oc_dns_lookup_async("localhost", dns_resolved, &resolved));
+    oc_dns_cancel_lookup(dns_resolved, &cancelled);
+    wait_for_dns_lookup(&resolved);
+    EXPECT_TRUE(resolved);
+    EXPECT_FALSE(cancelled);
+}
+#endif /* OC_IPV4 */
+
+TEST_F(TestConnectivity, oc_dns_lookup_negative)
+{
+    oc_dns_clear_cache();
+    oc_string_t addr;
+    EXPECT_EQ(-1, oc_dns_lookup("iotivity.invalid", &addr, IPV6));
+    bool resolved = false;
+    ASSERT_EQ(1,
+              oc_dns_lookup_async("iotivity.invalid", dns_resolved, &resolved));
+    wait_for_dns_lookup(&resolved);
+    EXPECT_TRUE(resolved);
+
+    /* the failure is cached rather than looked up again */
+    resolved = false;
+    EXPECT_EQ(0,
+              oc_dns_lookup_async("iotivity.invalid", dns_resolved, &resolved));
+    EXPECT_EQ(-1, oc_dns_lookup("iotivity.invalid", &addr, IPV6));
+}
+#endif /* OC_DNS_CACHE */
+
 #ifdef OC_TCP
 TEST_F(TestConnectivity, oc_tcp_get_csm_state_P)
 {
@@ -193,4 +362,189 @@ TEST_F(TestConnectivity, oc_tcp_update_csm_state_N)
 
     EXPECT_NE(CSM_DONE, ret);
 }
+
+static pthread_mutex_t backpressure_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int congested_events = 0;
+static int drained_events = 0;
+
+static void
+on_backpressure(const oc_endpoint_t *endpoint, bool congested)
+{
+    (void)endpoint;
+    pthread_mutex_lock(&backpressure_mutex);
+    if (congested) {
+        congested_events++;
+    } else {
+        drained_events++;
+    }
+    pthread_mutex_unlock(&backpressure_mutex);
+}
+
+static int
+get_backpressure_events(int *events)
+{
+    pthread_mutex_lock(&backpressure_mutex);
+    int n = *events;
+    pthread_mutex_unlock(&backpressure_mutex);
+    return n;
+}
+
+TEST_F(TestConnectivity, oc_tcp_backpressure_cb)
+{
+    congested_events = 0;
+    drained_events = 0;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_LE(0, listener);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(0, bind(listener, (struct sockaddr *)&addr, addr_len));
+    ASSERT_EQ(0, listen(listener, 1));
+    ASSERT_EQ(0, getsockname(listener, (struct sockaddr *)&addr, &addr_len));
+
+    uint8_t data[1024];
+    memset(data, 0xab, sizeof(data));
+    oc_message_t message;
+    memset(&message, 0, sizeof(message));
+    message.endpoint.flags = (transport_flags)(IPV4 | TCP);
+    message.endpoint.device = device;
+    memcpy(message.endpoint.addr.ipv4.address, &addr.sin_addr.s_addr, 4);
+    message.endpoint.addr.ipv4.port = ntohs(addr.sin_port);
+    message.data = data;
+    message.length = sizeof(data);
+
+    /* messages queue up while connecting, or once the peer stops reading */
+    oc_tcp_set_backpressure_cb(on_backpressure);
+    for (int i = 0; i < 100000 && get_backpressure_events(&congested_events) == 0;
+         i++) {
+        oc_send_buffer(&message);
+    }
+    EXPECT_EQ(1, get_backpressure_events(&congested_events));
+
+    /* reading lets the network thread write the queue out */
+    int conn = accept(listener, NULL, NULL);
+    ASSERT_LE(0, conn);
+    uint8_t buf[4096];
+    for (int i = 0; i < 5000 && get_backpressure_events(&drained_events) == 0;
+         i++) {
+        while (recv(conn, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            ;
+        usleep(1000);
+    }
+    EXPECT_EQ(1, get_backpressure_events(&drained_events));
+
+    oc_tcp_set_backpressure_cb(NULL);
+    close(conn);
+    close(listener);
+}
+
+static int
+connect_to_tcp_endpoint(void)
+{
+    oc_endpoint_t *ep = oc_connectivity_get_endpoints(device);
+    for (; ep != NULL; ep = ep->next) {
+        if ((ep->flags & (IPV4 | TCP)) == (IPV4 | TCP) &&
+            !(ep->flags & SECURED)) {
+            break;
+        }
+    }
+    if (!ep) {
+        return -1;
+    }
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(ep->addr.ipv4.port);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static bool
+is_open(int sock)
+{
+    uint8_t buf;
+    return recv(sock, &buf, sizeof(buf), MSG_DONTWAIT) < 0 &&
+           (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+TEST_F(TestConnectivity, oc_tcp_receive_partial_message_timeout)
+{
+    int partial = connect_to_tcp_endpoint();
+    ASSERT_LE(0, partial);
+    int idle = connect_to_tcp_endpoint();
+    ASSERT_LE(0, idle);
+    int trickled = connect_to_tcp_endpoint();
+    ASSERT_LE(0, trickled);
+
+    /* the first byte of a CoAP over TCP header */
+    uint8_t header = 0x60;
+    ASSERT_EQ(1, send(partial, &header, 1, 0));
+
+    /* GET /oic/d, then a message with an extended length header, a byte at a
+     * time */
+    const uint8_t frames[] = { 0x60, 0x01, 0xb3, 'o',  'i', 'c', 0x01, 'd',
+                               0xd0, 0x00, 0x01, 0xbc, 'a', 'b', 'c',  'd',
+                               'e',  'f',  'g',  'h',  'i', 'j', 'k',  'l' };
+    for (size_t i = 0; i < sizeof(frames); i++) {
+        ASSERT_EQ(1, send(trickled, &frames[i], 1, 0));
+        usleep(10 * 1000);
+    }
+
+    /* only the session stuck in the middle of a message is closed */
+    struct pollfd pfd = { partial, POLLIN, 0 };
+    ASSERT_EQ(1, poll(&pfd, 1, 10 * 1000));
+    uint8_t buf;
+    EXPECT_EQ(0, recv(partial, &buf, sizeof(buf), 0));
+    EXPECT_TRUE(is_open(idle));
+    EXPECT_TRUE(is_open(trickled));
+
+    close(trickled);
+    close(idle);
+    close(partial);
+}
+
+TEST_F(TestConnectivity, oc_tcp_refuse_descriptor_out_of_fd_set)
+{
+    struct rlimit limit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &limit));
+    if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < FD_SETSIZE + 8) {
+        /* the host does not allow descriptors past FD_SETSIZE */
+        return;
+    }
+    struct rlimit raised = limit;
+    raised.rlim_cur = FD_SETSIZE + 8;
+    ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &raised));
+
+    /* take every descriptor below FD_SETSIZE */
+    std::vector<int> fillers;
+    int fd = open("/dev/null", O_RDONLY);
+    while (fd >= 0 && fd < FD_SETSIZE) {
+        fillers.push_back(fd);
+        fd = dup(fd);
+    }
+    ASSERT_LE(FD_SETSIZE, fd);
+    close(fd);
+
+    /* the accepted session could not be watched, it is closed right away */
+    int sock = connect_to_tcp_endpoint();
+    ASSERT_LE(FD_SETSIZE, sock);
+    struct pollfd pfd = { sock, POLLIN, 0 };
+    ASSERT_EQ(1, poll(&pfd, 1, 10 * 1000));
+    uint8_t buf;
+    EXPECT_EQ(0, recv(sock, &buf, sizeof(buf), 0));
+    close(sock);
+
+    for (size_t i = 0; i < fillers.size(); i++) {
+        close(fillers[i]);
+    }
+    setrlimit(RLIMIT_NOFILE, &limit);
+}
 #endif /* OC_TCP */
\ No newline at end of file
@@ -48,6 +48,12 @@ oc_clock_time(void)
   return time;
 }
 
+oc_clock_time_t
+oc_clock_time_monotonic(void)
+{
+  return (oc_clock_time_t)GetTickCount64();
+}
+
 unsigned long
 oc_clock_seconds(void)
 {
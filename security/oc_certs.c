@@ -28,6 +28,9 @@
 #include "oc_helpers.h"
 #include "oc_keypair.h"
 #include "security/oc_tls.h"
+#ifdef OC_TLS_HANDSHAKE_THREADS
+#include <pthread.h>
+#endif /* OC_TLS_HANDSHAKE_THREADS */
 
 #define UUID_PREFIX "uuid:"
 #define UUID_PREFIX_LEN (5)
@@ -139,13 +142,8 @@ oc_certs_parse_role_certificate(const unsigned char *role_certificate,
   }
 
   /* Verify that the role certificate was signed by a CA */
-  uint32_t flags = 0;
-  mbedtls_x509_crt *trust_ca = oc_tls_get_trust_anchors();
-  ret = mbedtls_x509_crt_verify_with_profile(cert, trust_ca, NULL,
-                                             &mbedtls_x509_crt_profile_default,
-                                             NULL, &flags, NULL, NULL);
-  if (ret != 0 || flags != 0) {
-    OC_ERR("error verifying role certificate %d", ret);
+  if (oc_certs_verify_chain(cert, oc_tls_get_trust_anchors()) < 0) {
+    OC_ERR("error verifying role certificate");
     goto exit_parse_role_cert;
   }
 
@@ -418,18 +416,6 @@ validate_x509v1_fields(const mbedtls_x509_crt *cert)
     return -1;
   }
 
-  /* notBefore */
-  if (mbedtls_x509_time_is_future(&cert->valid_from)) {
-    OC_WRN("certificate not yet active");
-    return -1;
-  }
-
-  /* notAfter */
-  if (mbedtls_x509_time_is_past(&cert->valid_to)) {
-    OC_WRN("certificate has expired");
-    return -1;
-  }
-
   /* Subject Public Key Info */
   /* id-ecPublicKey */
   if ((MBEDTLS_X509_ID_FLAG(cert->sig_pk) &
@@ -448,11 +434,29 @@ validate_x509v1_fields(const mbedtls_x509_crt *cert)
   return 0;
 }
 
-int
-oc_certs_validate_non_end_entity_cert(const mbedtls_x509_crt *cert,
-                                      bool is_root, bool is_otm, int depth)
+static int
+validate_validity_period(const mbedtls_x509_time *valid_from,
+                         const mbedtls_x509_time *valid_to)
+{
+  /* notBefore */
+  if (mbedtls_x509_time_is_future(valid_from)) {
+    OC_WRN("certificate not yet active");
+    return -1;
+  }
+
+  /* notAfter */
+  if (mbedtls_x509_time_is_past(valid_to)) {
+    OC_WRN("certificate has expired");
+    return -1;
+  }
+
+  return 0;
+}
+
+static int
+validate_non_end_entity_cert(const mbedtls_x509_crt *cert, bool is_root,
+                             bool is_otm, int depth)
 {
-  OC_DBG("attempting to validate %s cert", is_root ? "root" : "intermediate");
   /* Validate common X.509v1 fields */
   if (validate_x509v1_fields(cert) < 0) {
     return -1;
@@ -512,10 +516,9 @@ oc_certs_validate_non_end_entity_cert(const mbedtls_x509_crt *cert,
   return 0;
 }
 
-int
-oc_certs_validate_end_entity_cert(const mbedtls_x509_crt *cert)
+static int
+validate_end_entity_cert(const mbedtls_x509_crt *cert)
 {
-  OC_DBG("attempting to validate end entity cert");
   /* Validate common X.509v1 fields */
   if (validate_x509v1_fields(cert) < 0) {
     return -1;
@@ -607,11 +610,9 @@ oc_certs_validate_end_entity_cert(const mbedtls_x509_crt *cert)
   return 0;
 }
 
-int
-oc_certs_validate_role_cert(const mbedtls_x509_crt *cert)
+static int
+validate_role_cert(const mbedtls_x509_crt *cert)
 {
-  OC_DBG("attempting to validate role certificate");
-
   /* Validate common X.509v1 fields */
   if (validate_x509v1_fields(cert) < 0) {
     return -1;
@@ -703,6 +704,270 @@ oc_certs_validate_role_cert(const mbedtls_x509_crt *cert)
   return 0;
 }
 
+/* Results of the checks above and of chain verifications, keyed by the
+ * SHA-256 digest of the DER encoding of the certificate or chain and by the
+ * generation of the trust anchors they were checked against. Certificates
+ * presented in every handshake and role certificates checked on every request
+ * are so only inspected once. The validity period is not part of a cached
+ * result; it is checked on every lookup against the notBefore and notAfter
+ * kept with the entry.
+ */
+typedef enum {
+  CERT_CHECK_END_ENTITY = 1,
+  CERT_CHECK_ROLE,
+  CERT_CHECK_ROOT,
+  CERT_CHECK_INTERMEDIATE,
+  CERT_CHECK_CHAIN,
+  CERT_CHECK_OTM = 0x80
+} cert_check_t;
+
+typedef struct oc_cert_validation_t
+{
+  unsigned char digest[32];
+  mbedtls_x509_time valid_from;
+  mbedtls_x509_time valid_to;
+  uint32_t generation;
+  int depth;
+  uint8_t check; /* 0 for an unused entry */
+  int8_t result;
+} oc_cert_validation_t;
+
+static oc_cert_validation_t validations[OC_CERTS_VALIDATION_CACHE_SIZE];
+static uint32_t trust_anchors_generation;
+#ifdef OC_TLS_HANDSHAKE_THREADS
+/* certificates are validated on the handshake threads */
+static pthread_mutex_t validations_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define validations_lock() pthread_mutex_lock(&validations_mutex)
+#define validations_unlock() pthread_mutex_unlock(&validations_mutex)
+#else /* OC_TLS_HANDSHAKE_THREADS */
+#define validations_lock()
+#define validations_unlock()
+#endif /* !OC_TLS_HANDSHAKE_THREADS */
+
+void
+oc_certs_clear_validation_cache(void)
+{
+  validations_lock();
+  memset(validations, 0, sizeof(validations));
+  validations_unlock();
+}
+
+void
+oc_certs_trust_anchors_changed(void)
+{
+  validations_lock();
+  trust_anchors_generation++;
+  validations_unlock();
+}
+
+/* Look up the result of check on the certificate or chain with digest. On a
+ * hit entry is filled in, on a miss it is prepared for cache_validation().
+ */
+static bool
+lookup_validation(const unsigned char *digest, uint8_t check, int depth,
+                  oc_cert_validation_t *entry)
+{
+  size_t slot = ((size_t)digest[0] | (size_t)digest[1] << 8) ^
+                (size_t)check ^ (size_t)depth;
+  oc_cert_validation_t *v = &validations[slot % OC_CERTS_VALIDATION_CACHE_SIZE];
+
+  validations_lock();
+  bool cached = v->check == check && v->depth == depth &&
+                v->generation == trust_anchors_generation &&
+                memcmp(v->digest, digest, sizeof(v->digest)) == 0;
+  if (cached) {
+    memcpy(entry, v, sizeof(*entry));
+  } else {
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->digest, digest, sizeof(entry->digest));
+    entry->generation = trust_anchors_generation;
+    entry->depth = depth;
+    entry->check = check;
+  }
+  validations_unlock();
+  return cached;
+}
+
+static void
+cache_validation(const oc_cert_validation_t *entry)
+{
+  size_t slot = ((size_t)entry->digest[0] | (size_t)entry->digest[1] << 8) ^
+                (size_t)entry->check ^ (size_t)entry->depth;
+  oc_cert_validation_t *v = &validations[slot % OC_CERTS_VALIDATION_CACHE_SIZE];
+
+  validations_lock();
+  /* not if the trust anchors changed while it was checked */
+  if (entry->generation == trust_anchors_generation) {
+    memcpy(v, entry, sizeof(*v));
+  }
+  validations_unlock();
+}
+
+static int
+run_cert_check(const mbedtls_x509_crt *cert, uint8_t check, int depth)
+{
+  bool is_otm = (check & CERT_CHECK_OTM) != 0;
+  switch (check & ~CERT_CHECK_OTM) {
+  case CERT_CHECK_END_ENTITY:
+    return validate_end_entity_cert(cert);
+  case CERT_CHECK_ROLE:
+    return validate_role_cert(cert);
+  case CERT_CHECK_ROOT:
+    return validate_non_end_entity_cert(cert, true, is_otm, depth);
+  default:
+    return validate_non_end_entity_cert(cert, false, is_otm, depth);
+  }
+}
+
+static int
+validate_cert(const mbedtls_x509_crt *cert, uint8_t check, int depth)
+{
+  unsigned char digest[MBEDTLS_MD_MAX_SIZE];
+  if (mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), cert->raw.p,
+                 cert->raw.len, digest) != 0) {
+    OC_WRN("unable to hash certificate, validating it uncached");
+    if (run_cert_check(cert, check, depth) < 0) {
+      return -1;
+    }
+    return validate_validity_period(&cert->valid_from, &cert->valid_to);
+  }
+
+  oc_cert_validation_t entry;
+  if (!lookup_validation(digest, check, depth, &entry)) {
+    memcpy(&entry.valid_from, &cert->valid_from, sizeof(entry.valid_from));
+    memcpy(&entry.valid_to, &cert->valid_to, sizeof(entry.valid_to));
+    entry.result = (int8_t)run_cert_check(cert, check, depth);
+    cache_validation(&entry);
+  } else {
+    OC_DBG("using cached certificate validation result");
+  }
+
+  if (entry.result < 0) {
+    return -1;
+  }
+  return validate_validity_period(&entry.valid_from, &entry.valid_to);
+}
+
+int
+oc_certs_validate_non_end_entity_cert(const mbedtls_x509_crt *cert,
+                                      bool is_root, bool is_otm, int depth)
+{
+  OC_DBG("attempting to validate %s cert", is_root ? "root" : "intermediate");
+  uint8_t check = is_root ? CERT_CHECK_ROOT : CERT_CHECK_INTERMEDIATE;
+  if (is_otm) {
+    check |= CERT_CHECK_OTM;
+  }
+  return validate_cert(cert, check, depth);
+}
+
+int
+oc_certs_validate_end_entity_cert(const mbedtls_x509_crt *cert)
+{
+  OC_DBG("attempting to validate end entity cert");
+  return validate_cert(cert, CERT_CHECK_END_ENTITY, 0);
+}
+
+int
+oc_certs_validate_role_cert(const mbedtls_x509_crt *cert)
+{
+  OC_DBG("attempting to validate role certificate");
+  return validate_cert(cert, CERT_CHECK_ROLE, 0);
+}
+
+static int
+compare_x509_time(const mbedtls_x509_time *a, const mbedtls_x509_time *b)
+{
+  if (a->year != b->year) {
+    return a->year - b->year;
+  }
+  if (a->mon != b->mon) {
+    return a->mon - b->mon;
+  }
+  if (a->day != b->day) {
+    return a->day - b->day;
+  }
+  if (a->hour != b->hour) {
+    return a->hour - b->hour;
+  }
+  if (a->min != b->min) {
+    return a->min - b->min;
+  }
+  return a->sec - b->sec;
+}
+
+/* Narrow the validity period of the entry to that of every certificate on the
+ * verified path, trust anchor included.
+ */
+static int
+collect_chain_validity(void *data, mbedtls_x509_crt *crt, int depth,
+                       uint32_t *flags)
+{
+  (void)depth;
+  (void)flags;
+  oc_cert_validation_t *entry = (oc_cert_validation_t *)data;
+  if (compare_x509_time(&crt->valid_from, &entry->valid_from) > 0) {
+    memcpy(&entry->valid_from, &crt->valid_from, sizeof(entry->valid_from));
+  }
+  if (entry->valid_to.year == 0 ||
+      compare_x509_time(&crt->valid_to, &entry->valid_to) < 0) {
+    memcpy(&entry->valid_to, &crt->valid_to, sizeof(entry->valid_to));
+  }
+  return 0;
+}
+
+int
+oc_certs_verify_chain(mbedtls_x509_crt *chain, mbedtls_x509_crt *trust_ca)
+{
+  uint32_t flags = 0;
+  const mbedtls_md_info_t *md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+  unsigned char digest[MBEDTLS_MD_MAX_SIZE];
+  mbedtls_md_context_t ctx;
+  mbedtls_md_init(&ctx);
+  int ret = mbedtls_md_setup(&ctx, md, 0);
+  if (ret == 0) {
+    ret = mbedtls_md_starts(&ctx);
+  }
+  int length = 0;
+  const mbedtls_x509_crt *c = chain;
+  for (; ret == 0 && c != NULL && c->raw.len > 0; c = c->next, length++) {
+    ret = mbedtls_md_update(&ctx, c->raw.p, c->raw.len);
+  }
+  if (ret == 0) {
+    ret = mbedtls_md_finish(&ctx, digest);
+  }
+  mbedtls_md_free(&ctx);
+  if (ret != 0) {
+    OC_WRN("unable to hash certificate chain, verifying it uncached");
+    ret = mbedtls_x509_crt_verify_with_profile(
+      chain, trust_ca, NULL, &mbedtls_x509_crt_profile_default, NULL, &flags,
+      NULL, NULL);
+    return (ret != 0 || flags != 0) ? -1 : 0;
+  }
+
+  oc_cert_validation_t entry;
+  if (lookup_validation(digest, CERT_CHECK_CHAIN, length, &entry)) {
+    OC_DBG("using cached certificate chain verification result");
+  } else {
+    ret = mbedtls_x509_crt_verify_with_profile(
+      chain, trust_ca, NULL, &mbedtls_x509_crt_profile_default, NULL, &flags,
+      collect_chain_validity, &entry);
+    entry.result = (ret != 0 || flags != 0) ? -1 : 0;
+    /* a certificate not yet or no longer valid may be fine some other time */
+    if (entry.result == 0 ||
+        (flags & ~(MBEDTLS_X509_BADCERT_EXPIRED | MBEDTLS_X509_BADCERT_FUTURE |
+                   MBEDTLS_X509_BADCRL_EXPIRED | MBEDTLS_X509_BADCRL_FUTURE)) !=
+          0) {
+      cache_validation(&entry);
+    }
+  }
+
+  if (entry.result < 0) {
+    OC_WRN("certificate chain verification failed");
+    return -1;
+  }
+  return validate_validity_period(&entry.valid_from, &entry.valid_to);
+}
+
 int
 oc_certs_is_subject_the_issuer(mbedtls_x509_crt *issuer,
                                mbedtls_x509_crt *child)
@@ -26,6 +26,10 @@
 extern "C" {
 #endif
 
+#ifndef OC_CERTS_VALIDATION_CACHE_SIZE
+#define OC_CERTS_VALIDATION_CACHE_SIZE (16)
+#endif /* !OC_CERTS_VALIDATION_CACHE_SIZE */
+
 int oc_certs_parse_CN_for_UUID(const mbedtls_x509_crt *cert,
                                oc_string_t *subjectuuid);
 int oc_certs_parse_CN_for_UUID_raw(const unsigned char *cert, size_t cert_size,
@@ -45,6 +49,17 @@ int oc_certs_validate_end_entity_cert(const mbedtls_x509_crt *ee_cert);
 
 int oc_certs_validate_role_cert(const mbedtls_x509_crt *role_cert);
 
+/* Verify that chain was issued by one of trust_ca. The result is cached with
+ * those of the above validations. */
+int oc_certs_verify_chain(mbedtls_x509_crt *chain, mbedtls_x509_crt *trust_ca);
+
+/* Forget the results of the above validations. */
+void oc_certs_clear_validation_cache(void);
+
+/* Start a new generation of trust anchors, results cached under the previous
+ * one are no longer used. */
+void oc_certs_trust_anchors_changed(void);
+
 int oc_certs_is_subject_the_issuer(mbedtls_x509_crt *issuer,
                                    mbedtls_x509_crt *child);
 
@@ -152,6 +152,10 @@ get_new_credid(bool roles_resource, oc_tls_peer_t *client, size_t device)
 void
 oc_sec_remove_cred(oc_sec_cred_t *cred, size_t device)
 {
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  /* handshakes on the worker threads look up credentials */
+  oc_tls_handshake_drain();
+#endif /* OC_TLS_HANDSHAKE_THREADS */
   oc_list_remove(devices[device].creds, cred);
   if (oc_string_len(cred->role.role) > 0) {
 #if defined(OC_PKI) && defined(OC_CLIENT)
@@ -346,6 +350,9 @@ oc_sec_add_new_cred(size_t device, bool roles_resource, oc_tls_peer_t *client,
   (void)publicdata;
   (void)publicdata_size;
   (void)get_device_uuid;
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  oc_tls_handshake_drain();
+#endif /* OC_TLS_HANDSHAKE_THREADS */
 #ifdef OC_PKI
   oc_string_t public_key;
   memset(&public_key, 0, sizeof(oc_string_t));
@@ -106,6 +106,10 @@ oc_sec_doxm_default(size_t device)
     }
   }
 
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  /* handshakes on the worker threads read oxmsel and the deviceuuid */
+  oc_tls_handshake_drain();
+#endif /* OC_TLS_HANDSHAKE_THREADS */
   doxm[device].oxmsel = 0;
 #ifdef OC_PKI
   doxm[device].sct = 9;
@@ -286,6 +290,9 @@ oc_sec_decode_doxm(oc_rep_t *rep, bool from_storage, size_t device)
     t = t->next;
   }
 
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  oc_tls_handshake_drain();
+#endif /* OC_TLS_HANDSHAKE_THREADS */
   while (rep != NULL) {
     len = oc_string_len(rep->name);
     switch (rep->type) {
@@ -270,7 +270,8 @@ oc_obt_load_state(void)
 
   ret = oc_storage_read("obt_state", buf, OC_MAX_APP_DATA_SIZE);
   if (ret > 0) {
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
     oc_rep_set_pool(&rep_objects);
     int err = oc_parse_rep(buf, ret, &rep);
     head = rep;
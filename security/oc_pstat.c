@@ -137,6 +137,9 @@ oc_pstat_handle_state(oc_sec_pstat_t *ps, size_t device, bool from_storage,
                       bool self_reset)
 {
   OC_DBG("oc_pstat: Entering pstat_handle_state");
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  oc_tls_handshake_drain();
+#endif /* OC_TLS_HANDSHAKE_THREADS */
   oc_sec_acl_t *acl = oc_sec_get_acl(device);
   oc_sec_doxm_t *doxm = oc_sec_get_doxm(device);
   oc_sec_creds_t *creds = oc_sec_get_creds(device);
@@ -467,6 +470,10 @@ bool
 oc_sec_decode_pstat(oc_rep_t *rep, bool from_storage, size_t device)
 {
   bool transition_state = false, target_mode = false;
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  /* handshakes on the worker threads read the device state */
+  oc_tls_handshake_drain();
+#endif /* OC_TLS_HANDSHAKE_THREADS */
   oc_sec_pstat_t ps;
   memcpy(&ps, &pstat[device], sizeof(oc_sec_pstat_t));
 
@@ -75,9 +75,10 @@ oc_sec_load_doxm(size_t device)
     memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
     struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                    rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
@@ -118,9 +119,10 @@ oc_sec_load_pstat(size_t device)
     memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
     struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                    rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
@@ -162,9 +164,10 @@ oc_sec_load_sp(size_t device)
     memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
     struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                    rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
@@ -231,9 +234,10 @@ oc_sec_load_ecdsa_keypair(size_t device)
     memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
     struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                    rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
@@ -304,9 +308,10 @@ oc_sec_load_cred(size_t device)
     memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
     struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                    rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
@@ -343,9 +348,10 @@ oc_sec_load_acl(size_t device)
     memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
     struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                    rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
@@ -480,9 +486,10 @@ oc_sec_load_unique_ids(size_t device)
     memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
     struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                    rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
     int err = oc_parse_rep(buf, ret, &rep);
@@ -600,9 +607,10 @@ oc_sec_load_sdi(size_t device)
     memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
     struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                    rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
@@ -641,9 +649,10 @@ oc_sec_load_ael(size_t device)
     memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
     struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
                                    rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0,
+                                   0 OC_MEMB_TRACE_NAME(rep_objects) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
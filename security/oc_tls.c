@@ -37,6 +37,7 @@
 
 #include "api/oc_events.h"
 #include "api/oc_main.h"
+#include "api/oc_metrics_internal.h"
 #include "api/oc_session_events_internal.h"
 #include "messaging/coap/observe.h"
 #include "messaging/coap/engine.h"
@@ -55,10 +56,66 @@
 #include "oc_tls.h"
 #include "oc_audit.h"
 
+#ifdef OC_TLS_HANDSHAKE_THREADS
+#ifndef OC_DYNAMIC_ALLOCATION
+#error "OC_TLS_HANDSHAKE_THREADS requires OC_DYNAMIC_ALLOCATION"
+#endif /* !OC_DYNAMIC_ALLOCATION */
+#include "oc_signal_event_loop.h"
+#include <pthread.h>
+#include <stdlib.h>
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+
 OC_PROCESS(oc_tls_handler, "TLS Process");
 OC_MEMB(tls_peers_s, oc_tls_peer_t, OC_MAX_TLS_PEERS);
 OC_LIST(tls_peers);
 
+#ifdef OC_TLS_HANDSHAKE_THREADS
+/* Handshake steps of one peer handed to a worker thread. While the job is out
+ * the worker alone drives the peer's mbedtls context. Records it writes, the
+ * timer it sets and audit events it raises are kept here, and applied on the
+ * event loop once the job comes back through a TLS_HANDSHAKE_DONE event. */
+typedef struct oc_tls_handshake_job_t
+{
+  struct oc_tls_handshake_job_t *next;
+  oc_tls_peer_t *peer;
+  OC_LIST_STRUCT(recv_q);
+  uint8_t *records; /* each record follows its length as a uint32_t */
+  size_t records_len;
+  size_t records_size;
+  int timer; /* what ssl_get_timer() answers on the worker */
+  bool timer_expired;
+  bool timer_set;
+  uint32_t int_ms;
+  uint32_t fin_ms;
+  const char *audit_aeid;
+  const char *audit_message;
+  uint8_t audit_category;
+  uint8_t audit_priority;
+  bool failed;   /* the peer must be freed */
+  bool released; /* the peer was freed on the event loop meanwhile */
+} oc_tls_handshake_job_t;
+
+static pthread_t handshake_threads[OC_TLS_HANDSHAKE_THREADS];
+static size_t num_handshake_threads;
+static pthread_mutex_t handshake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t handshake_cond = PTHREAD_COND_INITIALIZER;
+static size_t handshakes_out; /* jobs waiting or running */
+static bool handshake_terminate;
+OC_LIST(handshake_jobs);
+OC_LIST(completed_handshakes);
+/* the DRBG and the cookie context are shared by all handshakes */
+static pthread_mutex_t crypto_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* So are the identity keys and the trust anchors. Without
+ * MBEDTLS_THREADING_C, mbedtls caches precomputed points in their EC groups
+ * on first use, so the steps using them run one at a time. */
+static pthread_mutex_t keys_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+OC_PROCESS(oc_tls_handshake_events, "");
+
+static void start_handshake_threads(void);
+static void stop_handshake_threads(void);
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+
 static mbedtls_entropy_context entropy_ctx;
 static mbedtls_ctr_drbg_context ctr_drbg_ctx;
 static mbedtls_ssl_cookie_ctx cookie_ctx;
@@ -66,9 +123,13 @@ static oc_random_pin_t random_pin;
 unsigned char PIN[8];
 #define PIN_LEN (8)
 
+static void wait_for_handshakes(void);
+
 void
 oc_tls_generate_random_pin(void)
 {
+  /* get_psk_cb() reads the PIN on the handshake threads */
+  wait_for_handshakes();
   int p = 0;
   while (p < PIN_LEN) {
     PIN[p++] = oc_random_value() % 10 + 48;
@@ -105,6 +166,7 @@ oc_auto_assert_roles(bool auto_assert)
 typedef struct oc_x509_cacrt_t
 {
   struct oc_x509_cacrt_t *next;
+  struct oc_x509_cacrt_t *bucket_next;
   size_t device;
   oc_sec_cred_t *cred;
   mbedtls_x509_crt *cert;
@@ -113,6 +175,11 @@ typedef struct oc_x509_cacrt_t
 OC_MEMB(ca_certs_s, oc_x509_cacrt_t, OC_MAX_NUM_DEVICES);
 OC_LIST(ca_certs);
 
+/* Trust anchors hashed by their subject DN, for matching the certificates
+ * of a peer's chain against them */
+#define TRUST_ANCHOR_BUCKETS (8)
+static oc_x509_cacrt_t *trust_anchor_index[TRUST_ANCHOR_BUCKETS];
+
 typedef struct oc_x509_crt_t
 {
   struct oc_x509_crt_t *next;
@@ -120,7 +187,6 @@ typedef struct oc_x509_crt_t
   oc_sec_cred_t *cred;
   mbedtls_x509_crt cert;
   mbedtls_pk_context pk;
-  oc_x509_cacrt_t *ctx;
 } oc_x509_crt_t;
 
 #include "oc_certs.h"
@@ -261,17 +327,54 @@ is_peer_active(oc_tls_peer_t *peer)
   return false;
 }
 
-static oc_event_callback_retval_t oc_tls_inactive(void *data);
+/* A peer is busy while a worker thread runs its handshake. */
+static bool
+peer_busy(const oc_tls_peer_t *peer)
+{
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  return peer->job != NULL;
+#else  /* OC_TLS_HANDSHAKE_THREADS */
+  (void)peer;
+  return false;
+#endif /* !OC_TLS_HANDSHAKE_THREADS */
+}
 
-#ifdef OC_CLIENT
 static void
-oc_tls_free_invalid_peer(oc_tls_peer_t *peer)
+wait_for_handshakes(void)
 {
-  OC_DBG("\noc_tls: removing invalid peer");
-  oc_list_remove(tls_peers, peer);
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  oc_tls_handshake_drain();
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+}
 
-  oc_ri_remove_timed_event_callback(peer, oc_tls_inactive);
+static oc_event_callback_retval_t oc_tls_inactive(void *data);
+
+static int peers_with_output;
+
+static void
+flush_output(oc_tls_peer_t *peer)
+{
+  oc_message_t *out = peer->out;
+  if (!out) {
+    return;
+  }
+  peer->out = NULL;
+  peers_with_output--;
+  if (out->length > 0) {
+    out->encrypted = 1;
+    oc_send_buffer(out);
+  }
+  oc_message_unref(out);
+}
 
+static void
+release_peer(oc_tls_peer_t *peer)
+{
+  if (peer->out) {
+    oc_message_unref(peer->out);
+    peer->out = NULL;
+    peers_with_output--;
+  }
   mbedtls_ssl_free(&peer->ssl_ctx);
   oc_message_t *message = (oc_message_t *)oc_list_pop(peer->send_q);
   while (message != NULL) {
@@ -290,13 +393,51 @@ oc_tls_free_invalid_peer(oc_tls_peer_t *peer)
   oc_etimer_stop(&peer->timer.fin_timer);
   oc_memb_free(&tls_peers_s, peer);
 }
+
+#ifdef OC_TLS_HANDSHAKE_THREADS
+static bool
+defer_release(oc_tls_peer_t *peer)
+{
+  if (!peer->job) {
+    return false;
+  }
+  /* released once the worker returns the peer, see complete_handshake() */
+  peer->job->released = true;
+  return true;
+}
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+
+#ifdef OC_CLIENT
+static void
+oc_tls_free_invalid_peer(oc_tls_peer_t *peer)
+{
+  OC_DBG("\noc_tls: removing invalid peer");
+  oc_list_remove(tls_peers, peer);
+
+  oc_ri_remove_timed_event_callback(peer, oc_tls_inactive);
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  if (defer_release(peer)) {
+    return;
+  }
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+  release_peer(peer);
+}
 #endif /* OC_CLIENT */
 
 static void
 oc_tls_free_peer(oc_tls_peer_t *peer, bool inactivity_cb)
 {
   OC_DBG("\noc_tls: removing peer");
+  /* a close_notify may still be waiting in the batch */
+  flush_output(peer);
   oc_list_remove(tls_peers, peer);
+  OC_METRICS_GAUGE_SET(OC_METRICS_TLS_PEERS, oc_list_length(tls_peers));
+#ifdef OC_METRICS
+  if (peer->handshaking) {
+    peer->handshaking = false;
+    OC_METRICS_INC(OC_METRICS_TLS_HANDSHAKES_FAILED);
+  }
+#endif /* OC_METRICS */
 #ifdef OC_SERVER
   /* remove all observations by this peer */
   coap_remove_observer_by_client(&peer->endpoint);
@@ -327,23 +468,12 @@ oc_tls_free_peer(oc_tls_peer_t *peer, bool inactivity_cb)
   if (!inactivity_cb) {
     oc_ri_remove_timed_event_callback(peer, oc_tls_inactive);
   }
-  mbedtls_ssl_free(&peer->ssl_ctx);
-  oc_message_t *message = (oc_message_t *)oc_list_pop(peer->send_q);
-  while (message != NULL) {
-    oc_message_unref(message);
-    message = (oc_message_t *)oc_list_pop(peer->send_q);
-  }
-  message = (oc_message_t *)oc_list_pop(peer->recv_q);
-  while (message != NULL) {
-    oc_message_unref(message);
-    message = (oc_message_t *)oc_list_pop(peer->recv_q);
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  if (defer_release(peer)) {
+    return;
   }
-#ifdef OC_PKI
-  oc_free_string(&peer->public_key);
-#endif /* OC_PKI */
-  mbedtls_ssl_config_free(&peer->ssl_conf);
-  oc_etimer_stop(&peer->timer.fin_timer);
-  oc_memb_free(&tls_peers_s, peer);
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+  release_peer(peer);
 }
 
 oc_tls_peer_t *
@@ -414,16 +544,18 @@ oc_tls_inactive(void *data)
   OC_DBG("oc_tls: DTLS inactivity callback");
   oc_tls_peer_t *peer = (oc_tls_peer_t *)data;
   if (is_peer_active(peer)) {
-    oc_clock_time_t time = oc_clock_time();
+    oc_clock_time_t time = oc_clock_loop_time();
     time -= peer->timestamp;
     if (time < (oc_clock_time_t)OC_DTLS_INACTIVITY_TIMEOUT *
                  (oc_clock_time_t)OC_CLOCK_SECOND) {
       OC_DBG("oc_tls: Resetting DTLS inactivity callback");
       return OC_EVENT_CONTINUE;
     }
-    mbedtls_ssl_close_notify(&peer->ssl_ctx);
-    if ((peer->endpoint.flags & TCP) == 0) {
+    if (!peer_busy(peer)) {
       mbedtls_ssl_close_notify(&peer->ssl_ctx);
+      if ((peer->endpoint.flags & TCP) == 0) {
+        mbedtls_ssl_close_notify(&peer->ssl_ctx);
+      }
     }
     oc_tls_free_peer(peer, true);
   }
@@ -435,17 +567,27 @@ static int
 ssl_recv(void *ctx, unsigned char *buf, size_t len)
 {
   oc_tls_peer_t *peer = (oc_tls_peer_t *)ctx;
-  oc_message_t *message = (oc_message_t *)oc_list_head(peer->recv_q);
+  oc_list_t recv_q = peer->recv_q;
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  if (peer->job) {
+    recv_q = peer->job->recv_q;
+  }
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+  oc_message_t *message = (oc_message_t *)oc_list_head(recv_q);
   if (message) {
     size_t recv_len = 0;
+#ifdef OC_REQUEST_TRACE
+    memcpy(peer->trace, message->trace, sizeof(peer->trace));
+#endif /* OC_REQUEST_TRACE */
 #ifdef OC_TCP
     if (message->endpoint.flags & TCP) {
       recv_len = message->length - message->read_offset;
       recv_len = (recv_len < len) ? recv_len : len;
       memcpy(buf, message->data + message->read_offset, recv_len);
+      oc_message_count_copy(message, recv_len);
       message->read_offset += recv_len;
       if (message->read_offset == message->length) {
-        oc_list_remove(peer->recv_q, message);
+        oc_list_remove(recv_q, message);
         oc_message_unref(message);
       }
     } else
@@ -453,7 +595,8 @@ ssl_recv(void *ctx, unsigned char *buf, size_t len)
     {
       recv_len = (message->length < len) ? message->length : len;
       memcpy(buf, message->data, recv_len);
-      oc_list_remove(peer->recv_q, message);
+      oc_message_count_copy(message, recv_len);
+      oc_list_remove(recv_q, message);
       oc_message_unref(message);
     }
     return (int)recv_len;
@@ -462,26 +605,109 @@ ssl_recv(void *ctx, unsigned char *buf, size_t len)
 }
 
 static int
-ssl_send(void *ctx, const unsigned char *buf, size_t len)
+send_record(oc_tls_peer_t *peer, const unsigned char *buf, size_t len)
 {
-  oc_tls_peer_t *peer = (oc_tls_peer_t *)ctx;
-  peer->timestamp = oc_clock_time();
   oc_message_t message;
-#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
-  message.data = malloc(OC_PDU_SIZE);
-  if (!message.data)
-    return 0;
-#endif /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
   memcpy(&message.endpoint, &peer->endpoint, sizeof(oc_endpoint_t));
   size_t send_len = (len < (unsigned)OC_PDU_SIZE) ? len : (unsigned)OC_PDU_SIZE;
+#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
+  /* the record was encrypted in place in the output buffer of mbedtls and
+   * oc_send_buffer() only reads it, so it is sent from there */
+  message.data = (uint8_t *)buf;
+#else  /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFFER_SIZE */
   memcpy(message.data, buf, send_len);
+  oc_message_count_copy(NULL, send_len);
+#endif /* !OC_DYNAMIC_ALLOCATION || OC_INOUT_BUFFER_SIZE */
   message.length = send_len;
   message.encrypted = 1;
-  int ret = oc_send_buffer(&message);
-#if defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_INOUT_BUFFER_SIZE)
-  free(message.data);
-#endif /* OC_DYNAMIC_ALLOCATION && !OC_INOUT_BUFER_SIZE */
-  return ret;
+  return oc_send_buffer(&message);
+}
+
+static void
+flush_all_output(void)
+{
+  oc_tls_peer_t *peer = (oc_tls_peer_t *)oc_list_head(tls_peers);
+  while (peers_with_output > 0 && peer != NULL) {
+    flush_output(peer);
+    peer = peer->next;
+  }
+}
+
+/* Records written over TCP, and those of a handshake flight over UDP, are
+ * gathered in an outgoing message of the pool and leave together once the
+ * TLS handler is done with its event. Application data over UDP is sent
+ * record by record as receivers only read one record per datagram.
+ */
+static bool
+batch_output(oc_tls_peer_t *peer)
+{
+#ifdef OC_TCP
+  if (peer->endpoint.flags & TCP) {
+    return true;
+  }
+#endif /* OC_TCP */
+  return peer->ssl_ctx.state != MBEDTLS_SSL_HANDSHAKE_OVER;
+}
+
+#ifdef OC_TLS_HANDSHAKE_THREADS
+static int
+keep_record(oc_tls_handshake_job_t *job, const unsigned char *buf, size_t len)
+{
+  uint32_t record_len = (uint32_t)len;
+  size_t needed = job->records_len + sizeof(record_len) + len;
+  if (needed > job->records_size) {
+    size_t size =
+      (job->records_size > 0) ? job->records_size : (size_t)OC_PDU_SIZE;
+    while (size < needed) {
+      size *= 2;
+    }
+    uint8_t *records = (uint8_t *)realloc(job->records, size);
+    if (!records) {
+      return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    job->records = records;
+    job->records_size = size;
+  }
+  memcpy(job->records + job->records_len, &record_len, sizeof(record_len));
+  memcpy(job->records + job->records_len + sizeof(record_len), buf, len);
+  job->records_len = needed;
+  return (int)len;
+}
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+
+static int
+ssl_send(void *ctx, const unsigned char *buf, size_t len)
+{
+  oc_tls_peer_t *peer = (oc_tls_peer_t *)ctx;
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  if (peer->job) {
+    /* sent from the event loop, see complete_handshake() */
+    return keep_record(peer->job, buf, len);
+  }
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+  peer->timestamp = oc_clock_loop_time();
+  if (!batch_output(peer)) {
+    flush_output(peer);
+    return send_record(peer, buf, len);
+  }
+  if (peer->out && len > oc_message_tailroom(peer->out)) {
+    flush_output(peer);
+  }
+  if (!peer->out) {
+    peer->out = oc_internal_allocate_outgoing_message();
+    if (!peer->out) {
+      return send_record(peer, buf, len);
+    }
+    memcpy(&peer->out->endpoint, &peer->endpoint, sizeof(oc_endpoint_t));
+    peers_with_output++;
+  }
+  if (len > oc_message_tailroom(peer->out)) {
+    return send_record(peer, buf, len);
+  }
+  memcpy(peer->out->data + peer->out->length, buf, len);
+  peer->out->length += len;
+  oc_message_count_copy(peer->out, len);
+  return (int)len;
 }
 
 static void
@@ -490,7 +716,8 @@ check_retr_timers(void)
   oc_tls_peer_t *peer = (oc_tls_peer_t *)oc_list_head(tls_peers), *next;
   while (peer != NULL) {
     next = peer->next;
-    if (peer->ssl_ctx.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+    if (!peer_busy(peer) &&
+        peer->ssl_ctx.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
       if (oc_etimer_expired(&peer->timer.fin_timer)) {
         int ret = mbedtls_ssl_handshake(&peer->ssl_ctx);
         if (ret == MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED) {
@@ -522,8 +749,19 @@ check_retr_timers(void)
 static void
 ssl_set_timer(void *ctx, uint32_t int_ms, uint32_t fin_ms)
 {
+  oc_tls_peer_t *peer = (oc_tls_peer_t *)ctx;
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  if (peer->job) {
+    /* the etimer belongs to the event loop, see complete_handshake() */
+    peer->job->timer_set = true;
+    peer->job->int_ms = int_ms;
+    peer->job->fin_ms = fin_ms;
+    peer->job->timer = (fin_ms != 0) ? 0 : -1;
+    return;
+  }
+#endif /* OC_TLS_HANDSHAKE_THREADS */
   if (fin_ms != 0) {
-    oc_tls_retr_timer_t *timer = (oc_tls_retr_timer_t *)ctx;
+    oc_tls_retr_timer_t *timer = &peer->timer;
     timer->int_ticks = (oc_clock_time_t)((int_ms * OC_CLOCK_SECOND) / 1.e03);
     oc_etimer_stop(&timer->fin_timer);
     timer->fin_timer.timer.interval =
@@ -563,6 +801,16 @@ static void
 oc_tls_audit_log(const char *aeid, const char *message, uint8_t category,
                  uint8_t priority, oc_tls_peer_t *peer)
 {
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  if (peer && peer->job) {
+    /* the audit log belongs to the event loop, see complete_handshake() */
+    peer->job->audit_aeid = aeid;
+    peer->job->audit_message = message;
+    peer->job->audit_category = category;
+    peer->job->audit_priority = priority;
+    return;
+  }
+#endif /* OC_TLS_HANDSHAKE_THREADS */
   char buff[IPADDR_BUFF_SIZE];
   if (peer) {
     SNPRINTFipaddr(buff, IPADDR_BUFF_SIZE, peer->endpoint);
@@ -578,16 +826,9 @@ static int
 get_psk_cb(void *data, mbedtls_ssl_context *ssl, const unsigned char *identity,
            size_t identity_len)
 {
-  (void)data;
   (void)identity_len;
   OC_DBG("oc_tls: In PSK callback");
-  oc_tls_peer_t *peer = oc_list_head(tls_peers);
-  while (peer != NULL) {
-    if (&peer->ssl_ctx == ssl) {
-      break;
-    }
-    peer = peer->next;
-  }
+  oc_tls_peer_t *peer = (oc_tls_peer_t *)data;
   if (peer) {
     OC_DBG("oc_tls: Found peer object");
     oc_sec_cred_t *cred =
@@ -640,22 +881,47 @@ get_psk_cb(void *data, mbedtls_ssl_context *ssl, const unsigned char *identity,
 }
 
 static int
-ssl_get_timer(void *ctx)
+timer_state(oc_tls_retr_timer_t *timer)
 {
-  oc_tls_retr_timer_t *timer = (oc_tls_retr_timer_t *)ctx;
   if (timer->fin_timer.timer.interval == 0)
     return -1;
   if (oc_etimer_expired(&timer->fin_timer)) {
-    timer->fin_timer.timer.interval = 0;
-    timer->int_ticks = 0;
     return 2;
-  } else if (oc_clock_time() >
+  } else if (oc_clock_loop_time() >
              (timer->fin_timer.timer.start + timer->int_ticks)) {
     return 1;
   }
   return 0;
 }
 
+static void
+reset_expired_timer(oc_tls_retr_timer_t *timer)
+{
+  timer->fin_timer.timer.interval = 0;
+  timer->int_ticks = 0;
+}
+
+static int
+ssl_get_timer(void *ctx)
+{
+  oc_tls_peer_t *peer = (oc_tls_peer_t *)ctx;
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  if (peer->job) {
+    int state = peer->job->timer;
+    if (state == 2) {
+      peer->job->timer_expired = true;
+      peer->job->timer = -1;
+    }
+    return state;
+  }
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+  int state = timer_state(&peer->timer);
+  if (state == 2) {
+    reset_expired_timer(&peer->timer);
+  }
+  return state;
+}
+
 #ifdef OC_PKI
 typedef bool (*check_if_known_cert_cb)(oc_sec_cred_t *cred);
 typedef void (*add_new_cert_cb)(oc_sec_cred_t *cred, size_t device);
@@ -847,6 +1113,7 @@ void
 oc_tls_refresh_identity_certs(void)
 {
   OC_DBG("refreshing identity certs");
+  wait_for_handshakes();
   oc_tls_refresh_certs(OC_CREDUSAGE_MFG_CERT | OC_CREDUSAGE_IDENTITY_CERT,
                        is_known_identity_cert, add_new_identity_cert);
 }
@@ -854,6 +1121,7 @@ oc_tls_refresh_identity_certs(void)
 void
 oc_tls_remove_identity_cert(oc_sec_cred_t *cred)
 {
+  wait_for_handshakes();
   oc_x509_crt_t *cert = (oc_x509_crt_t *)oc_list_head(identity_certs);
   while (cert != NULL && cert->cred != cred) {
     cert = cert->next;
@@ -866,18 +1134,75 @@ oc_tls_remove_identity_cert(oc_sec_cred_t *cred)
   }
 }
 
-void
-oc_tls_remove_trust_anchor(oc_sec_cred_t *cred)
+static size_t
+trust_anchor_bucket(const mbedtls_x509_buf *subject)
 {
-  oc_x509_cacrt_t *cert = (oc_x509_cacrt_t *)oc_list_head(ca_certs);
-  while (cert && cert->cred != cred) {
-    cert = cert->next;
+  /* FNV-1a */
+  uint32_t hash = 2166136261u;
+  size_t i;
+  for (i = 0; i < subject->len; i++) {
+    hash ^= subject->p[i];
+    hash *= 16777619u;
   }
-  if (cert) {
-    oc_list_remove(ca_certs, cert);
-    oc_memb_free(&ca_certs_s, cert);
+  return hash % TRUST_ANCHOR_BUCKETS;
+}
+
+static void
+index_trust_anchor(oc_x509_cacrt_t *cert)
+{
+  oc_x509_cacrt_t **slot =
+    &trust_anchor_index[trust_anchor_bucket(&cert->cert->subject_raw)];
+  while (*slot) {
+    slot = &(*slot)->bucket_next;
+  }
+  cert->bucket_next = NULL;
+  *slot = cert;
+}
+
+/* Returns the first trustca of device from cert onwards in its bucket whose
+ * certificate is crt. */
+static oc_x509_cacrt_t *
+match_trust_anchor(oc_x509_cacrt_t *cert, const mbedtls_x509_crt *crt,
+                   size_t device)
+{
+  for (; cert != NULL; cert = cert->bucket_next) {
+    if (cert->device == device &&
+        cert->cred->credusage == OC_CREDUSAGE_TRUSTCA &&
+        crt->raw.len == cert->cert->raw.len &&
+        memcmp(crt->raw.p, cert->cert->raw.p, crt->raw.len) == 0) {
+      return cert;
+    }
   }
+  return NULL;
+}
+
+static oc_x509_cacrt_t *
+find_trust_anchor(const mbedtls_x509_crt *crt, size_t device)
+{
+  return match_trust_anchor(
+    trust_anchor_index[trust_anchor_bucket(&crt->subject_raw)], crt, device);
+}
+
+static void
+clear_trust_anchors(void)
+{
+  oc_x509_cacrt_t *ca = (oc_x509_cacrt_t *)oc_list_pop(ca_certs);
+  while (ca) {
+    oc_memb_free(&ca_certs_s, ca);
+    ca = (oc_x509_cacrt_t *)oc_list_pop(ca_certs);
+  }
+  memset(trust_anchor_index, 0, sizeof(trust_anchor_index));
   mbedtls_x509_crt_free(&trust_anchors);
+}
+
+void
+oc_tls_remove_trust_anchor(oc_sec_cred_t *cred)
+{
+  (void)cred;
+  wait_for_handshakes();
+  /* The remaining trust anchors point into the parsed chain, so rebuild all
+   * of them from their credentials, which no longer include cred. */
+  clear_trust_anchors();
   mbedtls_x509_crt_init(&trust_anchors);
   oc_tls_refresh_trust_anchors();
 }
@@ -962,6 +1287,7 @@ add_new_trust_anchor(oc_sec_cred_t *cred, size_t device)
   cert->cert = c;
 
   oc_list_add(ca_certs, cert);
+  index_trust_anchor(cert);
 
   OC_DBG("adding new trust anchor");
 }
@@ -970,8 +1296,10 @@ void
 oc_tls_refresh_trust_anchors(void)
 {
   OC_DBG("refreshing trust anchors");
+  wait_for_handshakes();
   oc_tls_refresh_certs(OC_CREDUSAGE_MFG_TRUSTCA | OC_CREDUSAGE_TRUSTCA,
                        is_known_trust_anchor, add_new_trust_anchor);
+  oc_certs_trust_anchors_changed();
 }
 
 #ifdef OC_CLIENT
@@ -1142,16 +1470,9 @@ verify_certificate(void *opq, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
       }
     } else {
       if (id_cert && id_cert->cred->credusage == OC_CREDUSAGE_IDENTITY_CERT) {
-        oc_x509_cacrt_t *ca_cert = (oc_x509_cacrt_t *)oc_list_head(ca_certs);
-        while (ca_cert) {
-          if (ca_cert->device == id_cert->device &&
-              ca_cert->cred->credusage == OC_CREDUSAGE_TRUSTCA &&
-              crt->raw.len == ca_cert->cert->raw.len &&
-              memcmp(crt->raw.p, ca_cert->cert->raw.p, crt->raw.len) == 0) {
-            id_cert->ctx = ca_cert;
-            break;
-          }
-          ca_cert = ca_cert->next;
+        oc_x509_cacrt_t *ca_cert = find_trust_anchor(crt, id_cert->device);
+        if (ca_cert) {
+          peer->root_cert = ca_cert->cert;
         }
       }
     }
@@ -1194,25 +1515,18 @@ verify_certificate(void *opq, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
       wildcard_sub.id[0] = '*';
 
       /* Get a handle to the peer's root certificate */
-      if (!id_cert->ctx || !id_cert->ctx->cert) {
+      if (!peer->root_cert) {
         OC_DBG("could not find peer's root certificate");
         return -1;
       }
-      mbedtls_x509_crt *root_crt = id_cert->ctx->cert;
+      mbedtls_x509_crt *root_crt = peer->root_cert;
 
       OC_DBG(
         "looking for a matching trustca entry currently tracked by oc_tls");
-      oc_x509_cacrt_t *ca_cert = (oc_x509_cacrt_t *)oc_list_head(ca_certs);
-      for (; ca_cert != NULL && ca_cert->device == id_cert->device &&
-             ca_cert->cred->credusage == OC_CREDUSAGE_TRUSTCA;
-           ca_cert = ca_cert->next) {
-        if (root_crt->raw.len == ca_cert->cert->raw.len &&
-            memcmp(root_crt->raw.p, ca_cert->cert->raw.p, root_crt->raw.len) ==
-              0) {
-        } else {
-          OC_DBG("trustca mismatch, check next known trustca");
-          continue;
-        }
+      oc_x509_cacrt_t *ca_cert = find_trust_anchor(root_crt, id_cert->device);
+      for (; ca_cert != NULL;
+           ca_cert = match_trust_anchor(ca_cert->bucket_next, root_crt,
+                                        id_cert->device)) {
         OC_DBG("found matching trustca; check if trustca's cred entry has a "
                "UUID matching with the peer's UUID, or *");
 #ifdef OC_DEBUG
@@ -1252,6 +1566,42 @@ verify_certificate(void *opq, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
 }
 #endif /* OC_PKI */
 
+#ifdef OC_TLS_HANDSHAKE_THREADS
+static int
+ssl_random(void *ctx, unsigned char *output, size_t len)
+{
+  pthread_mutex_lock(&crypto_mutex);
+  int ret = mbedtls_ctr_drbg_random(ctx, output, len);
+  pthread_mutex_unlock(&crypto_mutex);
+  return ret;
+}
+
+static int
+ssl_cookie_write(void *ctx, unsigned char **p, unsigned char *end,
+                 const unsigned char *cli_id, size_t cli_id_len)
+{
+  pthread_mutex_lock(&crypto_mutex);
+  int ret = mbedtls_ssl_cookie_write(ctx, p, end, cli_id, cli_id_len);
+  pthread_mutex_unlock(&crypto_mutex);
+  return ret;
+}
+
+static int
+ssl_cookie_check(void *ctx, const unsigned char *cookie, size_t cookie_len,
+                 const unsigned char *cli_id, size_t cli_id_len)
+{
+  pthread_mutex_lock(&crypto_mutex);
+  int ret =
+    mbedtls_ssl_cookie_check(ctx, cookie, cookie_len, cli_id, cli_id_len);
+  pthread_mutex_unlock(&crypto_mutex);
+  return ret;
+}
+#else /* OC_TLS_HANDSHAKE_THREADS */
+#define ssl_random mbedtls_ctr_drbg_random
+#define ssl_cookie_write mbedtls_ssl_cookie_write
+#define ssl_cookie_check mbedtls_ssl_cookie_check
+#endif /* !OC_TLS_HANDSHAKE_THREADS */
+
 static int
 oc_tls_populate_ssl_config(mbedtls_ssl_config *conf, size_t device, int role,
                            int transport_type)
@@ -1284,17 +1634,16 @@ oc_tls_populate_ssl_config(mbedtls_ssl_config *conf, size_t device, int role,
   mbedtls_ssl_conf_dbg(conf, oc_mbedtls_debug, stdout);
 #endif /* OC_DEBUG */
 
-  mbedtls_ssl_conf_rng(conf, mbedtls_ctr_drbg_random, &ctr_drbg_ctx);
+  mbedtls_ssl_conf_rng(conf, ssl_random, &ctr_drbg_ctx);
   mbedtls_ssl_conf_min_version(conf, MBEDTLS_SSL_MAJOR_VERSION_3,
                                MBEDTLS_SSL_MINOR_VERSION_3);
   oc_sec_pstat_t *ps = oc_sec_get_pstat(device);
   if ((ps->s > OC_DOS_RFOTM) || (role != MBEDTLS_SSL_IS_SERVER)) {
     mbedtls_ssl_conf_authmode(conf, MBEDTLS_SSL_VERIFY_REQUIRED);
   }
-  mbedtls_ssl_conf_psk_cb(conf, get_psk_cb, NULL);
   if (transport_type == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-    mbedtls_ssl_conf_dtls_cookies(conf, mbedtls_ssl_cookie_write,
-                                  mbedtls_ssl_cookie_check, &cookie_ctx);
+    mbedtls_ssl_conf_dtls_cookies(conf, ssl_cookie_write, ssl_cookie_check,
+                                  &cookie_ctx);
     mbedtls_ssl_conf_handshake_timeout(conf, 2500, 20000);
   }
 
@@ -1313,6 +1662,19 @@ oc_tls_add_peer(oc_endpoint_t *endpoint, int role)
       OC_LIST_STRUCT_INIT(peer, recv_q);
       OC_LIST_STRUCT_INIT(peer, send_q);
       peer->next = 0;
+      peer->out = NULL;
+#ifdef OC_METRICS
+      peer->handshaking = false;
+#endif /* OC_METRICS */
+#ifdef OC_REQUEST_TRACE
+      peer->trace[OC_METRICS_STAGE_RECEIVED] = 0;
+#endif /* OC_REQUEST_TRACE */
+#ifdef OC_TLS_HANDSHAKE_THREADS
+      peer->job = NULL;
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+#ifdef OC_PKI
+      peer->root_cert = NULL;
+#endif /* OC_PKI */
       peer->role = role;
       memset(&peer->timer, 0, sizeof(oc_tls_retr_timer_t));
       mbedtls_ssl_init(&peer->ssl_ctx);
@@ -1327,6 +1689,7 @@ oc_tls_add_peer(oc_endpoint_t *endpoint, int role)
         oc_tls_free_peer(peer, false);
         return NULL;
       }
+      mbedtls_ssl_conf_psk_cb(&peer->ssl_conf, get_psk_cb, peer);
 
 #ifdef OC_PKI
 #if defined(OC_CLOUD) && defined(OC_CLIENT)
@@ -1363,9 +1726,15 @@ oc_tls_add_peer(oc_endpoint_t *endpoint, int role)
         return NULL;
       }
       oc_list_add(tls_peers, peer);
+#ifdef OC_METRICS
+      peer->handshaking = true;
+      peer->handshake_start = oc_clock_loop_time();
+      OC_METRICS_INC(OC_METRICS_TLS_HANDSHAKES);
+#endif /* OC_METRICS */
+      OC_METRICS_GAUGE_SET(OC_METRICS_TLS_PEERS, oc_list_length(tls_peers));
 
       if (!(endpoint->flags & TCP)) {
-        mbedtls_ssl_set_timer_cb(&peer->ssl_ctx, &peer->timer, ssl_set_timer,
+        mbedtls_ssl_set_timer_cb(&peer->ssl_ctx, peer, ssl_set_timer,
                                  ssl_get_timer);
         oc_ri_add_timed_event_callback_seconds(
           peer, oc_tls_inactive, (oc_clock_time_t)OC_DTLS_INACTIVITY_TIMEOUT);
@@ -1380,6 +1749,9 @@ oc_tls_add_peer(oc_endpoint_t *endpoint, int role)
 void
 oc_tls_shutdown(void)
 {
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  stop_handshake_threads();
+#endif /* OC_TLS_HANDSHAKE_THREADS */
   oc_tls_peer_t *p = oc_list_pop(tls_peers);
   while (p != NULL) {
     oc_tls_free_peer(p, false);
@@ -1393,12 +1765,8 @@ oc_tls_shutdown(void)
     oc_memb_free(&identity_certs_s, cert);
     cert = (oc_x509_crt_t *)oc_list_pop(identity_certs);
   }
-  oc_x509_cacrt_t *ca = (oc_x509_cacrt_t *)oc_list_pop(ca_certs);
-  while (ca) {
-    oc_memb_free(&ca_certs_s, ca);
-    ca = (oc_x509_cacrt_t *)oc_list_pop(ca_certs);
-  }
-  mbedtls_x509_crt_free(&trust_anchors);
+  clear_trust_anchors();
+  oc_certs_clear_validation_cache();
 #endif /* OC_PKI */
   mbedtls_ctr_drbg_free(&ctr_drbg_ctx);
   mbedtls_ssl_cookie_free(&cookie_ctx);
@@ -1438,6 +1806,10 @@ oc_tls_init_context(void)
   mbedtls_x509_crt_init(&trust_anchors);
 #endif /* OC_PKI */
 
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  start_handshake_threads();
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+
   return 0;
 dtls_init_err:
   OC_ERR("oc_tls: TLS initialization error");
@@ -1450,9 +1822,11 @@ oc_tls_close_connection(oc_endpoint_t *endpoint)
 {
   oc_tls_peer_t *peer = oc_tls_get_peer(endpoint);
   if (peer) {
-    mbedtls_ssl_close_notify(&peer->ssl_ctx);
-    if ((peer->endpoint.flags & TCP) == 0) {
+    if (!peer_busy(peer)) {
       mbedtls_ssl_close_notify(&peer->ssl_ctx);
+      if ((peer->endpoint.flags & TCP) == 0) {
+        mbedtls_ssl_close_notify(&peer->ssl_ctx);
+      }
     }
     oc_tls_free_peer(peer, false);
   }
@@ -1635,6 +2009,11 @@ oc_tls_send_message(oc_message_t *message)
 {
   size_t length = 0;
   oc_tls_peer_t *peer = oc_tls_get_peer(&message->endpoint);
+  if (peer && peer_busy(peer)) {
+    /* written once the worker has returned the peer */
+    oc_list_add(peer->send_q, message);
+    return message->length;
+  }
   if (peer) {
     int ret = mbedtls_ssl_write(&peer->ssl_ctx, (unsigned char *)message->data,
                                 message->length);
@@ -1654,7 +2033,7 @@ oc_tls_send_message(oc_message_t *message)
   return length;
 }
 
-#ifdef OC_CLIENT
+#if defined(OC_CLIENT) || defined(OC_TLS_HANDSHAKE_THREADS)
 static void
 write_application_data(oc_tls_peer_t *peer)
 {
@@ -1680,7 +2059,9 @@ write_application_data(oc_tls_peer_t *peer)
     message = (oc_message_t *)oc_list_pop(peer->send_q);
   }
 }
+#endif /* OC_CLIENT || OC_TLS_HANDSHAKE_THREADS */
 
+#ifdef OC_CLIENT
 static void
 oc_tls_init_connection(oc_message_t *message)
 {
@@ -1713,6 +2094,10 @@ oc_tls_init_connection(oc_message_t *message)
       oc_message_add_ref(message);
       oc_list_add(peer->send_q, message);
     }
+    if (peer_busy(peer)) {
+      oc_message_unref(message);
+      return;
+    }
     int ret = mbedtls_ssl_handshake(&peer->ssl_ctx);
     if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
         ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
@@ -1758,7 +2143,7 @@ bool
 oc_tls_connected(oc_endpoint_t *endpoint)
 {
   oc_tls_peer_t *peer = oc_tls_get_peer(endpoint);
-  if (peer) {
+  if (peer && !peer_busy(peer)) {
     return (peer->ssl_ctx.state == MBEDTLS_SSL_HANDSHAKE_OVER);
   }
   return false;
@@ -1772,97 +2157,402 @@ assert_all_roles_internal(oc_client_response_t *data)
 }
 #endif /* OC_PKI && OC_CLIENT */
 
-static void
-read_application_data(oc_tls_peer_t *peer)
+/* Runs handshake steps until the handshake is over or waits on the peer.
+ * Returns -1 if the peer must be freed. */
+#ifdef OC_TLS_HANDSHAKE_THREADS
+/* Whether the handshake step from state signs with the own key or verifies
+ * the peer's chain against the trust anchors. */
+static bool
+step_uses_shared_keys(int state)
 {
-  OC_DBG("oc_tls: In read_application_data");
-  if (!is_peer_active(peer)) {
-    OC_DBG("oc_tls: read_application_data: Peer not active");
-    return;
+  switch (state) {
+  case MBEDTLS_SSL_SERVER_CERTIFICATE:
+  case MBEDTLS_SSL_SERVER_KEY_EXCHANGE:
+  case MBEDTLS_SSL_CLIENT_CERTIFICATE:
+  case MBEDTLS_SSL_CERTIFICATE_VERIFY:
+    return true;
+  default:
+    return false;
   }
+}
+#endif /* OC_TLS_HANDSHAKE_THREADS */
 
-  if (peer->ssl_ctx.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
-    int ret = 0;
-    do {
-      ret = mbedtls_ssl_handshake_step(&peer->ssl_ctx);
-      if (peer->ssl_ctx.state == MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC ||
-          peer->ssl_ctx.state == MBEDTLS_SSL_SERVER_CHANGE_CIPHER_SPEC) {
-        memcpy(peer->master_secret, peer->ssl_ctx.session_negotiate->master,
-               sizeof(peer->master_secret));
-        OC_DBG("oc_tls: Got master secret");
-        OC_LOGbytes(peer->master_secret, 48);
-      }
-      if (peer->ssl_ctx.state == MBEDTLS_SSL_CLIENT_KEY_EXCHANGE ||
-          peer->ssl_ctx.state == MBEDTLS_SSL_SERVER_KEY_EXCHANGE) {
-        memcpy(peer->client_server_random, peer->ssl_ctx.handshake->randbytes,
-               sizeof(peer->client_server_random));
-        OC_DBG("oc_tls: Got nonce");
-        OC_LOGbytes(peer->client_server_random, 64);
+static int
+handshake_steps(oc_tls_peer_t *peer)
+{
+  int ret = 0;
+  do {
+#ifdef OC_TLS_HANDSHAKE_THREADS
+    bool shared_keys = step_uses_shared_keys(peer->ssl_ctx.state);
+    if (shared_keys) {
+      pthread_mutex_lock(&keys_mutex);
+    }
+    ret = mbedtls_ssl_handshake_step(&peer->ssl_ctx);
+    if (shared_keys) {
+      pthread_mutex_unlock(&keys_mutex);
+    }
+#else  /* OC_TLS_HANDSHAKE_THREADS */
+    ret = mbedtls_ssl_handshake_step(&peer->ssl_ctx);
+#endif /* !OC_TLS_HANDSHAKE_THREADS */
+    if (peer->ssl_ctx.state == MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC ||
+        peer->ssl_ctx.state == MBEDTLS_SSL_SERVER_CHANGE_CIPHER_SPEC) {
+      memcpy(peer->master_secret, peer->ssl_ctx.session_negotiate->master,
+             sizeof(peer->master_secret));
+      OC_DBG("oc_tls: Got master secret");
+      OC_LOGbytes(peer->master_secret, 48);
+    }
+    if (peer->ssl_ctx.state == MBEDTLS_SSL_CLIENT_KEY_EXCHANGE ||
+        peer->ssl_ctx.state == MBEDTLS_SSL_SERVER_KEY_EXCHANGE) {
+      memcpy(peer->client_server_random, peer->ssl_ctx.handshake->randbytes,
+             sizeof(peer->client_server_random));
+      OC_DBG("oc_tls: Got nonce");
+      OC_LOGbytes(peer->client_server_random, 64);
+    }
+    if (ret == MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED) {
+      mbedtls_ssl_session_reset(&peer->ssl_ctx);
+      /* For HelloVerifyRequest cookies */
+      if (peer->role == MBEDTLS_SSL_IS_SERVER &&
+          mbedtls_ssl_set_client_transport_id(
+            &peer->ssl_ctx, (const unsigned char *)&peer->endpoint.addr,
+            sizeof(peer->endpoint.addr)) != 0) {
+        return -1;
       }
-      if (ret == MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED) {
-        mbedtls_ssl_session_reset(&peer->ssl_ctx);
-        /* For HelloVerifyRequest cookies */
-        if (peer->role == MBEDTLS_SSL_IS_SERVER &&
-            mbedtls_ssl_set_client_transport_id(
-              &peer->ssl_ctx, (const unsigned char *)&peer->endpoint.addr,
-              sizeof(peer->endpoint.addr)) != 0) {
-          oc_tls_free_peer(peer, false);
-          return;
-        }
-      } else if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
-                 ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    } else if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
+               ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
 #ifdef OC_DEBUG
-        char buf[256];
-        mbedtls_strerror(ret, buf, 256);
-        OC_ERR("oc_tls: mbedtls_error: %s", buf);
+      char buf[256];
+      mbedtls_strerror(ret, buf, 256);
+      OC_ERR("oc_tls: mbedtls_error: %s", buf);
 #endif /* OC_DEBUG */
-        oc_tls_free_peer(peer, false);
-        return;
-      }
-    } while (ret == 0 && peer->ssl_ctx.state != MBEDTLS_SSL_HANDSHAKE_OVER);
+      return -1;
+    }
+  } while (ret == 0 && peer->ssl_ctx.state != MBEDTLS_SSL_HANDSHAKE_OVER);
+  return 0;
+}
 
-    if (peer->ssl_ctx.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
-      OC_DBG("oc_tls: (D)TLS Session is connected via ciphersuite [0x%x]",
-             peer->ssl_ctx.session->ciphersuite);
-      oc_handle_session(&peer->endpoint, OC_SESSION_CONNECTED);
+static void
+handshake_completed(oc_tls_peer_t *peer)
+{
+  OC_DBG("oc_tls: (D)TLS Session is connected via ciphersuite [0x%x]",
+         peer->ssl_ctx.session->ciphersuite);
+#ifdef OC_METRICS
+  if (peer->handshaking) {
+    peer->handshaking = false;
+    OC_METRICS_INC(OC_METRICS_TLS_HANDSHAKES_COMPLETED);
+    OC_METRICS_OBSERVE(OC_METRICS_TLS_HANDSHAKE_TIME,
+                       (oc_clock_loop_time() - peer->handshake_start) * 1000 /
+                         OC_CLOCK_SECOND);
+  }
+#endif /* OC_METRICS */
+  oc_handle_session(&peer->endpoint, OC_SESSION_CONNECTED);
 #ifdef OC_CLIENT
 #if defined(OC_CLOUD) && defined(OC_PKI)
-      if (!peer->ssl_conf.f_vrfy) {
-        const mbedtls_x509_crt *cert =
-          mbedtls_ssl_get_peer_cert(&peer->ssl_ctx);
-        oc_string_t uuid;
-        if (oc_certs_parse_CN_for_UUID(cert, &uuid) < 0) {
-          peer->uuid.id[0] = '*';
-        } else {
-          oc_str_to_uuid(oc_string(uuid), &peer->uuid);
-          oc_free_string(&uuid);
-        }
-      }
+  if (!peer->ssl_conf.f_vrfy) {
+    const mbedtls_x509_crt *cert = mbedtls_ssl_get_peer_cert(&peer->ssl_ctx);
+    oc_string_t uuid;
+    if (oc_certs_parse_CN_for_UUID(cert, &uuid) < 0) {
+      peer->uuid.id[0] = '*';
+    } else {
+      oc_str_to_uuid(oc_string(uuid), &peer->uuid);
+      oc_free_string(&uuid);
+    }
+  }
 #endif /* OC_CLOUD && OC_PKI */
 #ifdef OC_PKI
-      if (auto_assert_all_roles && !oc_tls_uses_psk_cred(peer) &&
-          oc_get_all_roles()) {
-        oc_assert_all_roles(&peer->endpoint, assert_all_roles_internal, peer);
-      } else
+  if (auto_assert_all_roles && !oc_tls_uses_psk_cred(peer) &&
+      oc_get_all_roles()) {
+    oc_assert_all_roles(&peer->endpoint, assert_all_roles_internal, peer);
+  } else
 #endif /* OC_PKI */
-      {
-        oc_tls_handler_schedule_write(peer);
-      }
+  {
+    oc_tls_handler_schedule_write(peer);
+  }
 #endif /* OC_CLIENT */
+}
+
+#ifdef OC_TLS_HANDSHAKE_THREADS
+static void
+free_handshake_job(oc_tls_handshake_job_t *job)
+{
+  oc_tls_peer_t *peer = job->peer;
+  peer->job = NULL;
+  /* records the worker did not read go back ahead of those received since */
+  oc_message_t *message = (oc_message_t *)oc_list_chop(job->recv_q);
+  while (message != NULL) {
+    oc_list_push(peer->recv_q, message);
+    message = (oc_message_t *)oc_list_chop(job->recv_q);
+  }
+  free(job->records);
+  free(job);
+}
+
+static void
+complete_handshake(oc_tls_handshake_job_t *job)
+{
+  oc_tls_peer_t *peer = job->peer;
+  bool failed = job->failed;
+  peer->job = NULL;
+  if (job->audit_message) {
+    oc_tls_audit_log(job->audit_aeid, job->audit_message,
+                     job->audit_category, job->audit_priority, peer);
+  }
+  if (job->released) {
+    free_handshake_job(job);
+    release_peer(peer);
+    return;
+  }
+
+  peer->timestamp = oc_clock_loop_time();
+  if (job->timer_expired) {
+    reset_expired_timer(&peer->timer);
+  }
+  if (job->timer_set) {
+    ssl_set_timer(peer, job->int_ms, job->fin_ms);
+  }
+  size_t offset = 0;
+  while (offset < job->records_len) {
+    uint32_t record_len;
+    memcpy(&record_len, job->records + offset, sizeof(record_len));
+    offset += sizeof(record_len);
+    ssl_send(peer, job->records + offset, record_len);
+    offset += record_len;
+  }
+  free_handshake_job(job);
+
+  if (failed) {
+    oc_tls_free_peer(peer, false);
+    return;
+  }
+  if (peer->ssl_ctx.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
+    handshake_completed(peer);
+    if (peer->role == MBEDTLS_SSL_IS_SERVER) {
+      write_application_data(peer);
+    }
+  }
+  if (is_peer_active(peer)) {
+    flush_output(peer);
+    if (oc_list_length(peer->recv_q) > 0) {
+      oc_tls_handler_schedule_read(peer);
+    }
+  }
+}
+
+static void
+process_completed_handshakes(void)
+{
+  pthread_mutex_lock(&handshake_mutex);
+  oc_tls_handshake_job_t *job =
+    (oc_tls_handshake_job_t *)oc_list_pop(completed_handshakes);
+  pthread_mutex_unlock(&handshake_mutex);
+  while (job != NULL) {
+    complete_handshake(job);
+    pthread_mutex_lock(&handshake_mutex);
+    job = (oc_tls_handshake_job_t *)oc_list_pop(completed_handshakes);
+    pthread_mutex_unlock(&handshake_mutex);
+  }
+}
+
+static void
+post_completed_handshakes(void)
+{
+  if (oc_process_post(&oc_tls_handler, oc_events[TLS_HANDSHAKE_DONE], NULL) ==
+      OC_PROCESS_ERR_FULL) {
+    process_completed_handshakes();
+  }
+}
+
+OC_PROCESS_THREAD(oc_tls_handshake_events, ev, data)
+{
+  (void)ev;
+  (void)data;
+  OC_PROCESS_POLLHANDLER(post_completed_handshakes());
+  OC_PROCESS_BEGIN();
+  while (oc_process_is_running(&(oc_tls_handshake_events))) {
+    OC_PROCESS_YIELD();
+  }
+  OC_PROCESS_END();
+}
+
+static void *
+handshake_thread(void *data)
+{
+  (void)data;
+  pthread_mutex_lock(&handshake_mutex);
+  while (!handshake_terminate) {
+    oc_tls_handshake_job_t *job =
+      (oc_tls_handshake_job_t *)oc_list_pop(handshake_jobs);
+    if (!job) {
+      pthread_cond_wait(&handshake_cond, &handshake_mutex);
+      continue;
+    }
+    pthread_mutex_unlock(&handshake_mutex);
+
+    job->failed = (handshake_steps(job->peer) < 0);
+
+    pthread_mutex_lock(&handshake_mutex);
+    oc_list_add(completed_handshakes, job);
+    handshakes_out--;
+    pthread_cond_broadcast(&handshake_cond);
+    pthread_mutex_unlock(&handshake_mutex);
+    oc_process_poll(&(oc_tls_handshake_events));
+    _oc_signal_event_loop();
+    pthread_mutex_lock(&handshake_mutex);
+  }
+  pthread_mutex_unlock(&handshake_mutex);
+  return NULL;
+}
+
+/* Hands the handshake of peer over to a worker thread. Returns false if it
+ * must run inline. */
+static bool
+dispatch_handshake(oc_tls_peer_t *peer)
+{
+  if (num_handshake_threads == 0) {
+    return false;
+  }
+  pthread_mutex_lock(&handshake_mutex);
+  bool full = (handshakes_out >= OC_TLS_HANDSHAKE_QUEUE_DEPTH);
+  pthread_mutex_unlock(&handshake_mutex);
+  if (full) {
+    OC_DBG("oc_tls: handshake queue full, running handshake inline");
+    return false;
+  }
+  oc_tls_handshake_job_t *job =
+    (oc_tls_handshake_job_t *)calloc(1, sizeof(oc_tls_handshake_job_t));
+  if (!job) {
+    return false;
+  }
+  job->peer = peer;
+  OC_LIST_STRUCT_INIT(job, recv_q);
+  oc_message_t *message = (oc_message_t *)oc_list_pop(peer->recv_q);
+  while (message != NULL) {
+    oc_list_add(job->recv_q, message);
+    message = (oc_message_t *)oc_list_pop(peer->recv_q);
+  }
+  job->timer = timer_state(&peer->timer);
+  peer->job = job;
+
+  pthread_mutex_lock(&handshake_mutex);
+  oc_list_add(handshake_jobs, job);
+  handshakes_out++;
+  pthread_cond_broadcast(&handshake_cond);
+  pthread_mutex_unlock(&handshake_mutex);
+  return true;
+}
+
+static void
+start_handshake_threads(void)
+{
+  handshake_terminate = false;
+  oc_process_start(&oc_tls_handshake_events, NULL);
+  size_t i;
+  for (i = 0; i < OC_TLS_HANDSHAKE_THREADS; i++) {
+    if (pthread_create(&handshake_threads[i], NULL, handshake_thread, NULL) !=
+        0) {
+      OC_ERR("oc_tls: could not start handshake thread %zd", i);
+      break;
+    }
+    num_handshake_threads++;
+  }
+  OC_DBG("oc_tls: started %zd handshake threads", num_handshake_threads);
+}
+
+static void
+stop_handshake_threads(void)
+{
+  pthread_mutex_lock(&handshake_mutex);
+  handshake_terminate = true;
+  pthread_cond_broadcast(&handshake_cond);
+  pthread_mutex_unlock(&handshake_mutex);
+  size_t i;
+  for (i = 0; i < num_handshake_threads; i++) {
+    pthread_join(handshake_threads[i], NULL);
+  }
+  num_handshake_threads = 0;
+
+  /* jobs that never ran and results never picked up by the event loop */
+  oc_tls_handshake_job_t *job =
+    (oc_tls_handshake_job_t *)oc_list_pop(handshake_jobs);
+  while (job != NULL) {
+    handshakes_out--;
+    oc_list_add(completed_handshakes, job);
+    job = (oc_tls_handshake_job_t *)oc_list_pop(handshake_jobs);
+  }
+  job = (oc_tls_handshake_job_t *)oc_list_pop(completed_handshakes);
+  while (job != NULL) {
+    oc_tls_peer_t *peer = job->peer;
+    bool released = job->released;
+    free_handshake_job(job);
+    if (released) {
+      release_peer(peer);
+    }
+    job = (oc_tls_handshake_job_t *)oc_list_pop(completed_handshakes);
+  }
+  oc_process_exit(&oc_tls_handshake_events);
+}
+
+void
+oc_tls_handshake_drain(void)
+{
+  pthread_mutex_lock(&handshake_mutex);
+  /* Jobs no thread has picked up go back to their peers untouched, and are
+   * dispatched again once the event loop gets to them, so this only waits
+   * for the steps already running. */
+  oc_tls_handshake_job_t *job =
+    (oc_tls_handshake_job_t *)oc_list_pop(handshake_jobs);
+  bool returned = (job != NULL);
+  while (job != NULL) {
+    handshakes_out--;
+    oc_list_add(completed_handshakes, job);
+    job = (oc_tls_handshake_job_t *)oc_list_pop(handshake_jobs);
+  }
+  if (returned) {
+    oc_process_poll(&(oc_tls_handshake_events));
+  }
+  while (handshakes_out > 0) {
+    pthread_cond_wait(&handshake_cond, &handshake_mutex);
+  }
+  pthread_mutex_unlock(&handshake_mutex);
+}
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+
+static void
+read_application_data(oc_tls_peer_t *peer)
+{
+  OC_DBG("oc_tls: In read_application_data");
+  if (!is_peer_active(peer)) {
+    OC_DBG("oc_tls: read_application_data: Peer not active");
+    return;
+  }
+  if (peer_busy(peer)) {
+    /* read again once the worker has returned the peer */
+    return;
+  }
+
+  if (peer->ssl_ctx.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+#ifdef OC_TLS_HANDSHAKE_THREADS
+    if (dispatch_handshake(peer)) {
+      return;
+    }
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+    if (handshake_steps(peer) < 0) {
+      oc_tls_free_peer(peer, false);
+      return;
+    }
+    if (peer->ssl_ctx.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
+      handshake_completed(peer);
     }
   } else {
-#ifdef OC_INOUT_BUFFER_SIZE
-    oc_message_t message[1];
-#else  /* OC_INOUT_BUFFER_SIZE */
+    /* decrypted straight into the message handed to the CoAP engine */
     oc_message_t *message = oc_allocate_message();
-    if (message) {
-#endif /* !OC_INOUT_BUFFER_SIZE */
+    if (!message) {
+      OC_WRN("oc_tls: could not allocate incoming message buffer");
+      return;
+    }
     memcpy(&message->endpoint, &peer->endpoint, sizeof(oc_endpoint_t));
     int ret = mbedtls_ssl_read(&peer->ssl_ctx, message->data, OC_PDU_SIZE);
     if (ret <= 0) {
-#ifndef OC_INOUT_BUFFER_SIZE
       oc_message_unref(message);
-#endif /* OC_INOUT_BUFFER_SIZE */
       if (ret == 0 || ret == MBEDTLS_ERR_SSL_WANT_READ ||
           ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
         OC_DBG("oc_tls: Received WantRead/WantWrite");
@@ -1889,28 +2579,18 @@ read_application_data(oc_tls_peer_t *peer)
     }
     message->length = ret;
     message->encrypted = 0;
-    oc_message_t *msg = message;
-#ifdef OC_INOUT_BUFFER_SIZE
-    msg = oc_allocate_message();
-    if (!msg) {
-      OC_WRN("oc_tls: could not allocate incoming message buffer");
-      return;
-    }
-    memcpy(&msg->endpoint, &peer->endpoint, sizeof(oc_endpoint_t));
-    msg->length = message->length;
-    memcpy(msg->data, message->data, message->length);
-#endif /* OC_INOUT_BUFFER_SIZE */
-    if (oc_process_post(&coap_engine, oc_events[INBOUND_RI_EVENT], msg) ==
+    /* mbedtls decrypts in its input buffer and copies the plaintext out */
+    oc_message_count_copy(message, message->length);
+#ifdef OC_REQUEST_TRACE
+    memcpy(message->trace, peer->trace, sizeof(message->trace));
+#endif /* OC_REQUEST_TRACE */
+    OC_METRICS_TRACE_STAMP(message, OC_METRICS_STAGE_DECRYPTED);
+    if (oc_process_post(&coap_engine, oc_events[INBOUND_RI_EVENT], message) ==
         OC_PROCESS_ERR_FULL) {
-#ifndef OC_INOUT_BUFFER_SIZE
-      oc_message_unref(msg);
-#endif /* !OC_INOUT_BUFFER_SIZE */
+      oc_message_unref(message);
     }
     OC_DBG("oc_tls: Decrypted incoming message");
-#ifndef OC_INOUT_BUFFER_SIZE
   }
-#endif /* !OC_INOUT_BUFFER_SIZE */
-}
 }
 
 static void
@@ -1927,7 +2607,7 @@ oc_tls_recv_message(oc_message_t *message)
 #endif /* OC_DEBUG */
 
     oc_list_add(peer->recv_q, message);
-    peer->timestamp = oc_clock_time();
+    peer->timestamp = oc_clock_loop_time();
     oc_tls_handler_schedule_read(peer);
   } else {
     oc_message_unref(message);
@@ -1991,6 +2671,12 @@ OC_PROCESS_THREAD(oc_tls_handler, ev, data)
       size_t device = (size_t)data;
       close_all_tls_sessions_for_device(device);
     }
+#ifdef OC_TLS_HANDSHAKE_THREADS
+    else if (ev == oc_events[TLS_HANDSHAKE_DONE]) {
+      process_completed_handshakes();
+    }
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+    flush_all_output();
   }
 
   OC_PROCESS_END();
@@ -40,6 +40,14 @@ typedef struct
   oc_clock_time_t int_ticks;
 } oc_tls_retr_timer_t;
 
+#ifdef OC_TLS_HANDSHAKE_THREADS
+#ifndef OC_TLS_HANDSHAKE_QUEUE_DEPTH
+#define OC_TLS_HANDSHAKE_QUEUE_DEPTH (16)
+#endif /* !OC_TLS_HANDSHAKE_QUEUE_DEPTH */
+
+struct oc_tls_handshake_job_t;
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+
 typedef struct oc_tls_peer_t
 {
   struct oc_tls_peer_t *next;
@@ -54,8 +62,22 @@ typedef struct oc_tls_peer_t
   uint8_t client_server_random[64];
   oc_uuid_t uuid;
   oc_clock_time_t timestamp;
+  oc_message_t *out; /* records batched for a single datagram or send */
+#ifdef OC_METRICS
+  oc_clock_time_t handshake_start;
+  bool handshaking; /* counted as started, not yet as completed or failed */
+#endif /* OC_METRICS */
+#ifdef OC_REQUEST_TRACE
+  /* trace of the last record read, handed on to the plaintext */
+  oc_clock_time_t trace[OC_METRICS_NUM_STAGES];
+#endif /* OC_REQUEST_TRACE */
+#ifdef OC_TLS_HANDSHAKE_THREADS
+  /* handshake steps running on a worker thread, which owns ssl_ctx */
+  struct oc_tls_handshake_job_t *job;
+#endif /* OC_TLS_HANDSHAKE_THREADS */
 #ifdef OC_PKI
   oc_string_t public_key;
+  mbedtls_x509_crt *root_cert; /* trusted root of the peer's chain */
 #endif /* OC_PKI */
 } oc_tls_peer_t;
 
@@ -111,6 +133,15 @@ void oc_tls_remove_trust_anchor(oc_sec_cred_t *cred);
 
 mbedtls_x509_crt *oc_tls_get_trust_anchors(void);
 
+#ifdef OC_TLS_HANDSHAKE_THREADS
+/* Wait until no handshake runs on the worker threads. Called before changing
+ * the credentials and state that their callbacks read. Handshakes still
+ * queued are handed back to the event loop, but this blocks the event loop
+ * until the steps already running finish, which may take one ECC operation
+ * per thread. */
+void oc_tls_handshake_drain(void);
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,128 @@
+/******************************************************************
+ *
+ * Copyright 2020 Cascoda Ltd All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include <cstring>
+#include "gtest/gtest.h"
+
+#include "oc_certs.h"
+
+#if defined(OC_SECURITY) && defined(OC_PKI)
+
+/* a root CA, an unrelated root CA and an end-entity certificate issued by
+ * the first, all valid from 2020 to 2049 */
+static const char root_pem[] =
+    "-----BEGIN CERTIFICATE-----\n"
+    "MIIBXjCCAQWgAwIBAgIBATAKBggqhkjOPQQDAjAXMRUwEwYDVQQDDAxUZXN0IHJv\n"
+    "b3QgQ0EwHhcNMjAwMTAxMDAwMDAwWhcNNDkxMjMxMjM1OTU5WjAXMRUwEwYDVQQD\n"
+    "DAxUZXN0IHJvb3QgQ0EwWTATBgcqhkjOPQIBBggqhkjOPQMBBwNCAASbH5qSA3D6\n"
+    "e4lzNSbKA4O9mduuRVDfG/qc0eVlF2RBom6vWZGwabC+aRBlK1MnzWEJv8lVegV/\n"
+    "Bo07q6SO33t0o0IwQDAPBgNVHRMBAf8EBTADAQH/MA4GA1UdDwEB/wQEAwIBBjAd\n"
+    "BgNVHQ4EFgQUqdU7QiHZcdpRn/yX3Z3QGc3IwCQwCgYIKoZIzj0EAwIDRwAwRAIg\n"
+    "AgQq/iiQXm5hXJuLzkHbrspnPKJf85jrm0JWAi08NooCICVveqq9bP48E2CVH4kE\n"
+    "/bK1DHN7OE0o6JuanvbBt/33\n"
+    "-----END CERTIFICATE-----\n";
+
+static const char other_pem[] =
+    "-----BEGIN CERTIFICATE-----\n"
+    "MIIBYTCCAQegAwIBAgIBAjAKBggqhkjOPQQDAjAYMRYwFAYDVQQDDA1UZXN0IG90\n"
+    "aGVyIENBMB4XDTIwMDEwMTAwMDAwMFoXDTQ5MTIzMTIzNTk1OVowGDEWMBQGA1UE\n"
+    "AwwNVGVzdCBvdGhlciBDQTBZMBMGByqGSM49AgEGCCqGSM49AwEHA0IABFDbSj60\n"
+    "q81uKLjr+I7IZMHhgLXMqAEpXk0JQCoIh/0OAzgKbPuSLJEMaGtqng4fZrjZ+/GR\n"
+    "0XZFkHpiagD7ucOjQjBAMA8GA1UdEwEB/wQFMAMBAf8wDgYDVR0PAQH/BAQDAgEG\n"
+    "MB0GA1UdDgQWBBQkmbQdZRcYXFfjiqerJ32LK4WxQDAKBggqhkjOPQQDAgNIADBF\n"
+    "AiBbOktWbqWORO5B1uBgfZlCYdCTre+1GQ+01tO86IlNyQIhAIrFOuaJduXCqGx/\n"
+    "oG5jJXQPBtlotQy8yPD8R9Y+j1XF\n"
+    "-----END CERTIFICATE-----\n";
+
+static const char ee_pem[] =
+    "-----BEGIN CERTIFICATE-----\n"
+    "MIIBmjCCAUCgAwIBAgIBAzAKBggqhkjOPQQDAjAXMRUwEwYDVQQDDAxUZXN0IHJv\n"
+    "b3QgQ0EwHhcNMjAwMTAxMDAwMDAwWhcNNDkxMjMxMjM1OTU5WjA0MTIwMAYDVQQD\n"
+    "DCl1dWlkOjEyMzQ1Njc4LTEyMzQtMTIzNC0xMjM0LTEyMzQ1Njc4OTAxMjBZMBMG\n"
+    "ByqGSM49AgEGCCqGSM49AwEHA0IABIWWKs07DnHXir9v5xB53+YTgtVHkE4XbdCT\n"
+    "0VdQ2n7BvFy/YXAXdMaPdhyqH3ifp3398hb3ieWNgqT6TSGVeUujYDBeMAwGA1Ud\n"
+    "EwEB/wQCMAAwDgYDVR0PAQH/BAQDAgOIMB0GA1UdDgQWBBRm38iNF0erqsPZEj9G\n"
+    "WW9hK7db6jAfBgNVHSMEGDAWgBSp1TtCIdlx2lGf/JfdndAZzcjAJDAKBggqhkjO\n"
+    "PQQDAgNIADBFAiEA5JsjcjotRld0dfSztySOeNUw/+e9L1U5ZuY7Nk+DlUYCIC6j\n"
+    "jjpl9sg2iGzpTrJU2RKm5NJHkn53MND9TsmOYEh2\n"
+    "-----END CERTIFICATE-----\n";
+
+class TestCerts: public testing::Test
+{
+    protected:
+        virtual void SetUp()
+        {
+            oc_certs_clear_validation_cache();
+            mbedtls_x509_crt_init(&root);
+            mbedtls_x509_crt_init(&other);
+            mbedtls_x509_crt_init(&ee);
+            ASSERT_EQ(0, parse(&root, root_pem));
+            ASSERT_EQ(0, parse(&other, other_pem));
+            ASSERT_EQ(0, parse(&ee, ee_pem));
+        }
+
+        virtual void TearDown()
+        {
+            mbedtls_x509_crt_free(&root);
+            mbedtls_x509_crt_free(&other);
+            mbedtls_x509_crt_free(&ee);
+            oc_certs_clear_validation_cache();
+        }
+
+        static int parse(mbedtls_x509_crt *crt, const char *pem)
+        {
+            return mbedtls_x509_crt_parse(crt, (const unsigned char *)pem,
+                                          strlen(pem) + 1);
+        }
+
+        mbedtls_x509_crt root;
+        mbedtls_x509_crt other;
+        mbedtls_x509_crt ee;
+};
+
+/* Results are cached per generation of trust anchors, not per set passed in.
+ * Verifying against a set that could not have issued the chain so tells a
+ * cached result from a fresh verification.
+ */
+
+TEST_F(TestCerts, VerifyChainMiss)
+{
+    EXPECT_EQ(-1, oc_certs_verify_chain(&ee, &other));
+    /* another chain is verified on its own */
+    EXPECT_EQ(0, oc_certs_verify_chain(&other, &other));
+    EXPECT_EQ(-1, oc_certs_verify_chain(&ee, &other));
+}
+
+TEST_F(TestCerts, VerifyChainHit)
+{
+    EXPECT_EQ(0, oc_certs_verify_chain(&ee, &root));
+    /* same chain, same generation: the cached result */
+    EXPECT_EQ(0, oc_certs_verify_chain(&ee, &other));
+}
+
+TEST_F(TestCerts, VerifyChainTrustAnchorsChanged)
+{
+    EXPECT_EQ(0, oc_certs_verify_chain(&ee, &root));
+    oc_certs_trust_anchors_changed();
+    EXPECT_EQ(-1, oc_certs_verify_chain(&ee, &other));
+    EXPECT_EQ(-1, oc_certs_verify_chain(&ee, &root));
+    oc_certs_trust_anchors_changed();
+    EXPECT_EQ(0, oc_certs_verify_chain(&ee, &root));
+}
+
+#endif /* OC_SECURITY && OC_PKI */
@@ -0,0 +1,404 @@
+/******************************************************************
+ *
+ * Copyright 2020 Cascoda Ltd All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "mbedtls/ssl_internal.h"
+
+#include "api/oc_events.h"
+#include "oc_api.h"
+#include "oc_buffer.h"
+#include "oc_tls.h"
+#include "port/oc_clock.h"
+#include "security/oc_cred_internal.h"
+#include "security/oc_doxm.h"
+#include "security/oc_pstat.h"
+#include "util/oc_process.h"
+
+#if defined(OC_SECURITY) && defined(OC_CLIENT)
+
+extern "C" {
+void oc_tls_init_connection(oc_message_t *message);
+}
+
+/* DTLS record type and handshake message type of a ClientHello */
+#define DTLS_HANDSHAKE 0x16
+#define DTLS_CLIENT_HELLO 0x01
+#define DTLS_RECORD_HEADER_LEN 13
+#define MAX_DATAGRAM_LEN 1500
+
+class TestTlsPeer : public testing::Test {
+public:
+    static oc_handler_t s_handler;
+
+    static int appInit(void)
+    {
+        int result = oc_init_platform("Cascoda", NULL, NULL);
+        result |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                                "ocf.res.1.0.0", NULL, NULL);
+        return result;
+    }
+
+    static void signalEventLoop(void) {}
+
+protected:
+    static void SetUpTestCase()
+    {
+        s_handler.init = &appInit;
+        s_handler.signal_event_loop = &signalEventLoop;
+        ASSERT_EQ(0, oc_main_init(&s_handler));
+        /* client connections are only set up in RFNOP */
+        oc_sec_get_pstat(0)->s = OC_DOS_RFNOP;
+    }
+
+    static void TearDownTestCase() { oc_main_shutdown(); }
+
+    virtual void SetUp()
+    {
+        /* a DTLS server that never answers unless told to */
+        sock = socket(AF_INET6, SOCK_DGRAM, 0);
+        ASSERT_LE(0, sock);
+        struct sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_loopback;
+        socklen_t addr_len = sizeof(addr);
+        ASSERT_EQ(0, bind(sock, (struct sockaddr *)&addr, addr_len));
+        ASSERT_EQ(0, getsockname(sock, (struct sockaddr *)&addr, &addr_len));
+
+        memset(&ep, 0, sizeof(ep));
+        ep.flags = (transport_flags)(IPV6 | SECURED);
+        ep.device = 0;
+        ep.addr.ipv6.address[15] = 1;
+        ep.addr.ipv6.port = ntohs(addr.sin6_port);
+        oc_tls_select_anon_ciphersuite();
+    }
+
+    virtual void TearDown()
+    {
+        oc_tls_close_connection(&ep);
+        close(sock);
+    }
+
+    oc_message_t *newMessage()
+    {
+        oc_message_t *message = oc_internal_allocate_outgoing_message();
+        if (message) {
+            memcpy(&message->endpoint, &ep, sizeof(ep));
+        }
+        return message;
+    }
+
+    /* Run the event loop until the server socket has a datagram or ms
+     * milliseconds passed. Returns the length of the datagram or -1. */
+    ssize_t receive(uint8_t *buf, size_t len, int ms)
+    {
+        for (int waited = 0; waited <= ms; waited += 10) {
+            oc_main_poll();
+            struct pollfd pfd = { sock, POLLIN, 0 };
+            if (poll(&pfd, 1, 10) == 1) {
+                return recvfrom(sock, buf, len, 0, (struct sockaddr *)&from,
+                                &from_len);
+            }
+        }
+        return -1;
+    }
+
+    static bool isClientHello(const uint8_t *buf, ssize_t len)
+    {
+        return len > DTLS_RECORD_HEADER_LEN && buf[0] == DTLS_HANDSHAKE &&
+               buf[DTLS_RECORD_HEADER_LEN] == DTLS_CLIENT_HELLO;
+    }
+
+    int sock;
+    oc_endpoint_t ep;
+    /* the address the device sent its records from */
+    struct sockaddr_in6 from;
+    socklen_t from_len = sizeof(from);
+};
+
+oc_handler_t TestTlsPeer::s_handler;
+
+TEST_F(TestTlsPeer, FlushAfterEvent)
+{
+    oc_message_t *message = newMessage();
+    ASSERT_NE(nullptr, message);
+    oc_process_post(&oc_tls_handler, oc_events[INIT_TLS_CONN_EVENT], message);
+
+    /* the ClientHello leaves once the TLS handler is done with the event */
+    uint8_t buf[MAX_DATAGRAM_LEN];
+    ssize_t len = receive(buf, sizeof(buf), 1000);
+    EXPECT_TRUE(isClientHello(buf, len));
+    EXPECT_NE(nullptr, oc_tls_get_peer(&ep));
+}
+
+TEST_F(TestTlsPeer, FlushOnFree)
+{
+    oc_message_t *message = newMessage();
+    ASSERT_NE(nullptr, message);
+    /* outside the TLS handler, so nothing flushes the batch */
+    oc_tls_init_connection(message);
+    oc_tls_peer_t *p = oc_tls_get_peer(&ep);
+    ASSERT_NE(nullptr, p);
+    EXPECT_NE(nullptr, p->out);
+    uint8_t buf[MAX_DATAGRAM_LEN];
+    EXPECT_EQ(-1, recv(sock, buf, sizeof(buf), MSG_DONTWAIT));
+
+    /* freeing the peer sends what it had batched */
+    oc_tls_close_connection(&ep);
+    EXPECT_EQ(nullptr, oc_tls_get_peer(&ep));
+    ssize_t len = receive(buf, sizeof(buf), 1000);
+    EXPECT_TRUE(isClientHello(buf, len));
+}
+
+TEST_F(TestTlsPeer, RecordsOfPeerStayInOrder)
+{
+    oc_process_queue_stats_t unicast, security;
+    ASSERT_TRUE(
+      oc_process_get_queue_stats(OC_PROCESS_PRIORITY_UNICAST, &unicast));
+    ASSERT_TRUE(
+      oc_process_get_queue_stats(OC_PROCESS_PRIORITY_SECURITY, &security));
+
+    /* application data followed by an alert of the same peer */
+    oc_endpoint_t other = ep;
+    other.addr.ipv6.port++;
+    const uint8_t types[] = { 23, 21, 22 };
+    for (size_t i = 0; i < sizeof(types); i++) {
+        oc_message_t *message = oc_allocate_message();
+        ASSERT_NE(nullptr, message);
+        memcpy(&message->endpoint, i < 2 ? &ep : &other, sizeof(ep));
+        message->encrypted = 1;
+        memset(message->data, 0, DTLS_RECORD_HEADER_LEN);
+        message->data[0] = types[i];
+        message->length = DTLS_RECORD_HEADER_LEN;
+        oc_recv_message(message);
+    }
+
+    /* the alert waits behind the data, while a handshake of another peer
+     * still goes first */
+    oc_process_queue_stats_t stats;
+    ASSERT_TRUE(
+      oc_process_get_queue_stats(OC_PROCESS_PRIORITY_UNICAST, &stats));
+    EXPECT_EQ(unicast.queued + 2, stats.queued);
+    ASSERT_TRUE(
+      oc_process_get_queue_stats(OC_PROCESS_PRIORITY_SECURITY, &stats));
+    EXPECT_EQ(security.queued + 1, stats.queued);
+
+    /* the records are garbage and dropped by the TLS handler */
+    while (oc_main_poll() != 0) {
+    }
+    oc_tls_close_connection(&other);
+}
+
+#ifdef OC_TLS_HANDSHAKE_THREADS
+/* The probe runs on the event loop after the TLS handler has handed a
+ * handshake to a worker thread, and applies a change there while the job is
+ * still out. It reposts itself into the lowest priority class until then. */
+static oc_endpoint_t probe_ep;
+static void (*probe_change)(void);
+static oc_clock_time_t probe_deadline;
+static bool probe_done;
+static bool probe_observed;
+static bool probe_busy_after;
+
+OC_PROCESS(handshake_probe, "Handshake probe");
+
+OC_PROCESS_THREAD(handshake_probe, ev, data)
+{
+    (void)data;
+    OC_PROCESS_BEGIN();
+    while (1) {
+        OC_PROCESS_YIELD();
+        if (ev != OC_PROCESS_EVENT_CONTINUE || probe_done) {
+            continue;
+        }
+        oc_tls_peer_t *peer = oc_tls_get_peer(&probe_ep);
+        if (peer && peer->job) {
+            probe_observed = true;
+            probe_done = true;
+            probe_change();
+            /* the worker is done with the peer once the change returns */
+            peer = oc_tls_get_peer(&probe_ep);
+            probe_busy_after = (peer && peer->job);
+        } else if (!peer || peer->ssl_ctx.handshake->verify_cookie_len > 0 ||
+                   oc_clock_time() > probe_deadline) {
+            /* the handshake came back before the probe could run */
+            probe_done = true;
+        } else {
+            oc_process_post_priority(&handshake_probe,
+                                     OC_PROCESS_EVENT_CONTINUE, NULL,
+                                     OC_PROCESS_PRIORITY_MULTICAST);
+        }
+    }
+    OC_PROCESS_END();
+}
+
+static void
+addRemoveCred(void)
+{
+    static const uint8_t key[16] = { 0 };
+    int credid = oc_sec_add_new_cred(
+      0, false, NULL, -1, OC_CREDTYPE_PSK, OC_CREDUSAGE_NULL,
+      "11111111-2222-3333-4444-555555555555", OC_ENCODING_RAW, sizeof(key),
+      key, OC_ENCODING_UNSUPPORTED, 0, NULL, NULL, NULL);
+    oc_sec_cred_t *cred = oc_sec_get_cred_by_credid(credid, 0);
+    if (cred) {
+        oc_sec_remove_cred(cred, 0);
+    }
+}
+
+static void
+updatePstat(void)
+{
+    /* an empty update leaves the state as it is */
+    oc_sec_decode_pstat(NULL, false, 0);
+}
+
+class TestTlsHandshakeThreads : public TestTlsPeer {
+protected:
+    /* Start a handshake and answer its ClientHello with a
+     * HelloVerifyRequest, which the client processes on a worker thread
+     * while the probe runs change. */
+    void runProbe(void (*change)(void))
+    {
+        oc_message_t *message = newMessage();
+        ASSERT_NE(nullptr, message);
+        oc_process_post(&oc_tls_handler, oc_events[INIT_TLS_CONN_EVENT],
+                        message);
+        uint8_t buf[MAX_DATAGRAM_LEN];
+        ASSERT_TRUE(isClientHello(buf, receive(buf, sizeof(buf), 1000)));
+
+        memcpy(&probe_ep, &ep, sizeof(ep));
+        probe_change = change;
+        probe_deadline = oc_clock_time() + OC_CLOCK_SECOND;
+        probe_done = false;
+        probe_observed = false;
+        probe_busy_after = false;
+        oc_process_start(&handshake_probe, NULL);
+
+        /* record header, handshake header and the version and cookie */
+        const uint8_t hello_verify_request[] = {
+            DTLS_HANDSHAKE, 0xfe, 0xfd, 0, 0, 0, 0, 0, 0, 0, 0, 0, 19,
+            0x03, 0, 0, 7, 0, 0, 0, 0, 0, 0, 0, 7,
+            0xfe, 0xfd, 4, 'a', 'b', 'c', 'd'
+        };
+        ASSERT_EQ((ssize_t)sizeof(hello_verify_request),
+                  sendto(sock, hello_verify_request,
+                         sizeof(hello_verify_request), 0,
+                         (struct sockaddr *)&from, from_len));
+        oc_process_post_priority(&handshake_probe, OC_PROCESS_EVENT_CONTINUE,
+                                 NULL, OC_PROCESS_PRIORITY_MULTICAST);
+        for (int i = 0; i < 100 && !probe_done; i++) {
+            oc_main_poll();
+            usleep(10 * 1000);
+        }
+        oc_process_exit(&handshake_probe);
+        ASSERT_TRUE(probe_done);
+    }
+
+    /* Length of the cookie in a ClientHello, or -1. */
+    static int cookieLength(const uint8_t *buf, ssize_t len)
+    {
+        if (!isClientHello(buf, len)) {
+            return -1;
+        }
+        /* handshake header, client version and random */
+        ssize_t offset = DTLS_RECORD_HEADER_LEN + 12 + 2 + 32;
+        if (offset >= len) {
+            return -1;
+        }
+        offset += 1 + buf[offset];
+        return offset < len ? buf[offset] : -1;
+    }
+
+    /* Wait for the ClientHello that carries the cookie. */
+    bool receiveClientHelloWithCookie(int ms)
+    {
+        uint8_t buf[MAX_DATAGRAM_LEN];
+        ssize_t len;
+        while ((len = receive(buf, sizeof(buf), ms)) > 0) {
+            if (cookieLength(buf, len) == 4) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+TEST_F(TestTlsHandshakeThreads, CredChangeDrainsHandshakes)
+{
+    runProbe(addRemoveCred);
+    /* the change waited for the worker, or took back the job it had not
+     * started yet */
+    EXPECT_FALSE(probe_busy_after);
+    /* the records the worker wrote go out on the event loop */
+    EXPECT_TRUE(receiveClientHelloWithCookie(1000));
+}
+
+TEST_F(TestTlsHandshakeThreads, PstatChangeDrainsHandshakes)
+{
+    runProbe(updatePstat);
+    EXPECT_FALSE(probe_busy_after);
+    EXPECT_TRUE(receiveClientHelloWithCookie(1000));
+}
+
+static void
+updateDoxm(void)
+{
+    /* an empty update leaves the doxm as it is */
+    oc_sec_decode_doxm(NULL, false, 0);
+}
+
+TEST_F(TestTlsHandshakeThreads, DoxmChangeDrainsHandshakes)
+{
+    runProbe(updateDoxm);
+    EXPECT_FALSE(probe_busy_after);
+    EXPECT_TRUE(receiveClientHelloWithCookie(1000));
+}
+
+TEST_F(TestTlsHandshakeThreads, PinChangeDrainsHandshakes)
+{
+    runProbe(oc_tls_generate_random_pin);
+    EXPECT_FALSE(probe_busy_after);
+    EXPECT_TRUE(receiveClientHelloWithCookie(1000));
+}
+
+static void
+closeConnection(void)
+{
+    oc_tls_close_connection(&probe_ep);
+}
+
+TEST_F(TestTlsHandshakeThreads, ReleaseWhileBusy)
+{
+    runProbe(closeConnection);
+    /* the peer is gone at once, its state goes when the job returns */
+    EXPECT_EQ(nullptr, oc_tls_get_peer(&ep));
+    if (probe_observed) {
+        /* and what the worker wrote for it is dropped */
+        EXPECT_FALSE(receiveClientHelloWithCookie(500));
+    }
+}
+#endif /* OC_TLS_HANDSHAKE_THREADS */
+
+#endif /* OC_SECURITY && OC_CLIENT */
@@ -229,6 +229,11 @@ int jni_main_init(const oc_handler_t *handler)
 }
 %}
 %ignore oc_main_poll;
+// the JNI code runs its own event loop thread
+%ignore oc_set_fd_watch_callback;
+%ignore oc_main_on_readable;
+%ignore oc_main_on_writable;
+%ignore oc_main_on_timeout;
 %ignore oc_main_shutdown;
 %rename(mainShutdown) jni_main_shutdown;
 %inline %{
@@ -808,6 +813,7 @@ void jni_remove_ownership_status_cb(jobject cb)
    */
   public";
 %rename(collectionGetLinks) oc_collection_get_links;
+%rename(collectionSetBatchNotifyInterval) oc_collection_set_batch_notify_interval;
 
 // DOCUMENTATION workaround
 %javamethodmodifiers oc_add_collection "/**
@@ -855,6 +861,8 @@ void jni_resource_make_public(oc_resource_t *resource) {
 %rename(resourceSetDiscoverable) oc_resource_set_discoverable;
 %rename(resourceSetObservable) oc_resource_set_observable;
 %rename(resourceSetPeriodicObservable) oc_resource_set_periodic_observable;
+// the JNI request callbacks share one JNIEnv and must not run on worker threads
+%ignore oc_resource_set_concurrent;
 
 /* Code and typemaps for mapping the oc_resource_set_request_handler to the java OCRequestHandler */
 %{
@@ -911,6 +919,8 @@ void jni_oc_request_callback(oc_request_t *request, oc_interface_mask_t interfac
   $2 = user_data;
 }
 %ignore oc_resource_set_request_handler;
+%ignore oc_resource_set_stream_handler;
+%ignore oc_resource_stream_changed;
 %rename(resourceSetRequestHandler) jni_oc_resource_set_request_handler;
 %inline %{
 void jni_oc_resource_set_request_handler(oc_resource_t *resource,
@@ -1527,6 +1537,7 @@ void jni_oc_response_handler(oc_client_response_t *response)
   $2 = user_data;
 }
 %ignore oc_do_get;
+%ignore oc_do_get_stream;
 %rename(doGet) jni_oc_do_get;
 %inline %{
 bool jni_oc_do_get(const char *uri, oc_endpoint_t *endpoint, const char *query,
@@ -1913,7 +1924,12 @@ void jni_oc_remove_delayed_callback(jobject callback) {
 %rename(tokenLen) oc_client_cb_t::token_len;
 %rename(stopMulticastReceive) oc_client_cb_t::stop_multicast_receive;
 %rename(refCount) oc_client_cb_t::ref_count;
+%ignore oc_client_cb_t::stream;
+%ignore oc_client_cb_t::stream_offset;
+%ignore oc_client_cb_t::stream_etag;
+%ignore oc_client_cb_t::stream_etag_len;
 %ignore oc_ri_invoke_client_cb;
+%ignore oc_ri_invoke_client_stream_cb;
 %ignore oc_ri_alloc_client_cb;
 %ignore oc_ri_get_client_cb;
 %ignore oc_ri_find_client_cb_by_token;
@@ -29,6 +29,7 @@ typedef long long oc_clock_time_t;
 
 %rename(clockInit) oc_clock_init;
 %rename(clockTime) oc_clock_time;
+%rename(clockTimeMonotonic) oc_clock_time_monotonic;
 %rename(clockSeconds) oc_clock_seconds;
 %rename(clockWait) oc_clock_wait;
 %include "port/oc_clock.h"
\ No newline at end of file
@@ -115,6 +115,10 @@ static void jni_cloud_cb(oc_cloud_context_t *ctx, oc_cloud_status_t status, void
 %rename (rdPublishedResources) oc_cloud_context_t::rd_published_resources;
 %rename (rdDeleteResources) oc_cloud_context_t::rd_delete_resources;
 %rename (rdDeleteAll) oc_cloud_context_t::rd_delete_all;
+%ignore oc_cloud_context_t::rd_publish_time;
+%ignore oc_cloud_context_t::notify_window_ms;
+%ignore oc_cloud_context_t::notify_rate;
+%ignore oc_cloud_context_t::notify_burst;
 %ignore oc_cloud_context_t::cps;
 %rename (cloudConf) oc_cloud_context_t::cloud_conf;
 %rename (cloudManager) oc_cloud_context_t::cloud_manager;
@@ -320,6 +324,21 @@ int jni_cloud_publish_resources(size_t device)
 }
 %}
 
+%ignore oc_cloud_set_notification_policy;
+%rename (setNotificationPolicy) jni_cloud_set_notification_policy;
+%inline %{
+int jni_cloud_set_notification_policy(oc_cloud_context_t *ctx, uint16_t window_ms,
+                                      uint16_t rate, uint16_t burst)
+{
+#ifdef OC_CLOUD
+  return oc_cloud_set_notification_policy(ctx, window_ms, rate, burst);
+#else /* OC_CLOUD*/
+  OC_DBG("JNI: %s - Must build with OC_CLOUD defined to use this function.\n", __func__);
+  return -1;
+#endif /* !OC_CLOUD */
+}
+%}
+
 %ignore oc_cloud_discover_resources;
 %rename (discoverResources) jni_cloud_discover_resources;
 
@@ -18,6 +18,7 @@
 typedef struct oc_link_s oc_link_t;
 %rename(OCLink) oc_link_s;
 %ignore oc_link_s::OC_LIST_STRUCT(params);
+%ignore oc_link_s::notify_pending;
 %extend oc_link_s {
   oc_link_params_t *getParamsListHead() {
     return oc_list_head(self->params);
@@ -29,8 +30,12 @@ typedef struct oc_collection_s oc_collection_t;
 %ignore oc_collection_s::put_handler;
 %ignore oc_collection_s::post_handler;
 %ignore oc_collection_s::delete_handler;
+%ignore oc_collection_s::stream_handler;
 %ignore oc_collection_s::get_properties;
 %ignore oc_collection_s::set_properties;
+%ignore oc_collection_s::batch_notify_interval;
+%ignore oc_collection_s::batch_notify_full;
+%ignore oc_collection_s::batch_notify_scheduled;
 %rename(tagPositionRelative) oc_collection_s::tag_pos_rel;
 %rename(tagPositionDescription) oc_collection_s::tag_pos_desc;
 %rename(tagPositionFunction) oc_collection_s::tag_pos_func;
@@ -60,6 +65,7 @@ typedef struct oc_collection_s oc_collection_t;
 %rename(newCollection) oc_collection_alloc;
 %rename(freeCollection) oc_collection_free;
 %rename(getNextCollectionWithLink) oc_get_next_collection_with_link;
+%ignore oc_collection_defer_batch_notification;
 %rename(getCollectionByUri) oc_get_collection_by_uri;
 %rename(collectionGetAll) oc_collection_get_all;
 %rename(getLinkByUri) oc_get_link_by_uri;
@@ -62,5 +62,14 @@ void jni_connectivity_shutdown(size_t device)
 %ignore tcp_csm_state_t;
 %ignore oc_tcp_get_csm_state;
 %ignore oc_tcp_update_csm_state;
+%ignore oc_tcp_backpressure_cb_t;
+%ignore oc_tcp_set_backpressure_cb;
+%ignore oc_fd_events_t;
+%ignore oc_fd_watch_cb_t;
+%ignore oc_connectivity_set_fd_watch_callback;
+%ignore oc_connectivity_on_readable;
+%ignore oc_connectivity_on_writable;
+%ignore oc_connectivity_on_timeout;
+%ignore oc_connectivity_update_fd_watches;
 
 %include "port/oc_connectivity.h"
\ No newline at end of file
@@ -33,6 +33,8 @@
 %rename (queryLen) oc_request_t::query_len;
 %rename (requestPayload) oc_request_t::request_payload;
 %ignore oc_request_handler_s;
+%ignore oc_stream_handler_s;
+%ignore oc_stream_producer_t;
 
 %ignore oc_properties_cb_t;
 %ignore oc_properties_cb_t_cb;
@@ -54,6 +56,7 @@
 %ignore oc_resource_s::delete_handler;
 %ignore oc_resource_s::get_properties;
 %ignore oc_resource_s::set_properties;
+%ignore oc_resource_s::stream_handler;
 %rename(tagPositionRelative) oc_resource_s::tag_pos_rel;
 %immutable oc_resource_s::tag_pos_rel;
 %rename(tagPositionDescription) oc_resource_s::tag_pos_desc;
@@ -80,6 +83,7 @@
 %ignore oc_status_code;
 %ignore oc_ri_get_app_resource_by_uri;
 %ignore oc_ri_get_app_resources;
+%ignore oc_ri_produce_stream_block;
 %ignore oc_ri_alloc_resource;
 %ignore oc_ri_alloc_resource;
 %ignore oc_ri_add_resource;
@@ -0,0 +1,46 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef OC_ATOMIC_H
+#define OC_ATOMIC_H
+
+/* Primitives for state shared between the network threads and the event
+ * loop without holding the network event handler mutex. OC_ATOMICS is only
+ * defined where the compiler provides them and pointer sized operations are
+ * lock-free on the target; other builds keep using the mutex.
+ */
+#if defined(__GNUC__) && defined(__GCC_ATOMIC_POINTER_LOCK_FREE) &&          \
+  (__GCC_ATOMIC_POINTER_LOCK_FREE == 2)
+#define OC_ATOMICS
+
+#define oc_atomic_load(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define oc_atomic_store(ptr, value)                                            \
+  __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define oc_atomic_exchange(ptr, value)                                         \
+  __atomic_exchange_n((ptr), (value), __ATOMIC_ACQ_REL)
+#define oc_atomic_compare_exchange(ptr, expected, desired)                     \
+  __atomic_compare_exchange_n((ptr), (expected), (desired), 0,                 \
+                              __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+/* orders the stores before it with the loads after it */
+#define oc_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+/* counters only; no ordering with respect to other memory */
+#define oc_atomic_increment(ptr) __atomic_add_fetch((ptr), 1, __ATOMIC_RELAXED)
+#define oc_atomic_decrement(ptr) __atomic_sub_fetch((ptr), 1, __ATOMIC_RELAXED)
+#define oc_atomic_add(ptr, value)                                              \
+  __atomic_add_fetch((ptr), (value), __ATOMIC_RELAXED)
+#endif /* __GNUC__ && __GCC_ATOMIC_POINTER_LOCK_FREE == 2 */
+
+#endif /* OC_ATOMIC_H */
@@ -52,7 +52,7 @@ update_time(void)
   if (timerlist == NULL) {
     next_expiration = 0;
   } else {
-    now = oc_clock_time();
+    now = oc_clock_loop_time();
     t = timerlist;
     /* Must calculate distance to next time into account due to wraps */
     tdist = t->timer.start + t->timer.interval - now;
@@ -18,148 +18,417 @@
 
 #ifdef OC_MEMORY_TRACE
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-#include "oc_list.h"
 #include "oc_mem_trace.h"
+#include "port/oc_clock.h"
 #include "port/oc_log.h"
+#include "util/oc_atomic.h"
+#include <stdbool.h>
+#include <string.h>
 
-#define FUNC_NAME_LEN 30
+/* Allocations and frees are aggregated per call site and per pool in fixed
+ * size open addressing tables, so tracing an operation costs the same however
+ * many came before it. Live allocations are looked up by address to charge a
+ * free to the call site that allocated the memory and to measure how long it
+ * was held. One in every sample_rate operations is also copied to a ring of
+ * recent events.
+ */
+#define NO_ENTRY (0xffff)
+/* probes before giving up on a live allocation slot */
+#define MAX_PROBES (32)
 
-typedef struct _mem_info
+typedef struct
 {
-  int peak;
-  int current;
-  OC_LIST_STRUCT(mem_log_list);
-} mem_info_s;
+  void *address; /* NULL for an unused slot */
+  oc_clock_time_t time;
+  size_t size;
+  uint16_t site;
+  uint16_t pool;
+} live_alloc_t;
+
+static oc_mem_trace_stats_t sites[OC_MEM_TRACE_SITES];
+static oc_mem_trace_stats_t pools[OC_MEM_TRACE_POOLS];
+static live_alloc_t live[OC_MEM_TRACE_LIVE];
+static oc_mem_trace_stats_t totals;
+static uint32_t untracked;
 
-typedef struct _mem_logger
+#if OC_MEM_TRACE_EVENTS > 0
+static oc_mem_trace_event_t events[OC_MEM_TRACE_EVENTS];
+static uint32_t num_events;
+static uint32_t sample_rate = OC_MEM_TRACE_SAMPLE_RATE;
+static uint32_t sample_countdown;
+#endif /* OC_MEM_TRACE_EVENTS > 0 */
+
+/* Operations come from the network threads as well as the event loop; the
+ * critical sections are a few table probes long. */
+#ifdef OC_ATOMICS
+static int trace_lock;
+#define mem_trace_lock()                                                       \
+  do {                                                                         \
+  } while (oc_atomic_exchange(&trace_lock, 1) != 0)
+#define mem_trace_unlock() oc_atomic_store(&trace_lock, 0)
+#else /* OC_ATOMICS */
+#define mem_trace_lock()
+#define mem_trace_unlock()
+#endif /* !OC_ATOMICS */
+
+static size_t
+hash_ptr(const void *ptr)
 {
-  struct mem_logger_s *next; /* for LIST */
-  char func[FUNC_NAME_LEN + 1];
-  int size;
-  int current;
-  int peak;
-  int type; // MEM_TRACE_ALLOC, MEM_TRACE_FREE
-  void *address;
-} mem_logger_s;
+  uintptr_t h = (uintptr_t)ptr;
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return (size_t)h;
+}
 
-static mem_info_s mInfo = {
-  0,
-};
+static uint16_t
+find_stats(oc_mem_trace_stats_t *table, size_t size, const char *name,
+           const char *pool)
+{
+  size_t i = (hash_ptr(name) ^ hash_ptr(pool)) % size;
+  size_t probes;
+  for (probes = 0; probes < size; probes++, i = (i + 1) % size) {
+    if (!table[i].name) {
+      table[i].name = name;
+      table[i].pool = pool;
+      return (uint16_t)i;
+    }
+    if (table[i].name == name && table[i].pool == pool) {
+      return (uint16_t)i;
+    }
+  }
+  return NO_ENTRY;
+}
 
-#ifndef OC_DYNAMIC_ALLOCATION
-#define LOGGER_ITEM_LEN 1000
-mem_logger_s logger_item_list[LOGGER_ITEM_LEN];
-int list_index = 0;
-#endif /* !OC_DYNAMIC_ALLOCATION */
+static void
+count_alloc(oc_mem_trace_stats_t *stats, size_t size)
+{
+  stats->allocs++;
+  stats->current_bytes += size;
+  if (stats->current_bytes > stats->peak_bytes) {
+    stats->peak_bytes = stats->current_bytes;
+  }
+}
 
-static void oc_mem_trace_free(void);
+static void
+count_free(oc_mem_trace_stats_t *stats, size_t size, bool tracked,
+           oc_clock_time_t lifetime)
+{
+  stats->frees++;
+  stats->current_bytes -=
+    (size < stats->current_bytes) ? size : stats->current_bytes;
+  if (tracked) {
+    stats->lifetime_total += lifetime;
+    if (lifetime > stats->lifetime_max) {
+      stats->lifetime_max = lifetime;
+    }
+  }
+}
 
-void
-oc_mem_trace_init(void)
+static size_t
+find_live(void *address)
 {
-  mInfo.current = 0;
-  mInfo.peak = 0;
-  OC_LIST_STRUCT_INIT(&mInfo, mem_log_list);
+  size_t i = hash_ptr(address) % OC_MEM_TRACE_LIVE;
+  size_t probes;
+  for (probes = 0; probes < MAX_PROBES && live[i].address;
+       probes++, i = (i + 1) % OC_MEM_TRACE_LIVE) {
+    if (live[i].address == address) {
+      return i;
+    }
+  }
+  return OC_MEM_TRACE_LIVE;
 }
 
-void
-oc_mem_trace_add_pace(const char *func, int size, int type, void *address)
+static bool
+add_live(void *address, oc_clock_time_t time, size_t size, uint16_t site,
+         uint16_t pool)
 {
-  if(!mInfo.mem_log_list)
-    return;
+  size_t i = hash_ptr(address) % OC_MEM_TRACE_LIVE;
+  size_t probes;
+  for (probes = 0; probes < MAX_PROBES;
+       probes++, i = (i + 1) % OC_MEM_TRACE_LIVE) {
+    if (!live[i].address || live[i].address == address) {
+      live[i].address = address;
+      live[i].time = time;
+      live[i].size = size;
+      live[i].site = site;
+      live[i].pool = pool;
+      return true;
+    }
+  }
+  return false;
+}
 
-  if (type == MEM_TRACE_ALLOC) {
-    mInfo.current += size;
-    if (mInfo.current > mInfo.peak) {
-      mInfo.peak = mInfo.current;
+static void
+remove_live(size_t i)
+{
+  /* Shift back the entries that follow so that no lookup stops early at the
+   * hole, rather than leaving tombstones behind. */
+  size_t j = i;
+  for (;;) {
+    j = (j + 1) % OC_MEM_TRACE_LIVE;
+    if (!live[j].address) {
+      break;
     }
-  } else if (type == MEM_TRACE_FREE) {
-    mInfo.current -= size;
-  } else {
-    OC_ERR("mem trace : UNKNOWN TYPE");
+    size_t home = hash_ptr(live[j].address) % OC_MEM_TRACE_LIVE;
+    bool in_place =
+      (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+    if (!in_place) {
+      live[i] = live[j];
+      i = j;
+    }
+  }
+  live[i].address = NULL;
+}
+
+static void
+record_event(oc_clock_time_t time, const char *func, const char *pool,
+             void *address, size_t size, int type)
+{
+#if OC_MEM_TRACE_EVENTS > 0
+  if (sample_rate == 0) {
     return;
   }
-#ifdef OC_DYNAMIC_ALLOCATION
-  mem_logger_s *mem_log_item = (mem_logger_s *)calloc(1, sizeof(mem_logger_s));
-#else
-  /* Only LOGGER_ITEM_LEN mem_log_items are available in static allocation
-   */
-  if (list_index >= LOGGER_ITEM_LEN)
+  if (sample_countdown > 1) {
+    sample_countdown--;
     return;
+  }
+  sample_countdown = sample_rate;
+  oc_mem_trace_event_t *event = &events[num_events % OC_MEM_TRACE_EVENTS];
+  num_events++;
+  event->time = time;
+  event->func = func;
+  event->pool = pool;
+  event->address = address;
+  event->size = size;
+  event->type = type;
+#else  /* OC_MEM_TRACE_EVENTS > 0 */
+  (void)time;
+  (void)func;
+  (void)pool;
+  (void)address;
+  (void)size;
+  (void)type;
+#endif /* OC_MEM_TRACE_EVENTS == 0 */
+}
 
-  mem_logger_s *mem_log_item = &logger_item_list[list_index++];
-#endif
-
-  size_t func_name_len = strlen(func);
-  if (FUNC_NAME_LEN < func_name_len)
-    func_name_len = FUNC_NAME_LEN;
-  memcpy(mem_log_item->func, (char *)func, func_name_len);
-  mem_log_item->func[func_name_len] = '\0';
-  mem_log_item->size = size;
-  mem_log_item->current = mInfo.current;
-  mem_log_item->peak = mInfo.peak;
-  mem_log_item->type = type;
-  mem_log_item->address = address;
-
-  oc_list_add((&mInfo)->mem_log_list, mem_log_item);
+void
+oc_mem_trace_init(void)
+{
+  mem_trace_lock();
+  memset(sites, 0, sizeof(sites));
+  memset(pools, 0, sizeof(pools));
+  memset(live, 0, sizeof(live));
+  memset(&totals, 0, sizeof(totals));
+  untracked = 0;
+#if OC_MEM_TRACE_EVENTS > 0
+  num_events = 0;
+  sample_countdown = 0;
+#endif /* OC_MEM_TRACE_EVENTS > 0 */
+  mem_trace_unlock();
 }
 
 void
-oc_mem_trace_print_paces(void)
+oc_mem_trace_alloc(const char *func, const char *pool, size_t size,
+                   void *address)
 {
-  int cnt = 0;
-  mem_logger_s *mem_log_item_link = oc_list_head((&mInfo)->mem_log_list);
+  if (!address) {
+    return;
+  }
+  oc_clock_time_t now = oc_clock_time_monotonic();
+  mem_trace_lock();
+  uint16_t site = find_stats(sites, OC_MEM_TRACE_SITES, func, pool);
+  uint16_t p = find_stats(pools, OC_MEM_TRACE_POOLS, pool, NULL);
+  count_alloc(&totals, size);
+  if (site != NO_ENTRY) {
+    count_alloc(&sites[site], size);
+  }
+  if (p != NO_ENTRY) {
+    count_alloc(&pools[p], size);
+  }
+  if (site == NO_ENTRY || p == NO_ENTRY ||
+      !add_live(address, now, size, site, p)) {
+    untracked++;
+  }
+  record_event(now, func, pool, address, size, MEM_TRACE_ALLOC);
+  mem_trace_unlock();
+}
 
-  PRINT("==================================================================");
-  PRINT("=================\n");
-  PRINT("  %2s   %-22s   %11s    %5s   %5s    %5s    %5s \n", "No.", "Func",
-        "Address", "Size", "Req", "Cur", "Peak");
-  PRINT("------------------------------------------------------------------");
-  PRINT("-----------------\n");
+void
+oc_mem_trace_free(const char *func, const char *pool, size_t size,
+                  void *address)
+{
+  if (!address) {
+    return;
+  }
+  oc_clock_time_t now = oc_clock_time_monotonic();
+  mem_trace_lock();
+  uint16_t site = NO_ENTRY, p = NO_ENTRY;
+  oc_clock_time_t lifetime = 0;
+  size_t i = find_live(address);
+  bool tracked = i < OC_MEM_TRACE_LIVE;
+  if (tracked) {
+    site = live[i].site;
+    p = live[i].pool;
+    size = live[i].size;
+    lifetime = now - live[i].time;
+    remove_live(i);
+  } else {
+    /* allocated before tracing started, or never found a slot */
+    p = find_stats(pools, OC_MEM_TRACE_POOLS, pool, NULL);
+    untracked++;
+  }
+  count_free(&totals, size, tracked, lifetime);
+  if (site != NO_ENTRY) {
+    count_free(&sites[site], size, tracked, lifetime);
+  }
+  if (p != NO_ENTRY) {
+    count_free(&pools[p], size, tracked, lifetime);
+  }
+  record_event(now, func, pool, address, size, MEM_TRACE_FREE);
+  mem_trace_unlock();
+}
 
-  while (mem_log_item_link) {
-    PRINT(" %3d   %-26.25s  %10p   %5d   %5s    %5d    %5d\n", ++cnt,
-          mem_log_item_link->func, mem_log_item_link->address,
-          mem_log_item_link->size,
-          (mem_log_item_link->type == MEM_TRACE_FREE) ? "Free" : "Alloc",
-          mem_log_item_link->current, mem_log_item_link->peak);
+void
+oc_mem_trace_get_totals(oc_mem_trace_stats_t *stats, uint32_t *num_untracked)
+{
+  mem_trace_lock();
+  if (stats) {
+    memcpy(stats, &totals, sizeof(totals));
+  }
+  if (num_untracked) {
+    *num_untracked = untracked;
+  }
+  mem_trace_unlock();
+}
 
-    mem_log_item_link = oc_list_item_next(mem_log_item_link);
+static size_t
+get_largest(const oc_mem_trace_stats_t *table, size_t size,
+            oc_mem_trace_stats_t *out, size_t max)
+{
+  size_t n = 0, i;
+  mem_trace_lock();
+  for (i = 0; i < size; i++) {
+    const oc_mem_trace_stats_t *stats = &table[i];
+    if (!stats->name || max == 0 ||
+        (n == max && stats->current_bytes <= out[n - 1].current_bytes)) {
+      continue;
+    }
+    size_t j = (n < max) ? n++ : n - 1;
+    for (; j > 0 && out[j - 1].current_bytes < stats->current_bytes; j--) {
+      out[j] = out[j - 1];
+    }
+    out[j] = *stats;
   }
-  PRINT("===================================================================");
-  PRINT("================\n");
+  mem_trace_unlock();
+  return n;
 }
 
-void
-oc_mem_trace_shutdown(void)
+size_t
+oc_mem_trace_get_sites(oc_mem_trace_stats_t *out, size_t max)
 {
-  oc_mem_trace_print_paces();
+  return get_largest(sites, OC_MEM_TRACE_SITES, out, max);
+}
 
-  if (mInfo.current) {
-    PRINT("########################################################\n");
-    PRINT("####### Unreleased memory size: [%8d bytes] #######\n",
-          mInfo.current);
-    PRINT("########################################################\n");
+size_t
+oc_mem_trace_get_pools(oc_mem_trace_stats_t *out, size_t max)
+{
+  return get_largest(pools, OC_MEM_TRACE_POOLS, out, max);
+}
+
+size_t
+oc_mem_trace_get_events(oc_mem_trace_event_t *out, size_t max)
+{
+#if OC_MEM_TRACE_EVENTS > 0
+  size_t n = 0;
+  mem_trace_lock();
+  uint32_t available =
+    (num_events < OC_MEM_TRACE_EVENTS) ? num_events : OC_MEM_TRACE_EVENTS;
+  if (max > available) {
+    max = available;
+  }
+  for (; n < max; n++) {
+    out[n] = events[(num_events - max + n) % OC_MEM_TRACE_EVENTS];
   }
+  mem_trace_unlock();
+  return n;
+#else  /* OC_MEM_TRACE_EVENTS > 0 */
+  (void)out;
+  (void)max;
+  return 0;
+#endif /* OC_MEM_TRACE_EVENTS == 0 */
+}
 
-  oc_mem_trace_free();
+void
+oc_mem_trace_set_sample_rate(uint32_t one_in)
+{
+#if OC_MEM_TRACE_EVENTS > 0
+  mem_trace_lock();
+  sample_rate = one_in;
+  sample_countdown = 0;
+  mem_trace_unlock();
+#else  /* OC_MEM_TRACE_EVENTS > 0 */
+  (void)one_in;
+#endif /* OC_MEM_TRACE_EVENTS == 0 */
 }
 
 static void
-oc_mem_trace_free(void)
+print_stats(const oc_mem_trace_stats_t *stats)
 {
+  PRINT(" %-30.30s %-22.22s %8u %8u %9u %9u %10lu\n", stats->name,
+        stats->pool ? stats->pool : "", (unsigned)stats->allocs,
+        (unsigned)stats->frees, (unsigned)stats->current_bytes,
+        (unsigned)stats->peak_bytes,
+        (unsigned long)(stats->frees
+                          ? stats->lifetime_total / stats->frees
+                          : 0));
+}
 
-  mem_logger_s *mem_log_item = oc_list_pop((&mInfo)->mem_log_list);
+void
+oc_mem_trace_print(void)
+{
+  oc_mem_trace_stats_t stats[16];
+  uint32_t num_untracked;
+  size_t n, i;
 
-  while (mem_log_item) {
-#ifdef OC_DYNAMIC_ALLOCATION
-    free(mem_log_item);
-#endif
-    mem_log_item = oc_list_pop((&mInfo)->mem_log_list);
+  PRINT("==================================================================");
+  PRINT("==================================================\n");
+  PRINT(" %-30s %-22s %8s %8s %9s %9s %10s\n", "Func/Pool", "Pool", "Allocs",
+        "Frees", "Cur", "Peak", "Lifetime");
+  PRINT("------------------------------------------------------------------");
+  PRINT("--------------------------------------------------\n");
+  n = oc_mem_trace_get_pools(stats, sizeof(stats) / sizeof(stats[0]));
+  for (i = 0; i < n; i++) {
+    print_stats(&stats[i]);
+  }
+  PRINT("------------------------------------------------------------------");
+  PRINT("--------------------------------------------------\n");
+  n = oc_mem_trace_get_sites(stats, sizeof(stats) / sizeof(stats[0]));
+  for (i = 0; i < n; i++) {
+    print_stats(&stats[i]);
+  }
+  PRINT("------------------------------------------------------------------");
+  PRINT("--------------------------------------------------\n");
+  oc_mem_trace_get_totals(&stats[0], &num_untracked);
+  stats[0].name = "total";
+  print_stats(&stats[0]);
+  PRINT(" untracked operations: %u\n", (unsigned)num_untracked);
+  PRINT("==================================================================");
+  PRINT("==================================================\n");
+}
+
+void
+oc_mem_trace_shutdown(void)
+{
+  oc_mem_trace_print();
+
+  oc_mem_trace_stats_t stats;
+  oc_mem_trace_get_totals(&stats, NULL);
+  if (stats.current_bytes) {
+    PRINT("########################################################\n");
+    PRINT("####### Unreleased memory size: [%8u bytes] #######\n",
+          (unsigned)stats.current_bytes);
+    PRINT("########################################################\n");
   }
 }
 #else  /* OC_MEMORY_TRACE */
@@ -19,6 +19,10 @@
 #ifndef OC_MEM_TRACE_H
 #define OC_MEM_TRACE_H
 
+#include "oc_config.h"
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -27,10 +31,76 @@ extern "C"
 #define MEM_TRACE_ALLOC (1) // it would be combination when BYTE, INT, DOUBLE
 #define MEM_TRACE_FREE (0)
 
+/* Number of (function, pool) call sites aggregated */
+#ifndef OC_MEM_TRACE_SITES
+#define OC_MEM_TRACE_SITES (128)
+#endif /* !OC_MEM_TRACE_SITES */
+/* Number of pools aggregated */
+#ifndef OC_MEM_TRACE_POOLS
+#define OC_MEM_TRACE_POOLS (64)
+#endif /* !OC_MEM_TRACE_POOLS */
+/* Number of live allocations whose call site and age are remembered */
+#ifndef OC_MEM_TRACE_LIVE
+#ifdef OC_DYNAMIC_ALLOCATION
+#define OC_MEM_TRACE_LIVE (1024)
+#else /* OC_DYNAMIC_ALLOCATION */
+#define OC_MEM_TRACE_LIVE (256)
+#endif /* !OC_DYNAMIC_ALLOCATION */
+#endif /* !OC_MEM_TRACE_LIVE */
+/* Number of sampled events kept, 0 to leave out the event ring */
+#ifndef OC_MEM_TRACE_EVENTS
+#define OC_MEM_TRACE_EVENTS (64)
+#endif /* !OC_MEM_TRACE_EVENTS */
+/* Record one in this many operations in the event ring, 0 for none */
+#ifndef OC_MEM_TRACE_SAMPLE_RATE
+#define OC_MEM_TRACE_SAMPLE_RATE (0)
+#endif /* !OC_MEM_TRACE_SAMPLE_RATE */
+
+typedef struct oc_mem_trace_stats_t
+{
+  const char *name; /* function of a call site, or pool */
+  const char *pool; /* pool a call site allocates from */
+  uint32_t allocs;
+  uint32_t frees;
+  size_t current_bytes;
+  size_t peak_bytes;
+  /* ages of the freed allocations that were tracked while live */
+  oc_clock_time_t lifetime_total;
+  oc_clock_time_t lifetime_max;
+} oc_mem_trace_stats_t;
+
+typedef struct oc_mem_trace_event_t
+{
+  oc_clock_time_t time; /* oc_clock_time_monotonic() */
+  const char *func;
+  const char *pool;
+  void *address;
+  size_t size;
+  int type; /* MEM_TRACE_ALLOC or MEM_TRACE_FREE */
+} oc_mem_trace_event_t;
+
 void oc_mem_trace_init(void);
-void oc_mem_trace_add_pace(const char *func, int size, int type, void *address);
 void oc_mem_trace_shutdown(void);
 
+void oc_mem_trace_alloc(const char *func, const char *pool, size_t size,
+                        void *address);
+void oc_mem_trace_free(const char *func, const char *pool, size_t size,
+                       void *address);
+
+/* Totals over all pools; untracked counts the operations that could not be
+ * attributed to their call site or pool for lack of table space. */
+void oc_mem_trace_get_totals(oc_mem_trace_stats_t *totals,
+                             uint32_t *untracked);
+/* Copy up to max call sites or pools, those holding the most memory first,
+ * and return how many were copied. */
+size_t oc_mem_trace_get_sites(oc_mem_trace_stats_t *sites, size_t max);
+size_t oc_mem_trace_get_pools(oc_mem_trace_stats_t *pools, size_t max);
+/* Copy up to max of the most recent sampled events, oldest first. */
+size_t oc_mem_trace_get_events(oc_mem_trace_event_t *events, size_t max);
+void oc_mem_trace_set_sample_rate(uint32_t one_in);
+
+void oc_mem_trace_print(void);
+
 #ifdef __cplusplus
 }
 #endif
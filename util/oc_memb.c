@@ -93,7 +93,7 @@ _oc_memb_alloc(
   }
 
 #ifdef OC_MEMORY_TRACE
-  oc_mem_trace_add_pace(func, m->size, MEM_TRACE_ALLOC, ptr);
+  oc_mem_trace_alloc(func, m->name ? m->name : "memb", m->size, ptr);
 #endif
 
   return ptr;
@@ -112,7 +112,7 @@ _oc_memb_free(
   }
 
 #ifdef OC_MEMORY_TRACE
-  oc_mem_trace_add_pace(func, m->size, MEM_TRACE_FREE, ptr);
+  oc_mem_trace_free(func, m->name ? m->name : "memb", m->size, ptr);
 #endif
 
   int i = m->num;
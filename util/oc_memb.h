@@ -83,6 +83,13 @@ extern "C" {
  * \param num The total number of memory chunks in the block.
  *
  */
+#ifdef OC_MEMORY_TRACE
+/* pool name reported by the memory tracer */
+#define OC_MEMB_TRACE_NAME(name) , #name
+#else /* OC_MEMORY_TRACE */
+#define OC_MEMB_TRACE_NAME(name)
+#endif /* !OC_MEMORY_TRACE */
+
 #ifdef OC_DYNAMIC_ALLOCATION
 #ifdef __cplusplus
 }
@@ -92,20 +99,23 @@ extern "C" {
 extern "C" {
 #endif
 #define OC_MEMB(name, structure, num)                                          \
-  static struct oc_memb name = { sizeof(structure), 0, 0, 0, 0 }
+  static struct oc_memb name = { sizeof(structure), 0, 0, 0,                   \
+                                 0 OC_MEMB_TRACE_NAME(name) }
 #define OC_MEMB_STATIC(name, structure, num)                                   \
   static char CC_CONCAT(name, _memb_count)[num];                               \
   static structure CC_CONCAT(name, _memb_mem)[num];                            \
   static struct oc_memb name = { sizeof(structure), num,                       \
                                  CC_CONCAT(name, _memb_count),                 \
-                                 (void *)CC_CONCAT(name, _memb_mem), 0 }
+                                 (void *)CC_CONCAT(name, _memb_mem),           \
+                                 0 OC_MEMB_TRACE_NAME(name) }
 #else /* OC_DYNAMIC_ALLOCATION */
 #define OC_MEMB(name, structure, num)                                          \
   static char CC_CONCAT(name, _memb_count)[num];                               \
   static structure CC_CONCAT(name, _memb_mem)[num];                            \
   static struct oc_memb name = { sizeof(structure), num,                       \
                                  CC_CONCAT(name, _memb_count),                 \
-                                 (void *)CC_CONCAT(name, _memb_mem), 0 }
+                                 (void *)CC_CONCAT(name, _memb_mem),           \
+                                 0 OC_MEMB_TRACE_NAME(name) }
 #endif /* !OC_DYNAMIC_ALLOCATION */
 
 typedef void (*oc_memb_buffers_avail_callback_t)(int);
@@ -117,6 +127,9 @@ struct oc_memb
   char *count;
   void *mem;
   oc_memb_buffers_avail_callback_t buffers_avail_cb;
+#ifdef OC_MEMORY_TRACE
+  const char *name;
+#endif /* OC_MEMORY_TRACE */
 };
 
 /**
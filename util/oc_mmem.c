@@ -41,6 +41,16 @@
 #ifdef OC_MEMORY_TRACE
 #include "oc_mem_trace.h"
 #include <stdbool.h>
+
+static const char *pool_names[] = { "BYTE_POOL", "INT_POOL", "DOUBLE_POOL" };
+
+/* Without dynamic allocation freeing a block moves the blocks after it, so
+ * allocations are traced by their handle instead. */
+#ifdef OC_DYNAMIC_ALLOCATION
+#define TRACE_ADDRESS(m) ((m)->ptr)
+#else /* OC_DYNAMIC_ALLOCATION */
+#define TRACE_ADDRESS(m) ((void *)(m))
+#endif /* !OC_DYNAMIC_ALLOCATION */
 #endif
 
 #ifndef OC_DYNAMIC_ALLOCATION
@@ -130,7 +140,10 @@ _oc_mmem_alloc(
   }
 
 #ifdef OC_MEMORY_TRACE
-  oc_mem_trace_add_pace(func, bytes_allocated, MEM_TRACE_ALLOC, m->ptr);
+  if (pool_type <= DOUBLE_POOL) {
+    oc_mem_trace_alloc(func, pool_names[pool_type], bytes_allocated,
+                       TRACE_ADDRESS(m));
+  }
 #endif
 
   return (int) bytes_allocated;
@@ -160,7 +173,10 @@ _oc_mmem_free(
   default:
     break;
   }
-  oc_mem_trace_add_pace(func, bytes_freed, MEM_TRACE_FREE, m->ptr);
+  if (pool_type <= DOUBLE_POOL) {
+    oc_mem_trace_free(func, pool_names[pool_type], bytes_freed,
+                      TRACE_ADDRESS(m));
+  }
 #endif /* OC_MEMORY_TRACE */
 
 #ifndef OC_DYNAMIC_ALLOCATION
@@ -0,0 +1,77 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "oc_mpsc.h"
+
+#ifdef OC_ATOMICS
+#include <stddef.h>
+
+/* Dmitry Vyukov's intrusive MPSC node-based queue. The queue always holds at
+ * least one node; the stub takes that place whenever it would otherwise be
+ * empty.
+ */
+
+void
+oc_mpsc_init(oc_mpsc_queue_t *queue)
+{
+  queue->stub.next = NULL;
+  queue->tail = &queue->stub;
+  oc_atomic_store(&queue->head, &queue->stub);
+}
+
+void
+oc_mpsc_push(oc_mpsc_queue_t *queue, void *item)
+{
+  oc_mpsc_node_t *node = (oc_mpsc_node_t *)item;
+  oc_atomic_store(&node->next, NULL);
+  oc_mpsc_node_t *prev = oc_atomic_exchange(&queue->head, node);
+  /* until this store the consumer cannot see past prev */
+  oc_atomic_store(&prev->next, node);
+}
+
+void *
+oc_mpsc_pop(oc_mpsc_queue_t *queue)
+{
+  oc_mpsc_node_t *tail = queue->tail;
+  oc_mpsc_node_t *next = oc_atomic_load(&tail->next);
+  if (tail == &queue->stub) {
+    if (!next) {
+      return NULL;
+    }
+    queue->tail = next;
+    tail = next;
+    next = oc_atomic_load(&next->next);
+  }
+  if (next) {
+    queue->tail = next;
+    return tail;
+  }
+  if (tail != oc_atomic_load(&queue->head)) {
+    /* a push is in progress */
+    return NULL;
+  }
+  /* tail is the last node; put the stub behind it so it can be handed out */
+  oc_mpsc_push(queue, &queue->stub);
+  next = oc_atomic_load(&tail->next);
+  if (next) {
+    queue->tail = next;
+    return tail;
+  }
+  return NULL;
+}
+#else  /* OC_ATOMICS */
+typedef int dummy_declaration;
+#endif /* !OC_ATOMICS */
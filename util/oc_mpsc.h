@@ -0,0 +1,66 @@
+/*
+// Copyright (c) 2020 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef OC_MPSC_H
+#define OC_MPSC_H
+
+#include "util/oc_atomic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef OC_ATOMICS
+
+/* Intrusive multi-producer single-consumer queue. Like oc_list, it links
+ * structures whose first member is the "next" pointer, so a message can be
+ * queued without any allocation. Any thread may push; only one thread may
+ * pop. Neither operation takes a lock, and a push is a single atomic
+ * exchange.
+ */
+typedef struct oc_mpsc_node_s
+{
+  struct oc_mpsc_node_s *next;
+} oc_mpsc_node_t;
+
+typedef struct oc_mpsc_queue_s
+{
+  oc_mpsc_node_t *head; /* last pushed node; written by producers */
+  oc_mpsc_node_t *tail; /* next node to pop; owned by the consumer */
+  oc_mpsc_node_t stub;
+} oc_mpsc_queue_t;
+
+/* Define a statically initialized queue, usable before any code runs */
+#define OC_MPSC_QUEUE(name)                                                    \
+  static oc_mpsc_queue_t name = { &name.stub, &name.stub, { NULL } }
+
+void oc_mpsc_init(oc_mpsc_queue_t *queue);
+
+void oc_mpsc_push(oc_mpsc_queue_t *queue, void *item);
+
+/* Returns NULL if the queue is empty, or if the producer of the next item
+ * has not finished linking it yet. Producers signal the consumer after a
+ * push, so the consumer simply pops again on its next wakeup.
+ */
+void *oc_mpsc_pop(oc_mpsc_queue_t *queue);
+
+#endif /* OC_ATOMICS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_MPSC_H */
@@ -33,6 +33,7 @@
  */
 
 #include "oc_process.h"
+#include "api/oc_metrics_internal.h"
 #include "oc_buffer.h"
 #include <stdio.h>
 #ifdef OC_DYNAMIC_ALLOCATION
@@ -59,19 +60,84 @@ struct event_data
   struct oc_process *p;
 };
 
+/* Initial size of a queue in dynamic builds, and the default bound of the
+ * control queue in static builds. */
+#define OC_PROCESS_NUMEVENTS 10
+
+/* Default bounds of the priority classes; 0 leaves a class unbounded in
+ * dynamic builds. In static builds they size the storage of each class. */
+#ifndef OC_PROCESS_MAX_CONTROL_EVENTS
 #ifdef OC_DYNAMIC_ALLOCATION
-static unsigned long OC_PROCESS_NUMEVENTS = 10;
+#define OC_PROCESS_MAX_CONTROL_EVENTS (0)
 #else /* OC_DYNAMIC_ALLOCATION */
-#define OC_PROCESS_NUMEVENTS 10
+#define OC_PROCESS_MAX_CONTROL_EVENTS OC_PROCESS_NUMEVENTS
+#endif /* !OC_DYNAMIC_ALLOCATION */
+#endif /* !OC_PROCESS_MAX_CONTROL_EVENTS */
+
+#ifndef OC_PROCESS_MAX_SECURITY_EVENTS
+#ifdef OC_DYNAMIC_ALLOCATION
+#define OC_PROCESS_MAX_SECURITY_EVENTS (16)
+#else /* OC_DYNAMIC_ALLOCATION */
+#define OC_PROCESS_MAX_SECURITY_EVENTS (2)
+#endif /* !OC_DYNAMIC_ALLOCATION */
+#endif /* !OC_PROCESS_MAX_SECURITY_EVENTS */
+
+#ifndef OC_PROCESS_MAX_UNICAST_EVENTS
+#ifdef OC_DYNAMIC_ALLOCATION
+#define OC_PROCESS_MAX_UNICAST_EVENTS (64)
+#else /* OC_DYNAMIC_ALLOCATION */
+#define OC_PROCESS_MAX_UNICAST_EVENTS (6)
 #endif /* !OC_DYNAMIC_ALLOCATION */
+#endif /* !OC_PROCESS_MAX_UNICAST_EVENTS */
 
-static oc_process_num_events_t nevents, fevent;
+#ifndef OC_PROCESS_MAX_MULTICAST_EVENTS
 #ifdef OC_DYNAMIC_ALLOCATION
-static struct event_data *events;
+#define OC_PROCESS_MAX_MULTICAST_EVENTS (16)
+#else /* OC_DYNAMIC_ALLOCATION */
+#define OC_PROCESS_MAX_MULTICAST_EVENTS (2)
+#endif /* !OC_DYNAMIC_ALLOCATION */
+#endif /* !OC_PROCESS_MAX_MULTICAST_EVENTS */
+
+/*
+ * One FIFO ring of events per priority class.
+ */
+typedef struct
+{
+  struct event_data *events;
+  oc_process_num_events_t size, nevents, fevent, peak;
+  unsigned long posted, dropped;
+} event_queue_t;
+
+#ifdef OC_DYNAMIC_ALLOCATION
+static event_queue_t queues[OC_PROCESS_NUM_PRIORITIES];
 #else  /* OC_DYNAMIC_ALLOCATION */
-static struct event_data events[OC_PROCESS_NUMEVENTS];
+static struct event_data control_events[OC_PROCESS_MAX_CONTROL_EVENTS];
+static struct event_data security_events[OC_PROCESS_MAX_SECURITY_EVENTS];
+static struct event_data unicast_events[OC_PROCESS_MAX_UNICAST_EVENTS];
+static struct event_data multicast_events[OC_PROCESS_MAX_MULTICAST_EVENTS];
+static event_queue_t queues[OC_PROCESS_NUM_PRIORITIES] = {
+  { control_events, OC_PROCESS_MAX_CONTROL_EVENTS, 0, 0, 0, 0, 0 },
+  { security_events, OC_PROCESS_MAX_SECURITY_EVENTS, 0, 0, 0, 0, 0 },
+  { unicast_events, OC_PROCESS_MAX_UNICAST_EVENTS, 0, 0, 0, 0, 0 },
+  { multicast_events, OC_PROCESS_MAX_MULTICAST_EVENTS, 0, 0, 0, 0, 0 }
+};
 #endif /* !OC_DYNAMIC_ALLOCATION */
 
+/* Bounds and policies outlive oc_process_init() so that they can be
+ * configured before the stack starts. */
+static oc_process_num_events_t queue_limits[OC_PROCESS_NUM_PRIORITIES] = {
+  OC_PROCESS_MAX_CONTROL_EVENTS, OC_PROCESS_MAX_SECURITY_EVENTS,
+  OC_PROCESS_MAX_UNICAST_EVENTS, OC_PROCESS_MAX_MULTICAST_EVENTS
+};
+static oc_process_shed_policy_t queue_policies[OC_PROCESS_NUM_PRIORITIES] = {
+  OC_PROCESS_SHED_NEWEST, OC_PROCESS_SHED_NEWEST, OC_PROCESS_SHED_NEWEST,
+  OC_PROCESS_SHED_OLDEST
+};
+static oc_process_shed_cb_t shed_cb;
+
+/* Total number of events over all classes. */
+static oc_process_num_events_t nevents;
+
 #if OC_PROCESS_CONF_STATS
 oc_process_num_events_t process_maxevents;
 #endif
@@ -194,24 +260,28 @@ void
 oc_process_shutdown(void)
 {
 #ifdef OC_DYNAMIC_ALLOCATION
-  free(events);
+  int i;
+  for (i = 0; i < OC_PROCESS_NUM_PRIORITIES; i++) {
+    free(queues[i].events);
+    queues[i].events = NULL;
+    queues[i].size = 0;
+  }
 #endif /* OC_DYNAMIC_ALLOCATION */
 }
 
 void
 oc_process_init(void)
 {
-#ifdef OC_DYNAMIC_ALLOCATION
-  events = (struct event_data *)calloc(OC_PROCESS_NUMEVENTS,
-                                       sizeof(struct event_data));
-  if (!events) {
-    oc_abort("Insufficient memory");
+  int i;
+  for (i = 0; i < OC_PROCESS_NUM_PRIORITIES; i++) {
+    event_queue_t *q = &queues[i];
+    q->nevents = q->fevent = q->peak = 0;
+    q->posted = q->dropped = 0;
   }
-#endif /* OC_DYNAMIC_ALLOCATION */
 
   lastevent = OC_PROCESS_EVENT_MAX;
 
-  nevents = fevent = 0;
+  nevents = 0;
 #if OC_PROCESS_CONF_STATS
   process_maxevents = 0;
 #endif /* OC_PROCESS_CONF_STATS */
@@ -261,17 +331,24 @@ do_event(void)
    */
 
   if (nevents > 0) {
+    /* Take the oldest event of the most important non-empty class. */
+    event_queue_t *q = queues;
+    while (q->nevents == 0) {
+      q++;
+    }
 
     /* There are events that we should deliver. */
-    ev = events[fevent].ev;
+    ev = q->events[q->fevent].ev;
 
-    data = events[fevent].data;
-    receiver = events[fevent].p;
+    data = q->events[q->fevent].data;
+    receiver = q->events[q->fevent].p;
 
     /* Since we have seen the new event, we move pointer upwards
        and decrease the number of events. */
-    fevent = (fevent + 1) % OC_PROCESS_NUMEVENTS;
+    q->fevent = (q->fevent + 1) % q->size;
+    --q->nevents;
     --nevents;
+    OC_METRICS_GAUGE_SET(OC_METRICS_PROCESS_EVENTS, nevents);
 
     /* If this is a broadcast event, we deliver it to all events, in
        order of their priority. */
@@ -320,41 +397,95 @@ oc_process_nevents(void)
   return nevents + poll_requested;
 }
 /*---------------------------------------------------------------------------*/
-int
-oc_process_post(struct oc_process *p, oc_process_event_t ev,
-                oc_process_data_t data)
+static oc_process_num_events_t
+queue_limit(const event_queue_t *q, oc_process_priority_t priority)
 {
-  static oc_process_num_events_t snum;
+#ifdef OC_DYNAMIC_ALLOCATION
+  (void)q;
+  return queue_limits[priority];
+#else  /* OC_DYNAMIC_ALLOCATION */
+  if (queue_limits[priority] == 0 || queue_limits[priority] > q->size) {
+    return q->size;
+  }
+  return queue_limits[priority];
+#endif /* !OC_DYNAMIC_ALLOCATION */
+}
 
-  if (nevents == OC_PROCESS_NUMEVENTS) {
 #ifdef OC_DYNAMIC_ALLOCATION
-    OC_PROCESS_NUMEVENTS <<= 1;
-    events = (struct event_data *)realloc(events, (OC_PROCESS_NUMEVENTS) *
-                                                    sizeof(struct event_data));
-    if (!events) {
-      oc_abort("Insufficient memory");
+static void
+grow_queue(event_queue_t *q, oc_process_num_events_t limit)
+{
+  oc_process_num_events_t size =
+    (q->size > 0) ? (q->size << 1) : OC_PROCESS_NUMEVENTS;
+  if (limit > 0 && size > limit) {
+    size = limit;
+  }
+  struct event_data *events =
+    (struct event_data *)calloc(size, sizeof(struct event_data));
+  if (!events) {
+    oc_abort("Insufficient memory");
+  }
+  oc_process_num_events_t i;
+  for (i = 0; i < q->nevents; i++) {
+    memcpy(&events[i], &q->events[(q->fevent + i) % q->size],
+           sizeof(struct event_data));
+  }
+  free(q->events);
+  q->events = events;
+  q->size = size;
+  q->fevent = 0;
+}
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+int
+oc_process_post_priority(struct oc_process *p, oc_process_event_t ev,
+                         oc_process_data_t data,
+                         oc_process_priority_t priority)
+{
+  if ((unsigned)priority >= OC_PROCESS_NUM_PRIORITIES) {
+    return OC_PROCESS_ERR_FULL;
+  }
+  event_queue_t *q = &queues[priority];
+  oc_process_num_events_t limit = queue_limit(q, priority);
+
+  if (limit > 0 && q->nevents >= limit) {
+    if (queue_policies[priority] == OC_PROCESS_SHED_NEWEST) {
+      q->dropped++;
+      OC_METRICS_INC(OC_METRICS_EVENTS_DROPPED);
+      return OC_PROCESS_ERR_FULL;
     }
-    oc_process_num_events_t i = fevent, n = nevents - fevent, j = 0;
-    while (i < (OC_PROCESS_NUMEVENTS - n)) {
-      if (i < nevents) {
-        memcpy(&events[OC_PROCESS_NUMEVENTS - n + j], &events[i],
-               sizeof(struct event_data));
-        j++;
+    while (q->nevents >= limit) {
+      struct event_data *oldest = &q->events[q->fevent];
+      q->fevent = (q->fevent + 1) % q->size;
+      --q->nevents;
+      --nevents;
+      q->dropped++;
+      OC_METRICS_INC(OC_METRICS_EVENTS_DROPPED);
+      if (shed_cb) {
+        shed_cb(oldest->p, oldest->ev, oldest->data);
       }
-      memset(&events[i], 0, sizeof(struct event_data));
-      i++;
     }
-    fevent = OC_PROCESS_NUMEVENTS - n;
-#else  /* OC_DYNAMIC_ALLOCATION */
-    return OC_PROCESS_ERR_FULL;
-#endif /* !OC_DYNAMIC_ALLOCATION */
   }
 
-  snum = (oc_process_num_events_t)(fevent + nevents) % OC_PROCESS_NUMEVENTS;
-  events[snum].ev = ev;
-  events[snum].data = data;
-  events[snum].p = p;
+#ifdef OC_DYNAMIC_ALLOCATION
+  if (q->nevents == q->size) {
+    grow_queue(q, limit);
+  }
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+  oc_process_num_events_t snum =
+    (oc_process_num_events_t)(q->fevent + q->nevents) % q->size;
+  q->events[snum].ev = ev;
+  q->events[snum].data = data;
+  q->events[snum].p = p;
+  ++q->nevents;
   ++nevents;
+  q->posted++;
+  if (q->nevents > q->peak) {
+    q->peak = q->nevents;
+  }
+  OC_METRICS_GAUGE_SET(OC_METRICS_PROCESS_EVENTS, nevents);
+  OC_METRICS_OBSERVE(OC_METRICS_EVENT_QUEUE_DEPTH, nevents);
 
 #if OC_PROCESS_CONF_STATS
   if (nevents > process_maxevents) {
@@ -365,6 +496,67 @@ oc_process_post(struct oc_process *p, oc_process_event_t ev,
   return OC_PROCESS_ERR_OK;
 }
 /*---------------------------------------------------------------------------*/
+int
+oc_process_post(struct oc_process *p, oc_process_event_t ev,
+                oc_process_data_t data)
+{
+  return oc_process_post_priority(p, ev, data, OC_PROCESS_PRIORITY_CONTROL);
+}
+/*---------------------------------------------------------------------------*/
+void
+oc_process_set_queue_limit(oc_process_priority_t priority,
+                           oc_process_num_events_t limit,
+                           oc_process_shed_policy_t policy)
+{
+  if ((unsigned)priority >= OC_PROCESS_NUM_PRIORITIES) {
+    return;
+  }
+  queue_limits[priority] = limit;
+  if (priority != OC_PROCESS_PRIORITY_CONTROL) {
+    queue_policies[priority] = policy;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+oc_process_set_shed_callback(oc_process_shed_cb_t cb)
+{
+  shed_cb = cb;
+}
+/*---------------------------------------------------------------------------*/
+bool
+oc_process_has_event(oc_process_priority_t priority, oc_process_event_t ev,
+                     oc_process_match_cb_t match, const void *user_data)
+{
+  if ((unsigned)priority >= OC_PROCESS_NUM_PRIORITIES || !match) {
+    return false;
+  }
+  const event_queue_t *q = &queues[priority];
+  oc_process_num_events_t i;
+  for (i = 0; i < q->nevents; i++) {
+    const struct event_data *e = &q->events[(q->fevent + i) % q->size];
+    if (e->ev == ev && match(e->data, user_data)) {
+      return true;
+    }
+  }
+  return false;
+}
+/*---------------------------------------------------------------------------*/
+bool
+oc_process_get_queue_stats(oc_process_priority_t priority,
+                           oc_process_queue_stats_t *stats)
+{
+  if ((unsigned)priority >= OC_PROCESS_NUM_PRIORITIES || !stats) {
+    return false;
+  }
+  const event_queue_t *q = &queues[priority];
+  stats->queued = q->nevents;
+  stats->peak = q->peak;
+  stats->limit = queue_limit(q, priority);
+  stats->posted = q->posted;
+  stats->dropped = q->dropped;
+  return true;
+}
+/*---------------------------------------------------------------------------*/
 void
 oc_process_post_synch(struct oc_process *p, oc_process_event_t ev,
                       oc_process_data_t data)
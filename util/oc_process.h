@@ -43,6 +43,7 @@
 #ifndef OC_PROCESS_H
 #define OC_PROCESS_H
 #include "util/pt/pt.h"
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -83,6 +84,64 @@ typedef unsigned char oc_process_num_events_t;
 #define OC_PROCESS_ERR_FULL 1
 /* @} */
 
+/**
+ * \name Event priorities and overload shedding
+ * @{
+ */
+
+/**
+ * \brief Priority classes of the event queue.
+ *
+ * Every class has its own bounded FIFO. oc_process_run() always delivers the
+ * oldest event of the most important non-empty class, so a flood of
+ * discovery requests can not delay retransmissions or DTLS handshakes.
+ */
+typedef enum {
+  OC_PROCESS_PRIORITY_CONTROL = 0, ///< internal events of the stack
+  OC_PROCESS_PRIORITY_SECURITY,    ///< inbound handshakes and alerts
+  OC_PROCESS_PRIORITY_UNICAST,     ///< inbound unicast messages
+  OC_PROCESS_PRIORITY_MULTICAST,   ///< inbound multicast (discovery) messages
+  OC_PROCESS_NUM_PRIORITIES
+} oc_process_priority_t;
+
+/**
+ * \brief What to drop when an event is posted to a full class.
+ */
+typedef enum {
+  OC_PROCESS_SHED_NEWEST = 0, ///< reject the event being posted
+  OC_PROCESS_SHED_OLDEST      ///< drop the oldest queued event of the class
+} oc_process_shed_policy_t;
+
+/**
+ * \brief Counters of one priority class.
+ */
+typedef struct
+{
+  oc_process_num_events_t queued; ///< events currently waiting
+  oc_process_num_events_t peak;   ///< most events ever waiting at once
+  oc_process_num_events_t limit;  ///< bound of the class, 0 if unbounded
+  unsigned long posted;           ///< events accepted into the class
+  unsigned long dropped;          ///< events shed by either policy
+} oc_process_queue_stats_t;
+
+struct oc_process;
+
+/**
+ * \brief Callback releasing the data of an event queued with
+ * OC_PROCESS_SHED_OLDEST that was dropped to make room for a newer one.
+ */
+typedef void (*oc_process_shed_cb_t)(struct oc_process *p,
+                                     oc_process_event_t ev,
+                                     oc_process_data_t data);
+
+/**
+ * \brief Predicate over the data of a queued event.
+ */
+typedef bool (*oc_process_match_cb_t)(oc_process_data_t data,
+                                      const void *user_data);
+
+/** @} */
+
 #define OC_PROCESS_NONE NULL
 
 #define OC_PROCESS_EVENT_NONE 0x80
@@ -367,6 +426,89 @@ void oc_process_start(struct oc_process *p, oc_process_data_t data);
 int oc_process_post(struct oc_process *p, oc_process_event_t ev,
                     oc_process_data_t data);
 
+/**
+ * Post an asynchronous event into a priority class.
+ *
+ * oc_process_post() posts into OC_PROCESS_PRIORITY_CONTROL. When the class
+ * is at its limit the event is shed according to the policy of the class:
+ * with OC_PROCESS_SHED_NEWEST this call fails, with OC_PROCESS_SHED_OLDEST
+ * the oldest event of the class is handed to the shed callback and this
+ * event takes its place.
+ *
+ * \param p The process to which the event should be posted, or
+ * OC_PROCESS_BROADCAST.
+ *
+ * \param ev The event to be posted.
+ *
+ * \param data The auxiliary data to be sent with the event
+ *
+ * \param priority The priority class of the event.
+ *
+ * \retval OC_PROCESS_ERR_OK The event could be posted.
+ *
+ * \retval OC_PROCESS_ERR_FULL The class was full and the event was not
+ * posted; the caller still owns data.
+ */
+int oc_process_post_priority(struct oc_process *p, oc_process_event_t ev,
+                             oc_process_data_t data,
+                             oc_process_priority_t priority);
+
+/**
+ * Set the bound and the shedding policy of a priority class.
+ *
+ * May be called at any time, including before oc_process_init(). Lowering the
+ * limit below the number of queued events only affects later posts. In
+ * static builds the limit is capped by the storage reserved for the class.
+ * The control class always sheds the newest event, as its events carry no
+ * data the shed callback could release.
+ *
+ * \param priority The priority class.
+ *
+ * \param limit The maximum number of queued events, 0 for no bound in
+ * dynamic builds.
+ *
+ * \param policy What to drop once the class is full.
+ */
+void oc_process_set_queue_limit(oc_process_priority_t priority,
+                                oc_process_num_events_t limit,
+                                oc_process_shed_policy_t policy);
+
+/**
+ * Set the callback that releases events dropped by OC_PROCESS_SHED_OLDEST.
+ *
+ * \param cb The callback, or NULL when no class holds data to release.
+ */
+void oc_process_set_shed_callback(oc_process_shed_cb_t cb);
+
+/**
+ * Look for an event that is still queued in a priority class.
+ *
+ * \param priority The priority class.
+ *
+ * \param ev The event to look for.
+ *
+ * \param match Called with the data of every queued ev until it returns true.
+ *
+ * \param user_data Passed to match.
+ *
+ * \return true if match accepted the data of a queued ev.
+ */
+bool oc_process_has_event(oc_process_priority_t priority,
+                          oc_process_event_t ev, oc_process_match_cb_t match,
+                          const void *user_data);
+
+/**
+ * Read the counters of a priority class.
+ *
+ * \param priority The priority class.
+ *
+ * \param stats Filled in with the counters of the class.
+ *
+ * \return true on success, false for an invalid class or NULL stats.
+ */
+bool oc_process_get_queue_stats(oc_process_priority_t priority,
+                                oc_process_queue_stats_t *stats);
+
 /**
  * Post a synchronous event to a process.
  *
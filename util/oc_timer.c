@@ -50,7 +50,7 @@ void
 oc_timer_set(struct oc_timer *t, oc_clock_time_t interval)
 {
   t->interval = interval;
-  t->start = oc_clock_time();
+  t->start = oc_clock_loop_time();
 }
 /*---------------------------------------------------------------------------*/
 /**
@@ -90,7 +90,7 @@ oc_timer_reset(struct oc_timer *t)
 void
 oc_timer_restart(struct oc_timer *t)
 {
-  t->start = oc_clock_time();
+  t->start = oc_clock_loop_time();
 }
 /*---------------------------------------------------------------------------*/
 /**
@@ -109,7 +109,7 @@ oc_timer_expired(struct oc_timer *t)
 {
   /* Note: Can not return diff >= t->interval so we add 1 to diff and return
      t->interval < diff - required to avoid an internal error in mspgcc. */
-  oc_clock_time_t diff = (oc_clock_time() - t->start) + 1;
+  oc_clock_time_t diff = (oc_clock_loop_time() - t->start) + 1;
   return t->interval < diff;
 }
 /*---------------------------------------------------------------------------*/
@@ -126,6 +126,6 @@ oc_timer_expired(struct oc_timer *t)
 oc_clock_time_t
 oc_timer_remaining(struct oc_timer *t)
 {
-  return t->start + t->interval - oc_clock_time();
+  return t->start + t->interval - oc_clock_loop_time();
 }
 /*---------------------------------------------------------------------------*/